@@ -36,6 +36,36 @@ AABB AABB::overlap(const AABB & b1, const AABB & b2) {
 
 // Based on: https://zeux.io/2010/10/17/aabb-from-obb-with-component-wise-abs/
 AABB AABB::transform(const AABB & aabb, const Matrix4 & transformation) {
+#if SIMD_SSE
+	__m128 aabb_min = SIMD::load3(&aabb.min.x);
+	__m128 aabb_max = SIMD::load3(&aabb.max.x);
+
+	__m128 half   = _mm_set1_ps(0.5f);
+	__m128 center = _mm_mul_ps(half, _mm_add_ps(aabb_min, aabb_max));
+	__m128 extent = _mm_mul_ps(half, _mm_sub_ps(aabb_max, aabb_min));
+
+	// Columns of the transformation
+	__m128 column_0 = transformation.load_row(0);
+	__m128 column_1 = transformation.load_row(1);
+	__m128 column_2 = transformation.load_row(2);
+	__m128 column_3 = transformation.load_row(3);
+	_MM_TRANSPOSE4_PS(column_0, column_1, column_2, column_3);
+
+	__m128 new_center = column_3;
+	new_center = _mm_add_ps(new_center, _mm_mul_ps(column_0, SIMD::broadcast<0>(center)));
+	new_center = _mm_add_ps(new_center, _mm_mul_ps(column_1, SIMD::broadcast<1>(center)));
+	new_center = _mm_add_ps(new_center, _mm_mul_ps(column_2, SIMD::broadcast<2>(center)));
+
+	__m128 new_extent = _mm_mul_ps(SIMD::abs(column_0), SIMD::broadcast<0>(extent));
+	new_extent = _mm_add_ps(new_extent, _mm_mul_ps(SIMD::abs(column_1), SIMD::broadcast<1>(extent)));
+	new_extent = _mm_add_ps(new_extent, _mm_mul_ps(SIMD::abs(column_2), SIMD::broadcast<2>(extent)));
+
+	AABB result;
+	SIMD::store3(&result.min.x, _mm_sub_ps(new_center, new_extent));
+	SIMD::store3(&result.max.x, _mm_add_ps(new_center, new_extent));
+
+	return result;
+#else
 	Vector3 center = 0.5f * (aabb.min + aabb.max);
 	Vector3 extent = 0.5f * (aabb.max - aabb.min);
 
@@ -47,4 +77,5 @@ AABB AABB::transform(const AABB & aabb, const Matrix4 & transformation) {
 	result.max = new_center + new_extent;
 
 	return result;
+#endif
 }
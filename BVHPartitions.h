@@ -5,7 +5,7 @@
 
 // Contains various ways to parition space into "left" and "right" as well as helper methods
 namespace BVHPartitions {
-	const int SBVH_BIN_COUNT = 256;
+	const int SBVH_MAX_BIN_COUNT = 256; // Upper bound on the amount of bins used to evaluate Spatial Splits
 		
 	// Calculates the smallest enclosing AABB over the union of all AABB's of the primitives in the range defined by [first, last>
 	template<typename Primitive>
@@ -173,7 +173,11 @@ namespace BVHPartitions {
 		return min_split_index;
 	}
 
-	inline int partition_spatial(const Triangle * triangles, int * indices[3], int first_index, int index_count, float * sah, int & split_dimension, float & split_cost, AABB & aabb_left, AABB & aabb_right, int & n_left, int & n_right, AABB bounds) {
+	// Bins Triangles along every dimension using 'bin_count' bins to find the Spatial Split with the lowest SAH cost
+	inline int partition_spatial(const Triangle * triangles, int * indices[3], int first_index, int index_count, int & split_dimension, float & split_cost, AABB & aabb_left, AABB & aabb_right, int & n_left, int & n_right, AABB bounds, int bin_count) {
+		assert(bin_count >= 2 && bin_count <= SBVH_MAX_BIN_COUNT);
+
+
 		float min_bin_cost = INFINITY;
 		int   min_bin_index     = -1;
 		int   min_bin_dimension = -1;
@@ -182,15 +186,22 @@ namespace BVHPartitions {
 		for (int dimension = 0; dimension < 3; dimension++) {
 			float bounds_min  = bounds.min[dimension] - 0.001f;
 			float bounds_max  = bounds.max[dimension] + 0.001f;
-			float bounds_step = (bounds_max - bounds_min) / SBVH_BIN_COUNT;
+			float bounds_step = (bounds_max - bounds_min) / bin_count;
 			
 			float inv_bounds_delta = 1.0f / (bounds_max - bounds_min);
 
 			struct Bin {
-				AABB aabb = AABB::create_empty();
-				int entries = 0;
-				int exits   = 0;
-			} bins[SBVH_BIN_COUNT];
+				AABB aabb;
+				int entries;
+				int exits;
+			} bins[SBVH_MAX_BIN_COUNT];
+
+			// Only the bins that are actually in use need to be initialized
+			for (int b = 0; b < bin_count; b++) {
+				bins[b].aabb    = AABB::create_empty();
+				bins[b].entries = 0;
+				bins[b].exits   = 0;
+			}
 
 			for (int i = first_index; i < first_index + index_count; i++) {
 				const Triangle & triangle = triangles[indices[dimension][i]];
@@ -211,11 +222,11 @@ namespace BVHPartitions {
 				float vertex_min = vertices[0][dimension];
 				float vertex_max = vertices[2][dimension];
 				
-				int bin_min = int(SBVH_BIN_COUNT * ((triangle_aabb.min[dimension] - bounds_min) * inv_bounds_delta));
-				int bin_max = int(SBVH_BIN_COUNT * ((triangle_aabb.max[dimension] - bounds_min) * inv_bounds_delta));
+				int bin_min = int(bin_count * ((triangle_aabb.min[dimension] - bounds_min) * inv_bounds_delta));
+				int bin_max = int(bin_count * ((triangle_aabb.max[dimension] - bounds_min) * inv_bounds_delta));
 
-				bin_min = Math::clamp(bin_min, 0, SBVH_BIN_COUNT - 1);
-				bin_max = Math::clamp(bin_max, 0, SBVH_BIN_COUNT - 1);
+				bin_min = Math::clamp(bin_min, 0, bin_count - 1);
+				bin_max = Math::clamp(bin_max, 0, bin_count - 1);
 
 				bins[bin_min].entries++;
 				bins[bin_max].exits++;
@@ -305,22 +316,22 @@ namespace BVHPartitions {
 				}
 			}
 
-			float bin_sah[SBVH_BIN_COUNT];
+			float bin_sah[SBVH_MAX_BIN_COUNT];
 
-			AABB bounds_left [SBVH_BIN_COUNT];
-			AABB bounds_right[SBVH_BIN_COUNT + 1];
+			AABB bounds_left [SBVH_MAX_BIN_COUNT];
+			AABB bounds_right[SBVH_MAX_BIN_COUNT + 1];
 			
-			bounds_left [0]              = AABB::create_empty();
-			bounds_right[SBVH_BIN_COUNT] = AABB::create_empty();
+			bounds_left [0]         = AABB::create_empty();
+			bounds_right[bin_count] = AABB::create_empty();
 
-			int count_left [SBVH_BIN_COUNT];
-			int count_right[SBVH_BIN_COUNT + 1];
+			int count_left [SBVH_MAX_BIN_COUNT];
+			int count_right[SBVH_MAX_BIN_COUNT + 1];
 
-			count_left [0]              = 0;
-			count_right[SBVH_BIN_COUNT] = 0;
+			count_left [0]         = 0;
+			count_right[bin_count] = 0;
 			
 			// First traverse left to right along the current dimension to evaluate first half of the SAH
-			for (int b = 1; b < SBVH_BIN_COUNT; b++) {
+			for (int b = 1; b < bin_count; b++) {
 				bounds_left[b] = bounds_left[b-1];
 				bounds_left[b].expand(bins[b-1].aabb);
 
@@ -336,7 +347,7 @@ namespace BVHPartitions {
 			}
 
 			// Then traverse right to left along the current dimension to evaluate second half of the SAH
-			for (int b = SBVH_BIN_COUNT - 1; b > 0; b--) {
+			for (int b = bin_count - 1; b > 0; b--) {
 				bounds_right[b] = bounds_right[b+1];
 				bounds_right[b].expand(bins[b].aabb);
 				
@@ -351,11 +362,11 @@ namespace BVHPartitions {
 				}
 			}
 
-			assert(count_left [SBVH_BIN_COUNT - 1] + bins[SBVH_BIN_COUNT - 1].entries == index_count);
-			assert(count_right[1]                  + bins[0].exits                    == index_count);
+			assert(count_left [bin_count - 1] + bins[bin_count - 1].entries == index_count);
+			assert(count_right[1]             + bins[0].exits               == index_count);
 
 			// Find the splitting plane that yields the lowest SAH cost along the current dimension
-			for (int b = 1; b < SBVH_BIN_COUNT; b++) {
+			for (int b = 1; b < bin_count; b++) {
 				float cost = bin_sah[b];
 				if (cost < min_bin_cost) {
 					min_bin_cost = cost;
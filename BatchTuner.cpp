@@ -0,0 +1,168 @@
+#include "BatchTuner.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Math.h"
+#include "Util.h"
+
+void BatchTuner::init(const char * key, int batch_size_max, int granularity) {
+	this->key = new char[strlen(key) + 1];
+	strcpy(this->key, key);
+
+	this->batch_size_max = batch_size_max;
+	this->granularity    = granularity;
+
+	pixel_count = 0;
+	batch_size  = batch_size_max;
+
+	candidate_count = 0;
+	candidate_index = -1;
+}
+
+void BatchTuner::free() {
+	delete [] key;
+}
+
+void BatchTuner::begin(int pixel_count, bool force_tuning) {
+	this->pixel_count = pixel_count;
+
+	candidate_index = -1;
+
+	if (!force_tuning && cache_load()) return;
+
+	// Batches larger than the screen all render the same, so the candidates are halved starting at whichever is smaller.
+	// Smaller candidates are rounded down to a multiple of 'granularity'
+	candidate_count = 0;
+
+	int size = Math::min(batch_size_max, pixel_count);
+	candidates[candidate_count++] = size;
+
+	while (candidate_count < MAX_CANDIDATES && size / 2 >= granularity) {
+		size /= 2;
+
+		candidates[candidate_count++] = (size / granularity) * granularity;
+	}
+
+	if (candidate_count <= 1) {
+		batch_size = Math::min(batch_size_max, pixel_count);
+		return;
+	}
+
+	candidate_index = 0;
+	frame = 0;
+
+	printf("Tuning batch size over %i candidates\n", candidate_count);
+}
+
+int BatchTuner::get_batch_size() const {
+	if (is_tuning()) return candidates[candidate_index];
+
+	return Math::min(batch_size, batch_size_max);
+}
+
+bool BatchTuner::frame_done(float time) {
+	if (!is_tuning()) return false;
+
+	if (frame >= WARMUP_FRAMES) {
+		times[candidate_index][frame - WARMUP_FRAMES] = time;
+	}
+	frame++;
+
+	if (frame < WARMUP_FRAMES + MEASURE_FRAMES) return false;
+
+	// Move on to the next candidate
+	frame = 0;
+	candidate_index++;
+
+	if (candidate_index < candidate_count) return true;
+
+	// All candidates were measured, every candidate renders the same pixels so the fastest median frame time has the highest throughput
+	float best_time = INFINITY;
+
+	for (int c = 0; c < candidate_count; c++) {
+		float * candidate_times = times[c];
+		std::sort(candidate_times, candidate_times + MEASURE_FRAMES);
+
+		float median = candidate_times[MEASURE_FRAMES / 2];
+
+		printf("    Batch size %8i: %.2f ms (%.1f Mpixels/s)\n", candidates[c], median, float(pixel_count) / (1000.0f * median));
+
+		if (median < best_time) {
+			best_time  = median;
+			batch_size = candidates[c];
+		}
+	}
+	printf("Picked batch size %i\n", batch_size);
+
+	candidate_index = -1;
+
+	cache_save();
+
+	return batch_size != candidates[candidate_count - 1];
+}
+
+// The cache file has one line per entry: pixel count, batch size and the key, which may contain spaces
+bool BatchTuner::cache_load() {
+	FILE * file = Util::file_open(CACHE_FILENAME, "r");
+	if (file == nullptr) return false;
+
+	bool found = false;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file)) {
+		int  entry_pixel_count;
+		int  entry_batch_size;
+		char entry_key[1024];
+
+		if (sscanf(line, "%i %i %1023[^\n]", &entry_pixel_count, &entry_batch_size, entry_key) != 3) continue;
+
+		if (entry_pixel_count == pixel_count && strcmp(entry_key, key) == 0) {
+			batch_size = entry_batch_size;
+			found = true;
+		}
+	}
+
+	fclose(file);
+
+	return found;
+}
+
+void BatchTuner::cache_save() const {
+	std::vector<std::string> lines;
+
+	// Keep the entries of other scenes, Devices and resolutions
+	FILE * file = Util::file_open(CACHE_FILENAME, "r");
+	if (file) {
+		char line[1024];
+		while (fgets(line, sizeof(line), file)) {
+			int  entry_pixel_count;
+			int  entry_batch_size;
+			char entry_key[1024];
+
+			if (sscanf(line, "%i %i %1023[^\n]", &entry_pixel_count, &entry_batch_size, entry_key) != 3) continue;
+			if (entry_pixel_count == pixel_count && strcmp(entry_key, key) == 0) continue;
+
+			lines.emplace_back(line);
+		}
+		fclose(file);
+	}
+
+	file = Util::file_open(CACHE_FILENAME, "w");
+	if (file == nullptr) {
+		printf("WARNING: Unable to write %s!\n", CACHE_FILENAME);
+		return;
+	}
+
+	for (const std::string & line : lines) {
+		fputs(line.c_str(), file);
+		if (line.back() != '\n') fputc('\n', file);
+	}
+	fprintf(file, "%i %i %s\n", pixel_count, batch_size, key);
+
+	fclose(file);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Picks the batch size of the wavefront, up to a fixed cap, that gives the highest throughput on the current scene and Device.
+// Every candidate batch size renders a few warmup frames followed by a few measured frames, the fastest candidate wins.
+// The result is stored in a cache file, keyed by scene, Device and pixel count, so that tuning only happens once
+struct BatchTuner {
+	static constexpr int WARMUP_FRAMES  = 2;
+	static constexpr int MEASURE_FRAMES = 5;
+
+	static constexpr int MAX_CANDIDATES = 4;
+
+	static constexpr const char * CACHE_FILENAME = "batch_size.cache";
+
+	// 'key' identifies the scene and Device. 'batch_size_max' caps the batch size, it is the number of Rays the wavefront buffers were allocated for.
+	// There is no separate memory budget: a batch never spans more than one sample of the screen, so batches beyond the pixel count are never useful
+	void init(const char * key, int batch_size_max, int granularity);
+	void free();
+
+	// Called whenever the pixel count changes, uses the cached batch size if there is one and starts tuning otherwise
+	void begin(int pixel_count, bool force_tuning = false);
+
+	inline bool is_tuning() const { return candidate_index != -1; }
+
+	int get_batch_size() const;
+
+	// Reports the Device time of a frame that was rendered with get_batch_size(), in ms.
+	// Returns true if the next frame should use a different batch size
+	bool frame_done(float time);
+
+private:
+	char * key;
+
+	int batch_size_max;
+	int granularity;
+
+	int pixel_count;
+	int batch_size;
+
+	int candidates[MAX_CANDIDATES];
+	int candidate_count;
+	int candidate_index; // -1 if not tuning
+
+	int   frame;
+	float times[MAX_CANDIDATES][MEASURE_FRAMES];
+
+	bool cache_load();
+	void cache_save() const;
+};
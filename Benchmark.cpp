@@ -0,0 +1,917 @@
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include "BVHBuilder.h"
+#include "SBVHBuilder.h"
+#include "QBVHBuilder.h"
+#include "CWBVHBuilder.h"
+#include "BVHPartitions.h"
+
+#include "OBJLoader.h"
+#include "MeshData.h"
+#include "FlatScene.h"
+#include "Material.h"
+#include "Texture.h"
+#include "TextureCPU.h"
+
+#include "Matrix4.h"
+#include "Quaternion.h"
+#include "MathSoA.h"
+
+#include "CountingSort.h"
+#include "RaySortCPU.h"
+
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Numa.h"
+#include "Util.h"
+
+// Microbenchmarks for the hot Host side routines of the core library.
+// Every benchmark is run a number of warmup iterations before its timed iterations,
+// the reported time is the median of the timed iterations to be robust against outliers
+
+struct BenchmarkOptions {
+	int warmup     = 3;
+	int iterations = 15;
+	int cpu        = 0; // Core the benchmark thread is pinned to, -1 disables pinning
+
+	const char * filter    = nullptr; // Only runs benchmarks whose name contains this string
+	const char * json_file = nullptr;
+
+	bool use_data = true; // Also run on the Meshes in Data/
+};
+
+struct BenchmarkResult {
+	std::string name;
+
+	int items; // Amount of work per iteration, for example the amount of Triangles
+
+	double median; // In microseconds
+	double min;
+	double max;
+	double mean;
+};
+
+static BenchmarkOptions             options;
+static std::vector<BenchmarkResult> results;
+
+// Results of benchmarked code are written here so the compiler cannot optimize it away
+static volatile float sink;
+
+// Runs 'body' warmup + iterations times, 'setup' and 'teardown' run around every iteration but are not timed
+static void run(const char * name, int items, const std::function<void()> & setup, const std::function<void()> & body, const std::function<void()> & teardown) {
+	if (options.filter && strstr(name, options.filter) == nullptr) return;
+
+	std::vector<double> timings;
+	timings.reserve(options.iterations);
+
+	for (int i = 0; i < options.warmup + options.iterations; i++) {
+		if (setup) setup();
+
+		std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+		body();
+		std::chrono::high_resolution_clock::time_point stop_time  = std::chrono::high_resolution_clock::now();
+
+		if (teardown) teardown();
+
+		if (i >= options.warmup) {
+			timings.push_back(std::chrono::duration<double, std::micro>(stop_time - start_time).count());
+		}
+	}
+
+	std::sort(timings.begin(), timings.end());
+
+	BenchmarkResult result;
+	result.name  = name;
+	result.items = items;
+
+	int count = timings.size();
+	result.median = count % 2 == 1 ? timings[count / 2] : 0.5 * (timings[count / 2 - 1] + timings[count / 2]);
+	result.min    = timings[0];
+	result.max    = timings[count - 1];
+
+	result.mean = 0.0;
+	for (int i = 0; i < count; i++) result.mean += timings[i];
+	result.mean /= double(count);
+
+	printf("%-48s %12.1f us (min %12.1f us, max %12.1f us)\n", name, result.median, result.min, result.max);
+
+	results.push_back(result);
+}
+
+static void run(const char * name, int items, const std::function<void()> & body) {
+	run(name, items, nullptr, body, nullptr);
+}
+
+static float random_float() {
+	return float(Random::get_value()) / float(UINT_MAX);
+}
+
+static Vector3 random_vector(float scale) {
+	return Vector3(random_float(), random_float(), random_float()) * scale;
+}
+
+static void init_triangle(Triangle & triangle) {
+	Vector3 positions[3] = { triangle.position_0, triangle.position_1, triangle.position_2 };
+	triangle.aabb = AABB::from_points(positions, 3);
+}
+
+// Small Triangles scattered uniformly in a cube, always generated from the same seed so that runs are comparable
+static std::vector<Triangle> generate_triangles(int triangle_count, unsigned seed) {
+	Random::init(seed);
+
+	std::vector<Triangle> triangles(triangle_count);
+
+	for (int i = 0; i < triangle_count; i++) {
+		Triangle & triangle = triangles[i];
+
+		triangle.position_0 = random_vector(100.0f);
+		triangle.position_1 = triangle.position_0 + random_vector(2.0f) - Vector3(1.0f);
+		triangle.position_2 = triangle.position_0 + random_vector(2.0f) - Vector3(1.0f);
+
+		triangle.normal_0 = triangle.normal_1 = triangle.normal_2 = Vector3(0.0f, 1.0f, 0.0f);
+
+		triangle.material_id = 0;
+
+		init_triangle(triangle);
+	}
+
+	return triangles;
+}
+
+static void free_bvh(BVH & bvh) {
+	delete [] bvh.indices;
+	delete [] bvh.nodes;
+
+	bvh.indices = nullptr;
+	bvh.nodes   = nullptr;
+}
+
+static BVH build_sbvh(const std::vector<Triangle> & triangles, int max_primitives_in_leaf) {
+	BVH sbvh;
+
+	SBVHBuilder sbvh_builder;
+	sbvh_builder.init(&sbvh, triangles.size(), max_primitives_in_leaf);
+	sbvh_builder.build(triangles.data(), triangles.size());
+	sbvh_builder.free();
+
+	return sbvh;
+}
+
+// Partitions the root Node, which is the most expensive call in every builder
+static void benchmark_partitions(const char * input_name, const std::vector<Triangle> & triangles) {
+	int triangle_count = triangles.size();
+
+	std::vector<int> indices_x(triangle_count);
+	std::vector<int> indices_y(triangle_count);
+	std::vector<int> indices_z(triangle_count);
+
+	for (int i = 0; i < triangle_count; i++) {
+		indices_x[i] = i;
+		indices_y[i] = i;
+		indices_z[i] = i;
+	}
+
+	std::sort(indices_x.begin(), indices_x.end(), [&](int a, int b) { return triangles[a].get_center().x < triangles[b].get_center().x; });
+	std::sort(indices_y.begin(), indices_y.end(), [&](int a, int b) { return triangles[a].get_center().y < triangles[b].get_center().y; });
+	std::sort(indices_z.begin(), indices_z.end(), [&](int a, int b) { return triangles[a].get_center().z < triangles[b].get_center().z; });
+
+	int * indices[3] = { indices_x.data(), indices_y.data(), indices_z.data() };
+
+	std::vector<float> sah(triangle_count);
+
+	AABB root_aabb = BVHPartitions::calculate_bounds(triangles.data(), indices[0], 0, triangle_count);
+
+	char name[128];
+
+	snprintf(name, sizeof(name), "partition_sah/%s", input_name);
+	run(name, triangle_count, [&]() {
+		int   split_dimension;
+		float split_cost;
+		sink = float(BVHPartitions::partition_sah(triangles.data(), indices, 0, triangle_count, sah.data(), split_dimension, split_cost));
+	});
+
+	snprintf(name, sizeof(name), "partition_object/%s", input_name);
+	run(name, triangle_count, [&]() {
+		int   split_dimension;
+		float split_cost;
+		AABB  aabb_left, aabb_right;
+		sink = float(BVHPartitions::partition_object(triangles.data(), indices, 0, triangle_count, sah.data(), split_dimension, split_cost, root_aabb, aabb_left, aabb_right));
+	});
+
+	for (int bin_count : { 32, BVHPartitions::SBVH_MAX_BIN_COUNT }) {
+		snprintf(name, sizeof(name), "partition_spatial_%i/%s", bin_count, input_name);
+		run(name, triangle_count, [&]() {
+			int   split_dimension;
+			float split_cost;
+			AABB  aabb_left, aabb_right;
+			int   n_left, n_right;
+			sink = float(BVHPartitions::partition_spatial(triangles.data(), indices, 0, triangle_count, split_dimension, split_cost, aabb_left, aabb_right, n_left, n_right, root_aabb, bin_count));
+		});
+	}
+}
+
+static void benchmark_builders(const char * input_name, const std::vector<Triangle> & triangles) {
+	int triangle_count = triangles.size();
+
+	char name[128];
+
+	BVH bvh;
+
+	BVHBuilder bvh_builder;
+	snprintf(name, sizeof(name), "build_bvh/%s", input_name);
+	run(name, triangle_count, [&]() {
+		bvh_builder.init(&bvh, triangle_count, 1);
+	}, [&]() {
+		bvh_builder.build(triangles.data(), triangle_count);
+	}, [&]() {
+		bvh_builder.free();
+		free_bvh(bvh);
+	});
+
+	const char * preset_names[] = { "fast", "balanced", "max" };
+
+	for (int preset : { SBVH_PRESET_FAST, SBVH_PRESET_BALANCED }) {
+		SBVHBuilder sbvh_builder;
+		snprintf(name, sizeof(name), "build_sbvh_%s/%s", preset_names[preset], input_name);
+		run(name, triangle_count, [&]() {
+			sbvh_builder.init(&bvh, triangle_count, 1, SBVHSettings::from_preset(preset));
+		}, [&]() {
+			sbvh_builder.build(triangles.data(), triangle_count);
+		}, [&]() {
+			sbvh_builder.free();
+			free_bvh(bvh);
+		});
+	}
+
+	// The collapses start from the SBVH that MeshData uses for the respective BVH type
+	BVH sbvh = build_sbvh(triangles, INT_MAX);
+
+	QBVH qbvh;
+	QBVHBuilder qbvh_builder;
+	snprintf(name, sizeof(name), "collapse_qbvh/%s", input_name);
+	run(name, sbvh.node_count, [&]() {
+		qbvh_builder.init(&qbvh, sbvh);
+	}, [&]() {
+		qbvh_builder.build(sbvh);
+	}, [&]() {
+		delete [] qbvh.nodes;
+	});
+
+	free_bvh(sbvh);
+	sbvh = build_sbvh(triangles, 1);
+
+	CWBVH cwbvh;
+	CWBVHBuilder cwbvh_builder;
+	snprintf(name, sizeof(name), "collapse_cwbvh/%s", input_name);
+	run(name, sbvh.node_count, [&]() {
+		cwbvh_builder.init(&cwbvh, sbvh);
+	}, [&]() {
+		cwbvh_builder.build(sbvh);
+	}, [&]() {
+		cwbvh_builder.free();
+
+		delete [] cwbvh.indices;
+		delete [] cwbvh.nodes;
+	});
+
+	free_bvh(sbvh);
+}
+
+static const BenchmarkResult * find_result(const char * name) {
+	for (const BenchmarkResult & result : results) {
+		if (result.name == name) return &result;
+	}
+	return nullptr;
+}
+
+// Traces incoherent secondary Rays, starting on random Triangles in random directions, in their original order and sorted by RaySort::get_key.
+// Besides the timings it reports how many traversal steps Warps would take in lockstep, which is what the sort reduces on the Device
+static void benchmark_ray_sort(const char * input_name, const std::vector<Triangle> & triangles) {
+	constexpr int RAY_COUNT = 1 << 14;
+
+	Random::init(4);
+
+	BVH bvh = build_sbvh(triangles, 4);
+
+	std::vector<float> origin_x   (RAY_COUNT), origin_y   (RAY_COUNT), origin_z   (RAY_COUNT);
+	std::vector<float> direction_x(RAY_COUNT), direction_y(RAY_COUNT), direction_z(RAY_COUNT);
+
+	for (int i = 0; i < RAY_COUNT; i++) {
+		const Triangle & triangle = triangles[Random::get_value() % triangles.size()];
+
+		Vector3 direction = Vector3::normalize(random_vector(2.0f) - Vector3(1.0f));
+		Vector3 origin    = triangle.get_center() + 0.001f * direction;
+
+		origin_x   [i] = origin.x;    origin_y   [i] = origin.y;    origin_z   [i] = origin.z;
+		direction_x[i] = direction.x; direction_y[i] = direction.y; direction_z[i] = direction.z;
+	}
+
+	std::vector<int> keys   (RAY_COUNT);
+	std::vector<int> indices(RAY_COUNT);
+	std::vector<int> steps  (RAY_COUNT);
+
+	auto sort = [&]() {
+		RaySortCPU::get_keys(RAY_COUNT, origin_x.data(), origin_y.data(), origin_z.data(), direction_x.data(), direction_y.data(), direction_z.data(), bvh.nodes[0].aabb, keys.data());
+		CountingSort::sort(keys.data(), RAY_COUNT, RAY_SORT_KEY_COUNT, indices.data());
+	};
+
+	auto trace = [&](const int * order) {
+		float t_sum = 0.0f;
+
+		for (int i = 0; i < RAY_COUNT; i++) {
+			int index = order ? order[i] : i;
+
+			float t;
+			steps[index] = RaySortCPU::trace(bvh, triangles.data(), Vector3(origin_x[index], origin_y[index], origin_z[index]), Vector3(direction_x[index], direction_y[index], direction_z[index]), t);
+
+			if (t < INFINITY) t_sum += t;
+		}
+
+		sink = t_sum;
+	};
+
+	char name_sort         [128]; snprintf(name_sort,          sizeof(name_sort),          "ray_sort/%s",         input_name);
+	char name_trace        [128]; snprintf(name_trace,         sizeof(name_trace),         "ray_trace/%s",        input_name);
+	char name_trace_sorted [128]; snprintf(name_trace_sorted,  sizeof(name_trace_sorted),  "ray_trace_sorted/%s", input_name);
+
+	run(name_sort,         RAY_COUNT, [&]() { sort(); });
+	run(name_trace,        RAY_COUNT, [&]() { trace(nullptr); });
+	run(name_trace_sorted, RAY_COUNT, [&]() { trace(indices.data()); });
+
+	const BenchmarkResult * result_sort         = find_result(name_sort);
+	const BenchmarkResult * result_trace        = find_result(name_trace);
+	const BenchmarkResult * result_trace_sorted = find_result(name_trace_sorted);
+
+	if (result_sort && result_trace && result_trace_sorted) {
+		long long steps_total = 0;
+		for (int i = 0; i < RAY_COUNT; i++) steps_total += steps[i];
+
+		long long warp_steps_unsorted = RaySortCPU::warp_steps(steps.data(), RAY_COUNT, nullptr);
+		long long warp_steps_sorted   = RaySortCPU::warp_steps(steps.data(), RAY_COUNT, indices.data());
+
+		double time_unsorted = result_trace->median;
+		double time_sorted   = result_trace_sorted->median + result_sort->median;
+
+		printf("    %.1f traversal steps per Ray, %.1f -> %.1f per Ray in lockstep Warps (%.1f%% fewer), sort + trace %.1f%% faster than trace\n",
+			double(steps_total)         / double(RAY_COUNT),
+			double(warp_steps_unsorted) / double(RAY_COUNT / WARP_SIZE),
+			double(warp_steps_sorted)   / double(RAY_COUNT / WARP_SIZE),
+			100.0 * (1.0 - double(warp_steps_sorted) / double(warp_steps_unsorted)),
+			100.0 * (time_unsorted / time_sorted - 1.0)
+		);
+	}
+
+	free_bvh(bvh);
+}
+
+// Flattens a number of copies of the same MeshData into the Device layout, as done by Pathtracer::init
+static void benchmark_flatten_scene(ThreadPool & thread_pool) {
+	constexpr int MESH_DATA_COUNT = 8;
+
+	std::vector<Triangle> triangles = generate_triangles(50000, 3);
+
+	BVH sbvh = build_sbvh(triangles, BVH_TYPE == BVH_CWBVH ? 1 : INT_MAX);
+
+	MeshData mesh_data;
+	mesh_data.triangle_count  = triangles.size();
+	mesh_data.triangles       = triangles.data();
+	mesh_data.material_offset = 0;
+
+#if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
+	mesh_data.bvh = sbvh;
+#elif BVH_TYPE == BVH_QBVH
+	QBVHBuilder qbvh_builder;
+	qbvh_builder.init(&mesh_data.bvh, sbvh);
+	qbvh_builder.build(sbvh);
+#elif BVH_TYPE == BVH_CWBVH
+	CWBVHBuilder cwbvh_builder;
+	cwbvh_builder.init(&mesh_data.bvh, sbvh);
+	cwbvh_builder.build(sbvh);
+	cwbvh_builder.free();
+#endif
+
+	int mesh_data_count = MeshData::mesh_datas.size();
+	for (int i = 0; i < MESH_DATA_COUNT; i++) {
+		MeshData::mesh_datas.push_back(&mesh_data);
+	}
+
+	ThreadPool thread_pool_single;
+	thread_pool_single.init(1);
+
+	FlatScene flat_scene;
+
+	std::vector<ThreadPool *> thread_pools = { &thread_pool_single };
+	if (thread_pool.thread_count > 1) thread_pools.push_back(&thread_pool);
+
+	for (ThreadPool * pool : thread_pools) {
+		char name[128];
+		snprintf(name, sizeof(name), "flatten_scene_%i_threads/synthetic_8x50k", pool->thread_count);
+
+		run(name, MESH_DATA_COUNT * mesh_data.bvh.index_count, nullptr, [&]() {
+			flat_scene.init(0, *pool);
+			flat_scene.init_lights(*pool);
+		}, [&]() {
+			flat_scene.free();
+		});
+	}
+
+	thread_pool_single.free();
+
+	MeshData::mesh_datas.resize(mesh_data_count);
+
+#if BVH_TYPE == BVH_QBVH
+	delete [] mesh_data.bvh.nodes; // Shares its indices with the SBVH
+#elif BVH_TYPE == BVH_CWBVH
+	delete [] mesh_data.bvh.indices;
+	delete [] mesh_data.bvh.nodes;
+#endif
+	free_bvh(sbvh);
+}
+
+static void benchmark_downsample() {
+	constexpr int width_src  = 1024;
+	constexpr int height_src = 1024;
+	constexpr int width_dst  = width_src  / 2;
+	constexpr int height_dst = height_src / 2;
+
+	Random::init(1);
+
+	std::vector<Vector4> texture_src(width_src * height_src);
+	std::vector<Vector4> texture_dst(width_dst * height_dst);
+	std::vector<Vector4> temp       (width_dst * height_src);
+
+	for (int i = 0; i < width_src * height_src; i++) {
+		texture_src[i] = Vector4(random_float(), random_float(), random_float(), 1.0f);
+	}
+
+	struct {
+		int          filter;
+		const char * name;
+	} filters[] = {
+		{ MIPMAP_DOWNSAMPLE_FILTER_BOX,     "downsample_box/1024"     },
+		{ MIPMAP_DOWNSAMPLE_FILTER_LANCZOS, "downsample_lanczos/1024" },
+		{ MIPMAP_DOWNSAMPLE_FILTER_KAISER,  "downsample_kaiser/1024"  }
+	};
+
+	for (const auto & filter : filters) {
+		run(filter.name, width_src * height_src, [&]() {
+			Texture::downsample(filter.filter, width_src, height_src, width_dst, height_dst, texture_src.data(), texture_dst.data(), temp.data());
+			sink = texture_dst[0].x;
+		});
+	}
+}
+
+// Creates a size x size RGBA Texture of random texels with a full Mip chain, box filtered like Texture::load does
+static Texture create_texture_rgba(int size) {
+	int mip_levels = 1 + int(log2f(float(size)));
+
+	int texel_count = 0;
+	for (int l = 0; l < mip_levels; l++) texel_count += (size >> l) * (size >> l);
+
+	Vector4 * data        = new Vector4[texel_count];
+	int     * mip_offsets = new int[mip_levels];
+
+	for (int i = 0; i < size * size; i++) {
+		data[i] = Vector4(random_float(), random_float(), random_float(), 1.0f);
+	}
+
+	std::vector<Vector4> temp((size / 2) * size);
+
+	int offset = 0;
+
+	for (int l = 0; l < mip_levels; l++) {
+		mip_offsets[l] = offset * sizeof(Vector4);
+
+		if (l > 0) {
+			int size_src = size >> (l - 1);
+			int size_dst = size >>  l;
+
+			Texture::downsample(MIPMAP_DOWNSAMPLE_FILTER_BOX, size_src, size_src, size_dst, size_dst, data + offset - size_src * size_src, data + offset, temp.data());
+		}
+
+		offset += (size >> l) * (size >> l);
+	}
+
+	Texture texture;
+	texture.data        = reinterpret_cast<const unsigned char *>(data);
+	texture.format      = Texture::Format::RGBA;
+	texture.channels    = 4;
+	texture.width       = size;
+	texture.height      = size;
+	texture.mip_levels  = mip_levels;
+	texture.mip_offsets = mip_offsets;
+
+	return texture;
+}
+
+// Creates a BC Texture of size x size texels with a full Mip chain down to a single block, filled with random blocks
+static Texture create_texture_bc(int size, Texture::Format format) {
+	int block_size = format == Texture::Format::BC1 ? 8 : 16;
+	int blocks     = size / 4;
+	int mip_levels = 1 + int(log2f(float(blocks)));
+
+	int byte_count = 0;
+	for (int l = 0; l < mip_levels; l++) byte_count += block_size * (blocks >> l) * (blocks >> l);
+
+	unsigned char * data        = new unsigned char[byte_count];
+	int           * mip_offsets = new int[mip_levels];
+
+	for (int i = 0; i < byte_count; i++) data[i] = (unsigned char)Random::get_value();
+
+	int offset = 0;
+
+	for (int l = 0; l < mip_levels; l++) {
+		mip_offsets[l] = offset;
+
+		offset += block_size * (blocks >> l) * (blocks >> l);
+	}
+
+	Texture texture;
+	texture.data        = data;
+	texture.format      = format;
+	texture.channels    = format == Texture::Format::BC1 ? 2 : 4;
+	texture.width       = blocks;
+	texture.height      = blocks;
+	texture.mip_levels  = mip_levels;
+	texture.mip_offsets = mip_offsets;
+
+	return texture;
+}
+
+// Host Texture lookups in every supported format, one at a time and batched using TextureCPU::get_lod_batch and get_grad_batch.
+// Footprints of the gradient lookups are up to 32 texels long and 1 to 4 texels wide, so that anisotropic filtering kicks in
+static void benchmark_texture_sampling() {
+	constexpr int SIZE  = 1024;
+	constexpr int COUNT = 1 << 16;
+
+	Random::init(5);
+
+	Texture texture_rgba  = create_texture_rgba(SIZE);
+	Texture texture_rgba8 = TextureCPU::convert_to_rgba8(texture_rgba);
+	Texture texture_bc1   = create_texture_bc(SIZE, Texture::Format::BC1);
+	Texture texture_bc3   = create_texture_bc(SIZE, Texture::Format::BC3);
+
+	std::vector<float> s(COUNT), t(COUNT), lod(COUNT);
+	std::vector<float> dsdx(COUNT), dtdx(COUNT), dsdy(COUNT), dtdy(COUNT);
+
+	for (int i = 0; i < COUNT; i++) {
+		s  [i] = 4.0f * random_float() - 2.0f;
+		t  [i] = 4.0f * random_float() - 2.0f;
+		lod[i] = 10.0f * random_float();
+
+		float angle = random_float() * TWO_PI;
+		float major = (1.0f + 31.0f * random_float()) / float(SIZE);
+		float minor = (1.0f +  3.0f * random_float()) / float(SIZE);
+
+		dsdx[i] =  major * cosf(angle);
+		dtdx[i] =  major * sinf(angle);
+		dsdy[i] = -minor * sinf(angle);
+		dtdy[i] =  minor * cosf(angle);
+	}
+
+	std::vector<Vector4> result_single(COUNT);
+	std::vector<Vector4> result_batch (COUNT);
+
+	struct {
+		const Texture & texture;
+		const char    * name;
+	} textures[] = {
+		{ texture_rgba,  "rgba"  },
+		{ texture_rgba8, "rgba8" },
+		{ texture_bc1,   "bc1"   },
+		{ texture_bc3,   "bc3"   }
+	};
+
+	for (const auto & texture : textures) {
+		char name_lod       [128]; snprintf(name_lod,        sizeof(name_lod),        "texture_lod/%s",        texture.name);
+		char name_lod_batch [128]; snprintf(name_lod_batch,  sizeof(name_lod_batch),  "texture_lod_batch/%s",  texture.name);
+		char name_grad      [128]; snprintf(name_grad,       sizeof(name_grad),       "texture_grad/%s",       texture.name);
+		char name_grad_batch[128]; snprintf(name_grad_batch, sizeof(name_grad_batch), "texture_grad_batch/%s", texture.name);
+
+		float difference_lod  = 0.0f;
+		float difference_grad = 0.0f;
+
+		auto max_difference = [&]() {
+			float difference = 0.0f;
+			for (int i = 0; i < COUNT; i++) {
+				difference = Math::max(difference, fabsf(result_single[i].x - result_batch[i].x));
+				difference = Math::max(difference, fabsf(result_single[i].y - result_batch[i].y));
+				difference = Math::max(difference, fabsf(result_single[i].z - result_batch[i].z));
+				difference = Math::max(difference, fabsf(result_single[i].w - result_batch[i].w));
+			}
+			return difference;
+		};
+
+		run(name_lod, COUNT, [&]() {
+			for (int i = 0; i < COUNT; i++) {
+				result_single[i] = TextureCPU::get_lod(texture.texture, s[i], t[i], lod[i]);
+			}
+			sink = result_single[0].x;
+		});
+		run(name_lod_batch, COUNT, [&]() {
+			TextureCPU::get_lod_batch(texture.texture, COUNT, s.data(), t.data(), lod.data(), result_batch.data());
+			sink = result_batch[0].x;
+		});
+		if (find_result(name_lod) && find_result(name_lod_batch)) difference_lod = max_difference();
+
+		run(name_grad, COUNT, [&]() {
+			for (int i = 0; i < COUNT; i++) {
+				result_single[i] = TextureCPU::get_grad(texture.texture, s[i], t[i], dsdx[i], dtdx[i], dsdy[i], dtdy[i]);
+			}
+			sink = result_single[0].x;
+		});
+		run(name_grad_batch, COUNT, [&]() {
+			TextureCPU::get_grad_batch(texture.texture, COUNT, s.data(), t.data(), dsdx.data(), dtdx.data(), dsdy.data(), dtdy.data(), result_batch.data());
+			sink = result_batch[0].x;
+		});
+		if (find_result(name_grad) && find_result(name_grad_batch)) difference_grad = max_difference();
+
+		// Lookups per microsecond equals millions of lookups per second
+		auto msamples = [](const char * name) {
+			const BenchmarkResult * result = find_result(name);
+			return result ? double(result->items) / result->median : 0.0;
+		};
+
+		if (find_result(name_lod) || find_result(name_grad)) {
+			printf("    %s: trilinear %.1f / %.1f Msamples/s, anisotropic %.1f / %.1f Msamples/s (single / batch), max batch difference %.2e%s\n",
+				texture.name,
+				msamples(name_lod),  msamples(name_lod_batch),
+				msamples(name_grad), msamples(name_grad_batch),
+				Math::max(difference_lod, difference_grad),
+				Math::max(difference_lod, difference_grad) > 1e-5f ? " INVALID" : ""
+			);
+		}
+	}
+
+	texture_rgba .free();
+	texture_rgba8.free();
+	texture_bc1  .free();
+	texture_bc3  .free();
+}
+
+static void benchmark_math() {
+	constexpr int COUNT = 1 << 16;
+
+	Random::init(2);
+
+	std::vector<AABB>       aabbs      (COUNT);
+	std::vector<Matrix4>    matrices   (COUNT);
+	std::vector<Quaternion> quaternions(COUNT);
+	std::vector<Vector3>    vectors    (COUNT);
+
+	for (int i = 0; i < COUNT; i++) {
+		Vector3 points[2] = { random_vector(10.0f), random_vector(10.0f) };
+		aabbs[i] = AABB::from_points(points, 2);
+
+		quaternions[i] = Quaternion::axis_angle(Vector3::normalize(random_vector(1.0f) + Vector3(0.1f)), random_float() * TWO_PI);
+		vectors    [i] = random_vector(10.0f);
+
+		matrices[i] = Matrix4::create_translation(vectors[i]) * Matrix4::create_rotation(quaternions[i]) * Matrix4::create_scale(random_float() + 0.5f);
+	}
+
+	run("aabb_transform", COUNT, [&]() {
+		float sum = 0.0f;
+		for (int i = 0; i < COUNT; i++) {
+			sum += AABB::transform(aabbs[i], matrices[i]).max.x;
+		}
+		sink = sum;
+	});
+
+	run("matrix4_multiply", COUNT, [&]() {
+		Matrix4 result;
+		for (int i = 0; i < COUNT; i++) {
+			result = result * matrices[i];
+		}
+		sink = result(0, 0);
+	});
+
+	run("matrix4_transform_position", COUNT, [&]() {
+		float sum = 0.0f;
+		for (int i = 0; i < COUNT; i++) {
+			sum += Matrix4::transform_position(matrices[i], vectors[i]).y;
+		}
+		sink = sum;
+	});
+
+	run("matrix4_create_rotation", COUNT, [&]() {
+		float sum = 0.0f;
+		for (int i = 0; i < COUNT; i++) {
+			sum += Matrix4::create_rotation(quaternions[i])(1, 2);
+		}
+		sink = sum;
+	});
+
+	run("quaternion_multiply", COUNT, [&]() {
+		Quaternion result;
+		for (int i = 0; i < COUNT; i++) {
+			result = Quaternion::normalize(quaternions[i] * result);
+		}
+		sink = result.w;
+	});
+
+	run("quaternion_rotate", COUNT, [&]() {
+		float sum = 0.0f;
+		for (int i = 0; i < COUNT; i++) {
+			sum += (quaternions[i] * vectors[i]).z;
+		}
+		sink = sum;
+	});
+
+	// Bulk operations, comparing the AoS loops against the batched SoA versions
+	AABBSoA aabbs_soa;
+	AABBSoA aabbs_soa_result;
+	aabbs_soa       .init(COUNT);
+	aabbs_soa_result.init(COUNT);
+
+	Vector3SoA vectors_soa;
+	Vector3SoA vectors_soa_result;
+	vectors_soa       .init(COUNT);
+	vectors_soa_result.init(COUNT);
+
+	for (int i = 0; i < COUNT; i++) {
+		aabbs_soa  .set(i, aabbs  [i]);
+		vectors_soa.set(i, vectors[i]);
+	}
+
+	std::vector<AABB>    aabbs_result  (COUNT);
+	std::vector<Vector3> vectors_result(COUNT);
+	std::vector<float>   surface_areas (COUNT);
+
+	run("bulk_transform_positions/aos", COUNT, [&]() {
+		for (int i = 0; i < COUNT; i++) {
+			vectors_result[i] = Matrix4::transform_position(matrices[0], vectors[i]);
+		}
+		sink = vectors_result[COUNT - 1].x;
+	});
+
+	run("bulk_transform_positions/soa", COUNT, [&]() {
+		MathSoA::transform_positions(matrices[0], vectors_soa, vectors_soa_result);
+		sink = vectors_soa_result.x[COUNT - 1];
+	});
+
+	run("bulk_transform_aabbs/aos", COUNT, [&]() {
+		for (int i = 0; i < COUNT; i++) {
+			aabbs_result[i] = AABB::transform(aabbs[i], matrices[0]);
+		}
+		sink = aabbs_result[COUNT - 1].min.x;
+	});
+
+	run("bulk_transform_aabbs/soa", COUNT, [&]() {
+		MathSoA::transform(matrices[0], aabbs_soa, aabbs_soa_result);
+		sink = aabbs_soa_result.min_x[COUNT - 1];
+	});
+
+	run("bulk_merge_aabbs/aos", COUNT, [&]() {
+		AABB merged = AABB::create_empty();
+		for (int i = 0; i < COUNT; i++) {
+			merged.expand(aabbs[i]);
+		}
+		sink = merged.max.x;
+	});
+
+	run("bulk_merge_aabbs/soa", COUNT, [&]() {
+		sink = MathSoA::merge(aabbs_soa).max.x;
+	});
+
+	run("bulk_surface_areas/aos", COUNT, [&]() {
+		for (int i = 0; i < COUNT; i++) {
+			surface_areas[i] = aabbs[i].surface_area();
+		}
+		sink = surface_areas[COUNT - 1];
+	});
+
+	run("bulk_surface_areas/soa", COUNT, [&]() {
+		MathSoA::surface_areas(aabbs_soa, surface_areas.data());
+		sink = surface_areas[COUNT - 1];
+	});
+
+	aabbs_soa         .free();
+	aabbs_soa_result  .free();
+	vectors_soa       .free();
+	vectors_soa_result.free();
+}
+
+static std::vector<Triangle> load_obj(const char * filename, const char * input_name) {
+	int material_count = Material::materials.size();
+
+	MeshData mesh_data;
+	OBJLoader::load_obj(filename, &mesh_data);
+
+	std::vector<Triangle> triangles(mesh_data.triangles, mesh_data.triangles + mesh_data.triangle_count);
+
+	delete [] mesh_data.triangles;
+
+	char name[128];
+	snprintf(name, sizeof(name), "obj_load/%s", input_name);
+
+	run(name, triangles.size(), nullptr, [&]() {
+		OBJLoader::load_obj(filename, &mesh_data);
+	}, [&]() {
+		delete [] mesh_data.triangles;
+	});
+
+	// Every load appends the Materials of the file
+	Material::materials.resize(material_count);
+
+	return triangles;
+}
+
+static void write_json(const char * filename) {
+	FILE * file = Util::file_open(filename, "wb");
+
+	if (file == nullptr) {
+		printf("ERROR: Unable to write benchmark results to %s!\n", filename);
+		abort();
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"config\": { \"warmup\": %i, \"iterations\": %i, \"cpu\": %i, \"hardware_threads\": %u, \"bvh_type\": %i },\n",
+		options.warmup, options.iterations, options.cpu, std::thread::hardware_concurrency(), BVH_TYPE
+	);
+	fprintf(file, "\t\"benchmarks\": [\n");
+
+	for (int i = 0; i < int(results.size()); i++) {
+		const BenchmarkResult & result = results[i];
+
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"items\": %i, \"median_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f, \"mean_us\": %.3f }%s\n",
+			result.name.c_str(), result.items, result.median, result.min, result.max, result.mean,
+			i + 1 < int(results.size()) ? "," : ""
+		);
+	}
+
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+
+	fclose(file);
+}
+
+int main(int argument_count, char ** arguments) {
+	for (int i = 1; i < argument_count; i++) {
+		const char * argument = arguments[i];
+		const char * value    = i + 1 < argument_count ? arguments[i + 1] : nullptr;
+
+		if (strcmp(argument, "--warmup") == 0 && value) {
+			options.warmup = atoi(value); i++;
+		} else if (strcmp(argument, "--iterations") == 0 && value) {
+			options.iterations = Math::max(atoi(value), 1); i++;
+		} else if (strcmp(argument, "--cpu") == 0 && value) {
+			options.cpu = atoi(value); i++;
+		} else if (strcmp(argument, "--filter") == 0 && value) {
+			options.filter = value; i++;
+		} else if (strcmp(argument, "--json") == 0 && value) {
+			options.json_file = value; i++;
+		} else if (strcmp(argument, "--no-data") == 0) {
+			options.use_data = false;
+		} else {
+			printf("Usage: %s [--warmup N] [--iterations N] [--cpu N] [--filter name] [--json file] [--no-data]\n", arguments[0]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Created before pinning, otherwise the workers would inherit the affinity of the benchmark thread
+	ThreadPool thread_pool;
+	thread_pool.init();
+
+	if (options.cpu >= 0 && !Numa::pin_thread(options.cpu)) {
+		printf("WARNING: Unable to pin benchmark thread to cpu %i!\n", options.cpu);
+	}
+
+	// Default Material, as expected by OBJLoader
+	Material::materials.emplace_back();
+
+	std::vector<Triangle> triangles_synthetic = generate_triangles(50000, 1);
+
+	benchmark_partitions("synthetic_50k", triangles_synthetic);
+	benchmark_builders  ("synthetic_50k", triangles_synthetic);
+	benchmark_ray_sort  ("synthetic_50k", triangles_synthetic);
+
+	if (options.use_data && Util::file_exists("Data/Bunny.obj")) {
+		std::vector<Triangle> triangles_bunny = load_obj("Data/Bunny.obj", "bunny");
+
+		benchmark_partitions("bunny", triangles_bunny);
+		benchmark_builders  ("bunny", triangles_bunny);
+		benchmark_ray_sort  ("bunny", triangles_bunny);
+	}
+
+	benchmark_flatten_scene(thread_pool);
+	benchmark_downsample();
+	benchmark_texture_sampling();
+	benchmark_math();
+
+	if (options.json_file) write_json(options.json_file);
+
+	Texture::wait_until_textures_loaded();
+
+	thread_pool.free();
+
+	return EXIT_SUCCESS;
+}
@@ -60,6 +60,8 @@ void CUDAContext::init() {
 
 	device = best_device;
 
+	CUDACALL(cuDeviceGetName(device_name, sizeof(device_name), device));
+
 	CUDACALL(cuCtxCreate(&context, 0, device));
 		
 	CUfunc_cache   config_cache;
@@ -6,6 +6,8 @@ namespace CUDAContext {
 
 	inline unsigned long long total_memory;
 
+	inline char device_name[256];
+
 	// Creates a new CUDA Context
 	void init();
 	void destroy();
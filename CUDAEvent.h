@@ -3,26 +3,41 @@
 
 #include "CUDACall.h"
 
-struct CUDAEvent {
-	CUevent event;
+// Timer backend for EventRing that uses CUDA Events on the default stream
+struct CUDAEventTimer {
+	typedef CUevent Event;
 
-	const char * category;
-	const char * name;
-
-	inline void init(const char * category, const char * name) {
+	inline Event create() {
+		CUevent event;
 		CUDACALL(cuEventCreate(&event, CU_EVENT_DEFAULT));
 
-		this->category = category;
-		this->name     = name;
+		return event;
+	}
+
+	inline void destroy(CUevent event) {
+		CUDACALL(cuEventDestroy(event));
+	}
+
+	inline void record(CUevent event) {
+		CUDACALL(cuEventRecord(event, nullptr));
+	}
+
+	inline bool is_complete(CUevent event) {
+		CUresult result = cuEventQuery(event);
+		if (result == CUDA_ERROR_NOT_READY) return false;
+
+		CUDACALL(result);
+
+		return true;
 	}
 
-	inline void record(CUstream stream = nullptr) const {
-		CUDACALL(cuEventRecord(event, stream));
+	inline void synchronize(CUevent event) {
+		CUDACALL(cuEventSynchronize(event));
 	}
 
-	inline static float time_elapsed_between(const CUDAEvent & start, const CUDAEvent & end) {
+	inline float time_elapsed_between(CUevent start, CUevent end) {
 		float result;
-		CUDACALL(cuEventElapsedTime(&result, start.event, end.event));
+		CUDACALL(cuEventElapsedTime(&result, start, end));
 
 		return result;
 	}
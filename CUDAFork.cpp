@@ -0,0 +1,69 @@
+#include "CUDAFork.h"
+
+#include <cassert>
+
+#include "CUDAGraph.h"
+
+void CUDAFork::init(int branch_count) {
+	this->branch_count = branch_count;
+	this->branch_index = -1;
+
+	streams     = new CUstream[branch_count];
+	events_join = new CUevent [branch_count];
+
+	// Non-blocking streams do not implicitly synchronize with the default stream, all ordering is done through the Events
+	for (int i = 0; i < branch_count; i++) {
+		CUDACALL(cuStreamCreate(&streams[i], CU_STREAM_NON_BLOCKING));
+		CUDACALL(cuEventCreate(&events_join[i], CU_EVENT_DISABLE_TIMING));
+	}
+	CUDACALL(cuEventCreate(&event_fork, CU_EVENT_DISABLE_TIMING));
+}
+
+void CUDAFork::free() {
+	for (int i = 0; i < branch_count; i++) {
+		CUDACALL(cuStreamDestroy(streams[i]));
+		CUDACALL(cuEventDestroy(events_join[i]));
+	}
+	CUDACALL(cuEventDestroy(event_fork));
+
+	delete [] streams;
+	delete [] events_join;
+}
+
+void CUDAFork::fork() {
+	assert(branch_index == -1);
+
+	if (CUDAGraph::active) {
+		CUDAGraph::active->fork();
+	} else {
+		CUDACALL(cuEventRecord(event_fork, nullptr));
+	}
+}
+
+void CUDAFork::branch() {
+	assert(branch_index + 1 < branch_count);
+	branch_index++;
+
+	if (CUDAGraph::active) {
+		CUDAGraph::active->branch();
+	} else {
+		CUDACALL(cuStreamWaitEvent(streams[branch_index], event_fork, 0));
+
+		stream_current = streams[branch_index];
+	}
+}
+
+void CUDAFork::join() {
+	if (CUDAGraph::active) {
+		CUDAGraph::active->join();
+	} else {
+		for (int i = 0; i <= branch_index; i++) {
+			CUDACALL(cuEventRecord(events_join[i], streams[i]));
+			CUDACALL(cuStreamWaitEvent(nullptr, events_join[i], 0));
+		}
+
+		stream_current = nullptr;
+	}
+
+	branch_index = -1;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cuda.h>
+
+#include "CUDACall.h"
+
+// Runs independent Kernels concurrently by forking the default stream into multiple branches.
+// Each branch is launched on its own stream, which waits on an Event recorded at the fork.
+// At the join the default stream waits until all branches that were used have completed.
+// While a CUDAGraph is active the branches become independent paths in the Graph instead
+struct CUDAFork {
+	inline static CUstream stream_current = nullptr; // Stream that CUDAKernel::execute launches on
+
+	void init(int branch_count);
+	void free();
+
+	void fork();
+	void branch(); // Starts the next branch, the first call starts branch 0
+	void join();
+
+private:
+	int branch_count;
+	int branch_index;
+
+	CUstream * streams;
+
+	CUevent   event_fork;
+	CUevent * events_join;
+};
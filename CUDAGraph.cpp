@@ -0,0 +1,192 @@
+#include "CUDAGraph.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+// Fills in the launch parameters of a Kernel Node, 'extra' needs room for 5 pointers
+static CUDA_KERNEL_NODE_PARAMS get_node_params(CUfunction function, int grid_dim_x, int grid_dim_y, int grid_dim_z, int block_dim_x, int block_dim_y, int block_dim_z, unsigned shared_memory_bytes, const void * parameters, size_t & parameter_size, void * extra[5]) {
+	extra[0] = CU_LAUNCH_PARAM_BUFFER_POINTER; extra[1] = const_cast<void *>(parameters);
+	extra[2] = CU_LAUNCH_PARAM_BUFFER_SIZE;    extra[3] = &parameter_size;
+	extra[4] = CU_LAUNCH_PARAM_END;
+
+	CUDA_KERNEL_NODE_PARAMS params = { };
+	params.func = function;
+	params.gridDimX  = grid_dim_x;  params.gridDimY  = grid_dim_y;  params.gridDimZ  = grid_dim_z;
+	params.blockDimX = block_dim_x; params.blockDimY = block_dim_y; params.blockDimZ = block_dim_z;
+	params.sharedMemBytes = shared_memory_bytes;
+	params.kernelParams   = nullptr;
+	params.extra          = extra;
+
+	return params;
+}
+
+static void launch_direct(CUfunction function, int grid_dim_x, int grid_dim_y, int grid_dim_z, int block_dim_x, int block_dim_y, int block_dim_z, unsigned shared_memory_bytes, const void * parameters, size_t parameter_size) {
+	void * extra[] = {
+		CU_LAUNCH_PARAM_BUFFER_POINTER, const_cast<void *>(parameters),
+		CU_LAUNCH_PARAM_BUFFER_SIZE,   &parameter_size,
+		CU_LAUNCH_PARAM_END
+	};
+
+	CUDACALL(cuLaunchKernel(function,
+		grid_dim_x,  grid_dim_y,  grid_dim_z,
+		block_dim_x, block_dim_y, block_dim_z,
+		shared_memory_bytes, nullptr, nullptr, extra
+	));
+}
+
+bool CUDAGraph::Node::matches(int grid_dim_x, int grid_dim_y, int grid_dim_z, int block_dim_x, int block_dim_y, int block_dim_z, unsigned shared_memory_bytes, const void * parameters, size_t parameter_size) const {
+	return
+		this->grid_dim_x  == grid_dim_x  && this->grid_dim_y  == grid_dim_y  && this->grid_dim_z  == grid_dim_z  &&
+		this->block_dim_x == block_dim_x && this->block_dim_y == block_dim_y && this->block_dim_z == block_dim_z &&
+		this->shared_memory_bytes == shared_memory_bytes &&
+		this->parameters.size() == parameter_size && memcmp(this->parameters.data(), parameters, parameter_size) == 0;
+}
+
+void CUDAGraph::begin() {
+	assert(active == nullptr);
+	active = this;
+
+	recording  = graph_exec == nullptr;
+	diverged   = false;
+	node_index = 0;
+
+	if (recording) {
+		nodes.clear();
+		dependencies.clear();
+
+		CUDACALL(cuGraphCreate(&graph, 0));
+	}
+}
+
+void CUDAGraph::end() {
+	assert(active == this);
+	active = nullptr;
+
+	if (recording) {
+		if (nodes.size() == 0) {
+			invalidate();
+			return;
+		}
+
+		CUDACALL(cuGraphInstantiate(&graph_exec, graph, nullptr, nullptr, 0));
+	} else if (!diverged && node_index != int(nodes.size())) {
+		// The frame launched fewer Kernels than were recorded
+		diverge();
+	}
+
+	if (diverged) {
+		invalidate();
+	} else {
+		CUDACALL(cuGraphLaunch(graph_exec, nullptr));
+	}
+}
+
+// The branch structure of a replayed frame is the same as that of the recording, so only recording needs to track it.
+// After a divergence all Kernels are launched on the default stream, which keeps them in order
+void CUDAGraph::fork() {
+	if (!recording) return;
+
+	dependencies_fork = dependencies;
+	dependencies_join.clear();
+
+	in_branch = false;
+}
+
+void CUDAGraph::branch() {
+	if (!recording) return;
+
+	if (in_branch) add_dependencies_join();
+
+	dependencies = dependencies_fork;
+	in_branch = true;
+}
+
+void CUDAGraph::join() {
+	if (!recording) return;
+
+	if (in_branch) add_dependencies_join();
+
+	dependencies = dependencies_join.size() > 0 ? dependencies_join : dependencies_fork;
+	in_branch = false;
+}
+
+// A branch that launched no Kernels leaves the fork dependencies in place, those should only be added once
+void CUDAGraph::add_dependencies_join() {
+	for (CUgraphNode node : dependencies) {
+		if (std::find(dependencies_join.begin(), dependencies_join.end(), node) == dependencies_join.end()) {
+			dependencies_join.push_back(node);
+		}
+	}
+}
+
+void CUDAGraph::invalidate() {
+	if (graph_exec) CUDACALL(cuGraphExecDestroy(graph_exec));
+	if (graph)      CUDACALL(cuGraphDestroy(graph));
+
+	graph_exec = nullptr;
+	graph      = nullptr;
+
+	nodes.clear();
+}
+
+void CUDAGraph::free() {
+	invalidate();
+}
+
+void CUDAGraph::launch_kernel(CUfunction function, int grid_dim_x, int grid_dim_y, int grid_dim_z, int block_dim_x, int block_dim_y, int block_dim_z, unsigned shared_memory_bytes, const void * parameters, size_t parameter_size) {
+	if (recording) {
+		void * extra[5];
+		CUDA_KERNEL_NODE_PARAMS params = get_node_params(function, grid_dim_x, grid_dim_y, grid_dim_z, block_dim_x, block_dim_y, block_dim_z, shared_memory_bytes, parameters, parameter_size, extra);
+
+		// Kernels depend on each other through global memory, so outside of fork() and join() the Graph is a linear chain
+		CUgraphNode node;
+		CUDACALL(cuGraphAddKernelNode(&node, graph, dependencies.data(), dependencies.size(), &params));
+
+		dependencies.clear();
+		dependencies.push_back(node);
+
+		const unsigned char * bytes = reinterpret_cast<const unsigned char *>(parameters);
+
+		nodes.push_back({ node, function, grid_dim_x, grid_dim_y, grid_dim_z, block_dim_x, block_dim_y, block_dim_z, shared_memory_bytes, std::vector<unsigned char>(bytes, bytes + parameter_size) });
+
+		return;
+	}
+
+	if (!diverged && (node_index == int(nodes.size()) || nodes[node_index].function != function)) {
+		diverge();
+	}
+
+	if (diverged) {
+		launch_direct(function, grid_dim_x, grid_dim_y, grid_dim_z, block_dim_x, block_dim_y, block_dim_z, shared_memory_bytes, parameters, parameter_size);
+
+		return;
+	}
+
+	Node & node = nodes[node_index++];
+
+	if (!node.matches(grid_dim_x, grid_dim_y, grid_dim_z, block_dim_x, block_dim_y, block_dim_z, shared_memory_bytes, parameters, parameter_size)) {
+		node.grid_dim_x  = grid_dim_x;  node.grid_dim_y  = grid_dim_y;  node.grid_dim_z  = grid_dim_z;
+		node.block_dim_x = block_dim_x; node.block_dim_y = block_dim_y; node.block_dim_z = block_dim_z;
+		node.shared_memory_bytes = shared_memory_bytes;
+
+		const unsigned char * bytes = reinterpret_cast<const unsigned char *>(parameters);
+		node.parameters.assign(bytes, bytes + parameter_size);
+
+		void * extra[5];
+		CUDA_KERNEL_NODE_PARAMS params = get_node_params(function, grid_dim_x, grid_dim_y, grid_dim_z, block_dim_x, block_dim_y, block_dim_z, shared_memory_bytes, node.parameters.data(), parameter_size, extra);
+
+		CUDACALL(cuGraphExecKernelNodeSetParams(graph_exec, node.node, &params));
+	}
+}
+
+// Launches the Kernels that were deferred so far this frame, the rest of the frame is launched directly
+void CUDAGraph::diverge() {
+	for (int i = 0; i < node_index; i++) {
+		const Node & node = nodes[i];
+
+		launch_direct(node.function, node.grid_dim_x, node.grid_dim_y, node.grid_dim_z, node.block_dim_x, node.block_dim_y, node.block_dim_z, node.shared_memory_bytes, node.parameters.data(), node.parameters.size());
+	}
+
+	diverged = true;
+}
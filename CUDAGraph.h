@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+
+#include <cuda.h>
+
+#include "CUDACall.h"
+
+// Records the Kernel launches of a frame into a CUDA Graph, so that later frames launch the whole sequence at once.
+// While a Graph is active, CUDAKernel::execute hands its launch to the Graph instead of launching it directly.
+// When replaying, launch parameters that differ from the previous frame are updated in place.
+// If the Kernel sequence diverges from the recording the frame falls back to direct launches and the Graph is recorded again
+struct CUDAGraph {
+	inline static CUDAGraph * active = nullptr;
+
+	void begin(); // Records a new Graph if there is none, otherwise replays the existing one
+	void end();   // Launches the Graph
+
+	// Kernels launched in different branches between fork() and join() do not depend on each other,
+	// Kernels launched after join() depend on all branches
+	void fork();
+	void branch(); // Starts the next branch
+	void join();
+
+	void invalidate(); // Makes the next begin() record a new Graph
+	void free();
+
+	inline bool is_recorded() const { return graph_exec != nullptr; }
+
+	void launch_kernel(CUfunction function, int grid_dim_x, int grid_dim_y, int grid_dim_z, int block_dim_x, int block_dim_y, int block_dim_z, unsigned shared_memory_bytes, const void * parameters, size_t parameter_size);
+
+private:
+	struct Node {
+		CUgraphNode node;
+
+		CUfunction function;
+
+		int grid_dim_x,  grid_dim_y,  grid_dim_z;
+		int block_dim_x, block_dim_y, block_dim_z;
+
+		unsigned shared_memory_bytes;
+
+		std::vector<unsigned char> parameters;
+
+		bool matches(int grid_dim_x, int grid_dim_y, int grid_dim_z, int block_dim_x, int block_dim_y, int block_dim_z, unsigned shared_memory_bytes, const void * parameters, size_t parameter_size) const;
+	};
+
+	CUgraph     graph      = nullptr;
+	CUgraphExec graph_exec = nullptr;
+
+	std::vector<Node> nodes;
+
+	// Nodes that the next recorded Node depends on
+	std::vector<CUgraphNode> dependencies;
+	std::vector<CUgraphNode> dependencies_fork;
+	std::vector<CUgraphNode> dependencies_join;
+
+	bool in_branch;
+
+	int node_index; // Index of the next Node while replaying
+
+	bool recording;
+	bool diverged;
+
+	void diverge();
+
+	void add_dependencies_join();
+};
@@ -4,6 +4,8 @@
 #include <cuda.h>
 
 #include "CUDAModule.h"
+#include "CUDAGraph.h"
+#include "CUDAFork.h"
 
 struct CUDAKernel {
 	static const int PARAMETER_BUFFER_SIZE = 32 * 64; // In bytes
@@ -105,6 +107,15 @@ private:
 	}
 
 	inline void execute_internal(size_t parameter_buffer_size) const {
+		if (CUDAGraph::active) {
+			CUDAGraph::active->launch_kernel(kernel,
+				grid_dim_x,  grid_dim_y,  grid_dim_z,
+				block_dim_x, block_dim_y, block_dim_z,
+				shared_memory_bytes, parameter_buffer, parameter_buffer_size
+			);
+			return;
+		}
+
 		void * params[] = { 
 			CU_LAUNCH_PARAM_BUFFER_POINTER, parameter_buffer, 
 			CU_LAUNCH_PARAM_BUFFER_SIZE,   &parameter_buffer_size, 
@@ -114,7 +125,7 @@ private:
 		CUDACALL(cuLaunchKernel(kernel, 
 			grid_dim_x,  grid_dim_y,  grid_dim_z, 
 			block_dim_x, block_dim_y, block_dim_z, 
-			shared_memory_bytes, nullptr, nullptr, params
+			shared_memory_bytes, CUDAFork::stream_current, nullptr, params
 		));
 	}
 };
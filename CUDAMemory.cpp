@@ -45,6 +45,42 @@ void CUDAMemory::copy_array(CUarray array, int width_in_bytes, int height, const
 	CUDACALL(cuMemcpy2D(&copy));
 }
 
+CUarray_format CUDAMemory::get_array_format(const Texture & texture) {
+	switch (texture.format) {
+		case Texture::Format::BC1:   return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT32;
+		case Texture::Format::BC2:   return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT32;
+		case Texture::Format::BC3:   return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT32;
+		case Texture::Format::RGBA:  return CUarray_format::CU_AD_FORMAT_FLOAT;
+		case Texture::Format::RGBA8: return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT8;
+	}
+}
+
+CUresourceViewFormat CUDAMemory::get_resource_view_format(const Texture & texture) {
+	switch (texture.format) {
+		case Texture::Format::BC1:   return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UNSIGNED_BC1;
+		case Texture::Format::BC2:   return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UNSIGNED_BC2;
+		case Texture::Format::BC3:   return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UNSIGNED_BC3;
+		case Texture::Format::RGBA:  return CUresourceViewFormat::CU_RES_VIEW_FORMAT_FLOAT_4X32;
+		case Texture::Format::RGBA8: return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UINT_4X8;
+	}
+}
+
+int CUDAMemory::get_resource_view_width(const Texture & texture) {
+	if (texture.is_block_compressed()) {
+		return texture.width * 4;
+	} else {
+		return texture.width;
+	}
+}
+
+int CUDAMemory::get_resource_view_height(const Texture & texture) {
+	if (texture.is_block_compressed()) {
+		return texture.height * 4;
+	} else {
+		return texture.height;
+	}
+}
+
 CUgraphicsResource CUDAMemory::resource_register(unsigned gl_texture, unsigned flags) {
 	CUgraphicsResource resource; 
 	CUDACALL(cuGraphicsGLRegisterImage(&resource, gl_texture, GL_TEXTURE_2D, flags));
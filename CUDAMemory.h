@@ -1,6 +1,8 @@
 #pragma once
 #include "CUDACall.h"
 
+#include "Texture.h"
+
 namespace CUDAMemory {
 	// Type safe device pointer wrapper
 	template<typename T>
@@ -46,12 +48,36 @@ namespace CUDAMemory {
 		CUDACALL(cuMemcpyHtoD(ptr.ptr, data, count * sizeof(T)));
 	}
 
+	template<typename T>
+	inline void memcpy(T * data, Ptr<T> ptr, int count = 1) {
+		assert(ptr.ptr);
+		assert(data);
+		assert(count > 0);
+
+		CUDACALL(cuMemcpyDtoH(data, ptr.ptr, count * sizeof(T)));
+	}
+
+	template<typename T>
+	inline void memset(Ptr<T> ptr, unsigned char value, int count = 1) {
+		assert(ptr.ptr);
+		assert(count > 0);
+
+		CUDACALL(cuMemsetD8(ptr.ptr, value, count * sizeof(T)));
+	}
+
 	CUarray          create_array       (int width, int height, int channels, CUarray_format format);
 	CUmipmappedArray create_array_mipmap(int width, int height, int channels, CUarray_format format, int level_count);
 
 	// Copies data from the Host Texture to the Device Array
 	void copy_array(CUarray array, int width_in_bytes, int height, const void * data);
 	void copy_array_3d(CUarray array, int width_in_bytes, int height, const void * data);
+
+	// CUDA equivalents of the Host Texture formats
+	CUarray_format       get_array_format        (const Texture & texture);
+	CUresourceViewFormat get_resource_view_format(const Texture & texture);
+
+	int get_resource_view_width (const Texture & texture);
+	int get_resource_view_height(const Texture & texture);
 	
 	// Graphics Resource management (for OpenGL interop)
 	CUgraphicsResource resource_register(unsigned gl_texture, unsigned flags);
@@ -287,7 +287,7 @@ void CUDAModule::set_texture(const char * texture_name, CUarray array, CUfilter_
 }
 
 void CUDAModule::set_texture(const char * texture_name, const Texture * texture) const {	
-	CUarray_format format = texture->get_cuda_array_format();
+	CUarray_format format = CUDAMemory::get_array_format(*texture);
 
 	// Create Array on Device and copy Texture data over
 	CUarray array = CUDAMemory::create_array(texture->width, texture->height, texture->channels, format);
@@ -31,6 +31,17 @@ struct Settings {
 	bool enable_svgf                         = false;
 	bool enable_spatial_variance             = true;
 	bool enable_taa                          = true;
+	bool enable_material_sort                = false; // Sort shading queues by Material before shading
+	bool enable_radiance_cache               = false; // Update the Radiance Cache from path samples
+	bool radiance_cache_terminate_paths      = true;  // Terminate paths into the Radiance Cache, requires enable_radiance_cache
+	bool enable_path_regeneration            = false; // Refill the slots of terminated paths with new camera samples, only used when accumulating with a box filter
+	bool enable_deterministic_compaction     = false; // Append to the shading queues with a prefix sum instead of atomics, and seed random numbers per path instead of per queue slot
+	bool enable_ray_sort                     = false; // Sort the trace queue by Ray origin and direction before tracing bounces after the first
+	bool enable_path_guiding                 = false; // Sample diffuse and glossy bounces from an SD-tree learned from the path samples of previous frames, requires ENABLE_PATH_GUIDING
+
+	int indirect_downsample = 1; // Paths beyond diffuse primary hits are only traced for one pixel per block of N x N pixels (1, 2 or 4)
+
+	int samples_per_frame = 1; // Samples per pixel traced in one frame, only used when accumulating with a box filter
 	
 	bool demodulate_albedo = false;
 
@@ -53,6 +64,12 @@ struct Settings {
 #define SCREEN_HEIGHT 600
 
 
+// Rasterization
+// If enabled, the GBuffer for rasterized primary Rays is produced by a multithreaded software rasterizer on the CPU
+// instead of OpenGL, so that rasterization does not depend on an OpenGL context
+#define GBUFFER_CPU false
+
+
 // Rendering is performance in batches of BATCH_SIZE pixels
 // Larger batches are more efficient, but also require more GPU memory
 #define BATCH_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT)
@@ -62,6 +79,32 @@ struct Settings {
 
 #define NUM_BOUNCES 5
 
+// Upper limit for Settings::samples_per_frame
+#define MAX_SAMPLES_PER_FRAME 16
+
+
+// Path Regeneration
+// Number of wavefront iterations after the first in which the slots of terminated paths are refilled with new camera samples.
+// Regenerated paths also get NUM_BOUNCES bounces, so a frame runs at most MAX_WAVEFRONT_ITERATIONS iterations
+#define PATH_REGENERATION_ITERATIONS 3
+
+// Sample index of regenerated paths. The blue noise sequence has 256 samples per pixel and belongs to the first path of the pixel,
+// an index past its end makes random_float_heitz fall back to the xorshift sampler
+#define PATH_REGENERATION_SAMPLE_INDEX 256
+
+#define MAX_WAVEFRONT_ITERATIONS (NUM_BOUNCES + PATH_REGENERATION_ITERATIONS)
+
+
+// Queue Compaction
+// Block size of the Kernels that append to the shading queues with a prefix sum, see kernel_compaction_*
+#define COMPACTION_BLOCK_SIZE (WARP_SIZE * 4)
+
+
+// Ray Sorting
+// Bits per axis of the quantised Ray origin in the sort key, the key also holds the octant of the Ray direction
+#define RAY_SORT_ORIGIN_BITS 3
+#define RAY_SORT_KEY_COUNT   (8 << (3 * RAY_SORT_ORIGIN_BITS))
+
 
 // Lighting
 #define LIGHT_SELECT_UNIFORM 0
@@ -83,6 +126,8 @@ struct Settings {
 
 #define ENABLE_MIPMAPPING true
 
+#define TEXTURE_CPU_MAX_ANISOTROPY 16 // Most samples an anisotropic lookup on the Host takes, the Device uses the limit reported by the driver
+
 
 // Microfacet
 #define MICROFACET_BECKMANN 0 
@@ -103,6 +148,17 @@ struct Settings {
 
 #define BVH_TYPE BVH_CWBVH
 
+// SBVH construction presets, trade build time for traversal quality
+#define SBVH_PRESET_FAST     0 // Few bins, Spatial Splits only near the root
+#define SBVH_PRESET_BALANCED 1 // Bin count adapted to Node size
+#define SBVH_PRESET_MAX      2 // Maximum bin count everywhere, most aggressive Spatial Splits
+
+#define SBVH_PRESET SBVH_PRESET_BALANCED
+
+// Time budget for SBVH construction in milliseconds, once exceeded only Object Splits are performed
+// A value of 0 means no budget
+#define SBVH_TIME_BUDGET 0
+
 // Inverse of the percentage of active threads that triggers triangle postponing
 // A value of 5 means that if less than 1/5 = 20% of the active threads want to
 // intersect triangles we postpone the intersection test to decrease divergence within a Warp
@@ -119,3 +175,90 @@ static_assert(SHARED_STACK_SIZE < BVH_STACK_SIZE, "Shared Stack size must be str
 #define BVH_AXIS_Y_BITS (0b10 << 30)
 #define BVH_AXIS_Z_BITS (0b11 << 30)
 #define BVH_AXIS_MASK   (0b11 << 30)
+
+
+// Mesh LOD related
+// If enabled, a chain of simplified LODs is generated for every MeshData that does not contain Lights
+#define ENABLE_MESH_LODS false
+
+#define MESH_LOD_COUNT              4    // Maximum number of LODs per MeshData, including the full resolution MeshData
+#define MESH_LOD_REDUCTION          0.5f // Target Triangle count of each LOD relative to the previous LOD
+#define MESH_LOD_MIN_TRIANGLE_COUNT 256  // MeshDatas with fewer Triangles are not simplified further
+
+// An LOD is only selected if its error bound is smaller than this many pixels at the distance of the Mesh
+#define MESH_LOD_PIXEL_ERROR 0.5f
+
+
+// Radiance Cache
+// If enabled, outgoing radiance at diffuse path vertices is cached in a world space hash grid
+// and paths can be terminated into the cache once their footprint is large compared to the cache resolution
+#define ENABLE_RADIANCE_CACHE false
+
+#define RADIANCE_CACHE_SIZE        (1 << 20) // Number of entries in the hash table, must be a power of two
+#define RADIANCE_CACHE_MAX_PROBES  8         // Length of the linear probing sequence, insertion fails if no free slot is found within it
+
+#define RADIANCE_CACHE_CELL_SIZE   0.05f // Smallest cell size in world space
+#define RADIANCE_CACHE_CELL_PIXELS 8.0f  // Cells are scaled with distance to cover roughly this many pixels
+#define RADIANCE_CACHE_MAX_LEVEL   15
+
+#define RADIANCE_CACHE_MIN_SAMPLES 16.0f // A cell is only used for path termination once it has received this many samples
+#define RADIANCE_CACHE_MIN_ALPHA   0.02f // Lower bound on the weight of new samples, keeps the cache responsive to changes
+
+// A path is terminated into the cache if the footprint of its last bounce is at least this many cells wide
+#define RADIANCE_CACHE_FOOTPRINT_SCALE 4.0f
+
+// Number of frames rendered with and without path termination by the Radiance Cache benchmark
+#define RADIANCE_CACHE_BENCHMARK_FRAMES 64
+
+
+// Path Guiding
+// If enabled, incident radiance is learned online in an SD-tree (Mueller et al. 2017): a binary tree over space
+// whose leaves hold quadtrees over the sphere of directions, which are sampled with one-sample MIS against the BSDF
+#define ENABLE_PATH_GUIDING false
+
+#define PATH_GUIDING_BSDF_FRACTION 0.5f // Probability of sampling the BSDF instead of the SD-tree
+
+#define PATH_GUIDING_SPATIAL_THRESHOLD     12000 // A spatial leaf is split once it received this many samples, times the square root of the iteration length in frames
+#define PATH_GUIDING_SPATIAL_MAX_DEPTH     24
+#define PATH_GUIDING_DIRECTIONAL_THRESHOLD 0.01f // A directional node is subdivided if it received more than this fraction of the energy of its quadtree
+#define PATH_GUIDING_DIRECTIONAL_MAX_DEPTH 20
+
+// Iteration k trains the SD-tree for 2^k frames before it is refined, up to 2^PATH_GUIDING_MAX_ITERATION frames
+#define PATH_GUIDING_MAX_ITERATION 6
+
+#define PATH_GUIDING_MAX_SAMPLES (1 << 20) // Number of path samples per frame that are handed to the Host to train the SD-tree
+
+
+// Traversal Heatmap
+// If enabled, the BVH traversals count the Nodes and Triangles every Ray visits, per pixel and path depth,
+// so that the cost of tracing can be written as a heatmap. If disabled the counters compile out entirely
+#define ENABLE_TRAVERSAL_HEATMAP false
+
+#define TRAVERSAL_HEATMAP_HISTOGRAM_BINS 16 // Bins of the histogram of the cost per pixel, each bin covers a power of two
+
+// Traversal cost accumulated over the Rays of one pixel at one path depth
+struct TraversalCost {
+	unsigned nodes;
+	unsigned triangles;
+	unsigned rays;
+};
+
+
+// Indirect Upsampling
+// Exponent of the normal weight and depth tolerance (relative to the distance to the Camera)
+// of the joint bilateral filter that upsamples indirect lighting traced at reduced resolution
+#define INDIRECT_UPSAMPLE_SIGMA_NORMAL 32.0f
+#define INDIRECT_UPSAMPLE_SIGMA_DEPTH  0.05f
+
+
+// Host Rendering
+// The Host path tracer in TileRendererCPU splits the image into square tiles of TILE_SIZE_CPU pixels.
+// Every tile is traced as a single SoA batch of Rays through all bounces, so a batch should fit in the L2 cache of a core
+#define TILE_SIZE_CPU 32
+
+// Order in which the tiles are handed out, consecutive tiles along a space filling curve are close together in the image
+#define TILE_ORDER_SCANLINE 0
+#define TILE_ORDER_MORTON   1
+#define TILE_ORDER_HILBERT  2
+
+#define TILE_ORDER_CPU TILE_ORDER_HILBERT
@@ -0,0 +1,198 @@
+#pragma once
+// Compact encodings used by the Wavefront Ray buffers
+// This file is shared between the CUDA files and the C++ files, so that the Host can produce and inspect the same bit patterns
+
+#ifdef __CUDACC__
+	#define HOST_DEVICE __host__ __device__
+#else
+	#define HOST_DEVICE
+	#include <cmath>
+	#include <cstring>
+#endif
+
+namespace Packing {
+	HOST_DEVICE inline unsigned float_as_bits(float f) {
+#ifdef __CUDACC__
+		return __float_as_uint(f);
+#else
+		unsigned bits; memcpy(&bits, &f, sizeof(float));
+		return bits;
+#endif
+	}
+
+	HOST_DEVICE inline float bits_as_float(unsigned bits) {
+#ifdef __CUDACC__
+		return __uint_as_float(bits);
+#else
+		float f; memcpy(&f, &bits, sizeof(float));
+		return f;
+#endif
+	}
+
+	HOST_DEVICE inline float sign_not_zero(float f) {
+		return f >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// Octahedral encoding of a unit vector into two 16 bit snorms (see Cigolle et al. 2014)
+	// Worst case angular error is around 0.00007 radians
+	HOST_DEVICE inline unsigned oct_encode_direction(float x, float y, float z) {
+		float inv_l1_norm = 1.0f / (fabsf(x) + fabsf(y) + fabsf(z));
+
+		float u = x * inv_l1_norm;
+		float v = y * inv_l1_norm;
+
+		// Fold the lower hemisphere over the diagonals
+		if (z < 0.0f) {
+			float u_folded = (1.0f - fabsf(v)) * sign_not_zero(u);
+			float v_folded = (1.0f - fabsf(u)) * sign_not_zero(v);
+
+			u = u_folded;
+			v = v_folded;
+		}
+
+		// Quantize [-1, 1] to [0, 65535]
+		unsigned u_quantized = unsigned(fminf(fmaxf(u, -1.0f), 1.0f) * 32767.5f + 32767.5f + 0.5f);
+		unsigned v_quantized = unsigned(fminf(fmaxf(v, -1.0f), 1.0f) * 32767.5f + 32767.5f + 0.5f);
+
+		return u_quantized | (v_quantized << 16);
+	}
+
+	HOST_DEVICE inline void oct_decode_direction(unsigned packed, float & x, float & y, float & z) {
+		x = float(packed & 0xffff) / 32767.5f - 1.0f;
+		y = float(packed >> 16)    / 32767.5f - 1.0f;
+		z = 1.0f - fabsf(x) - fabsf(y);
+
+		// Unfold the lower hemisphere
+		if (z < 0.0f) {
+			float x_unfolded = (1.0f - fabsf(y)) * sign_not_zero(x);
+			float y_unfolded = (1.0f - fabsf(x)) * sign_not_zero(y);
+
+			x = x_unfolded;
+			y = y_unfolded;
+		}
+
+		float inv_length = 1.0f / sqrtf(x*x + y*y + z*z);
+		x *= inv_length;
+		y *= inv_length;
+		z *= inv_length;
+	}
+
+	// Largest finite half float
+	#define HALF_MAX 65504.0f
+
+	// Converts a float into an IEEE 754 half float with round to nearest even
+	// Values outside the half range are clamped to +-HALF_MAX, NaN is mapped to zero
+	HOST_DEVICE inline unsigned short float_to_half(float f) {
+		if (!(f == f)) return 0;
+
+		f = fminf(fmaxf(f, -HALF_MAX), HALF_MAX);
+
+		unsigned bits = float_as_bits(f);
+		unsigned sign = (bits >> 16) & 0x8000;
+
+		bits &= 0x7fffffff;
+
+		// Too small to be represented as a denormal half float
+		if (bits < 0x33000000) return sign;
+
+		int exponent = int(bits >> 23) - 127 + 15;
+
+		unsigned mantissa;
+		int      shift;
+		if (exponent <= 0) {
+			// Denormal half float, add implicit leading 1
+			mantissa = (bits & 0x7fffff) | 0x800000;
+			shift    = 14 - exponent;
+			exponent = 0;
+		} else {
+			mantissa = bits & 0x7fffff;
+			shift    = 13;
+		}
+
+		// Round to nearest even
+		unsigned half_mantissa = mantissa >> shift;
+		unsigned remainder     = mantissa & ((1u << shift) - 1);
+		unsigned halfway       = 1u << (shift - 1);
+
+		unsigned result = (unsigned(exponent) << 10) + half_mantissa;
+		if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) result++; // May carry into the exponent, which is correct
+
+		return sign | result;
+	}
+
+	HOST_DEVICE inline float half_to_float(unsigned short h) {
+		unsigned sign     = unsigned(h & 0x8000) << 16;
+		unsigned exponent = (h >> 10) & 0x1f;
+		unsigned mantissa = h & 0x3ff;
+
+		if (exponent == 0) {
+			// Zero or denormal, mantissa * 2^-24
+			float f = float(mantissa) * (1.0f / 16777216.0f);
+			return bits_as_float(float_as_bits(f) | sign);
+		}
+		if (exponent == 31) {
+			return bits_as_float(sign | 0x7f800000 | (mantissa << 13));
+		}
+
+		return bits_as_float(sign | ((exponent - 15 + 127) << 23) | (mantissa << 13));
+	}
+
+	// Barycentric coordinates of a hit, each quantized to a 16 bit unorm
+	// Barycentrics lie in [0, 1], where a unorm has a uniform error of at most 1 / 131070, which is finer than a half float near 1
+	HOST_DEVICE inline unsigned pack_barycentrics(float u, float v) {
+		unsigned u_quantized = unsigned(fminf(fmaxf(u, 0.0f), 1.0f) * 65535.0f + 0.5f);
+		unsigned v_quantized = unsigned(fminf(fmaxf(v, 0.0f), 1.0f) * 65535.0f + 0.5f);
+
+		return u_quantized | (v_quantized << 16);
+	}
+
+	HOST_DEVICE inline void unpack_barycentrics(unsigned packed, float & u, float & v) {
+		u = float(packed & 0xffff) / 65535.0f;
+		v = float(packed >> 16)    / 65535.0f;
+	}
+
+	// The Mesh of a hit shares a 32 bit word with its distance as a half float.
+	// The distance is only used for ray cones, ray differentials and absorption, where a relative error of 2^-11 is invisible
+	#define HIT_MESH_ID_BITS 16
+	#define HIT_MESH_ID_MASK ((1u << HIT_MESH_ID_BITS) - 1)
+
+	HOST_DEVICE inline unsigned pack_hit_mesh_t(int mesh_id, float t) {
+		return (unsigned(mesh_id) & HIT_MESH_ID_MASK) | (unsigned(float_to_half(t)) << HIT_MESH_ID_BITS);
+	}
+
+	HOST_DEVICE inline int unpack_hit_mesh_id(unsigned packed) {
+		return int(packed & HIT_MESH_ID_MASK);
+	}
+
+	HOST_DEVICE inline float unpack_hit_t(unsigned packed) {
+		return half_to_float(packed >> HIT_MESH_ID_BITS);
+	}
+
+	// The pixel state word of a Ray stores its pixel index together with the type of the last Material it interacted with,
+	// and the wavefront iteration at which its path was started (0 unless the path was regenerated, see CUDA_Source/Regeneration.h)
+	#define PIXEL_STATE_PIXEL_INDEX_BITS   26
+	#define PIXEL_STATE_PIXEL_INDEX_MASK   ((1u << PIXEL_STATE_PIXEL_INDEX_BITS) - 1)
+	#define PIXEL_STATE_MATERIAL_TYPE_BITS 2
+	#define PIXEL_STATE_MATERIAL_TYPE_MASK 0b11u
+	#define PIXEL_STATE_PATH_START_SHIFT   (PIXEL_STATE_PIXEL_INDEX_BITS + PIXEL_STATE_MATERIAL_TYPE_BITS)
+	#define PIXEL_STATE_PATH_START_MASK    0b1111u
+
+	HOST_DEVICE inline unsigned pack_pixel_state(int pixel_index, int material_type, int path_start = 0) {
+		return
+			(unsigned(pixel_index) & PIXEL_STATE_PIXEL_INDEX_MASK) |
+			((unsigned(material_type) & PIXEL_STATE_MATERIAL_TYPE_MASK) << PIXEL_STATE_PIXEL_INDEX_BITS) |
+			((unsigned(path_start)    & PIXEL_STATE_PATH_START_MASK)    << PIXEL_STATE_PATH_START_SHIFT);
+	}
+
+	HOST_DEVICE inline int unpack_pixel_index(unsigned pixel_state) {
+		return int(pixel_state & PIXEL_STATE_PIXEL_INDEX_MASK);
+	}
+
+	HOST_DEVICE inline int unpack_material_type(unsigned pixel_state) {
+		return int((pixel_state >> PIXEL_STATE_PIXEL_INDEX_BITS) & PIXEL_STATE_MATERIAL_TYPE_MASK);
+	}
+
+	HOST_DEVICE inline int unpack_path_start(unsigned pixel_state) {
+		return int((pixel_state >> PIXEL_STATE_PATH_START_SHIFT) & PIXEL_STATE_PATH_START_MASK);
+	}
+}
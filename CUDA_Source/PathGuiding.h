@@ -0,0 +1,157 @@
+#pragma once
+// Layout and lookups of the SD-tree used for path guiding (Mueller et al. 2017).
+// The spatial binary tree splits along x, y and z in turn, each of its leaves refers to a quadtree over the sphere of directions.
+// Directions are mapped to the unit square by the cylindrical mapping (cos(theta), phi), which preserves area.
+// This file is shared between the CUDA files and the C++ files, so that the Host builds exactly what the Device samples
+#include "Common.h"
+#include "Packing.h"
+
+#define ONE_OVER_FOUR_PI 0.07957747154f
+
+namespace PathGuiding {
+	// A child of 0 marks a leaf, the root is never a child
+	struct SpatialNode {
+		int child; // Index of the first of two consecutive children
+		int dtree; // Index of the root of the quadtree of a leaf
+	};
+
+	struct DirectionalNode {
+		float sum  [4]; // Energy received by each quadrant
+		int   child[4]; // Index of the node that subdivides each quadrant
+	};
+
+	// Incident radiance sample of a path vertex, divided by the pdf of its direction
+	struct Sample {
+		float position[3];
+		float radiance;
+		float direction[3];
+		float padding;
+	};
+
+	HOST_DEVICE inline void direction_to_square(const float direction[3], float & u, float & v) {
+		float cos_theta = fminf(fmaxf(direction[2], -1.0f), 1.0f);
+		float phi       = atan2f(direction[1], direction[0]);
+
+		u = fminf(0.5f * (cos_theta + 1.0f), 0.99999994f);
+		v = phi * ONE_OVER_TWO_PI;
+		if (v < 0.0f) v += 1.0f;
+		v = fminf(v, 0.99999994f);
+	}
+
+	HOST_DEVICE inline void square_to_direction(float u, float v, float direction[3]) {
+		float cos_theta = 2.0f * u - 1.0f;
+		float sin_theta = sqrtf(fmaxf(0.0f, 1.0f - cos_theta * cos_theta));
+		float phi       = TWO_PI * v;
+
+		direction[0] = sin_theta * cosf(phi);
+		direction[1] = sin_theta * sinf(phi);
+		direction[2] = cos_theta;
+	}
+
+	HOST_DEVICE inline int get_quadrant(float & u, float & v) {
+		int quadrant_x = u >= 0.5f;
+		int quadrant_y = v >= 0.5f;
+
+		// Rescale to the coordinates within the quadrant
+		u = 2.0f * u - float(quadrant_x);
+		v = 2.0f * v - float(quadrant_y);
+
+		return quadrant_x + 2 * quadrant_y;
+	}
+
+	HOST_DEVICE inline float get_total(const DirectionalNode & node) {
+		return node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+	}
+
+	// Finds the leaf that contains 'position', given relative to the bounds of the tree. Returns the root of its quadtree
+	HOST_DEVICE inline int find_dtree(const SpatialNode * nodes, const float position[3]) {
+		float p[3];
+		for (int dimension = 0; dimension < 3; dimension++) {
+			p[dimension] = fminf(fmaxf(position[dimension], 0.0f), 0.99999994f);
+		}
+
+		int node = 0;
+		int axis = 0;
+
+		while (nodes[node].child != 0) {
+			if (p[axis] < 0.5f) {
+				p[axis] = 2.0f * p[axis];
+				node = nodes[node].child;
+			} else {
+				p[axis] = 2.0f * p[axis] - 1.0f;
+				node = nodes[node].child + 1;
+			}
+
+			axis = axis == 2 ? 0 : axis + 1;
+		}
+
+		return nodes[node].dtree;
+	}
+
+	// Solid angle pdf of 'direction', a quadtree without energy is uniform over the sphere
+	HOST_DEVICE inline float pdf(const DirectionalNode * nodes, int root, const float direction[3]) {
+		float u, v;
+		direction_to_square(direction, u, v);
+
+		float pdf  = ONE_OVER_FOUR_PI;
+		int   node = root;
+
+		while (true) {
+			float total = get_total(nodes[node]);
+			if (total <= 0.0f) break;
+
+			int quadrant = get_quadrant(u, v);
+			pdf *= 4.0f * nodes[node].sum[quadrant] / total;
+
+			int child = nodes[node].child[quadrant];
+			if (child == 0) break;
+
+			node = child;
+		}
+
+		return pdf;
+	}
+
+	// Selects one quadrant out of the two that 'r' chooses between, and reuses 'r' for the next level
+	HOST_DEVICE inline int select(float weight_0, float weight_1, float & r) {
+		float p = weight_0 / (weight_0 + weight_1);
+
+		if (r < p) {
+			r = r / p;
+			return 0;
+		} else {
+			r = (r - p) / (1.0f - p);
+			return 1;
+		}
+	}
+
+	// Samples a direction proportional to the energy of the quadtree, by first choosing a column and then a row of quadrants at every level
+	HOST_DEVICE inline void sample(const DirectionalNode * nodes, int root, float r0, float r1, float direction[3]) {
+		float origin_u = 0.0f;
+		float origin_v = 0.0f;
+		float size     = 1.0f;
+
+		int node = root;
+
+		while (get_total(nodes[node]) > 0.0f) {
+			const float * sum = nodes[node].sum;
+
+			int quadrant_x = select(sum[0] + sum[2], sum[1] + sum[3], r0);
+			int quadrant_y = select(sum[quadrant_x], sum[quadrant_x + 2], r1);
+
+			r0 = fminf(r0, 0.99999994f);
+			r1 = fminf(r1, 0.99999994f);
+
+			size *= 0.5f;
+			origin_u += float(quadrant_x) * size;
+			origin_v += float(quadrant_y) * size;
+
+			int child = nodes[node].child[quadrant_x + 2 * quadrant_y];
+			if (child == 0) break;
+
+			node = child;
+		}
+
+		square_to_direction(origin_u + r0 * size, origin_v + r1 * size, direction);
+	}
+}
@@ -2,6 +2,12 @@
 #include "cudart/cuda_math.h"
 
 #include "Common.h"
+#include "Packing.h"
+#include "RadianceCache.h"
+#include "Upsample.h"
+#include "Regeneration.h"
+#include "RaySort.h"
+#include "PathGuiding.h"
 
 __device__ __constant__ int screen_width;
 __device__ __constant__ int screen_pitch;
@@ -23,6 +29,15 @@ __device__ float4 * frame_buffer_indirect;
 
 __device__ float4 * frame_buffer_moment;
 
+// Sum of the regenerated samples of a pixel in xyz, their count in w, see kernel_regenerate
+__device__ float4 * frame_buffer_regenerated;
+
+// Position in the stream of regenerated samples, persists across frames
+__device__ int path_regeneration_cursor;
+
+// Normal and distance to the Camera of diffuse primary hits, guides the upsampling of indirect lighting traced at reduced resolution
+__device__ float4 * indirect_guide;
+
 // GBuffers (OpenGL resource-mapped textures)
 __device__ Texture<float4> gbuffer_normal_and_depth;
 __device__ Texture<float2> gbuffer_uv;
@@ -73,59 +88,114 @@ struct Vector3_SoA {
 	}
 };
 
+// Buffer of unit vectors, each octahedral encoded into 32 bits
+// Directions are normalized on write, so t values along them are actual distances
+struct Direction_Packed {
+	unsigned * data;
+
+	__device__ void from_float3(int index, const float3 & vector) {
+		float3 direction = normalize(vector);
+		data[index] = Packing::oct_encode_direction(direction.x, direction.y, direction.z);
+	}
+
+	__device__ float3 to_float3(int index) const {
+		float3 direction;
+		Packing::oct_decode_direction(__ldg(&data[index]), direction.x, direction.y, direction.z);
+
+		return direction;
+	}
+};
+
+// Vector3 buffer stored as half floats, the fourth half is unused
+struct Vector3_Half {
+	uint2 * data;
+
+	__device__ void from_float3(int index, const float3 & vector) {
+		data[index] = make_uint2(
+			unsigned(Packing::float_to_half(vector.x)) | (unsigned(Packing::float_to_half(vector.y)) << 16),
+			unsigned(Packing::float_to_half(vector.z))
+		);
+	}
+
+	__device__ float3 to_float3(int index) const {
+		uint2 packed = __ldg(&data[index]);
+
+		return make_float3(
+			Packing::half_to_float(packed.x & 0xffff),
+			Packing::half_to_float(packed.x >> 16),
+			Packing::half_to_float(packed.y & 0xffff)
+		);
+	}
+};
+
+// Hit records in 12 bytes, split into two arrays so that both loads stay aligned
 struct HitBuffer {
-	uint4 * hits;
+	uint2    * hits;   // Triangle id and barycentrics, see Packing::pack_barycentrics
+	unsigned * mesh_t; // Mesh id and distance, see Packing::pack_hit_mesh_t
 
 	__device__ void set(int index, int mesh_id, int triangle_id, float t, float u, float v) {
-		unsigned uv = int(u * 65535.0f) | (int(v * 65535.0f) << 16);
-		hits[index] = make_uint4(mesh_id, triangle_id, float_as_uint(t), uv);
+		hits  [index] = make_uint2(triangle_id, Packing::pack_barycentrics(u, v));
+		mesh_t[index] = Packing::pack_hit_mesh_t(mesh_id, t);
 	}
 
 	__device__ void get(int index, int & mesh_id, int & triangle_id, float & t, float & u, float & v) const {
-		uint4 hit = __ldg(&hits[index]);
+		uint2    hit         = __ldg(&hits  [index]);
+		unsigned hit_mesh_t  = __ldg(&mesh_t[index]);
 
-		mesh_id     = hit.x;
-		triangle_id = hit.y;
-		
-		t = uint_as_float(hit.z);
+		triangle_id = hit.x;
+		Packing::unpack_barycentrics(hit.y, u, v);
+
+		mesh_id = Packing::unpack_hit_mesh_id(hit_mesh_t);
+		t       = Packing::unpack_hit_t      (hit_mesh_t);
+	}
+
+	__device__ int get_triangle_id(int index) const {
+		return __ldg(&hits[index]).x;
+	}
 
-		u = float(hit.w & 0xffff) / 65535.0f;
-		v = float(hit.w >> 16)    / 65535.0f;
+	__device__ void copy(int index_out, const HitBuffer & other, int index) {
+		hits  [index_out] = other.hits  [index];
+		mesh_t[index_out] = other.mesh_t[index];
 	}
 };
 
 // Input to the Trace and Sort Kernels in SoA layout
 struct TraceBuffer {
-	Vector3_SoA origin;
-	Vector3_SoA direction;
+	Vector3_SoA      origin;
+	Direction_Packed direction;
 
 #if ENABLE_MIPMAPPING
 	float * cone_width;
 #endif
 
-	float   * hit_ts;
 	HitBuffer hits;
 
-	int       * pixel_index;
-	Vector3_SoA throughput;
+	unsigned   * pixel_state; // Pixel index and type of the last Material, see Packing::pack_pixel_state
+	Vector3_Half throughput;
 
-	char  * last_material_type;
 	float * last_pdf;
+
+	// Used when sorting by Ray origin and direction, see kernel_ray_sort_*
+	int * sort_key;
+	int * sorted_index;
 };
 
 // Input to the various Shade Kernels in SoA layout
 struct MaterialBuffer {
-	Vector3_SoA direction;	
+	Direction_Packed direction;
 
 #if ENABLE_MIPMAPPING
 	float * cone_width;
 #endif
 
-	float   * hit_ts;
 	HitBuffer hits;
 
-	int       * pixel_index;
-	Vector3_SoA throughput;
+	unsigned   * pixel_state; // Pixel state of the incoming Ray, see Packing::pack_pixel_state
+	Vector3_Half throughput;
+
+	// Used when sorting by Material, see kernel_material_sort_*
+	int * sort_key;
+	int * sorted_index;
 };
 
 // Input to the Shadow Trace Kernel in SoA layout
@@ -135,31 +205,96 @@ struct ShadowRayBuffer {
 
 	float * max_distance;
 
-	int       * pixel_index;
+	unsigned  * pixel_state;
 	Vector3_SoA illumination;
 };
 
 __device__ TraceBuffer     ray_buffer_trace;
+__device__ TraceBuffer     ray_buffer_trace_staged; // Rays that continue their path, before the deterministic compaction appends them to ray_buffer_trace
 __device__ MaterialBuffer  ray_buffer_shade_diffuse;
 __device__ MaterialBuffer  ray_buffer_shade_dielectric;
 __device__ MaterialBuffer  ray_buffer_shade_glossy;
 __device__ ShadowRayBuffer ray_buffer_shadow;
 
 // Number of elements in each Buffer
-// Sizes are stored for ALL bounces so we only have to reset these
-// values back to 0 after every frame, instead of after every bounce
+// Sizes are stored for ALL wavefront iterations so we only have to reset these
+// values back to 0 after every frame, instead of after every iteration.
+// Without path regeneration there is one iteration per bounce
 struct BufferSizes {
-	int trace     [NUM_BOUNCES];
-	int diffuse   [NUM_BOUNCES];
-	int dielectric[NUM_BOUNCES];
-	int glossy    [NUM_BOUNCES];
-	int shadow    [NUM_BOUNCES];
+	int trace     [MAX_WAVEFRONT_ITERATIONS];
+	int diffuse   [MAX_WAVEFRONT_ITERATIONS];
+	int dielectric[MAX_WAVEFRONT_ITERATIONS];
+	int glossy    [MAX_WAVEFRONT_ITERATIONS];
+	int shadow    [MAX_WAVEFRONT_ITERATIONS];
 
 	// Global counters for tracing kernels
-	int rays_retired       [NUM_BOUNCES];
-	int rays_retired_shadow[NUM_BOUNCES];
+	int rays_retired       [MAX_WAVEFRONT_ITERATIONS];
+	int rays_retired_shadow[MAX_WAVEFRONT_ITERATIONS];
+
+	// Number of paths terminated into the Radiance Cache
+	int rays_cached[MAX_WAVEFRONT_ITERATIONS];
+
+	// Number of new camera samples appended to the trace queue after its 'trace' Rays
+	int regenerated[MAX_WAVEFRONT_ITERATIONS];
 } __device__ buffer_sizes;
 
+// Resets the Buffer sizes on the Device in between the samples of a frame, so that the reset can be part of the launch Graph.
+// Equivalent to uploading the Host BufferSizes, which are all zero except for the first trace queue
+extern "C" __global__ void kernel_buffer_sizes_reset(int trace_size) {
+	int * sizes = reinterpret_cast<int *>(&buffer_sizes);
+
+	for (int i = threadIdx.x; i < sizeof(BufferSizes) / sizeof(int); i += blockDim.x) {
+		sizes[i] = 0;
+	}
+
+	if (threadIdx.x == 0) buffer_sizes.trace[0] = trace_size;
+}
+
+// Deterministic compaction, used instead of atomic appends if enabled. It runs twice per iteration:
+// - The trace queue into the shading queues. kernel_sort (or kernel_primary) marks the shading queue of every Ray.
+// - The shading queues into the trace queue of the next iteration. The shade Kernels stage the Rays that continue their path
+//   in ray_buffer_trace_staged, at the position of their entry in the shading queues laid out one after the other.
+// kernel_compaction_count builds a histogram of the queues per block, kernel_compaction_scan turns those into offsets
+// and kernel_compaction_scatter appends the Rays in the order of their input
+#define COMPACTION_QUEUE_NONE  0xff
+#define COMPACTION_QUEUE_TRACE 0 // When compacting into the trace queue there is a single output queue
+
+__device__ __constant__ unsigned char * compaction_queue;         // Output queue of every input Ray, COMPACTION_QUEUE_NONE if its path ended
+__device__ __constant__ int           * compaction_block_offsets; // Three counts per block, replaced by the offset of the block in each queue
+
+// Number of input Rays of the compaction into the shading queues, or into the trace queue if 'trace_queue' is set
+__device__ inline int compaction_get_size(int bounce, bool trace_queue) {
+	if (trace_queue) {
+		return buffer_sizes.diffuse[bounce] + buffer_sizes.dielectric[bounce] + buffer_sizes.glossy[bounce];
+	} else {
+		return buffer_sizes.trace[bounce] + buffer_sizes.regenerated[bounce];
+	}
+}
+
+// Position in ray_buffer_trace_staged of the Ray that continues the path of entry 'index' of a shading queue
+__device__ inline int compaction_get_staged_index(int bounce, Material::Type type, int index) {
+	switch (type) {
+		case Material::Type::DIFFUSE:    return index;
+		case Material::Type::DIELECTRIC: return index + buffer_sizes.diffuse[bounce];
+		default:                         return index + buffer_sizes.diffuse[bounce] + buffer_sizes.dielectric[bounce];
+	}
+}
+
+// Reserves the slot of a Ray that continues the path of entry 'index' of a shading queue in the trace queue of the next iteration.
+// Returns the buffer to write the Ray to, with deterministic compaction that is the staging buffer
+__device__ inline TraceBuffer * trace_queue_append(int bounce, Material::Type type, int index, int & index_out) {
+	if (settings.enable_deterministic_compaction) {
+		index_out = compaction_get_staged_index(bounce, type, index);
+		compaction_queue[index_out] = COMPACTION_QUEUE_TRACE;
+
+		return &ray_buffer_trace_staged;
+	}
+
+	index_out = atomic_agg_inc(&buffer_sizes.trace[bounce + 1]);
+
+	return &ray_buffer_trace;
+}
+
 struct Camera {
 	float3 position;
 	float3 bottom_left_corner;
@@ -168,9 +303,260 @@ struct Camera {
 	float  pixel_spread_angle;
 } __device__ __constant__ camera;
 
+// Ray buffers store normalized directions, but the ray differentials of primary Rays need the unnormalized camera direction
+// Reconstructs it from the sample position of the pixel and converts the hit distance into the t along that direction
+__device__ inline void primary_ray_unnormalize(int pixel_index, float3 & ray_direction, float & ray_t) {
+	float2 pixel_coord = sample_xy[pixel_index];
+
+	ray_direction = camera.bottom_left_corner + pixel_coord.x * camera.x_axis + pixel_coord.y * camera.y_axis;
+	ray_t /= length(ray_direction);
+}
+
+// Regenerated paths can share their pixel with the first path of the pixel and with each other, so they add their radiance atomically
+__device__ inline void frame_buffer_add_regenerated(int pixel_index, const float3 & illumination) {
+	atomicAdd(&frame_buffer_regenerated[pixel_index].x, illumination.x);
+	atomicAdd(&frame_buffer_regenerated[pixel_index].y, illumination.y);
+	atomicAdd(&frame_buffer_regenerated[pixel_index].z, illumination.z);
+}
+
+#if ENABLE_PATH_GUIDING
+// Guided path vertices of the current frame, one range of 'screen_pitch * screen_height' elements per bounce.
+// Like the Radiance Cache records, the radiance of the pixel at the time the vertex was shaded is subtracted at the end of the frame.
+// The direct light of the vertex arrives through its shadow Ray and not from the sampled direction, so it is subtracted as well
+struct PathGuidingRecords {
+	float4 * position;   // Position of the vertex in xyz, pdf of the sampled direction in w (0 if no vertex was recorded)
+	float4 * direction;  // Sampled direction in xyz, radiance of the pixel averaged over the colour channels in w
+	float  * throughput; // Throughput of the path leaving the vertex, averaged over the colour channels
+	float  * direct;     // Radiance the vertex received through its shadow Ray, averaged over the colour channels
+};
+
+__device__ __constant__ PathGuidingRecords path_guiding_records;
+
+// Stores the direct light of a vertex once its shadow Ray turned out to be unoccluded
+__device__ inline void path_guiding_record_direct(int bounce, int pixel_index, const float3 & illumination) {
+	if (!settings.enable_path_guiding || bounce >= NUM_BOUNCES - 1) return;
+
+	path_guiding_records.direct[bounce * screen_pitch * screen_height + pixel_index] = (illumination.x + illumination.y + illumination.z) * (1.0f / 3.0f);
+}
+#endif
+
 #include "Tracing.h"
 #include "Mipmap.h"
 
+// Material sorting
+// Each Material has a sort key such that Materials sharing a Texture have adjacent keys
+__device__ __constant__ const int * material_sort_keys;
+__device__ __constant__ int         material_sort_key_count;
+
+// Histogram and offsets of the keys, one range of 'material_sort_key_count' elements per shading queue
+__device__ __constant__ int * material_sort_histogram;
+__device__ __constant__ int * material_sort_offsets;
+
+// Maps an index over the concatenation of the diffuse, dielectric and glossy queues to a queue and an index within that queue
+__device__ inline MaterialBuffer * material_sort_get_queue(int bounce, int index, int & queue, int & queue_index) {
+	int size_diffuse    = buffer_sizes.diffuse   [bounce];
+	int size_dielectric = buffer_sizes.dielectric[bounce];
+	int size_glossy     = buffer_sizes.glossy    [bounce];
+
+	if (index < size_diffuse) {
+		queue       = 0;
+		queue_index = index;
+		return &ray_buffer_shade_diffuse;
+	}
+	index -= size_diffuse;
+
+	if (index < size_dielectric) {
+		queue       = 1;
+		queue_index = index;
+		return &ray_buffer_shade_dielectric;
+	}
+	index -= size_dielectric;
+
+	if (index < size_glossy) {
+		queue       = 2;
+		queue_index = index;
+		return &ray_buffer_shade_glossy;
+	}
+
+	return nullptr;
+}
+
+// Finds the index of the element a thread in a Shade Kernel should process
+__device__ inline int material_sort_get_index(const MaterialBuffer & buffer, int thread_index) {
+	return settings.enable_material_sort ? buffer.sorted_index[thread_index] : thread_index;
+}
+
+#if ENABLE_RADIANCE_CACHE
+// Radiance Cache hash table, a key of 0 marks an empty slot
+__device__ __constant__ unsigned * radiance_cache_keys;
+__device__ __constant__ float4   * radiance_cache_radiance;    // Radiance estimate in xyz, sample count in w
+__device__ __constant__ float4   * radiance_cache_accumulator; // Sum of the samples of the current frame in xyz, their count in w
+
+// Diffuse path vertices of the current frame, one range of 'screen_pitch * screen_height' elements per bounce.
+// The outgoing radiance of a vertex is only known once the rest of its path has been traced,
+// so the radiance of the pixel at the time the vertex was shaded is stored and subtracted at the end of the frame
+struct RadianceCacheRecords {
+	float4     * snapshot;   // Radiance of the pixel in xyz, cache slot in w (-1 if none)
+	Vector3_Half throughput; // Throughput of the path arriving at the vertex
+};
+
+__device__ __constant__ RadianceCacheRecords radiance_cache_records;
+
+// Returns the slot of the cell, allocating it if needed, or -1 if the probing sequence is full
+__device__ inline int radiance_cache_insert(unsigned hash, unsigned fingerprint) {
+	unsigned slot = hash & (RADIANCE_CACHE_SIZE - 1);
+
+	for (int probe = 0; probe < RADIANCE_CACHE_MAX_PROBES; probe++) {
+		unsigned key = atomicCAS(&radiance_cache_keys[slot], 0, fingerprint);
+		if (key == 0 || key == fingerprint) return slot;
+
+		slot = (slot + 1) & (RADIANCE_CACHE_SIZE - 1);
+	}
+
+	return -1;
+}
+
+// Returns the slot of the cell, or -1 if it is not in the table
+__device__ inline int radiance_cache_find(unsigned hash, unsigned fingerprint) {
+	unsigned slot = hash & (RADIANCE_CACHE_SIZE - 1);
+
+	for (int probe = 0; probe < RADIANCE_CACHE_MAX_PROBES; probe++) {
+		unsigned key = radiance_cache_keys[slot];
+		if (key == fingerprint) return slot;
+		if (key == 0)           return -1;
+
+		slot = (slot + 1) & (RADIANCE_CACHE_SIZE - 1);
+	}
+
+	return -1;
+}
+
+// Records a diffuse path vertex, its sample is added to the cache by kernel_radiance_cache_update
+__device__ inline void radiance_cache_record(int bounce, int pixel_index, const float3 & hit_point, const float3 & hit_normal, const float3 & throughput) {
+	int level = RadianceCache::get_level(length(hit_point - camera.position), camera.pixel_spread_angle);
+
+	unsigned hash, fingerprint;
+	RadianceCache::get_key(hit_point.x, hit_point.y, hit_point.z, hit_normal.x, hit_normal.y, hit_normal.z, level, hash, fingerprint);
+
+	int slot = radiance_cache_insert(hash, fingerprint);
+	if (slot == -1) return;
+
+	int index = bounce * screen_pitch * screen_height + pixel_index;
+
+	float4 radiance = frame_buffer_direct[pixel_index] + frame_buffer_indirect[pixel_index];
+
+	radiance_cache_records.snapshot[index] = make_float4(radiance.x, radiance.y, radiance.z, __int_as_float(slot));
+	radiance_cache_records.throughput.from_float3(index, throughput);
+}
+
+// Looks up the cached outgoing radiance at a diffuse hit, if the footprint of the Ray is large compared to the cell size.
+// The footprint is estimated from the distance travelled and the pdf of the sampled direction
+__device__ inline bool radiance_cache_lookup(int mesh_id, int triangle_id, float u, float v, const float3 & ray_direction, float ray_t, float ray_pdf, float3 & radiance) {
+	float3 hit_triangle_position_0, hit_triangle_position_edge_1, hit_triangle_position_edge_2;
+	float3 hit_triangle_normal_0,   hit_triangle_normal_edge_1,   hit_triangle_normal_edge_2;
+
+	triangle_get_positions_and_normals(triangle_id,
+		hit_triangle_position_0, hit_triangle_position_edge_1, hit_triangle_position_edge_2,
+		hit_triangle_normal_0,   hit_triangle_normal_edge_1,   hit_triangle_normal_edge_2
+	);
+
+	float3 hit_point  = barycentric(u, v, hit_triangle_position_0, hit_triangle_position_edge_1, hit_triangle_position_edge_2);
+	float3 hit_normal = barycentric(u, v, hit_triangle_normal_0,   hit_triangle_normal_edge_1,   hit_triangle_normal_edge_2);
+
+	// Same as kernel_shade_diffuse, so that lookups use the same keys as the recorded vertices
+	hit_normal = normalize(hit_normal);
+	mesh_transform_position_and_direction(mesh_id, hit_point, hit_normal);
+
+	if (dot(ray_direction, hit_normal) > 0.0f) hit_normal = -hit_normal;
+
+	int level = RadianceCache::get_level(length(hit_point - camera.position), camera.pixel_spread_angle);
+
+	float footprint = ray_t * rsqrtf(fmaxf(ray_pdf, 1e-8f));
+	if (footprint < RADIANCE_CACHE_FOOTPRINT_SCALE * RadianceCache::get_cell_size(level)) return false;
+
+	unsigned hash, fingerprint;
+	RadianceCache::get_key(hit_point.x, hit_point.y, hit_point.z, hit_normal.x, hit_normal.y, hit_normal.z, level, hash, fingerprint);
+
+	int slot = radiance_cache_find(hash, fingerprint);
+	if (slot == -1) return false;
+
+	float4 cached = radiance_cache_radiance[slot];
+	if (cached.w < RADIANCE_CACHE_MIN_SAMPLES) return false;
+
+	radiance = make_float3(cached.x, cached.y, cached.z);
+	return true;
+}
+#endif
+
+#if ENABLE_PATH_GUIDING
+// Flattened SD-tree, see SDTree on the Host
+struct PathGuidingTree {
+	const PathGuiding::SpatialNode     * spatial_nodes; // nullptr until the tree has been refined for the first time
+	const PathGuiding::DirectionalNode * directional_nodes;
+
+	float3 bounds_min;
+	float3 bounds_inv_extent;
+};
+
+__device__ __constant__ PathGuidingTree path_guiding_tree;
+
+// Training samples that are handed to the Host at the end of the frame
+__device__ __constant__ PathGuiding::Sample * path_guiding_samples;
+__device__ int path_guiding_sample_count;
+
+// Finds the quadtree of the leaf that contains 'position', or -1 if there is no tree yet or the leaf has not received any energy
+__device__ inline int path_guiding_find(const float3 & position) {
+	if (path_guiding_tree.spatial_nodes == nullptr) return -1;
+
+	float p[3] = {
+		(position.x - path_guiding_tree.bounds_min.x) * path_guiding_tree.bounds_inv_extent.x,
+		(position.y - path_guiding_tree.bounds_min.y) * path_guiding_tree.bounds_inv_extent.y,
+		(position.z - path_guiding_tree.bounds_min.z) * path_guiding_tree.bounds_inv_extent.z
+	};
+
+	int dtree = PathGuiding::find_dtree(path_guiding_tree.spatial_nodes, p);
+	if (PathGuiding::get_total(path_guiding_tree.directional_nodes[dtree]) <= 0.0f) return -1;
+
+	return dtree;
+}
+
+// One-sample MIS: a bounce samples the SD-tree instead of the BSDF with probability 1 - PATH_GUIDING_BSDF_FRACTION
+__device__ inline bool path_guiding_use_tree(int dtree, unsigned & seed) {
+	return dtree != -1 && random_float_xorshift(seed) >= PATH_GUIDING_BSDF_FRACTION;
+}
+
+__device__ inline float3 path_guiding_sample(int dtree, unsigned & seed) {
+	float r0 = random_float_xorshift(seed);
+	float r1 = random_float_xorshift(seed);
+
+	float direction[3];
+	PathGuiding::sample(path_guiding_tree.directional_nodes, dtree, r0, r1, direction);
+
+	return make_float3(direction[0], direction[1], direction[2]);
+}
+
+// Pdf of the mixture of the BSDF and the SD-tree, given the pdf of the BSDF
+__device__ inline float path_guiding_pdf(int dtree, const float3 & direction, float pdf_bsdf) {
+	if (dtree == -1) return pdf_bsdf;
+
+	float d[3] = { direction.x, direction.y, direction.z };
+
+	return PATH_GUIDING_BSDF_FRACTION * pdf_bsdf + (1.0f - PATH_GUIDING_BSDF_FRACTION) * PathGuiding::pdf(path_guiding_tree.directional_nodes, dtree, d);
+}
+
+// Records a path vertex that continues in 'direction', its sample is handed to the Host by kernel_path_guiding_update
+__device__ inline void path_guiding_record(int bounce, int pixel_index, const float3 & position, const float3 & direction, float pdf, const float3 & throughput) {
+	int index = bounce * screen_pitch * screen_height + pixel_index;
+
+	float4 radiance = frame_buffer_direct[pixel_index] + frame_buffer_indirect[pixel_index];
+
+	path_guiding_records.position  [index] = make_float4(position,  pdf);
+	path_guiding_records.direction [index] = make_float4(direction, (radiance.x + radiance.y + radiance.z) * (1.0f / 3.0f));
+	path_guiding_records.throughput[index] = (throughput.x + throughput.y + throughput.z) * (1.0f / 3.0f);
+	path_guiding_records.direct    [index] = 0.0f;
+}
+#endif
+
 // Sends the rasterized GBuffer to the right Material kernels,
 // as if the primary Rays they were Raytraced 
 extern "C" __global__ void kernel_primary(
@@ -183,6 +569,9 @@ extern "C" __global__ void kernel_primary(
 	int index = blockIdx.x * blockDim.x + threadIdx.x;
 	if (index >= pixel_count) return;
 
+	// Paths that end in this Kernel are not appended to any queue
+	if (settings.enable_deterministic_compaction) compaction_queue[index] = COMPACTION_QUEUE_NONE;
+
 	int index_offset = index + pixel_offset;
 	int x = index_offset % screen_width;
 	int y = index_offset / screen_width;
@@ -226,13 +615,28 @@ extern "C" __global__ void kernel_primary(
 		if (settings.demodulate_albedo || settings.enable_svgf) {
 			frame_buffer_albedo[pixel_index] = make_float4(1.0f);
 		}
-		frame_buffer_direct[pixel_index] = make_float4(sample_sky(normalize(ray_direction)));
+		frame_buffer_direct[pixel_index] += make_float4(sample_sky(normalize(ray_direction)));
 
 		return;
 	}
 
 	const Material & material = materials[triangle_get_material_id(triangle_id)];
 
+	unsigned pixel_state = Packing::pack_pixel_state(pixel_index, int(Material::Type::DIELECTRIC));
+
+	if (settings.enable_deterministic_compaction && material.type != Material::Type::LIGHT) {
+		// The Ray is staged in the trace queue at the slot of its pixel and appended to its queue by kernel_compaction_scatter
+		compaction_queue[index] = int(material.type) - int(Material::Type::DIFFUSE);
+
+		ray_buffer_trace.direction.from_float3(index, ray_direction);
+		ray_buffer_trace.hits.set(index, mesh_id, triangle_id, 0.0f, uv.x, uv.y);
+
+		ray_buffer_trace.pixel_state[index] = pixel_state;
+		ray_buffer_trace.throughput.from_float3(index, make_float3(1.0f));
+
+		return;
+	}
+
 	// Decide which Kernel to invoke, based on Material Type
 	switch (material.type) {
 		case Material::Type::LIGHT: {
@@ -240,7 +644,7 @@ extern "C" __global__ void kernel_primary(
 			if (settings.demodulate_albedo || settings.enable_svgf) {
 				frame_buffer_albedo[pixel_index] = make_float4(1.0f);
 			}
-			frame_buffer_direct[pixel_index] = make_float4(material.emission);
+			frame_buffer_direct[pixel_index] += make_float4(material.emission);
 
 			break;
 		}
@@ -252,7 +656,7 @@ extern "C" __global__ void kernel_primary(
 
 			ray_buffer_shade_diffuse.hits.set(index_out, mesh_id, triangle_id, 0.0f, uv.x, uv.y);
 
-			ray_buffer_shade_diffuse.pixel_index[index_out] = pixel_index;
+			ray_buffer_shade_diffuse.pixel_state[index_out] = pixel_state;
 			ray_buffer_shade_diffuse.throughput.from_float3(index_out, make_float3(1.0f));
 
 			break;
@@ -265,7 +669,7 @@ extern "C" __global__ void kernel_primary(
 
 			ray_buffer_shade_dielectric.hits.set(index_out, mesh_id, triangle_id, 0.0f, uv.x, uv.y);
 
-			ray_buffer_shade_dielectric.pixel_index[index_out] = pixel_index;
+			ray_buffer_shade_dielectric.pixel_state[index_out] = pixel_state;
 			ray_buffer_shade_dielectric.throughput.from_float3(index_out, make_float3(1.0f));
 			
 			break;
@@ -278,7 +682,7 @@ extern "C" __global__ void kernel_primary(
 
 			ray_buffer_shade_glossy.hits.set(index_out, mesh_id, triangle_id, 0.0f, uv.x, uv.y);
 
-			ray_buffer_shade_glossy.pixel_index[index_out] = pixel_index;
+			ray_buffer_shade_glossy.pixel_state[index_out] = pixel_state;
 			ray_buffer_shade_glossy.throughput.from_float3(index_out, make_float3(1.0f));
 			
 			break;
@@ -316,19 +720,159 @@ extern "C" __global__ void kernel_generate(
 	ray_buffer_trace.origin   .from_float3(index, camera.position);
 	ray_buffer_trace.direction.from_float3(index, direction_unnormalized);
 
-	ray_buffer_trace.pixel_index[index] = pixel_index;
+	ray_buffer_trace.pixel_state[index] = Packing::pack_pixel_state(pixel_index, int(Material::Type::DIELECTRIC));
 	ray_buffer_trace.throughput.from_float3(index, make_float3(1.0f));
+}
+
+// Fills the slots of terminated paths in the trace queue of this iteration with new camera samples.
+// The samples continue the stream of regenerated samples, which walks through all pixels, see Regeneration::get_pixel
+extern "C" __global__ void kernel_regenerate(int rand_seed, int bounce, int capacity, int stride) {
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+	int trace_size = buffer_sizes.trace[bounce];
+	int count      = Regeneration::get_count(trace_size, capacity);
+	if (index >= count) return;
+
+	if (index == 0) buffer_sizes.regenerated[bounce] = count;
+
+	int pixel_count  = screen_width * screen_height;
+	int stream_index = path_regeneration_cursor;
+	for (int i = 1; i < bounce; i++) {
+		stream_index += buffer_sizes.regenerated[i];
+	}
+
+	int pixel = Regeneration::get_pixel(stream_index + index, stride, pixel_count);
+	int x = pixel % screen_width;
+	int y = pixel / screen_width;
 
-	ray_buffer_trace.last_material_type[index] = char(Material::Type::DIELECTRIC);
+	int pixel_index = x + y * screen_pitch;
+
+	unsigned seed = wang_hash((index + trace_size) ^ rand_seed);
+
+	// The blue noise sequence of the pixel belongs to its first sample
+	float x_jittered = float(x) + random_float_xorshift(seed);
+	float y_jittered = float(y) + random_float_xorshift(seed);
+
+	float3 direction_unnormalized = camera.bottom_left_corner + x_jittered * camera.x_axis + y_jittered * camera.y_axis;
+
+	int index_out = trace_size + index;
+
+	ray_buffer_trace.origin   .from_float3(index_out, camera.position);
+	ray_buffer_trace.direction.from_float3(index_out, direction_unnormalized);
+
+	// Regenerated primary Rays use a ray cone that starts at the Camera instead of ray differentials
+#if ENABLE_MIPMAPPING
+	ray_buffer_trace.cone_width[index_out] = 0.0f;
+#endif
+
+	ray_buffer_trace.pixel_state[index_out] = Packing::pack_pixel_state(pixel_index, int(Material::Type::DIELECTRIC), bounce);
+	ray_buffer_trace.throughput.from_float3(index_out, make_float3(1.0f));
+
+	atomicAdd(&frame_buffer_regenerated[pixel_index].w, 1.0f);
+}
+
+// Histogram and offsets of the keys of the trace queue, 'RAY_SORT_KEY_COUNT' elements each
+__device__ __constant__ int * ray_sort_histogram;
+__device__ __constant__ int * ray_sort_offsets;
+
+// Computes the sort key of every Ray in the trace queue and builds a histogram of the keys.
+// The origins are quantised within the bounds of the scene
+extern "C" __global__ void kernel_ray_sort_count(int bounce, float3 bounds_min, float3 bounds_inv_extent) {
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index >= buffer_sizes.trace[bounce] + buffer_sizes.regenerated[bounce]) return;
+
+	float3 ray_origin    = ray_buffer_trace.origin   .to_float3(index);
+	float3 ray_direction = ray_buffer_trace.direction.to_float3(index);
+
+	int key = RaySort::get_key(
+		ray_origin.x,    ray_origin.y,    ray_origin.z,
+		ray_direction.x, ray_direction.y, ray_direction.z,
+		&bounds_min.x, &bounds_inv_extent.x
+	);
+
+	ray_buffer_trace.sort_key[index] = key;
+
+	atomicAdd(&ray_sort_histogram[key], 1);
+}
+
+// Exclusive prefix sum over the histogram by a single Warp
+// Also clears the histogram so it is ready for the next bounce
+extern "C" __global__ void kernel_ray_sort_scan() {
+	int lane = threadIdx.x;
+
+	int sum = 0;
+
+	for (int base = 0; base < RAY_SORT_KEY_COUNT; base += WARP_SIZE) {
+		int key   = base + lane;
+		int count = ray_sort_histogram[key];
+
+		// Inclusive Warp scan
+		int scan = count;
+		for (int offset = 1; offset < WARP_SIZE; offset <<= 1) {
+			int value = __shfl_up_sync(0xffffffff, scan, offset);
+			if (lane >= offset) scan += value;
+		}
+
+		ray_sort_offsets  [key] = sum + scan - count;
+		ray_sort_histogram[key] = 0;
+
+		sum += __shfl_sync(0xffffffff, scan, WARP_SIZE - 1);
+	}
+}
+
+// Scatters the index of every Ray to its sorted position
+extern "C" __global__ void kernel_ray_sort_scatter(int bounce) {
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index >= buffer_sizes.trace[bounce] + buffer_sizes.regenerated[bounce]) return;
+
+	int key = ray_buffer_trace.sort_key[index];
+
+#if __CUDA_ARCH__ >= 700
+	// Threads in the same Warp with the same key are handed out consecutive slots in increasing lane order
+	unsigned mask = __match_any_sync(active_thread_mask(), key);
+	int leader = __ffs(mask) - 1;
+	int lane   = threadIdx.x % WARP_SIZE;
+
+	int index_out;
+	if (lane == leader) {
+		index_out = atomicAdd(&ray_sort_offsets[key], __popc(mask));
+	}
+	index_out = __shfl_sync(mask, index_out, leader) + __popc(mask & ((1 << lane) - 1));
+#else
+	int index_out = atomicAdd(&ray_sort_offsets[key], 1);
+#endif
+
+	ray_buffer_trace.sorted_index[index_out] = index;
 }
 
-extern "C" __global__ void kernel_trace(int bounce) {
-	bvh_trace(buffer_sizes.trace[bounce], &buffer_sizes.rays_retired[bounce]);
+extern "C" __global__ void kernel_trace(int bounce, bool sorted) {
+	bvh_trace(buffer_sizes.trace[bounce] + buffer_sizes.regenerated[bounce], &buffer_sizes.rays_retired[bounce], sorted ? ray_buffer_trace.sorted_index : nullptr, bounce);
+}
+
+// With deterministic compaction the random numbers of a path are seeded by its pixel, start iteration and sample rather than by its slot in a queue,
+// so that they do not depend on the order in which atomically appended queues were filled, see Regeneration::get_path_seed
+__device__ inline unsigned get_seed(int index, unsigned pixel_state, int rand_seed, int sample_index) {
+	if (settings.enable_deterministic_compaction) {
+		return Regeneration::get_path_seed(Packing::unpack_pixel_index(pixel_state), Packing::unpack_path_start(pixel_state), sample_index, rand_seed);
+	}
+
+	return wang_hash(unsigned(index) ^ rand_seed);
 }
 
-extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
+// Light that reaches the primary hit through a sampled direction counts as direct lighting,
+// unless the path left a diffuse primary hit at reduced resolution, then it is upsampled along with the indirect lighting
+__device__ inline bool is_direct_lighting(int bounce, unsigned pixel_state) {
+	if (bounce != 1) return false;
+
+	return settings.indirect_downsample == 1 || Material::Type(Packing::unpack_material_type(pixel_state)) != Material::Type::DIFFUSE;
+}
+
+extern "C" __global__ void kernel_sort(int rand_seed, int bounce, int sample_index) {
 	int index = blockIdx.x * blockDim.x + threadIdx.x;
-	if (index >= buffer_sizes.trace[bounce]) return;
+	if (index >= buffer_sizes.trace[bounce] + buffer_sizes.regenerated[bounce]) return;
+
+	// Paths that end in this Kernel are not appended to any queue
+	if (settings.enable_deterministic_compaction) compaction_queue[index] = COMPACTION_QUEUE_NONE;
 
 	float3 ray_origin    = ray_buffer_trace.origin   .to_float3(index);
 	float3 ray_direction = ray_buffer_trace.direction.to_float3(index);
@@ -340,19 +884,23 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 	float hit_v;
 	ray_buffer_trace.hits.get(index, hit_mesh_id, hit_triangle_id, hit_t, hit_u, hit_v);
 
-	int    ray_pixel_index = ray_buffer_trace.pixel_index[index];
-	float3 ray_throughput  = ray_buffer_trace.throughput.to_float3(index);
+	unsigned ray_pixel_state = ray_buffer_trace.pixel_state[index];
+	int      ray_pixel_index = Packing::unpack_pixel_index(ray_pixel_state);
+	bool     ray_regenerated = Packing::unpack_path_start(ray_pixel_state) > 0;
+	float3   ray_throughput  = ray_buffer_trace.throughput.to_float3(index);
 	
 	// If we didn't hit anything, sample the Sky
 	if (hit_triangle_id == -1) {
 		float3 illumination = ray_throughput * sample_sky(normalize(ray_direction));
 
-		if (bounce == 0) {
+		if (ray_regenerated) {
+			frame_buffer_add_regenerated(ray_pixel_index, illumination);
+		} else if (bounce == 0) {
 			if (settings.demodulate_albedo || settings.enable_svgf) {
 				frame_buffer_albedo[ray_pixel_index] = make_float4(1.0f);
 			}
-			frame_buffer_direct[ray_pixel_index] = make_float4(illumination);
-		} else if (bounce == 1) {
+			frame_buffer_direct[ray_pixel_index] += make_float4(illumination);
+		} else if (is_direct_lighting(bounce, ray_pixel_state)) {
 			frame_buffer_direct[ray_pixel_index] += make_float4(illumination);
 		} else {
 			frame_buffer_indirect[ray_pixel_index] += make_float4(illumination);
@@ -367,20 +915,24 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 	if (material.type == Material::Type::LIGHT) {
 		bool no_mis = true;
 		if (settings.enable_next_event_estimation) {
+			Material::Type last_material_type = Material::Type(Packing::unpack_material_type(ray_pixel_state));
+
 			no_mis = 
-				(ray_buffer_trace.last_material_type[index] == char(Material::Type::DIELECTRIC)) ||
-				(ray_buffer_trace.last_material_type[index] == char(Material::Type::GLOSSY) && material.roughness < ROUGHNESS_CUTOFF);
+				(last_material_type == Material::Type::DIELECTRIC) ||
+				(last_material_type == Material::Type::GLOSSY && material.roughness < ROUGHNESS_CUTOFF);
 		}
 
 		if (no_mis) {
 			float3 illumination = ray_throughput * material.emission;
 
-			if (bounce == 0) {
+			if (ray_regenerated) {
+				frame_buffer_add_regenerated(ray_pixel_index, illumination);
+			} else if (bounce == 0) {
 				if (settings.demodulate_albedo || settings.enable_svgf) {
 					frame_buffer_albedo[ray_pixel_index] = make_float4(1.0f);
 				}
-				frame_buffer_direct[ray_pixel_index] = make_float4(material.emission);
-			} else if (bounce == 1) {
+				frame_buffer_direct[ray_pixel_index] += make_float4(material.emission);
+			} else if (is_direct_lighting(bounce, ray_pixel_state)) {
 				frame_buffer_direct[ray_pixel_index] += make_float4(illumination);
 			} else {
 				frame_buffer_indirect[ray_pixel_index] += make_float4(illumination);
@@ -431,7 +983,9 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 
 			float3 illumination = ray_throughput * material.emission * brdf_pdf / mis_pdf;
 
-			if (bounce == 1) {
+			if (ray_regenerated) {
+				frame_buffer_add_regenerated(ray_pixel_index, illumination);
+			} else if (is_direct_lighting(bounce, ray_pixel_state)) {
 				frame_buffer_direct[ray_pixel_index] += make_float4(illumination);
 			} else {
 				frame_buffer_indirect[ray_pixel_index] += make_float4(illumination);
@@ -441,7 +995,25 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 		return;
 	}
 
-	unsigned seed = wang_hash(index ^ rand_seed);
+#if ENABLE_RADIANCE_CACHE
+	// Paths that arrive at a diffuse surface after a rough bounce can be terminated into the Radiance Cache
+	if (settings.enable_radiance_cache && settings.radiance_cache_terminate_paths && bounce > 0 && material.type == Material::Type::DIFFUSE) {
+		Material::Type last_material_type = Material::Type(Packing::unpack_material_type(ray_pixel_state));
+
+		float3 radiance;
+		if (last_material_type != Material::Type::DIELECTRIC && radiance_cache_lookup(
+			hit_mesh_id, hit_triangle_id, hit_u, hit_v, ray_direction, hit_t, ray_buffer_trace.last_pdf[index], radiance
+		)) {
+			frame_buffer_indirect[ray_pixel_index] += make_float4(ray_throughput * radiance);
+
+			atomic_agg_inc(&buffer_sizes.rays_cached[bounce]);
+
+			return;
+		}
+	}
+#endif
+
+	unsigned seed = get_seed(index, ray_pixel_state, rand_seed, sample_index);
 
 	// Russian Roulette
 	float p_survive = saturate(fmaxf(ray_throughput.x, fmaxf(ray_throughput.y, ray_throughput.z)));
@@ -451,6 +1023,14 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 
 	ray_throughput /= p_survive;
 
+	if (settings.enable_deterministic_compaction) {
+		// The Ray is appended to its queue by kernel_compaction_scatter
+		compaction_queue[index] = int(material.type) - int(Material::Type::DIFFUSE);
+		ray_buffer_trace.throughput.from_float3(index, ray_throughput);
+
+		return;
+	}
+
 	switch (material.type) {
 		case Material::Type::DIFFUSE: {
 			int index_out = atomic_agg_inc(&buffer_sizes.diffuse[bounce]);
@@ -462,7 +1042,7 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 #endif
 			ray_buffer_shade_diffuse.hits.set(index_out, hit_mesh_id, hit_triangle_id, hit_t, hit_u, hit_v);
 			
-			ray_buffer_shade_diffuse.pixel_index[index_out] = ray_buffer_trace.pixel_index[index];
+			ray_buffer_shade_diffuse.pixel_state[index_out] = ray_pixel_state;
 			ray_buffer_shade_diffuse.throughput.from_float3(index_out, ray_throughput);
 
 			break;
@@ -478,7 +1058,7 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 #endif
 			ray_buffer_shade_dielectric.hits.set(index_out, hit_mesh_id, hit_triangle_id, hit_t, hit_u, hit_v);
 
-			ray_buffer_shade_dielectric.pixel_index[index_out] = ray_buffer_trace.pixel_index[index];
+			ray_buffer_shade_dielectric.pixel_state[index_out] = ray_pixel_state;
 			ray_buffer_shade_dielectric.throughput.from_float3(index_out, ray_throughput);
 
 			break;
@@ -494,7 +1074,7 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 #endif
 			ray_buffer_shade_glossy.hits.set(index_out, hit_mesh_id, hit_triangle_id, hit_t, hit_u, hit_v);
 
-			ray_buffer_shade_glossy.pixel_index[index_out] = ray_buffer_trace.pixel_index[index];
+			ray_buffer_shade_glossy.pixel_state[index_out] = ray_pixel_state;
 			ray_buffer_shade_glossy.throughput.from_float3(index_out, ray_throughput);
 
 			break;
@@ -502,9 +1082,213 @@ extern "C" __global__ void kernel_sort(int rand_seed, int bounce) {
 	}
 }
 
-extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int sample_index) {
+// Histogram of the output queues of the Rays in every block
+extern "C" __global__ void kernel_compaction_count(int bounce, bool trace_queue) {
+	__shared__ int block_counts[3];
+
+	if (threadIdx.x < 3) block_counts[threadIdx.x] = 0;
+	__syncthreads();
+
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+	int queue = index < compaction_get_size(bounce, trace_queue) ? compaction_queue[index] : COMPACTION_QUEUE_NONE;
+
+	// Integer counts are independent of the order of the adds, one add per Warp and queue
+	for (int q = 0; q < 3; q++) {
+		unsigned mask = __ballot_sync(0xffffffff, queue == q);
+		if (threadIdx.x % WARP_SIZE == 0 && mask != 0) atomicAdd(&block_counts[q], __popc(mask));
+	}
+	__syncthreads();
+
+	if (threadIdx.x < 3) compaction_block_offsets[blockIdx.x * 3 + threadIdx.x] = block_counts[threadIdx.x];
+}
+
+// Exclusive prefix sum over the block counts, one Warp per queue. The total is the size of the queue
+extern "C" __global__ void kernel_compaction_scan(int bounce, int block_count, bool trace_queue) {
+	int queue = blockIdx.x;
+	int lane  = threadIdx.x;
+
+	int sum = 0;
+
+	for (int base = 0; base < block_count; base += WARP_SIZE) {
+		int block = base + lane;
+		int count = block < block_count ? compaction_block_offsets[block * 3 + queue] : 0;
+
+		// Inclusive Warp scan
+		int scan = count;
+		for (int offset = 1; offset < WARP_SIZE; offset <<= 1) {
+			int value = __shfl_up_sync(0xffffffff, scan, offset);
+			if (lane >= offset) scan += value;
+		}
+
+		if (block < block_count) {
+			compaction_block_offsets[block * 3 + queue] = sum + scan - count;
+		}
+
+		sum += __shfl_sync(0xffffffff, scan, WARP_SIZE - 1);
+	}
+
+	if (lane == 0) {
+		if (trace_queue) {
+			if (queue == COMPACTION_QUEUE_TRACE) buffer_sizes.trace[bounce + 1] = sum;
+		} else {
+			switch (queue) {
+				case 0: buffer_sizes.diffuse   [bounce] = sum; break;
+				case 1: buffer_sizes.dielectric[bounce] = sum; break;
+				case 2: buffer_sizes.glossy    [bounce] = sum; break;
+			}
+		}
+	}
+}
+
+// Appends every Ray to its output queue at the offset of its block plus its rank within the block
+extern "C" __global__ void kernel_compaction_scatter(int bounce, bool trace_queue) {
+	__shared__ int warp_counts[COMPACTION_BLOCK_SIZE / WARP_SIZE][3];
+
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+	int queue = index < compaction_get_size(bounce, trace_queue) ? compaction_queue[index] : COMPACTION_QUEUE_NONE;
+
+	int warp = threadIdx.x / WARP_SIZE;
+	int lane = threadIdx.x % WARP_SIZE;
+
+	int rank = 0;
+	for (int q = 0; q < 3; q++) {
+		unsigned mask = __ballot_sync(0xffffffff, queue == q);
+
+		if (lane == 0)  warp_counts[warp][q] = __popc(mask);
+		if (queue == q) rank = __popc(mask & ((1u << lane) - 1));
+	}
+	__syncthreads();
+
+	if (queue == COMPACTION_QUEUE_NONE) return;
+
+	int index_out = compaction_block_offsets[blockIdx.x * 3 + queue] + rank;
+	for (int w = 0; w < warp; w++) {
+		index_out += warp_counts[w][queue];
+	}
+
+	if (trace_queue) {
+		ray_buffer_trace.origin.x      [index_out] = ray_buffer_trace_staged.origin.x      [index];
+		ray_buffer_trace.origin.y      [index_out] = ray_buffer_trace_staged.origin.y      [index];
+		ray_buffer_trace.origin.z      [index_out] = ray_buffer_trace_staged.origin.z      [index];
+		ray_buffer_trace.direction.data[index_out] = ray_buffer_trace_staged.direction.data[index];
+
+#if ENABLE_MIPMAPPING
+		ray_buffer_trace.cone_width[index_out] = ray_buffer_trace_staged.cone_width[index];
+#endif
+		ray_buffer_trace.pixel_state    [index_out] = ray_buffer_trace_staged.pixel_state    [index];
+		ray_buffer_trace.throughput.data[index_out] = ray_buffer_trace_staged.throughput.data[index];
+		ray_buffer_trace.last_pdf       [index_out] = ray_buffer_trace_staged.last_pdf       [index];
+
+		return;
+	}
+
+	MaterialBuffer * buffer;
+	switch (queue) {
+		case 0:  buffer = &ray_buffer_shade_diffuse;    break;
+		case 1:  buffer = &ray_buffer_shade_dielectric; break;
+		default: buffer = &ray_buffer_shade_glossy;     break;
+	}
+
+	// The packed data is copied as is, kernel_sort already applied Russian Roulette to the throughput
+	buffer->direction.data[index_out] = ray_buffer_trace.direction.data[index];
+
+#if ENABLE_MIPMAPPING
+	if (bounce > 0) buffer->cone_width[index_out] = ray_buffer_trace.cone_width[index];
+#endif
+	buffer->hits.copy(index_out, ray_buffer_trace.hits, index);
+
+	buffer->pixel_state    [index_out] = ray_buffer_trace.pixel_state    [index];
+	buffer->throughput.data[index_out] = ray_buffer_trace.throughput.data[index];
+}
+
+// Computes the sort key of every Ray in the shading queues and builds a histogram of the keys per queue
+extern "C" __global__ void kernel_material_sort_count(int bounce) {
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+
+	int queue;
+	int queue_index;
+	MaterialBuffer * buffer = material_sort_get_queue(bounce, index, queue, queue_index);
+	if (buffer == nullptr) return;
+
+	int triangle_id = buffer->hits.get_triangle_id(queue_index);
+	int key         = material_sort_keys[triangle_get_material_id(triangle_id)];
+
+	buffer->sort_key[queue_index] = key;
+
+	atomicAdd(&material_sort_histogram[queue * material_sort_key_count + key], 1);
+}
+
+// Exclusive prefix sum over the histogram of each queue, one Warp per queue
+// Also clears the histogram so it is ready for the next bounce
+extern "C" __global__ void kernel_material_sort_scan() {
+	int queue = blockIdx.x;
+	int lane  = threadIdx.x;
+
+	int * histogram = material_sort_histogram + queue * material_sort_key_count;
+	int * offsets   = material_sort_offsets   + queue * material_sort_key_count;
+
+	int sum = 0;
+
+	for (int base = 0; base < material_sort_key_count; base += WARP_SIZE) {
+		int key   = base + lane;
+		int count = key < material_sort_key_count ? histogram[key] : 0;
+
+		// Inclusive Warp scan
+		int scan = count;
+		for (int offset = 1; offset < WARP_SIZE; offset <<= 1) {
+			int value = __shfl_up_sync(0xffffffff, scan, offset);
+			if (lane >= offset) scan += value;
+		}
+
+		if (key < material_sort_key_count) {
+			offsets  [key] = sum + scan - count;
+			histogram[key] = 0;
+		}
+
+		sum += __shfl_sync(0xffffffff, scan, WARP_SIZE - 1);
+	}
+}
+
+// Scatters the index of every Ray to its sorted position
+extern "C" __global__ void kernel_material_sort_scatter(int bounce) {
 	int index = blockIdx.x * blockDim.x + threadIdx.x;
-	if (index >= buffer_sizes.diffuse[bounce]) return;
+
+	int queue;
+	int queue_index;
+	MaterialBuffer * buffer = material_sort_get_queue(bounce, index, queue, queue_index);
+	if (buffer == nullptr) return;
+
+	int key = buffer->sort_key[queue_index];
+
+	int * offset = &material_sort_offsets[queue * material_sort_key_count + key];
+
+#if __CUDA_ARCH__ >= 700
+	// Threads in the same Warp with the same key are handed out consecutive slots in increasing lane order,
+	// so that Rays that were adjacent in the queue mostly stay adjacent within their key
+	unsigned mask = __match_any_sync(active_thread_mask(), queue * material_sort_key_count + key);
+	int leader = __ffs(mask) - 1;
+	int lane   = threadIdx.x % WARP_SIZE;
+
+	int index_out;
+	if (lane == leader) {
+		index_out = atomicAdd(offset, __popc(mask));
+	}
+	index_out = __shfl_sync(mask, index_out, leader) + __popc(mask & ((1 << lane) - 1));
+#else
+	int index_out = atomicAdd(offset, 1);
+#endif
+
+	buffer->sorted_index[index_out] = queue_index;
+}
+
+extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int sample_index) {
+	int thread_index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (thread_index >= buffer_sizes.diffuse[bounce]) return;
+
+	int index = material_sort_get_index(ray_buffer_shade_diffuse, thread_index);
+
+	// Paths that end in this Kernel are not appended to the trace queue
+	if (settings.enable_deterministic_compaction) compaction_queue[compaction_get_staged_index(bounce, Material::Type::DIFFUSE, index)] = COMPACTION_QUEUE_NONE;
 
 	float3 ray_direction = ray_buffer_shade_diffuse.direction.to_float3(index);
 
@@ -515,7 +1299,19 @@ extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int s
 	float ray_v;
 	ray_buffer_shade_diffuse.hits.get(index, ray_mesh_id, ray_triangle_id, ray_t, ray_u, ray_v);
 
-	int ray_pixel_index = ray_buffer_shade_diffuse.pixel_index[index];
+	unsigned ray_pixel_state = ray_buffer_shade_diffuse.pixel_state[index];
+	int      ray_pixel_index = Packing::unpack_pixel_index(ray_pixel_state);
+	int      ray_path_start  = Packing::unpack_path_start (ray_pixel_state);
+	int      ray_depth       = bounce - ray_path_start;
+
+	unsigned seed = get_seed(index, ray_pixel_state, rand_seed, sample_index);
+
+	// The blue noise sequence of the pixel belongs to its first path, regenerated paths use the xorshift sampler
+	sample_index = Regeneration::get_sample_index(sample_index, ray_path_start);
+
+	// Primary Rays need their unnormalized direction for ray differentials
+	if (bounce == 0) primary_ray_unnormalize(ray_pixel_index, ray_direction, ray_t);
+
 	int x = ray_pixel_index % screen_pitch;
 	int y = ray_pixel_index / screen_pitch;
 
@@ -523,8 +1319,6 @@ extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int s
 
 	ASSERT(ray_triangle_id != -1, "Ray must have hit something for this Kernel to be invoked!");
 
-	unsigned seed = wang_hash(index ^ rand_seed);
-
 	const Material & material = materials[triangle_get_material_id(ray_triangle_id)];
 
 	ASSERT(material.type == Material::Type::DIFFUSE, "Material should be diffuse in this Kernel");
@@ -574,10 +1368,26 @@ extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int s
 	albedo = material.albedo(hit_tex_coord.x, hit_tex_coord.y);
 #endif
 
-	if (bounce == 0 && (settings.demodulate_albedo || settings.enable_svgf)) {
+	// The upsampling of indirect lighting needs the albedo to demodulate and remodulate it
+	if (bounce == 0 && (settings.demodulate_albedo || settings.enable_svgf || settings.indirect_downsample > 1)) {
 		frame_buffer_albedo[ray_pixel_index] = make_float4(albedo);
 	}
 
+	// At reduced indirect resolution only the source pixels continue their path, the others are upsampled by kernel_indirect_upsample
+	bool trace_indirect = true;
+	if (bounce == 0 && settings.indirect_downsample > 1) {
+		indirect_guide[ray_pixel_index] = make_float4(hit_normal, length(hit_point - camera.position));
+
+		trace_indirect = Upsample::is_source(x, y, settings.indirect_downsample, sample_index);
+	}
+
+#if ENABLE_RADIANCE_CACHE
+	// The last bounce only receives direct light, recording it would bias the cache
+	if (settings.enable_radiance_cache && bounce < NUM_BOUNCES - 1 && trace_indirect) {
+		radiance_cache_record(bounce, ray_pixel_index, hit_point, hit_normal, ray_throughput);
+	}
+#endif
+
 	float3 throughput = ray_throughput * albedo;
 	
 	if (settings.enable_next_event_estimation) {
@@ -586,7 +1396,7 @@ extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int s
 			// Trace Shadow Ray
 			float light_u, light_v;
 			int   light_transform_id;
-			int   light_id = random_point_on_random_light(x, y, sample_index, bounce, seed, light_u, light_v, light_transform_id);
+			int   light_id = random_point_on_random_light(x, y, sample_index, ray_depth, seed, light_u, light_v, light_transform_id);
 
 			float3 light_position_0, light_position_edge_1, light_position_edge_2;
 			float3 light_normal_0,   light_normal_edge_1,   light_normal_edge_2;
@@ -639,42 +1449,69 @@ extern "C" __global__ void kernel_shade_diffuse(int rand_seed, int bounce, int s
 
 				ray_buffer_shadow.max_distance[shadow_ray_index] = distance_to_light - EPSILON;
 
-				ray_buffer_shadow.pixel_index[shadow_ray_index] = ray_pixel_index;
+				ray_buffer_shadow.pixel_state[shadow_ray_index] = ray_pixel_state;
 				ray_buffer_shadow.illumination.from_float3(shadow_ray_index, illumination);
 			}
 		}
 	}
 
-	if (bounce == NUM_BOUNCES - 1) return;
-
-	int index_out = atomic_agg_inc(&buffer_sizes.trace[bounce + 1]);
+	if (ray_depth == NUM_BOUNCES - 1 || !trace_indirect) return;
 
 	float3 tangent, binormal;
 	orthonormal_basis(hit_normal, tangent, binormal);
 
-	float3 direction_local = random_cosine_weighted_direction(x, y, sample_index, bounce, seed);
+	float3 direction_local = random_cosine_weighted_direction(x, y, sample_index, ray_depth, seed);
 	float3 direction_world = local_to_world(direction_local, tangent, binormal, hit_normal);
 
-	ray_buffer_trace.origin   .from_float3(index_out, hit_point);
-	ray_buffer_trace.direction.from_float3(index_out, direction_world);
+	float pdf = fabsf(dot(direction_world, hit_normal)) * ONE_OVER_PI;
+
+#if ENABLE_PATH_GUIDING
+	if (settings.enable_path_guiding) {
+		int dtree = path_guiding_find(hit_point);
+		if (path_guiding_use_tree(dtree, seed)) {
+			direction_world = path_guiding_sample(dtree, seed);
+		}
+
+		// Only the SD-tree samples directions below the surface
+		float cos_o = dot(direction_world, hit_normal);
+		if (cos_o <= 0.0f) return;
+
+		float pdf_bsdf = cos_o * ONE_OVER_PI;
+		pdf = path_guiding_pdf(dtree, direction_world, pdf_bsdf);
+
+		// The throughput of a BSDF sample assumes that the cosine weighted BSDF equals its pdf, so the mixture is weighted by their ratio
+		throughput *= pdf_bsdf / pdf;
+
+		path_guiding_record(bounce, ray_pixel_index, hit_point, direction_world, pdf, throughput);
+	}
+#endif
+
+	int           index_out;
+	TraceBuffer * ray_buffer_out = trace_queue_append(bounce, Material::Type::DIFFUSE, index, index_out);
+
+	ray_buffer_out->origin   .from_float3(index_out, hit_point);
+	ray_buffer_out->direction.from_float3(index_out, direction_world);
 	
 #if ENABLE_MIPMAPPING
-	ray_buffer_trace.cone_width[index_out] = cone_width;
+	ray_buffer_out->cone_width[index_out] = cone_width;
 #endif
 
-	ray_buffer_trace.pixel_index[index_out]  = ray_pixel_index;
-	ray_buffer_trace.throughput.from_float3(index_out, throughput);
+	ray_buffer_out->pixel_state[index_out] = Packing::pack_pixel_state(ray_pixel_index, int(Material::Type::DIFFUSE), ray_path_start);
+	ray_buffer_out->throughput.from_float3(index_out, throughput);
 
-	ray_buffer_trace.last_material_type[index_out] = char(Material::Type::DIFFUSE);
-	ray_buffer_trace.last_pdf[index_out] = fabsf(dot(direction_world, hit_normal)) * ONE_OVER_PI;
+	ray_buffer_out->last_pdf[index_out] = pdf;
 }
 
-extern "C" __global__ void kernel_shade_dielectric(int rand_seed, int bounce) {
-	int index = blockIdx.x * blockDim.x + threadIdx.x;
-	if (index >= buffer_sizes.dielectric[bounce] || bounce == NUM_BOUNCES - 1) return;
+extern "C" __global__ void kernel_shade_dielectric(int rand_seed, int bounce, int sample_index) {
+	int thread_index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (thread_index >= buffer_sizes.dielectric[bounce]) return;
+
+	int index = material_sort_get_index(ray_buffer_shade_dielectric, thread_index);
+
+	// Paths that end in this Kernel are not appended to the trace queue
+	if (settings.enable_deterministic_compaction) compaction_queue[compaction_get_staged_index(bounce, Material::Type::DIELECTRIC, index)] = COMPACTION_QUEUE_NONE;
 
 	float3 ray_direction = ray_buffer_shade_dielectric.direction.to_float3(index);
-	if (bounce == 0) ray_direction = normalize(ray_direction);
 
 	int   ray_mesh_id;
 	int   ray_triangle_id;
@@ -683,21 +1520,18 @@ extern "C" __global__ void kernel_shade_dielectric(int rand_seed, int bounce) {
 	float ray_v;
 	ray_buffer_shade_dielectric.hits.get(index, ray_mesh_id, ray_triangle_id, ray_t, ray_u, ray_v);
 
-	// Primary Ray direction is not normalized because ray differentials need their original length
-	// This is not needed in this kernel so normalize the direction and correct t so that it is the actual distance along the ray
-	if (bounce == 0) {
-		float ray_direction_length_inv = 1.0f / length(ray_direction);
-		ray_t         *= ray_direction_length_inv;
-		ray_direction *= ray_direction_length_inv;
-	}
+	unsigned ray_pixel_state = ray_buffer_shade_dielectric.pixel_state[index];
+	int      ray_pixel_index = Packing::unpack_pixel_index(ray_pixel_state);
+	int      ray_path_start  = Packing::unpack_path_start (ray_pixel_state);
+	int      ray_depth       = bounce - ray_path_start;
 
-	int ray_pixel_index = ray_buffer_shade_dielectric.pixel_index[index];
+	if (ray_depth == NUM_BOUNCES - 1) return;
 
 	float3 ray_throughput = ray_buffer_shade_dielectric.throughput.to_float3(index);
 
 	ASSERT(ray_triangle_id != -1, "Ray must have hit something for this Kernel to be invoked!");
 
-	unsigned seed = wang_hash(index ^ rand_seed);
+	unsigned seed = get_seed(index, ray_pixel_state, rand_seed, sample_index);
 
 	const Material & material = materials[triangle_get_material_id(ray_triangle_id)];
 
@@ -717,7 +1551,8 @@ extern "C" __global__ void kernel_shade_dielectric(int rand_seed, int bounce) {
 	hit_normal = normalize(hit_normal);
 	mesh_transform_position_and_direction(ray_mesh_id, hit_point, hit_normal);
 
-	int index_out = atomic_agg_inc(&buffer_sizes.trace[bounce + 1]);
+	int           index_out;
+	TraceBuffer * ray_buffer_out = trace_queue_append(bounce, Material::Type::DIELECTRIC, index, index_out);
 
 	float3 direction;
 	float3 direction_reflected = reflect(ray_direction, hit_normal);
@@ -775,21 +1610,24 @@ extern "C" __global__ void kernel_shade_dielectric(int rand_seed, int bounce) {
 		frame_buffer_albedo[ray_pixel_index] = make_float4(1.0f);
 	}
 
-	ray_buffer_trace.origin   .from_float3(index_out, hit_point);
-	ray_buffer_trace.direction.from_float3(index_out, direction);
+	ray_buffer_out->origin   .from_float3(index_out, hit_point);
+	ray_buffer_out->direction.from_float3(index_out, direction);
 
 #if ENABLE_MIPMAPPING
-	ray_buffer_trace.cone_width[index_out] = ray_buffer_shade_diffuse.cone_width[index] + camera.pixel_spread_angle * ray_t;
+	ray_buffer_out->cone_width[index_out] = ray_buffer_shade_diffuse.cone_width[index] + camera.pixel_spread_angle * ray_t;
 #endif
-	ray_buffer_trace.pixel_index[index_out] = ray_pixel_index;
-	ray_buffer_trace.throughput.from_float3(index_out, ray_throughput);
-
-	ray_buffer_trace.last_material_type[index_out] = char(Material::Type::DIELECTRIC);
+	ray_buffer_out->pixel_state[index_out] = Packing::pack_pixel_state(ray_pixel_index, int(Material::Type::DIELECTRIC), ray_path_start);
+	ray_buffer_out->throughput.from_float3(index_out, ray_throughput);
 }
 
 extern "C" __global__ void kernel_shade_glossy(int rand_seed, int bounce, int sample_index) {
-	int index = blockIdx.x * blockDim.x + threadIdx.x;
-	if (index >= buffer_sizes.glossy[bounce]) return;
+	int thread_index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (thread_index >= buffer_sizes.glossy[bounce]) return;
+
+	int index = material_sort_get_index(ray_buffer_shade_glossy, thread_index);
+
+	// Paths that end in this Kernel are not appended to the trace queue
+	if (settings.enable_deterministic_compaction) compaction_queue[compaction_get_staged_index(bounce, Material::Type::GLOSSY, index)] = COMPACTION_QUEUE_NONE;
 
 	float3 ray_direction = ray_buffer_shade_glossy.direction.to_float3(index);
 
@@ -800,7 +1638,19 @@ extern "C" __global__ void kernel_shade_glossy(int rand_seed, int bounce, int sa
 	float ray_v;
 	ray_buffer_shade_glossy.hits.get(index, ray_mesh_id, ray_triangle_id, ray_t, ray_u, ray_v);
 
-	int ray_pixel_index = ray_buffer_shade_glossy.pixel_index[index];
+	unsigned ray_pixel_state = ray_buffer_shade_glossy.pixel_state[index];
+	int      ray_pixel_index = Packing::unpack_pixel_index(ray_pixel_state);
+	int      ray_path_start  = Packing::unpack_path_start (ray_pixel_state);
+	int      ray_depth       = bounce - ray_path_start;
+
+	unsigned seed = get_seed(index, ray_pixel_state, rand_seed, sample_index);
+
+	// The blue noise sequence of the pixel belongs to its first path, regenerated paths use the xorshift sampler
+	sample_index = Regeneration::get_sample_index(sample_index, ray_path_start);
+
+	// Primary Rays need their unnormalized direction for ray differentials
+	if (bounce == 0) primary_ray_unnormalize(ray_pixel_index, ray_direction, ray_t);
+
 	int x = ray_pixel_index % screen_pitch;
 	int y = ray_pixel_index / screen_pitch; 
 
@@ -808,8 +1658,6 @@ extern "C" __global__ void kernel_shade_glossy(int rand_seed, int bounce, int sa
 
 	ASSERT(ray_triangle_id != -1, "Ray must have hit something for this Kernel to be invoked!");
 
-	unsigned seed = wang_hash(index ^ rand_seed);
-
 	const Material & material = materials[triangle_get_material_id(ray_triangle_id)];
 
 	ASSERT(material.type == Material::Type::GLOSSY, "Material should be glossy in this Kernel");
@@ -877,7 +1725,7 @@ extern "C" __global__ void kernel_shade_glossy(int rand_seed, int bounce, int sa
 			float light_u;
 			float light_v;
 			int   light_transform_id;
-			int   light_id = random_point_on_random_light(x, y, sample_index, bounce, seed, light_u, light_v, light_transform_id);
+			int   light_id = random_point_on_random_light(x, y, sample_index, ray_depth, seed, light_u, light_v, light_transform_id);
 
 			float3 light_position_0, light_position_edge_1, light_position_edge_2;
 			float3 light_normal_0,   light_normal_edge_1,   light_normal_edge_2;
@@ -939,17 +1787,17 @@ extern "C" __global__ void kernel_shade_glossy(int rand_seed, int bounce, int sa
 
 				ray_buffer_shadow.max_distance[shadow_ray_index] = distance_to_light - EPSILON;
 
-				ray_buffer_shadow.pixel_index[shadow_ray_index] = ray_pixel_index;
+				ray_buffer_shadow.pixel_state[shadow_ray_index] = ray_pixel_state;
 				ray_buffer_shadow.illumination.from_float3(shadow_ray_index, illumination);
 			}
 		}
 	}
 
-	if (bounce == NUM_BOUNCES - 1) return;
+	if (ray_depth == NUM_BOUNCES - 1) return;
 
 	// Sample normal distribution in spherical coordinates
-	float theta = atanf(sqrtf(-alpha * alpha * logf(random_float_heitz(x, y, sample_index, bounce, 4, seed) + 1e-8f)));
-	float phi   = TWO_PI * random_float_heitz(x, y, sample_index, bounce, 5, seed);
+	float theta = atanf(sqrtf(-alpha * alpha * logf(random_float_heitz(x, y, sample_index, ray_depth, 4, seed) + 1e-8f)));
+	float phi   = TWO_PI * random_float_heitz(x, y, sample_index, ray_depth, 5, seed);
 
 	float sin_theta, cos_theta;
 	float sin_phi,   cos_phi;
@@ -978,22 +1826,177 @@ extern "C" __global__ void kernel_shade_glossy(int rand_seed, int bounce, int sa
 	float G = microfacet_G(i_dot_m, o_dot_m, i_dot_n, o_dot_n, m_dot_n, alpha);
 	float weight = fabsf(i_dot_m) * F * G / fabsf(i_dot_n * m_dot_n);
 
-	int index_out = atomic_agg_inc(&buffer_sizes.trace[bounce + 1]);
+	float pdf = D * fabsf(m_dot_n) / (4.0f * fabsf(o_dot_m));
 
-	ray_buffer_trace.origin   .from_float3(index_out, hit_point);
-	ray_buffer_trace.direction.from_float3(index_out, direction_out);
+#if ENABLE_PATH_GUIDING
+	// Near specular lobes are too narrow for the SD-tree to help, like NEE they are left to BSDF sampling
+	if (settings.enable_path_guiding && material.roughness >= ROUGHNESS_CUTOFF) {
+		float pdf_bsdf = pdf;
 
-	ray_buffer_trace.pixel_index[index_out] = ray_pixel_index;
-	ray_buffer_trace.throughput.from_float3(index_out, throughput);
+		int dtree = path_guiding_find(hit_point);
+		if (path_guiding_use_tree(dtree, seed)) {
+			direction_out = path_guiding_sample(dtree, seed);
 
-	ray_buffer_trace.last_material_type[index_out] = char(Material::Type::GLOSSY);
-	ray_buffer_trace.last_pdf[index_out] = D * fabsf(m_dot_n) / (4.0f * fabsf(o_dot_m));
+			// Only the SD-tree samples directions below the surface
+			if (dot(direction_out, hit_normal) <= 0.0f) return;
+
+			float3 half_vector = normalize(direction_in + direction_out);
+			float  h_dot_n = dot(half_vector, hit_normal);
+
+			pdf_bsdf = microfacet_D(h_dot_n, alpha) * h_dot_n / (4.0f * dot(half_vector, direction_out));
+		}
+
+		pdf = path_guiding_pdf(dtree, direction_out, pdf_bsdf);
+
+		// The throughput of a BSDF sample assumes that the cosine weighted BSDF equals its pdf, so the mixture is weighted by their ratio
+		throughput *= pdf_bsdf / pdf;
+
+		path_guiding_record(bounce, ray_pixel_index, hit_point, direction_out, pdf, throughput);
+	}
+#endif
+
+	int           index_out;
+	TraceBuffer * ray_buffer_out = trace_queue_append(bounce, Material::Type::GLOSSY, index, index_out);
+
+	ray_buffer_out->origin   .from_float3(index_out, hit_point);
+	ray_buffer_out->direction.from_float3(index_out, direction_out);
+
+	ray_buffer_out->pixel_state[index_out] = Packing::pack_pixel_state(ray_pixel_index, int(Material::Type::GLOSSY), ray_path_start);
+	ray_buffer_out->throughput.from_float3(index_out, throughput);
+	ray_buffer_out->last_pdf[index_out] = pdf;
 }
 
 extern "C" __global__ void kernel_trace_shadow(int bounce) {
 	bvh_trace_shadow(buffer_sizes.shadow[bounce], &buffer_sizes.rays_retired_shadow[bounce], bounce);
 }
 
+#if ENABLE_RADIANCE_CACHE
+// Adds the outgoing radiance of every recorded path vertex of this frame to the accumulator of its cell
+extern "C" __global__ void kernel_radiance_cache_update() {
+	int x = blockIdx.x * blockDim.x + threadIdx.x;
+	int y = blockIdx.y * blockDim.y + threadIdx.y;
+
+	if (x >= screen_width || y >= screen_height) return;
+
+	int pixel_index = x + y * screen_pitch;
+
+	float4 radiance_pixel = frame_buffer_direct[pixel_index] + frame_buffer_indirect[pixel_index];
+
+	for (int bounce = 0; bounce < NUM_BOUNCES - 1; bounce++) {
+		int index = bounce * screen_pitch * screen_height + pixel_index;
+
+		float4 snapshot = radiance_cache_records.snapshot[index];
+
+		int slot = __float_as_int(snapshot.w);
+		if (slot == -1) continue;
+
+		float3 throughput = radiance_cache_records.throughput.to_float3(index);
+
+		// Everything the pixel received after the vertex was shaded, divided by the throughput up to the vertex
+		float3 radiance = make_float3(
+			RadianceCache::get_sample(snapshot.x, radiance_pixel.x, throughput.x),
+			RadianceCache::get_sample(snapshot.y, radiance_pixel.y, throughput.y),
+			RadianceCache::get_sample(snapshot.z, radiance_pixel.z, throughput.z)
+		);
+
+		atomicAdd(&radiance_cache_accumulator[slot].x, radiance.x);
+		atomicAdd(&radiance_cache_accumulator[slot].y, radiance.y);
+		atomicAdd(&radiance_cache_accumulator[slot].z, radiance.z);
+		atomicAdd(&radiance_cache_accumulator[slot].w, 1.0f);
+
+		radiance_cache_records.snapshot[index].w = __int_as_float(-1);
+	}
+}
+
+// Blends the samples accumulated this frame into the radiance estimate of every cell
+extern "C" __global__ void kernel_radiance_cache_resolve() {
+	int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index >= RADIANCE_CACHE_SIZE) return;
+
+	float4 accumulated = radiance_cache_accumulator[index];
+	if (accumulated.w == 0.0f) return;
+
+	float4 radiance = radiance_cache_radiance[index];
+
+	RadianceCache::blend(
+		radiance.x, radiance.y, radiance.z, radiance.w,
+		accumulated.x, accumulated.y, accumulated.z, accumulated.w
+	);
+
+	radiance_cache_radiance   [index] = radiance;
+	radiance_cache_accumulator[index] = make_float4(0.0f);
+}
+#endif
+
+#if ENABLE_PATH_GUIDING
+// Turns every recorded path vertex of this frame into a sample of the incident radiance from its sampled direction
+extern "C" __global__ void kernel_path_guiding_update() {
+	int x = blockIdx.x * blockDim.x + threadIdx.x;
+	int y = blockIdx.y * blockDim.y + threadIdx.y;
+
+	if (x >= screen_width || y >= screen_height) return;
+
+	int pixel_index = x + y * screen_pitch;
+
+	float4 radiance_pixel = frame_buffer_direct[pixel_index] + frame_buffer_indirect[pixel_index];
+	float  radiance       = (radiance_pixel.x + radiance_pixel.y + radiance_pixel.z) * (1.0f / 3.0f);
+
+	for (int bounce = 0; bounce < NUM_BOUNCES - 1; bounce++) {
+		int index = bounce * screen_pitch * screen_height + pixel_index;
+
+		float4 position = path_guiding_records.position[index];
+		if (position.w <= 0.0f) continue;
+
+		path_guiding_records.position[index].w = 0.0f;
+
+		float throughput = path_guiding_records.throughput[index];
+		if (throughput <= 0.0f) continue;
+
+		float4 direction = path_guiding_records.direction[index];
+
+		// Everything the pixel received after the vertex was shaded, except its direct light, arrived through the sampled direction
+		float incident = (radiance - direction.w - path_guiding_records.direct[index]) / throughput;
+
+		int sample_index = atomic_agg_inc(&path_guiding_sample_count);
+		if (sample_index >= PATH_GUIDING_MAX_SAMPLES) continue;
+
+		PathGuiding::Sample & sample = path_guiding_samples[sample_index];
+		sample.position[0]  = position.x;
+		sample.position[1]  = position.y;
+		sample.position[2]  = position.z;
+		sample.radiance     = incident / position.w;
+		sample.direction[0] = direction.x;
+		sample.direction[1] = direction.y;
+		sample.direction[2] = direction.z;
+	}
+}
+#endif
+
+// Fills in the indirect lighting of diffuse primary hits that did not trace it themselves
+extern "C" __global__ void kernel_indirect_upsample(int frame_index) {
+	int x = blockIdx.x * blockDim.x + threadIdx.x;
+	int y = blockIdx.y * blockDim.y + threadIdx.y;
+
+	if (x >= screen_width || y >= screen_height) return;
+
+	int pixel_index = x + y * screen_pitch;
+
+	// Only pixels that are not sources are written, and only sources are read, so this can safely be done in place
+	if (indirect_guide[pixel_index].w == 0.0f || Upsample::is_source(x, y, settings.indirect_downsample, frame_index)) return;
+
+	float3 indirect;
+	Upsample::upsample_pixel(
+		x, y, screen_width, screen_height, screen_pitch,
+		settings.indirect_downsample, frame_index,
+		reinterpret_cast<const float *>(indirect_guide),
+		reinterpret_cast<const float *>(frame_buffer_albedo),
+		reinterpret_cast<const float *>(frame_buffer_indirect),
+		indirect.x, indirect.y, indirect.z
+	);
+
+	frame_buffer_indirect[pixel_index] = make_float4(indirect);
+}
+
 extern "C" __global__ void kernel_reconstruct() {
 	int x = blockIdx.x * blockDim.x + threadIdx.x;
 	int y = blockIdx.y * blockDim.y + threadIdx.y;
@@ -1058,7 +2061,7 @@ extern "C" __global__ void kernel_reconstruct() {
 	}
 }
 
-extern "C" __global__ void kernel_accumulate(float frames_accumulated) {
+extern "C" __global__ void kernel_accumulate(float frames_accumulated, int samples_per_frame) {
 	int x = blockIdx.x * blockDim.x + threadIdx.x;
 	int y = blockIdx.y * blockDim.y + threadIdx.y;
 
@@ -1072,11 +2075,22 @@ extern "C" __global__ void kernel_accumulate(float frames_accumulated) {
 		float4 direct   = frame_buffer_direct  [pixel_index];
 		float4 indirect = frame_buffer_indirect[pixel_index];
 
-		colour = direct + indirect;
+		// The Frame Buffers hold the sum of all samples of this frame
+		colour = (direct + indirect) / float(samples_per_frame);
 
 		if (settings.demodulate_albedo) {
 			colour /= fmaxf(frame_buffer_albedo[pixel_index], make_float4(1e-8f));
 		}	
+
+		// Average in the samples of paths that were regenerated into this pixel
+		float4 regenerated = frame_buffer_regenerated[pixel_index];
+		if (regenerated.w > 0.0f) {
+			colour.x = Regeneration::resolve(colour.x, regenerated.x, regenerated.w);
+			colour.y = Regeneration::resolve(colour.y, regenerated.y, regenerated.w);
+			colour.z = Regeneration::resolve(colour.z, regenerated.z, regenerated.w);
+
+			frame_buffer_regenerated[pixel_index] = make_float4(0.0f);
+		}
 	} else {
 		colour = reconstruction[pixel_index];
 		colour.x /= colour.w;
@@ -1101,4 +2115,18 @@ extern "C" __global__ void kernel_accumulate(float frames_accumulated) {
 	}
 	frame_buffer_direct  [pixel_index] = make_float4(0.0f);
 	frame_buffer_indirect[pixel_index] = make_float4(0.0f);
+
+	if (settings.indirect_downsample > 1) {
+		indirect_guide[pixel_index] = make_float4(0.0f);
+	}
+
+	// The next frame continues the stream of regenerated samples where this frame left off
+	if (x == 0 && y == 0) {
+		int regenerated_count = 0;
+		for (int i = 1; i <= PATH_REGENERATION_ITERATIONS; i++) {
+			regenerated_count += buffer_sizes.regenerated[i];
+		}
+
+		path_regeneration_cursor = Regeneration::advance_cursor(path_regeneration_cursor, regenerated_count, screen_width * screen_height);
+	}
 }
@@ -0,0 +1,90 @@
+#pragma once
+// World space hash grid used to cache outgoing radiance at diffuse path vertices
+// This file is shared between the CUDA files and the C++ files, so that the Host reference computes the same keys and updates
+#include "Common.h"
+#include "Packing.h"
+
+namespace RadianceCache {
+	// PCG hash, see "Hash Functions for GPU Rendering" (Jarzynski and Olano 2020)
+	HOST_DEVICE inline unsigned pcg_hash(unsigned value) {
+		unsigned state = value * 747796405u + 2891336453u;
+		unsigned word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+
+		return (word >> 22u) ^ word;
+	}
+
+	// Cells grow with the distance to the Camera so that they cover a roughly constant number of pixels (Binder et al. 2019)
+	HOST_DEVICE inline int get_level(float distance_to_camera, float pixel_spread_angle) {
+		float footprint = distance_to_camera * pixel_spread_angle * RADIANCE_CACHE_CELL_PIXELS;
+		if (footprint <= RADIANCE_CACHE_CELL_SIZE) return 0;
+
+		int level = int(floorf(log2f(footprint / RADIANCE_CACHE_CELL_SIZE)));
+		return level < RADIANCE_CACHE_MAX_LEVEL ? level : RADIANCE_CACHE_MAX_LEVEL;
+	}
+
+	HOST_DEVICE inline float get_cell_size(int level) {
+		return RADIANCE_CACHE_CELL_SIZE * float(1 << level);
+	}
+
+	// Quantizes a normal to its dominant axis, so that opposite sides of thin geometry do not share cells
+	HOST_DEVICE inline unsigned get_normal_bin(float x, float y, float z) {
+		float abs_x = fabsf(x);
+		float abs_y = fabsf(y);
+		float abs_z = fabsf(z);
+
+		if (abs_x >= abs_y && abs_x >= abs_z) {
+			return x >= 0.0f ? 0 : 1;
+		} else if (abs_y >= abs_z) {
+			return y >= 0.0f ? 2 : 3;
+		} else {
+			return z >= 0.0f ? 4 : 5;
+		}
+	}
+
+	// Computes the hash that determines the first slot to probe and the fingerprint stored in the table to identify the cell
+	// A fingerprint of 0 marks an empty slot and is never produced
+	HOST_DEVICE inline void get_key(
+		float position_x, float position_y, float position_z,
+		float normal_x,   float normal_y,   float normal_z,
+		int level,
+		unsigned & hash, unsigned & fingerprint
+	) {
+		float inv_cell_size = 1.0f / get_cell_size(level);
+
+		unsigned cell_x = unsigned(int(floorf(position_x * inv_cell_size)));
+		unsigned cell_y = unsigned(int(floorf(position_y * inv_cell_size)));
+		unsigned cell_z = unsigned(int(floorf(position_z * inv_cell_size)));
+
+		unsigned cell_info = unsigned(level) | (get_normal_bin(normal_x, normal_y, normal_z) << 8);
+
+		hash = pcg_hash(cell_x ^ pcg_hash(cell_y ^ pcg_hash(cell_z ^ pcg_hash(cell_info))));
+
+		fingerprint = pcg_hash(hash ^ pcg_hash(cell_x + pcg_hash(cell_y + pcg_hash(cell_z + cell_info))));
+		if (fingerprint == 0) fingerprint = 1;
+	}
+
+	// Outgoing radiance of a path vertex, given the radiance the pixel had when the vertex was shaded,
+	// the radiance of the pixel after the full path was traced and the throughput of the path up to the vertex
+	HOST_DEVICE inline float get_sample(float radiance_snapshot, float radiance_pixel, float throughput) {
+		if (throughput <= 0.0f) return 0.0f;
+
+		return fmaxf(radiance_pixel - radiance_snapshot, 0.0f) / throughput;
+	}
+
+	// Blends the samples gathered for a cell during the last frame into its radiance estimate.
+	// Starts as a cumulative average and becomes an exponential moving average once the cell has enough samples
+	HOST_DEVICE inline void blend(
+		float & radiance_r, float & radiance_g, float & radiance_b, float & sample_count,
+		float sum_r, float sum_g, float sum_b, float new_sample_count
+	) {
+		float inv_new_sample_count = 1.0f / new_sample_count;
+
+		float alpha = fmaxf(new_sample_count / (sample_count + new_sample_count), RADIANCE_CACHE_MIN_ALPHA);
+
+		radiance_r += alpha * (sum_r * inv_new_sample_count - radiance_r);
+		radiance_g += alpha * (sum_g * inv_new_sample_count - radiance_g);
+		radiance_b += alpha * (sum_b * inv_new_sample_count - radiance_b);
+
+		sample_count += new_sample_count;
+	}
+}
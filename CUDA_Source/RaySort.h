@@ -0,0 +1,50 @@
+#pragma once
+// Reordering of the trace queue, so that Rays that are traced by the same Warp start close together and travel in similar directions.
+// This file is shared between the CUDA files and the C++ files, so that the Host reference computes the same keys
+#include "Common.h"
+#include "Packing.h"
+
+namespace RaySort {
+	// Inserts two zero bits between each of the lowest RAY_SORT_ORIGIN_BITS bits of 'x'
+	HOST_DEVICE inline unsigned expand_bits(unsigned x) {
+		unsigned result = 0;
+
+		for (int i = 0; i < RAY_SORT_ORIGIN_BITS; i++) {
+			result |= ((x >> i) & 1) << (3 * i);
+		}
+
+		return result;
+	}
+
+	// Position of 'x' within [min, min + 1 / inv_extent), in cells of 1 / (1 << RAY_SORT_ORIGIN_BITS) of the extent
+	HOST_DEVICE inline unsigned quantise(float x, float min, float inv_extent) {
+		const int cell_count = 1 << RAY_SORT_ORIGIN_BITS;
+
+		int cell = int((x - min) * inv_extent * float(cell_count));
+
+		if (cell < 0)           return 0;
+		if (cell >= cell_count) return cell_count - 1;
+
+		return unsigned(cell);
+	}
+
+	// The octant of the direction is in the highest bits, so Rays are grouped by direction first
+	// and by the Morton order of their origin within the scene bounds second
+	HOST_DEVICE inline int get_key(
+		float origin_x,    float origin_y,    float origin_z,
+		float direction_x, float direction_y, float direction_z,
+		const float bounds_min[3], const float bounds_inv_extent[3]
+	) {
+		unsigned octant =
+			(direction_x < 0.0f ? 1 : 0) |
+			(direction_y < 0.0f ? 2 : 0) |
+			(direction_z < 0.0f ? 4 : 0);
+
+		unsigned morton =
+			(expand_bits(quantise(origin_x, bounds_min[0], bounds_inv_extent[0]))     ) |
+			(expand_bits(quantise(origin_y, bounds_min[1], bounds_inv_extent[1])) << 1) |
+			(expand_bits(quantise(origin_z, bounds_min[2], bounds_inv_extent[2])) << 2);
+
+		return int(octant << (3 * RAY_SORT_ORIGIN_BITS) | morton);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+// Streaming path regeneration: once paths start to terminate, the free slots of the trace queue are refilled with new camera samples,
+// so that the later wavefront iterations of a frame still work on a nearly full queue.
+// This file is shared between the CUDA files and the C++ files, so that the Host reference follows the same schedule
+#include "Common.h"
+#include "Packing.h"
+
+static_assert(PATH_REGENERATION_ITERATIONS <= PIXEL_STATE_PATH_START_MASK, "The iteration at which a path starts must fit in its pixel state");
+
+namespace Regeneration {
+	// Iteration 0 traces the first sample of every pixel, later iterations only regenerate if the new paths can still complete all their bounces
+	HOST_DEVICE inline bool is_regeneration_iteration(int iteration) {
+		return iteration >= 1 && iteration <= PATH_REGENERATION_ITERATIONS;
+	}
+
+	// Number of new samples that fit in the trace queue of an iteration
+	HOST_DEVICE inline int get_count(int trace_size, int capacity) {
+		return trace_size < capacity ? capacity - trace_size : 0;
+	}
+
+	HOST_DEVICE inline int gcd(int a, int b) {
+		while (b != 0) {
+			int t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+	// Regenerated samples walk through the pixels with a stride that is coprime with the pixel count,
+	// so that every pixel is visited once per 'pixel_count' samples and consecutive samples are spread over the screen
+	HOST_DEVICE inline int get_stride(int pixel_count) {
+		int stride = int(0.61803398875f * float(pixel_count)) | 1;
+
+		while (gcd(stride, pixel_count) != 1) stride++;
+
+		return stride;
+	}
+
+	// Maps a position in the stream of regenerated samples to a pixel, as an index into the unpadded 'pixel_count' pixels
+	HOST_DEVICE inline int get_pixel(int stream_index, int stride, int pixel_count) {
+		return int((long long)(stream_index % pixel_count) * stride % pixel_count);
+	}
+
+	// The stream continues where the previous frame left off
+	HOST_DEVICE inline int advance_cursor(int cursor, int count, int pixel_count) {
+		return int(((long long)cursor + count) % pixel_count);
+	}
+
+	// PCG hash, same as RadianceCache::pcg_hash
+	HOST_DEVICE inline unsigned hash(unsigned value) {
+		unsigned state = value * 747796405u + 2891336453u;
+		unsigned word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+
+		return (word >> 22u) ^ word;
+	}
+
+	// Seed of the random numbers of a path at one wavefront iteration, when paths are seeded independently of their queue slot.
+	// A pixel can have several paths in flight, which differ in the iteration at which they were (re)generated and in the sample of the frame.
+	// Each is mixed in with its own round of hashing, so that these paths do not draw correlated random numbers.
+	// 'rand_seed' is drawn per Kernel launch and decorrelates the iterations
+	HOST_DEVICE inline unsigned get_path_seed(int pixel_index, int path_start, int sample_index, unsigned rand_seed) {
+		unsigned seed = hash(unsigned(pixel_index) ^ rand_seed);
+		seed = hash(seed + unsigned(path_start));
+		seed = hash(seed + unsigned(sample_index));
+
+		return seed;
+	}
+
+	// Sample index for the random numbers of a path, only the first path of a pixel uses the blue noise sequence
+	HOST_DEVICE inline int get_sample_index(int sample_index, int path_start) {
+		return path_start > 0 ? PATH_REGENERATION_SAMPLE_INDEX : sample_index;
+	}
+
+	// Average of the first sample of a pixel and its regenerated samples, per colour channel
+	HOST_DEVICE inline float resolve(float first, float regenerated_sum, float regenerated_count) {
+		return (first + regenerated_sum) / (1.0f + regenerated_count);
+	}
+}
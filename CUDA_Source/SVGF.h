@@ -81,6 +81,10 @@ extern "C" __global__ void kernel_svgf_temporal() {
 
 	// Check if this pixel belongs to the Skybox
 	if (depth == 0.0f) {
+		// The Skybox has no history, give it the same variance as a disoccluded pixel
+		direct.w   = 1.0f;
+		indirect.w = 1.0f;
+
 		frame_buffer_direct  [pixel_index] = direct;
 		frame_buffer_indirect[pixel_index] = indirect;
 
@@ -553,7 +557,11 @@ extern "C" __global__ void kernel_svgf_finalize(
 
 	// @SPEED
 	// Clear frame buffers for next frame
-	frame_buffer_albedo  [pixel_index] = make_float4(0.0f, 0.0f, 0.0f, 1.0f);
-	frame_buffer_direct  [pixel_index] = make_float4(0.0f, 0.0f, 0.0f, 1.0f);
-	frame_buffer_indirect[pixel_index] = make_float4(0.0f, 0.0f, 0.0f, 1.0f);
+	frame_buffer_albedo  [pixel_index] = make_float4(0.0f);
+	frame_buffer_direct  [pixel_index] = make_float4(0.0f);
+	frame_buffer_indirect[pixel_index] = make_float4(0.0f);
+
+	if (settings.indirect_downsample > 1) {
+		indirect_guide[pixel_index] = make_float4(0.0f);
+	}
 }
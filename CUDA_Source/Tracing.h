@@ -239,6 +239,37 @@ __device__ inline T stack_pop(const T shared_stack[], const T stack[], int & sta
 	}
 }
 
+#if ENABLE_TRAVERSAL_HEATMAP
+// Traversal cost per pixel, one range of 'screen_pitch * screen_height' elements per path depth, first for trace and then for shadow Rays
+__device__ __constant__ TraversalCost * traversal_cost;
+
+__device__ inline void traversal_cost_add(unsigned pixel_state, int bounce, bool shadow, int nodes, int triangles) {
+	int pixel_index = Packing::unpack_pixel_index(pixel_state);
+	int depth       = min(bounce - Packing::unpack_path_start(pixel_state), NUM_BOUNCES - 1);
+
+	TraversalCost & cost = traversal_cost[(int(shadow) * NUM_BOUNCES + depth) * screen_pitch * screen_height + pixel_index];
+
+	atomicAdd(&cost.nodes,     unsigned(nodes));
+	atomicAdd(&cost.triangles, unsigned(triangles));
+	atomicAdd(&cost.rays,      1u);
+}
+
+// The traversals count visited Nodes and Triangle tests in registers, and add them to the pixel of the Ray once it is done
+#define TRAVERSAL_COST_DECLARE()  int traversal_nodes, traversal_triangles
+#define TRAVERSAL_COST_RESET()    traversal_nodes = 0, traversal_triangles = 0
+#define TRAVERSAL_COST_NODE()     traversal_nodes++
+#define TRAVERSAL_COST_TRIANGLE() traversal_triangles++
+
+#define TRAVERSAL_COST_ADD(pixel_state, bounce, shadow) traversal_cost_add(pixel_state, bounce, shadow, traversal_nodes, traversal_triangles)
+#else
+#define TRAVERSAL_COST_DECLARE()
+#define TRAVERSAL_COST_RESET()
+#define TRAVERSAL_COST_NODE()
+#define TRAVERSAL_COST_TRIANGLE()
+
+#define TRAVERSAL_COST_ADD(pixel_state, bounce, shadow)
+#endif
+
 #if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
 
 struct AABB {
@@ -279,7 +310,7 @@ struct BVHNode {
 
 __device__ __constant__ BVHNode * bvh_nodes;
 
-__device__ void bvh_trace(int ray_count, int * rays_retired) {
+__device__ void bvh_trace(int ray_count, int * rays_retired, const int * ray_order, int bounce) {
 	extern __shared__ int shared_stack[];
 
 	int stack[BVH_STACK_SIZE - SHARED_STACK_SIZE];
@@ -292,6 +323,8 @@ __device__ void bvh_trace(int ray_count, int * rays_retired) {
 	int tlas_stack_size;
 	int mesh_id;
 
+	TRAVERSAL_COST_DECLARE();
+
 	while (true) {
 		bool inactive = stack_size == 0;
 
@@ -299,6 +332,9 @@ __device__ void bvh_trace(int ray_count, int * rays_retired) {
 			ray_index = atomic_agg_inc(rays_retired);
 			if (ray_index >= ray_count) return;
 
+			// Consecutive Rays in the sorted order are handed out to the same Warp
+			if (ray_order) ray_index = ray_order[ray_index];
+
 			ray.origin    = ray_buffer_trace.origin   .to_float3(ray_index);
 			ray.direction = ray_buffer_trace.direction.to_float3(ray_index);
 			ray.calc_direction_inv();
@@ -308,6 +344,8 @@ __device__ void bvh_trace(int ray_count, int * rays_retired) {
 
 			tlas_stack_size = -1;
 
+			TRAVERSAL_COST_RESET();
+
 			// Push root on stack
 			stack_size                          = 1;
 			shared_stack[SHARED_STACK_INDEX(0)] = 0;
@@ -327,6 +365,7 @@ __device__ void bvh_trace(int ray_count, int * rays_retired) {
 			int node_index = stack_pop(shared_stack, stack, stack_size);
 
 			const BVHNode & node = bvh_nodes[node_index];
+			TRAVERSAL_COST_NODE();
 
 			if (node.aabb.intersects(ray, ray_hit.t)) {
 				if (node.is_leaf()) {
@@ -342,6 +381,7 @@ __device__ void bvh_trace(int ray_count, int * rays_retired) {
 						stack_push(shared_stack, stack, stack_size, root_index);
 					} else {
 						for (int i = node.first; i < node.first + node.count; i++) {
+							TRAVERSAL_COST_TRIANGLE();
 							triangle_trace(mesh_id, i, ray, ray_hit);
 						}
 					}
@@ -364,6 +404,8 @@ __device__ void bvh_trace(int ray_count, int * rays_retired) {
 			if (stack_size == 0) {
 				ray_buffer_trace.hits.set(ray_index, ray_hit.mesh_id, ray_hit.triangle_id, ray_hit.t, ray_hit.u, ray_hit.v);
 
+				TRAVERSAL_COST_ADD(ray_buffer_trace.pixel_state[ray_index], bounce, false);
+
 				break;
 			}
 		}
@@ -384,6 +426,8 @@ __device__ void bvh_trace_shadow(int ray_count, int * rays_retired, int bounce)
 	int tlas_stack_size;
 	int mesh_id;
 
+	TRAVERSAL_COST_DECLARE();
+
 	while (true) {
 		bool inactive = stack_size == 0;
 
@@ -399,6 +443,8 @@ __device__ void bvh_trace_shadow(int ray_count, int * rays_retired, int bounce)
 
 			tlas_stack_size = -1;
 
+			TRAVERSAL_COST_RESET();
+
 			// Push root on stack
 			stack_size                          = 1;
 			shared_stack[SHARED_STACK_INDEX(0)] = 0;
@@ -418,6 +464,7 @@ __device__ void bvh_trace_shadow(int ray_count, int * rays_retired, int bounce)
 			int node_index = stack_pop(shared_stack, stack, stack_size);
 
 			const BVHNode & node = bvh_nodes[node_index];
+			TRAVERSAL_COST_NODE();
 
 			if (node.aabb.intersects(ray, max_distance)) {
 				if (node.is_leaf()) {
@@ -435,6 +482,7 @@ __device__ void bvh_trace_shadow(int ray_count, int * rays_retired, int bounce)
 						bool hit = false;
 
 						for (int i = node.first; i < node.first + node.count; i++) {
+							TRAVERSAL_COST_TRIANGLE();
 							if (triangle_trace_shadow(i, ray, max_distance)) {
 								hit = true;
 
@@ -443,6 +491,8 @@ __device__ void bvh_trace_shadow(int ray_count, int * rays_retired, int bounce)
 						}
 
 						if (hit) {
+							TRAVERSAL_COST_ADD(ray_buffer_shadow.pixel_state[ray_index], bounce, true);
+
 							stack_size = 0;
 
 							break;
@@ -466,15 +516,24 @@ __device__ void bvh_trace_shadow(int ray_count, int * rays_retired, int bounce)
 
 			if (stack_size == 0) {
 				// We didn't hit anything, apply illumination
-				int    pixel_index  = ray_buffer_shadow.pixel_index[ray_index];
-				float3 illumination = ray_buffer_shadow.illumination.to_float3(ray_index);
+				unsigned pixel_state  = ray_buffer_shadow.pixel_state[ray_index];
+				int      pixel_index  = Packing::unpack_pixel_index(pixel_state);
+				float3   illumination = ray_buffer_shadow.illumination.to_float3(ray_index);
+
+				TRAVERSAL_COST_ADD(pixel_state, bounce, true);
 
-				if (bounce == 0) {
+				if (Packing::unpack_path_start(pixel_state) > 0) {
+					frame_buffer_add_regenerated(pixel_index, illumination);
+				} else if (bounce == 0) {
 					frame_buffer_direct[pixel_index] += make_float4(illumination);
 				} else {
 					frame_buffer_indirect[pixel_index] += make_float4(illumination);
 				}
 
+#if ENABLE_PATH_GUIDING
+				path_guiding_record_direct(bounce, pixel_index, illumination);
+#endif
+
 				break;
 			}
 		}
@@ -569,7 +628,7 @@ __device__ inline void unpack_qbvh_node(unsigned packed, int & index, int & id)
 	id    = packed >> 30;
 }
 
-__device__ inline void bvh_trace(int ray_count, int * rays_retired) {
+__device__ inline void bvh_trace(int ray_count, int * rays_retired, const int * ray_order, int bounce) {
 	extern __shared__ unsigned shared_stack[];
 
 	unsigned stack[BVH_STACK_SIZE - SHARED_STACK_SIZE];
@@ -582,6 +641,8 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 	int tlas_stack_size;
 	int mesh_id;
 
+	TRAVERSAL_COST_DECLARE();
+
 	while (true) {
 		bool inactive = stack_size == 0;
 
@@ -589,6 +650,9 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 			ray_index = atomic_agg_inc(rays_retired);
 			if (ray_index >= ray_count) return;
 
+			// Consecutive Rays in the sorted order are handed out to the same Warp
+			if (ray_order) ray_index = ray_order[ray_index];
+
 			ray.origin    = ray_buffer_trace.origin   .to_float3(ray_index);
 			ray.direction = ray_buffer_trace.direction.to_float3(ray_index);
 			ray.calc_direction_inv();
@@ -598,6 +662,8 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 
 			tlas_stack_size = -1;
 
+			TRAVERSAL_COST_RESET();
+
 			// Push root on stack
 			stack_size                          = 1;
 			shared_stack[SHARED_STACK_INDEX(0)] = 1;
@@ -641,12 +707,14 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 						stack_push(shared_stack, stack, stack_size, root_index);
 				} else {
 					for (int j = index; j < index + count; j++) {
+						TRAVERSAL_COST_TRIANGLE();
 						triangle_trace(mesh_id, j, ray, ray_hit);
 					}
 				}
 			} else {
 				int child = index;
 
+				TRAVERSAL_COST_NODE();
 				AABBHits aabb_hits = qbvh_node_intersect(qbvh_nodes[child], ray, ray_hit.t);
 				
 				for (int i = 0; i < 4; i++) {
@@ -662,6 +730,8 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 			if (stack_size == 0) {
 				ray_buffer_trace.hits.set(ray_index, ray_hit.mesh_id, ray_hit.triangle_id, ray_hit.t, ray_hit.u, ray_hit.v);
 
+				TRAVERSAL_COST_ADD(ray_buffer_trace.pixel_state[ray_index], bounce, false);
+
 				break;
 			}
 		}
@@ -682,6 +752,8 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 	int tlas_stack_size;
 	int mesh_id;
 
+	TRAVERSAL_COST_DECLARE();
+
 	while (true) {
 		bool inactive = stack_size == 0;
 
@@ -697,6 +769,8 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 
 			tlas_stack_size = -1;
 
+			TRAVERSAL_COST_RESET();
+
 			// Push root on stack
 			stack_size                          = 1;
 			shared_stack[SHARED_STACK_INDEX(0)] = 1;
@@ -741,6 +815,7 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 					bool hit = false;
 
 					for (int j = index; j < index + count; j++) {
+						TRAVERSAL_COST_TRIANGLE();
 						if (triangle_trace_shadow(j, ray, max_distance)) {
 							hit = true;
 
@@ -749,6 +824,8 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 					}
 
 					if (hit) {
+						TRAVERSAL_COST_ADD(ray_buffer_shadow.pixel_state[ray_index], bounce, true);
+
 						stack_size = 0;
 
 						break;
@@ -757,6 +834,7 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 			} else {
 				int child = index;
 
+				TRAVERSAL_COST_NODE();
 				AABBHits aabb_hits = qbvh_node_intersect(qbvh_nodes[child], ray, max_distance);
 				
 				for (int i = 0; i < 4; i++) {
@@ -771,15 +849,24 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 
 			if (stack_size == 0) {
 				// We didn't hit anything, apply illumination
-				int    pixel_index  = ray_buffer_shadow.pixel_index[ray_index];
-				float3 illumination = ray_buffer_shadow.illumination.to_float3(ray_index);
+				unsigned pixel_state  = ray_buffer_shadow.pixel_state[ray_index];
+				int      pixel_index  = Packing::unpack_pixel_index(pixel_state);
+				float3   illumination = ray_buffer_shadow.illumination.to_float3(ray_index);
+
+				TRAVERSAL_COST_ADD(pixel_state, bounce, true);
 
-				if (bounce == 0) {
+				if (Packing::unpack_path_start(pixel_state) > 0) {
+					frame_buffer_add_regenerated(pixel_index, illumination);
+				} else if (bounce == 0) {
 					frame_buffer_direct[pixel_index] += make_float4(illumination);
 				} else {
 					frame_buffer_indirect[pixel_index] += make_float4(illumination);
 				}
 
+#if ENABLE_PATH_GUIDING
+				path_guiding_record_direct(bounce, pixel_index, illumination);
+#endif
+
 				break;
 			}
 		}
@@ -878,7 +965,7 @@ __device__ inline unsigned cwbvh_node_intersect(
 #define N_d 4
 #define N_w 16
 
-__device__ inline void bvh_trace(int ray_count, int * rays_retired) {
+__device__ inline void bvh_trace(int ray_count, int * rays_retired, const int * ray_order, int bounce) {
 	extern __shared__ uint2 shared_stack[];
 
 	uint2 stack[BVH_STACK_SIZE - SHARED_STACK_SIZE];
@@ -896,6 +983,8 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 	int tlas_stack_size;
 	int mesh_id;
 
+	TRAVERSAL_COST_DECLARE();
+
 	while (true) {
 		bool inactive = stack_size == 0 && current_group.y == 0;
 
@@ -903,6 +992,9 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 			ray_index = atomic_agg_inc(rays_retired);
 			if (ray_index >= ray_count) return;
 
+			// Consecutive Rays in the sorted order are handed out to the same Warp
+			if (ray_order) ray_index = ray_order[ray_index];
+
 			ray.origin    = ray_buffer_trace.origin   .to_float3(ray_index);
 			ray.direction = ray_buffer_trace.direction.to_float3(ray_index);
 			ray.calc_direction_inv();
@@ -921,6 +1013,8 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 			ray_hit.triangle_id = -1;
 
 			tlas_stack_size = -1;
+
+			TRAVERSAL_COST_RESET();
 		}
 
 		int iterations_lost = 0;
@@ -955,6 +1049,7 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 				float4 node_3 = __ldg(&cwbvh_nodes[child_node_index].node_3);
 				float4 node_4 = __ldg(&cwbvh_nodes[child_node_index].node_4);
 
+				TRAVERSAL_COST_NODE();
 				unsigned hitmask = cwbvh_node_intersect(ray, oct_inv4, ray_hit.t, node_0, node_1, node_2, node_3, node_4);
 
 				byte imask = extract_byte(float_as_uint(node_0.w), 3);
@@ -1012,6 +1107,7 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 					int triangle_index = msb(triangle_group.y);
 					triangle_group.y &= ~(1 << triangle_index);
 
+					TRAVERSAL_COST_TRIANGLE();
 					triangle_trace(mesh_id, triangle_group.x + triangle_index, ray, ray_hit);
 				}
 			}
@@ -1020,6 +1116,8 @@ __device__ inline void bvh_trace(int ray_count, int * rays_retired) {
 				if (stack_size == 0) {
 					ray_buffer_trace.hits.set(ray_index, ray_hit.mesh_id, ray_hit.triangle_id, ray_hit.t, ray_hit.u, ray_hit.v);
 
+					TRAVERSAL_COST_ADD(ray_buffer_trace.pixel_state[ray_index], bounce, false);
+
 					current_group.y = 0;
 
 					break;
@@ -1068,6 +1166,8 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 	int tlas_stack_size;
 	int mesh_id;
 
+	TRAVERSAL_COST_DECLARE();
+
 	while (true) {
 		bool inactive = stack_size == 0 && current_group.y == 0;
 
@@ -1092,6 +1192,8 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 			max_distance = ray_buffer_shadow.max_distance[ray_index];
 
 			tlas_stack_size = -1;
+
+			TRAVERSAL_COST_RESET();
 		}
 
 		int iterations_lost = 0;
@@ -1126,6 +1228,7 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 				float4 node_3 = cwbvh_nodes[child_node_index].node_3;
 				float4 node_4 = cwbvh_nodes[child_node_index].node_4;
 
+				TRAVERSAL_COST_NODE();
 				unsigned hitmask = cwbvh_node_intersect(ray, oct_inv4, max_distance, node_0, node_1, node_2, node_3, node_4);
 
 				byte imask = extract_byte(float_as_uint(node_0.w), 3);
@@ -1185,6 +1288,7 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 					int triangle_index = msb(triangle_group.y);
 					triangle_group.y &= ~(1 << triangle_index);
 
+					TRAVERSAL_COST_TRIANGLE();
 					if (triangle_trace_shadow(triangle_group.x + triangle_index, ray, max_distance)) {
 						hit = true;
 
@@ -1194,6 +1298,8 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 			}
 
 			if (hit) {
+				TRAVERSAL_COST_ADD(ray_buffer_shadow.pixel_state[ray_index], bounce, true);
+
 				stack_size      = 0;
 				current_group.y = 0;
 
@@ -1203,15 +1309,24 @@ __device__ inline void bvh_trace_shadow(int ray_count, int * rays_retired, int b
 			if ((current_group.y & 0xff000000) == 0) {
 				if (stack_size == 0) {
 					// We didn't hit anything, apply illumination
-					int    pixel_index  = ray_buffer_shadow.pixel_index[ray_index];
-					float3 illumination = ray_buffer_shadow.illumination.to_float3(ray_index);
+					unsigned pixel_state  = ray_buffer_shadow.pixel_state[ray_index];
+					int      pixel_index  = Packing::unpack_pixel_index(pixel_state);
+					float3   illumination = ray_buffer_shadow.illumination.to_float3(ray_index);
+
+					TRAVERSAL_COST_ADD(pixel_state, bounce, true);
 
-					if (bounce == 0) {
+					if (Packing::unpack_path_start(pixel_state) > 0) {
+						frame_buffer_add_regenerated(pixel_index, illumination);
+					} else if (bounce == 0) {
 						frame_buffer_direct[pixel_index] += make_float4(illumination);
 					} else {
 						frame_buffer_indirect[pixel_index] += make_float4(illumination);
 					}
 
+#if ENABLE_PATH_GUIDING
+					path_guiding_record_direct(bounce, pixel_index, illumination);
+#endif
+
 					current_group.y = 0;
 
 					break;
@@ -0,0 +1,123 @@
+#pragma once
+// Joint bilateral upsampling of indirect lighting that was traced at reduced resolution
+// This file is shared between the CUDA files and the C++ files, so that the Host reference produces the same weights
+#include "Common.h"
+#include "Packing.h"
+
+namespace Upsample {
+	// Only one pixel per block of 'factor' x 'factor' pixels traces indirect lighting.
+	// Its position within the block changes every frame so that all pixels are covered over time
+	HOST_DEVICE inline void get_source_offset(int factor, int frame_index, int & offset_x, int & offset_y) {
+		int block_size = factor * factor;
+		int index      = (frame_index * (block_size / 2 + 1)) % block_size; // Step is coprime with the block size
+
+		offset_x = index % factor;
+		offset_y = index / factor;
+	}
+
+	HOST_DEVICE inline bool is_source(int x, int y, int factor, int frame_index) {
+		int offset_x, offset_y;
+		get_source_offset(factor, frame_index, offset_x, offset_y);
+
+		return x % factor == offset_x && y % factor == offset_y;
+	}
+
+	// Weight of a source pixel based on how similar its primary hit is to the primary hit of the pixel being upsampled
+	HOST_DEVICE inline float geometry_weight(const float * guide, const float * guide_source) {
+		float cos_normal = guide[0] * guide_source[0] + guide[1] * guide_source[1] + guide[2] * guide_source[2];
+		if (cos_normal <= 0.0f) return 0.0f;
+
+		float weight_normal = powf(cos_normal, INDIRECT_UPSAMPLE_SIGMA_NORMAL);
+		float weight_depth  = expf(-fabsf(guide[3] - guide_source[3]) / (INDIRECT_UPSAMPLE_SIGMA_DEPTH * guide[3]));
+
+		return weight_normal * weight_depth;
+	}
+
+	// Reconstructs the indirect lighting of pixel (x, y) from the 4x4 nearest source pixels.
+	// All buffers have four floats per pixel. 'guide' holds the normal of the primary hit in xyz and its distance to the Camera in w,
+	// a distance of 0 means the pixel has no diffuse primary hit. Indirect lighting is demodulated by the albedo of the source
+	// and remodulated by the albedo of the pixel, so that texture detail is not blurred
+	HOST_DEVICE inline void upsample_pixel(
+		int x, int y, int width, int height, int pitch,
+		int factor, int frame_index,
+		const float * guide, const float * albedo, const float * indirect,
+		float & result_r, float & result_g, float & result_b
+	) {
+		int offset_x, offset_y;
+		get_source_offset(factor, frame_index, offset_x, offset_y);
+
+		// Top left source of the 4x4 neighbourhood
+		int base_x = x - (x - offset_x + factor) % factor - factor;
+		int base_y = y - (y - offset_y + factor) % factor - factor;
+
+		const float * guide_pixel = guide + 4 * (x + y * pitch);
+
+		float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f, sum_weight = 0.0f;
+		float fallback_r = 0.0f, fallback_g = 0.0f, fallback_b = 0.0f, fallback_weight = 0.0f;
+
+		float inv_extent = 1.0f / float(2 * factor);
+
+		for (int j = 0; j < 4; j++) {
+			int source_y = base_y + j * factor;
+			if (source_y < 0 || source_y >= height) continue;
+
+			for (int i = 0; i < 4; i++) {
+				int source_x = base_x + i * factor;
+				if (source_x < 0 || source_x >= width) continue;
+
+				int source_index = source_x + source_y * pitch;
+
+				const float * guide_source = guide + 4 * source_index;
+				if (guide_source[3] == 0.0f) continue; // Source did not trace a diffuse path
+
+				// Tent filter that spans two source spacings in every direction
+				float weight_spatial =
+					(1.0f - fabsf(float(source_x - x)) * inv_extent) *
+					(1.0f - fabsf(float(source_y - y)) * inv_extent);
+
+				const float * albedo_source   = albedo   + 4 * source_index;
+				const float * indirect_source = indirect + 4 * source_index;
+
+				float demodulated_r = indirect_source[0] / fmaxf(albedo_source[0], 1e-8f);
+				float demodulated_g = indirect_source[1] / fmaxf(albedo_source[1], 1e-8f);
+				float demodulated_b = indirect_source[2] / fmaxf(albedo_source[2], 1e-8f);
+
+				float weight = weight_spatial * geometry_weight(guide_pixel, guide_source);
+
+				sum_r      += weight * demodulated_r;
+				sum_g      += weight * demodulated_g;
+				sum_b      += weight * demodulated_b;
+				sum_weight += weight;
+
+				fallback_r      += weight_spatial * demodulated_r;
+				fallback_g      += weight_spatial * demodulated_g;
+				fallback_b      += weight_spatial * demodulated_b;
+				fallback_weight += weight_spatial;
+			}
+		}
+
+		// If no source has similar geometry, fall back to purely spatial weights rather than losing the lighting
+		if (sum_weight < 1e-6f) {
+			sum_r      = fallback_r;
+			sum_g      = fallback_g;
+			sum_b      = fallback_b;
+			sum_weight = fallback_weight;
+		}
+
+		if (sum_weight == 0.0f) {
+			result_r = 0.0f;
+			result_g = 0.0f;
+			result_b = 0.0f;
+
+			return;
+		}
+
+		const float * albedo_pixel = albedo + 4 * (x + y * pitch);
+
+		float inv_sum_weight = 1.0f / sum_weight;
+
+		result_r = sum_r * inv_sum_weight * albedo_pixel[0];
+		result_g = sum_g * inv_sum_weight * albedo_pixel[1];
+		result_b = sum_b * inv_sum_weight * albedo_pixel[2];
+	}
+}
@@ -32,13 +32,9 @@ public:
 	inline void init(CWBVH * cwbvh, const BVH & bvh) {
 		this->cwbvh = cwbvh;
 
+		// The Nodes and indices of the CWBVH are allocated by build()
 		cost      = new float   [bvh.node_count * 7];
 		decisions = new Decision[bvh.node_count * 7];
-
-		cwbvh->index_count = bvh.index_count;
-		cwbvh->indices     = bvh.indices;
-		cwbvh->node_count  = bvh.node_count;
-		cwbvh->nodes       = new CWBVHNode[cwbvh->node_count];
 	}
 
 	inline void free() {
@@ -0,0 +1,132 @@
+#include "CountingSort.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "CUDA_Source/Common.h"
+
+void CountingSort::sort(const int * keys, int count, int key_count, int * indices) {
+	int * offsets = new int[key_count + 1];
+	memset(offsets, 0, (key_count + 1) * sizeof(int));
+
+	// Build histogram
+	for (int i = 0; i < count; i++) {
+		assert(keys[i] >= 0 && keys[i] < key_count);
+
+		offsets[keys[i] + 1]++;
+	}
+
+	// Exclusive prefix sum
+	for (int k = 0; k < key_count; k++) {
+		offsets[k + 1] += offsets[k];
+	}
+
+	// Scatter, iterating in order keeps the sort stable
+	for (int i = 0; i < count; i++) {
+		indices[offsets[keys[i]]++] = i;
+	}
+
+	delete [] offsets;
+}
+
+bool CountingSort::is_sorted_permutation(const int * keys, int count, int key_count, const int * indices) {
+	bool * visited = new bool[count];
+	memset(visited, false, count * sizeof(bool));
+
+	bool result = true;
+
+	for (int i = 0; i < count; i++) {
+		int index = indices[i];
+
+		if (index < 0 || index >= count || visited[index]) {
+			result = false;
+			break;
+		}
+		visited[index] = true;
+
+		int key = keys[index];
+		if (key < 0 || key >= key_count || (i > 0 && keys[indices[i - 1]] > key)) {
+			result = false;
+			break;
+		}
+	}
+
+	delete [] visited;
+
+	return result;
+}
+
+float CountingSort::distinct_keys_per_warp(const int * keys, int count, const int * indices) {
+	if (count == 0) return 0.0f;
+
+	int warp_count     = (count + WARP_SIZE - 1) / WARP_SIZE;
+	int distinct_total = 0;
+
+	for (int w = 0; w < warp_count; w++) {
+		int lane_keys[WARP_SIZE];
+		int lane_count = 0;
+
+		int first = w * WARP_SIZE;
+		int last  = first + WARP_SIZE < count ? first + WARP_SIZE : count;
+
+		for (int i = first; i < last; i++) {
+			int key = keys[indices ? indices[i] : i];
+
+			bool seen = false;
+			for (int j = 0; j < lane_count; j++) {
+				if (lane_keys[j] == key) {
+					seen = true;
+					break;
+				}
+			}
+
+			if (!seen) lane_keys[lane_count++] = key;
+		}
+
+		distinct_total += lane_count;
+	}
+
+	return float(distinct_total) / float(warp_count);
+}
+
+void CountingSort::compact(const int * keys, int count, int key_count, int block_size, int * destinations, int * sizes) {
+	int block_count = (count + block_size - 1) / block_size;
+
+	int * block_offsets = new int[block_count * key_count];
+	memset(block_offsets, 0, block_count * key_count * sizeof(int));
+
+	// Histogram per block
+	for (int i = 0; i < count; i++) {
+		int key = keys[i];
+		if (key >= 0 && key < key_count) block_offsets[(i / block_size) * key_count + key]++;
+	}
+
+	// Exclusive prefix sum over the blocks, separately for every key
+	for (int k = 0; k < key_count; k++) {
+		int sum = 0;
+		for (int b = 0; b < block_count; b++) {
+			int block_count_key = block_offsets[b * key_count + k];
+			block_offsets[b * key_count + k] = sum;
+			sum += block_count_key;
+		}
+		sizes[k] = sum;
+	}
+
+	// Scatter, within a block the elements are ranked in order
+	for (int b = 0; b < block_count; b++) {
+		int first = b * block_size;
+		int last  = first + block_size < count ? first + block_size : count;
+
+		for (int i = first; i < last; i++) {
+			int key = keys[i];
+
+			if (key >= 0 && key < key_count) {
+				destinations[i] = block_offsets[b * key_count + key]++;
+			} else {
+				destinations[i] = -1;
+			}
+		}
+	}
+
+	delete [] block_offsets;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Host side reference implementation of the key sorts performed on the Device,
+// used to validate the Device results and to measure how coherent a sorted buffer is
+namespace CountingSort {
+	// Stable counting sort of 'count' keys in the range [0, key_count)
+	// After sorting, keys[indices[i]] <= keys[indices[i + 1]] for all i
+	void sort(const int * keys, int count, int key_count, int * indices);
+
+	// Checks whether 'indices' is a permutation of [0, count) that orders the keys,
+	// the order within a group of equal keys is not required to match the stable order
+	bool is_sorted_permutation(const int * keys, int count, int key_count, const int * indices);
+
+	// Average number of distinct keys per Warp when the keys are visited in the order given by 'indices'
+	// If 'indices' is nullptr the keys are visited in their original order
+	float distinct_keys_per_warp(const int * keys, int count, const int * indices = nullptr);
+
+	// Reference of the queue compaction on the Device: a histogram of the keys per block of 'block_size' elements,
+	// an exclusive prefix sum over the blocks per key, and a scatter that ranks the elements within their block.
+	// Elements with a key outside [0, key_count) are dropped. 'destinations' receives the position of every element
+	// within the queue of its key, or -1 if it was dropped, and 'sizes' receives the size of every queue
+	void compact(const int * keys, int count, int key_count, int block_size, int * destinations, int * sizes);
+}
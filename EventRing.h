@@ -0,0 +1,155 @@
+#pragma once
+#include <vector>
+#include <cassert>
+
+// Named section of a frame, it lasts until the next Event is recorded
+struct EventDesc {
+	const char * category;
+	const char * name;
+
+	inline void init(const char * category, const char * name) {
+		this->category = category;
+		this->name     = name;
+	}
+};
+
+// Records timing Events into one of FRAME_COUNT per-frame slots, and only reads a slot back once its last Event has completed.
+// Querying elapsed time of an Event that was just recorded forces the Host to wait for the Device,
+// by reading the results a few frames later the profiler does not serialize Host and Device work.
+//
+// 'Timer' is the backend that provides the actual Events, it should have the following members:
+//	typedef ... Event;
+//	Event create();
+//	void  destroy(Event event);
+//	void  record(Event event);
+//	bool  is_complete(Event event); // Must not block
+//	void  synchronize(Event event);
+//	float time_elapsed_between(Event start, Event end); // In milliseconds
+template<typename Timer>
+struct EventRing {
+	static constexpr int FRAME_COUNT = 3;
+
+	Timer timer;
+
+	// Timings of the most recent frame that completed on the Device
+	struct Timings {
+		int frame = -1; // -1 if no frame has completed yet
+
+		std::vector<const EventDesc *> events;
+		std::vector<float>             times; // Time between Event i and Event i + 1, there is one less time than there are Events
+	} timings;
+
+private:
+	typedef typename Timer::Event Event;
+
+	struct Frame {
+		std::vector<Event>             events; // Grows as needed, Events are reused between frames
+		std::vector<const EventDesc *> descs;
+
+		int event_count;
+		int frame;
+
+		bool pending; // Recorded but not yet read back
+	} frames[FRAME_COUNT];
+
+	int frame_current;
+
+	inline void resolve(Frame & frame) {
+		timings.frame = frame.frame;
+		timings.events.assign(frame.descs.begin(), frame.descs.begin() + frame.event_count);
+		timings.times.clear();
+
+		for (int i = 0; i < frame.event_count - 1; i++) {
+			timings.times.push_back(timer.time_elapsed_between(frame.events[i], frame.events[i + 1]));
+		}
+
+		frame.pending = false;
+	}
+
+	inline Frame & get_frame(int frame) {
+		return frames[frame % FRAME_COUNT];
+	}
+
+public:
+	inline void init(const Timer & timer = Timer()) {
+		this->timer = timer;
+
+		for (int i = 0; i < FRAME_COUNT; i++) {
+			frames[i].event_count = 0;
+			frames[i].frame       = -1;
+			frames[i].pending     = false;
+		}
+
+		frame_current = 0;
+	}
+
+	inline void free() {
+		for (int i = 0; i < FRAME_COUNT; i++) {
+			for (Event event : frames[i].events) {
+				timer.destroy(event);
+			}
+			frames[i].events.clear();
+			frames[i].descs .clear();
+		}
+	}
+
+	// Reads back all previous frames that have completed, then starts recording into the slot of the current frame
+	inline void begin_frame() {
+		for (int f = frame_current - FRAME_COUNT; f < frame_current; f++) {
+			if (f < 0) continue;
+
+			Frame & frame = get_frame(f);
+			if (!frame.pending) continue;
+
+			// Frames complete in order, if this one has not completed the later ones have not either
+			if (frame.event_count > 0 && !timer.is_complete(frame.events[frame.event_count - 1])) break;
+
+			resolve(frame);
+		}
+
+		Frame & frame = get_frame(frame_current);
+
+		// Only happens if the Device is FRAME_COUNT frames behind the Host
+		if (frame.pending) {
+			if (frame.event_count > 0) timer.synchronize(frame.events[frame.event_count - 1]);
+
+			resolve(frame);
+		}
+
+		frame.event_count = 0;
+		frame.frame       = frame_current;
+	}
+
+	inline void record(const EventDesc & desc) {
+		Frame & frame = get_frame(frame_current);
+
+		if (frame.event_count == int(frame.events.size())) {
+			frame.events.push_back(timer.create());
+			frame.descs .push_back(nullptr);
+		}
+
+		timer.record(frame.events[frame.event_count]);
+		frame.descs[frame.event_count] = &desc;
+		frame.event_count++;
+	}
+
+	inline void end_frame() {
+		get_frame(frame_current).pending = true;
+
+		frame_current++;
+	}
+
+	// Blocks until the last Event recorded so far has completed, and returns the time since the first Event of the current frame.
+	// Only meant for measurements that already synchronize with the Device
+	inline float time_elapsed_in_frame() {
+		Frame & frame = get_frame(frame_current);
+		assert(frame.event_count > 0);
+
+		Event first = frame.events[0];
+		Event last  = frame.events[frame.event_count - 1];
+
+		timer.synchronize(last);
+
+		return timer.time_elapsed_between(first, last);
+	}
+};
@@ -0,0 +1,239 @@
+#include "FlatScene.h"
+
+#include <algorithm>
+
+#include "MeshData.h"
+#include "Material.h"
+#include "Texture.h"
+
+#include "Math.h"
+
+// Number of elements that are processed per task
+static constexpr int CHUNK_SIZE = 16 * 1024;
+
+struct Chunk {
+	int mesh_data_index;
+	int first;
+	int count;
+};
+
+// Splits the elements of every MeshData into Chunks, so that large MeshDatas are processed by multiple threads
+template<typename GetCount>
+static std::vector<Chunk> get_chunks(int mesh_data_count, GetCount get_count) {
+	std::vector<Chunk> chunks;
+
+	for (int m = 0; m < mesh_data_count; m++) {
+		int count = get_count(MeshData::mesh_datas[m]);
+
+		for (int first = 0; first < count; first += CHUNK_SIZE) {
+			chunks.push_back({ m, first, Math::min(CHUNK_SIZE, count - first) });
+		}
+	}
+
+	return chunks;
+}
+
+void FlatScene::init(int bvh_node_offset, ThreadPool & thread_pool) {
+	mesh_data_count = MeshData::mesh_datas.size();
+
+	mesh_data_bvh_offsets      = new int[mesh_data_count];
+	mesh_data_index_offsets    = new int[mesh_data_count];
+	mesh_data_triangle_offsets = new int[mesh_data_count];
+
+	bvh_node_count = bvh_node_offset;
+	index_count    = 0;
+	triangle_count = 0;
+
+	for (int m = 0; m < mesh_data_count; m++) {
+		mesh_data_bvh_offsets     [m] = bvh_node_count;
+		mesh_data_index_offsets   [m] = index_count;
+		mesh_data_triangle_offsets[m] = triangle_count;
+
+		bvh_node_count += MeshData::mesh_datas[m]->bvh.node_count;
+		index_count    += MeshData::mesh_datas[m]->bvh.index_count;
+		triangle_count += MeshData::mesh_datas[m]->triangle_count;
+	}
+
+	bvh_nodes = new BVHNodeType[bvh_node_count];
+
+	triangles             = new CUDATriangle[index_count];
+	triangle_material_ids = new int         [index_count];
+	triangle_lods         = new float       [index_count];
+
+	reverse_indices = new int[triangle_count];
+
+	// Copy BVH Nodes, offsetting their child and Triangle indices
+	std::vector<Chunk> node_chunks = get_chunks(mesh_data_count, [](const MeshData * mesh_data) { return mesh_data->bvh.node_count; });
+
+	thread_pool.parallel_for(node_chunks.size(), [&](int chunk_index, int) {
+		const Chunk    & chunk     = node_chunks[chunk_index];
+		const MeshData * mesh_data = MeshData::mesh_datas[chunk.mesh_data_index];
+
+		int bvh_offset   = mesh_data_bvh_offsets  [chunk.mesh_data_index];
+		int index_offset = mesh_data_index_offsets[chunk.mesh_data_index];
+
+		for (int n = chunk.first; n < chunk.first + chunk.count; n++) {
+			BVHNodeType & node = bvh_nodes[bvh_offset + n];
+
+			node = mesh_data->bvh.nodes[n];
+
+#if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
+			if (node.is_leaf()) {
+				node.first += index_offset;
+			} else {
+				node.left += bvh_offset;
+			}
+#elif BVH_TYPE == BVH_QBVH
+			int child_count = node.get_child_count();
+			for (int c = 0; c < child_count; c++) {
+				if (node.is_leaf(c)) {
+					node.get_index(c) += index_offset;
+				} else {
+					node.get_index(c) += bvh_offset;
+				}
+			}
+#elif BVH_TYPE == BVH_CWBVH
+			node.base_index_child    += bvh_offset;
+			node.base_index_triangle += index_offset;
+#endif
+		}
+	});
+
+	// Convert Triangles to the Device layout, in BVH order
+	std::vector<Chunk> index_chunks = get_chunks(mesh_data_count, [](const MeshData * mesh_data) { return mesh_data->bvh.index_count; });
+
+	thread_pool.parallel_for(index_chunks.size(), [&](int chunk_index, int) {
+		const Chunk    & chunk     = index_chunks[chunk_index];
+		const MeshData * mesh_data = MeshData::mesh_datas[chunk.mesh_data_index];
+
+		int index_offset = mesh_data_index_offsets[chunk.mesh_data_index];
+
+		for (int i = chunk.first; i < chunk.first + chunk.count; i++) {
+			const Triangle & triangle        = mesh_data->triangles[mesh_data->bvh.indices[i]];
+			CUDATriangle   & triangle_device = triangles[index_offset + i];
+
+			triangle_device.position_0      = triangle.position_0;
+			triangle_device.position_edge_1 = triangle.position_1 - triangle.position_0;
+			triangle_device.position_edge_2 = triangle.position_2 - triangle.position_0;
+
+			triangle_device.normal_0      = triangle.normal_0;
+			triangle_device.normal_edge_1 = triangle.normal_1 - triangle.normal_0;
+			triangle_device.normal_edge_2 = triangle.normal_2 - triangle.normal_0;
+
+			triangle_device.tex_coord_0      = triangle.tex_coord_0;
+			triangle_device.tex_coord_edge_1 = triangle.tex_coord_1 - triangle.tex_coord_0;
+			triangle_device.tex_coord_edge_2 = triangle.tex_coord_2 - triangle.tex_coord_0;
+
+			int material_id = mesh_data->material_offset + triangle.material_id;
+			triangle_material_ids[index_offset + i] = material_id;
+
+			int texture_id = Material::materials[material_id].texture_id;
+			if (texture_id != -1) {
+				const Texture & texture = Texture::textures[texture_id];
+
+				// Triangle texture base LOD as described in "Texture Level of Detail Strategies for Real-Time Ray Tracing"
+				float t_a = float(texture.width * texture.height) * fabsf(
+					triangle_device.tex_coord_edge_1.x * triangle_device.tex_coord_edge_2.y -
+					triangle_device.tex_coord_edge_2.x * triangle_device.tex_coord_edge_1.y
+				);
+				float p_a = Vector3::length(Vector3::cross(triangle_device.position_edge_1, triangle_device.position_edge_2));
+
+				triangle_lods[index_offset + i] = 0.5f * log2f(t_a / p_a);
+			} else {
+				triangle_lods[index_offset + i] = 0.0f;
+			}
+		}
+	});
+
+	// Spatial splits can reference a Triangle multiple times, the last reference is used.
+	// MeshDatas are processed as a whole so that the result does not depend on scheduling
+	thread_pool.parallel_for(mesh_data_count, [&](int m, int) {
+		const MeshData * mesh_data = MeshData::mesh_datas[m];
+
+		int index_offset    = mesh_data_index_offsets   [m];
+		int triangle_offset = mesh_data_triangle_offsets[m];
+
+		for (int i = 0; i < mesh_data->bvh.index_count; i++) {
+			reverse_indices[triangle_offset + mesh_data->bvh.indices[i]] = index_offset + i;
+		}
+	});
+}
+
+void FlatScene::init_lights(ThreadPool & thread_pool) {
+	struct LightTriangle {
+		int   index;
+		float area;
+	};
+	std::vector<std::vector<LightTriangle>> light_triangles(mesh_data_count);
+
+	// Find the Light Triangles of every MeshData and sort them on area
+	thread_pool.parallel_for(mesh_data_count, [&](int m, int) {
+		const MeshData * mesh_data = MeshData::mesh_datas[m];
+
+		for (int t = 0; t < mesh_data->triangle_count; t++) {
+			const Triangle & triangle = mesh_data->triangles[t];
+
+			if (Material::materials[mesh_data->material_offset + triangle.material_id].type == Material::Type::LIGHT) {
+				float area = 0.5f * Vector3::length(Vector3::cross(
+					triangle.position_1 - triangle.position_0,
+					triangle.position_2 - triangle.position_0
+				));
+
+				light_triangles[m].push_back({ reverse_indices[mesh_data_triangle_offsets[m] + t], area });
+			}
+		}
+
+		std::sort(light_triangles[m].begin(), light_triangles[m].end(), [](const LightTriangle & a, const LightTriangle & b) { return a.area < b.area; });
+	});
+
+	light_meshes.clear();
+	light_mesh_data_indices.assign(mesh_data_count, -1);
+
+	int light_triangle_count = 0;
+
+	for (int m = 0; m < mesh_data_count; m++) {
+		if (light_triangles[m].empty()) continue;
+
+		light_mesh_data_indices[m] = light_meshes.size();
+
+		LightMesh & light_mesh = light_meshes.emplace_back();
+		light_mesh.triangle_first_index = light_triangle_count;
+		light_mesh.triangle_count       = light_triangles[m].size();
+
+		light_triangle_count += light_mesh.triangle_count;
+	}
+
+	light_indices         .resize(light_triangle_count);
+	light_areas_cumulative.resize(light_triangle_count);
+
+	thread_pool.parallel_for(mesh_data_count, [&](int m, int) {
+		if (light_mesh_data_indices[m] == -1) return;
+
+		LightMesh & light_mesh = light_meshes[light_mesh_data_indices[m]];
+
+		float cumulative_area = 0.0f;
+
+		for (int i = 0; i < light_mesh.triangle_count; i++) {
+			light_indices[light_mesh.triangle_first_index + i] = light_triangles[m][i].index;
+
+			cumulative_area += light_triangles[m][i].area;
+			light_areas_cumulative[light_mesh.triangle_first_index + i] = cumulative_area;
+		}
+
+		light_mesh.area = cumulative_area;
+	});
+}
+
+void FlatScene::free() {
+	delete [] mesh_data_bvh_offsets;
+	delete [] mesh_data_index_offsets;
+	delete [] mesh_data_triangle_offsets;
+
+	delete [] bvh_nodes;
+
+	delete [] triangles;
+	delete [] triangle_material_ids;
+	delete [] triangle_lods;
+
+	delete [] reverse_indices;
+}
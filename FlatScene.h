@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+
+#include "BVH.h"
+#include "ThreadPool.h"
+
+// Triangle as it is stored on the Device, with edges instead of the second and third vertex
+struct CUDATriangle {
+	Vector3 position_0;
+	Vector3 position_edge_1;
+	Vector3 position_edge_2;
+
+	Vector3 normal_0;
+	Vector3 normal_edge_1;
+	Vector3 normal_edge_2;
+
+	Vector2 tex_coord_0;
+	Vector2 tex_coord_edge_1;
+	Vector2 tex_coord_edge_2;
+};
+
+// The geometry of all MeshDatas concatenated into the layout that is uploaded to the Device.
+// Every buffer is written once, in its final layout, by parallel loops over the ThreadPool
+struct FlatScene {
+	int mesh_data_count;
+
+	int * mesh_data_bvh_offsets;      // Index of the root Node of every MeshData in 'bvh_nodes'
+	int * mesh_data_index_offsets;    // Index of the first Triangle of every MeshData in 'triangles'
+	int * mesh_data_triangle_offsets; // Index of the first Triangle of every MeshData when all MeshData Triangles are concatenated
+
+	int           bvh_node_count;
+	BVHNodeType * bvh_nodes;
+
+	// Indexed in BVH order
+	int            index_count;
+	CUDATriangle * triangles;
+	int          * triangle_material_ids;
+	float        * triangle_lods;
+
+	// Maps the concatenated MeshData Triangles to their index in 'triangles'
+	int   triangle_count;
+	int * reverse_indices;
+
+	struct LightMesh {
+		int triangle_first_index;
+		int triangle_count;
+
+		float area;
+	};
+	std::vector<LightMesh> light_meshes;
+
+	std::vector<int> light_mesh_data_indices; // Index into 'light_meshes' for every MeshData, -1 if the MeshData has no Lights
+
+	// Light Triangles of every LightMesh, sorted on area
+	std::vector<int>   light_indices;
+	std::vector<float> light_areas_cumulative;
+
+	// The first 'bvh_node_offset' Nodes are left free, they are reserved for the TLAS
+	void init(int bvh_node_offset, ThreadPool & thread_pool);
+	void init_lights(ThreadPool & thread_pool);
+
+	void free();
+};
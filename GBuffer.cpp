@@ -5,8 +5,62 @@
 
 #include <GL/glew.h>
 
+#include "MeshData.h"
+
 #include "Util.h"
 
+struct Vertex {
+	Vector3 position;
+	Vector3 normal;
+	Vector2 uv;
+	int     triangle_id;
+};
+
+void GBuffer::init_mesh_datas(const int * reverse_indices, const int * mesh_data_triangle_offsets) {
+	int mesh_data_count = MeshData::mesh_datas.size();
+	mesh_data_vbos.resize(mesh_data_count);
+
+	glGenBuffers(mesh_data_count, mesh_data_vbos.data());
+
+	for (int m = 0; m < mesh_data_count; m++) {
+		const MeshData * mesh_data      = MeshData::mesh_datas[m];
+		const int      * triangle_ids   = reverse_indices + mesh_data_triangle_offsets[m];
+
+		int      vertex_count = mesh_data->triangle_count * 3;
+		Vertex * vertices     = new Vertex[vertex_count];
+
+		for (int t = 0; t < mesh_data->triangle_count; t++) {
+			const Triangle & triangle = mesh_data->triangles[t];
+
+			int index_0 = 3 * t;
+			int index_1 = 3 * t + 1;
+			int index_2 = 3 * t + 2;
+
+			vertices[index_0].position = triangle.position_0;
+			vertices[index_1].position = triangle.position_1;
+			vertices[index_2].position = triangle.position_2;
+
+			vertices[index_0].normal = triangle.normal_0;
+			vertices[index_1].normal = triangle.normal_1;
+			vertices[index_2].normal = triangle.normal_2;
+
+			// Barycentric coordinates
+			vertices[index_0].uv = Vector2(0.0f, 0.0f);
+			vertices[index_1].uv = Vector2(1.0f, 0.0f);
+			vertices[index_2].uv = Vector2(0.0f, 1.0f);
+
+			vertices[index_0].triangle_id = triangle_ids[t];
+			vertices[index_1].triangle_id = triangle_ids[t];
+			vertices[index_2].triangle_id = triangle_ids[t];
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_data_vbos[m]);
+		glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+
+		delete [] vertices;
+	}
+}
+
 void GBuffer::resize(int width, int height) {
 	// Clean up previous GBuffer if it exists
 	if (gbuffer) {
@@ -122,4 +176,15 @@ void GBuffer::bind() {
 
 void GBuffer::unbind() {
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+void GBuffer::render_mesh_data(int mesh_data_index) const {
+	glBindBuffer(GL_ARRAY_BUFFER, mesh_data_vbos[mesh_data_index]);
+
+	glVertexAttribPointer (0, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, position)));
+	glVertexAttribPointer (1, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, normal)));
+	glVertexAttribPointer (2, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, uv)));
+	glVertexAttribIPointer(3, 1, GL_INT,          sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, triangle_id)));
+
+	glDrawArrays(GL_TRIANGLES, 0, MeshData::mesh_datas[mesh_data_index]->triangle_count * 3);
 }
\ No newline at end of file
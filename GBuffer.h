@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 
 struct GBuffer {
 	unsigned gbuffer = 0;
@@ -11,8 +12,16 @@ struct GBuffer {
 	unsigned buffer_z_gradient;
 	unsigned buffer_depth;
 
+	std::vector<unsigned> mesh_data_vbos; // One Vertex Buffer per MeshData
+
+	// Creates Vertex Buffers for all MeshDatas, 'reverse_indices' maps the Triangles of every MeshData
+	// (starting at mesh_data_triangle_offsets) to the global Triangle index that is written to the GBuffer
+	void init_mesh_datas(const int * reverse_indices, const int * mesh_data_triangle_offsets);
+
 	void resize(int width, int height);
 
 	void bind();
 	void unbind();
+
+	void render_mesh_data(int mesh_data_index) const;
 };
@@ -0,0 +1,499 @@
+#include "GBufferCPU.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "MeshData.h"
+
+#include "Math.h"
+
+// Size of the screen space tiles that Triangles are binned into, each tile is rasterized by a single thread
+#define TILE_SIZE 32
+
+// Number of Triangles that are transformed and binned per task
+#define SETUP_BATCH_SIZE 4096
+
+// Transforms a Vector3 as if the fourth coordinate is 1, keeping the resulting fourth coordinate
+static Vector4 transform_position(const Matrix4 & matrix, const Vector3 & position) {
+	return Vector4(
+		matrix(0, 0) * position.x + matrix(0, 1) * position.y + matrix(0, 2) * position.z + matrix(0, 3),
+		matrix(1, 0) * position.x + matrix(1, 1) * position.y + matrix(1, 2) * position.z + matrix(1, 3),
+		matrix(2, 0) * position.x + matrix(2, 1) * position.y + matrix(2, 2) * position.z + matrix(2, 3),
+		matrix(3, 0) * position.x + matrix(3, 1) * position.y + matrix(3, 2) * position.z + matrix(3, 3)
+	);
+}
+
+// Same encoding as oct_encode_normal in primary_fragment.glsl
+static Vector2 oct_encode_normal(const Vector3 & normal) {
+	float inv_l1_norm = 1.0f / (fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z));
+
+	float x = normal.x * inv_l1_norm;
+	float y = normal.y * inv_l1_norm;
+
+	if (normal.z < 0.0f) {
+		float x_wrapped = (1.0f - fabsf(y)) * (x >= 0.0f ? +1.0f : -1.0f);
+		float y_wrapped = (1.0f - fabsf(x)) * (y >= 0.0f ? +1.0f : -1.0f);
+
+		x = x_wrapped;
+		y = y_wrapped;
+	}
+
+	return Vector2(x * 0.5f + 0.5f, y * 0.5f + 0.5f);
+}
+
+void GBufferCPU::init(const int * triangle_ids, int triangle_count, const int * mesh_data_triangle_offsets, int mesh_data_count) {
+	this->triangle_ids               = new int[triangle_count];
+	this->mesh_data_triangle_offsets = new int[mesh_data_count];
+
+	memcpy(this->triangle_ids,               triangle_ids,               triangle_count  * sizeof(int));
+	memcpy(this->mesh_data_triangle_offsets, mesh_data_triangle_offsets, mesh_data_count * sizeof(int));
+
+	width  = 0;
+	height = 0;
+
+	normal_and_depth        = nullptr;
+	uv                      = nullptr;
+	uv_gradient             = nullptr;
+	mesh_id_and_triangle_id = nullptr;
+	motion                  = nullptr;
+	depth_gradient          = nullptr;
+
+	thread_count = 0;
+
+	thread_triangles = nullptr;
+	thread_bins      = nullptr;
+	tile_depths      = nullptr;
+	tile_triangles   = nullptr;
+}
+
+void GBufferCPU::free() {
+	resize(0, 0);
+
+	delete [] triangle_ids;
+	delete [] mesh_data_triangle_offsets;
+}
+
+void GBufferCPU::resize(int width, int height) {
+	this->width  = width;
+	this->height = height;
+
+	delete [] normal_and_depth;
+	delete [] uv;
+	delete [] uv_gradient;
+	delete [] mesh_id_and_triangle_id;
+	delete [] motion;
+	delete [] depth_gradient;
+
+	int pixel_count = width * height;
+
+	if (pixel_count > 0) {
+		normal_and_depth        = new Vector4[pixel_count];
+		uv                      = new Vector2[pixel_count];
+		uv_gradient             = new Vector4[pixel_count];
+		mesh_id_and_triangle_id = new int    [pixel_count * 2];
+		motion                  = new Vector2[pixel_count];
+		depth_gradient          = new Vector2[pixel_count];
+	} else {
+		normal_and_depth        = nullptr;
+		uv                      = nullptr;
+		uv_gradient             = nullptr;
+		mesh_id_and_triangle_id = nullptr;
+		motion                  = nullptr;
+		depth_gradient          = nullptr;
+	}
+
+	tile_count_x = Math::divide_round_up(width,  TILE_SIZE);
+	tile_count_y = Math::divide_round_up(height, TILE_SIZE);
+
+	// The number of bins depends on the tile count, the per thread buffers are reallocated on the next render
+	delete [] thread_triangles;
+	delete [] thread_bins;
+	delete [] tile_depths;
+	delete [] tile_triangles;
+
+	thread_count = 0;
+
+	thread_triangles = nullptr;
+	thread_bins      = nullptr;
+	tile_depths      = nullptr;
+	tile_triangles   = nullptr;
+}
+
+void GBufferCPU::render(const Scene & scene, const int * mesh_order, ThreadPool & thread_pool) {
+	int tile_count = tile_count_x * tile_count_y;
+	if (tile_count == 0) return;
+
+	if (thread_count != thread_pool.thread_count) {
+		delete [] thread_triangles;
+		delete [] thread_bins;
+		delete [] tile_depths;
+		delete [] tile_triangles;
+
+		thread_count = thread_pool.thread_count;
+
+		thread_triangles = new std::vector<RasterTriangle>[thread_count];
+		thread_bins      = new std::vector<int>           [thread_count * tile_count];
+		tile_depths      = new float                      [thread_count * TILE_SIZE * TILE_SIZE];
+		tile_triangles   = new const RasterTriangle *     [thread_count * TILE_SIZE * TILE_SIZE];
+	}
+
+	// Combine the Camera and Mesh transforms, and find where the Triangles of each Mesh start
+	mesh_view_projections     .resize(scene.mesh_count);
+	mesh_view_projections_prev.resize(scene.mesh_count);
+	mesh_triangle_offsets     .resize(scene.mesh_count + 1);
+
+	mesh_triangle_offsets[0] = 0;
+
+	for (int m = 0; m < scene.mesh_count; m++) {
+		const Mesh & mesh = scene.meshes[mesh_order[m]];
+
+		mesh_view_projections     [m] = scene.camera.view_projection      * mesh.transform;
+		mesh_view_projections_prev[m] = scene.camera.view_projection_prev * mesh.transform_prev;
+
+		mesh_triangle_offsets[m + 1] = mesh_triangle_offsets[m] + MeshData::mesh_datas[mesh.mesh_data_index_lod]->triangle_count;
+	}
+
+	// Clear the Triangle lists and bins, their capacity is kept between frames
+	for (int t = 0; t < thread_count; t++) {
+		thread_triangles[t].clear();
+	}
+	for (int i = 0; i < thread_count * tile_count; i++) {
+		thread_bins[i].clear();
+	}
+
+	int triangle_count = mesh_triangle_offsets[scene.mesh_count];
+
+	thread_pool.parallel_for(Math::divide_round_up(triangle_count, SETUP_BATCH_SIZE), [&](int batch, int thread_index) {
+		int first = batch * SETUP_BATCH_SIZE;
+		int last  = Math::min(first + SETUP_BATCH_SIZE, triangle_count);
+
+		setup_triangles(scene, mesh_order, first, last, thread_index);
+	});
+
+	thread_pool.parallel_for(tile_count, [&](int tile_index, int thread_index) {
+		rasterize_tile(scene, mesh_order, tile_index, thread_index);
+	});
+}
+
+void GBufferCPU::setup_triangles(const Scene & scene, const int * mesh_order, int first, int last, int thread_index) {
+	std::vector<RasterTriangle> & triangles = thread_triangles[thread_index];
+	std::vector<int>            * bins      = thread_bins + thread_index * tile_count_x * tile_count_y;
+
+	const Vector2 & jitter = scene.camera.jitter;
+
+	// Find the Mesh that contains the first Triangle of the range
+	int m = int(std::upper_bound(mesh_triangle_offsets.begin(), mesh_triangle_offsets.end(), first) - mesh_triangle_offsets.begin()) - 1;
+
+	for (int i = first; i < last; i++) {
+		while (i >= mesh_triangle_offsets[m + 1]) m++;
+
+		const Mesh     & mesh      = scene.meshes[mesh_order[m]];
+		const MeshData * mesh_data = MeshData::mesh_datas[mesh.mesh_data_index_lod];
+
+		int triangle_index = i - mesh_triangle_offsets[m];
+
+		const Triangle & triangle = mesh_data->triangles[triangle_index];
+
+		Vector4 clip[3] = {
+			transform_position(mesh_view_projections[m], triangle.position_0),
+			transform_position(mesh_view_projections[m], triangle.position_1),
+			transform_position(mesh_view_projections[m], triangle.position_2)
+		};
+
+		// Apply jitter the same way as the primary vertex shader
+		for (int v = 0; v < 3; v++) {
+			clip[v].x += jitter.x * clip[v].w;
+			clip[v].y += jitter.y * clip[v].w;
+		}
+
+		// Reject Triangles that lie completely outside one of the clip planes
+		if (clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) continue;
+		if (clip[0].x >  clip[0].w && clip[1].x >  clip[1].w && clip[2].x >  clip[2].w) continue;
+		if (clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w) continue;
+		if (clip[0].y >  clip[0].w && clip[1].y >  clip[1].w && clip[2].y >  clip[2].w) continue;
+		if (clip[0].z < -clip[0].w && clip[1].z < -clip[1].w && clip[2].z < -clip[2].w) continue;
+		if (clip[0].z >  clip[0].w && clip[1].z >  clip[1].w && clip[2].z >  clip[2].w) continue;
+
+		// Clip against the near plane, this is only used to find the screen space bounding box.
+		// Coverage is determined using homogeneous barycentrics, which do not require clipping
+		Vector4 polygon[4];
+		int     polygon_count = 0;
+
+		for (int v = 0; v < 3; v++) {
+			const Vector4 & curr = clip[v];
+			const Vector4 & next = clip[(v + 1) % 3];
+
+			float distance_curr = curr.z + curr.w;
+			float distance_next = next.z + next.w;
+
+			if (distance_curr >= 0.0f) polygon[polygon_count++] = curr;
+
+			if ((distance_curr >= 0.0f) != (distance_next >= 0.0f)) {
+				float t = distance_curr / (distance_curr - distance_next);
+
+				polygon[polygon_count++] = Vector4(
+					curr.x + t * (next.x - curr.x),
+					curr.y + t * (next.y - curr.y),
+					curr.z + t * (next.z - curr.z),
+					curr.w + t * (next.w - curr.w)
+				);
+			}
+		}
+
+		float screen_min_x = INFINITY, screen_max_x = -INFINITY;
+		float screen_min_y = INFINITY, screen_max_y = -INFINITY;
+
+		for (int v = 0; v < polygon_count; v++) {
+			if (polygon[v].w <= 0.0f) continue;
+
+			float inv_w = 1.0f / polygon[v].w;
+
+			float screen_x = (polygon[v].x * inv_w * 0.5f + 0.5f) * float(width);
+			float screen_y = (polygon[v].y * inv_w * 0.5f + 0.5f) * float(height);
+
+			screen_min_x = fminf(screen_min_x, screen_x); screen_max_x = fmaxf(screen_max_x, screen_x);
+			screen_min_y = fminf(screen_min_y, screen_y); screen_max_y = fmaxf(screen_max_y, screen_y);
+		}
+
+		// Pixel centers are at half integer coordinates
+		int x_min = int(ceilf (fmaxf(screen_min_x, -1.0f)                - 0.5f));
+		int x_max = int(floorf(fminf(screen_max_x, float(width)  + 1.0f) - 0.5f));
+		int y_min = int(ceilf (fmaxf(screen_min_y, -1.0f)                - 0.5f));
+		int y_max = int(floorf(fminf(screen_max_y, float(height) + 1.0f) - 0.5f));
+
+		x_min = Math::max(x_min, 0); x_max = Math::min(x_max, width  - 1);
+		y_min = Math::max(y_min, 0); y_max = Math::min(y_max, height - 1);
+
+		if (x_min > x_max || y_min > y_max) continue;
+
+		// Invert the matrix with the homogeneous 2D vertex positions as columns,
+		// multiplying it with (x, y, 1) gives the barycentrics of the point at NDC position (x, y) divided by its clip space w
+		Vector3 column_0(clip[0].x, clip[0].y, clip[0].w);
+		Vector3 column_1(clip[1].x, clip[1].y, clip[1].w);
+		Vector3 column_2(clip[2].x, clip[2].y, clip[2].w);
+
+		Vector3 row_0 = Vector3::cross(column_1, column_2);
+		Vector3 row_1 = Vector3::cross(column_2, column_0);
+		Vector3 row_2 = Vector3::cross(column_0, column_1);
+
+		float determinant = Vector3::dot(column_0, row_0);
+
+		// Triangle is seen edge-on and covers no pixels
+		if (determinant == 0.0f) continue;
+
+		float inv_determinant = 1.0f / determinant;
+
+		RasterTriangle raster_triangle;
+		raster_triangle.inv_clip[0] = row_0.x * inv_determinant; raster_triangle.inv_clip[1] = row_0.y * inv_determinant; raster_triangle.inv_clip[2] = row_0.z * inv_determinant;
+		raster_triangle.inv_clip[3] = row_1.x * inv_determinant; raster_triangle.inv_clip[4] = row_1.y * inv_determinant; raster_triangle.inv_clip[5] = row_1.z * inv_determinant;
+		raster_triangle.inv_clip[6] = row_2.x * inv_determinant; raster_triangle.inv_clip[7] = row_2.y * inv_determinant; raster_triangle.inv_clip[8] = row_2.z * inv_determinant;
+
+		raster_triangle.clip_z[0] = clip[0].z;
+		raster_triangle.clip_z[1] = clip[1].z;
+		raster_triangle.clip_z[2] = clip[2].z;
+
+		raster_triangle.x_min = x_min;
+		raster_triangle.y_min = y_min;
+		raster_triangle.x_max = x_max;
+		raster_triangle.y_max = y_max;
+
+		raster_triangle.mesh_id        = m;
+		raster_triangle.triangle_index = triangle_index;
+
+		int index = int(triangles.size());
+		triangles.push_back(raster_triangle);
+
+		// Add to all overlapping tiles
+		for (int tile_y = y_min / TILE_SIZE; tile_y <= y_max / TILE_SIZE; tile_y++) {
+			for (int tile_x = x_min / TILE_SIZE; tile_x <= x_max / TILE_SIZE; tile_x++) {
+				bins[tile_x + tile_y * tile_count_x].push_back(index);
+			}
+		}
+	}
+}
+
+// Computes the perspective correct barycentrics of the given pixel, also for pixels outside the Triangle
+static void get_barycentrics(const float inv_clip[9], float ndc_x, float ndc_y, float barycentrics[3]) {
+	float a_0 = inv_clip[0] * ndc_x + inv_clip[1] * ndc_y + inv_clip[2];
+	float a_1 = inv_clip[3] * ndc_x + inv_clip[4] * ndc_y + inv_clip[5];
+	float a_2 = inv_clip[6] * ndc_x + inv_clip[7] * ndc_y + inv_clip[8];
+
+	float sum = a_0 + a_1 + a_2;
+	if (sum == 0.0f) {
+		barycentrics[0] = barycentrics[1] = barycentrics[2] = 0.0f;
+		return;
+	}
+
+	float inv_sum = 1.0f / sum;
+	barycentrics[0] = a_0 * inv_sum;
+	barycentrics[1] = a_1 * inv_sum;
+	barycentrics[2] = a_2 * inv_sum;
+}
+
+void GBufferCPU::rasterize_tile(const Scene & scene, const int * mesh_order, int tile_index, int thread_index) {
+	int tile_x = tile_index % tile_count_x;
+	int tile_y = tile_index / tile_count_x;
+
+	int tile_x_min = tile_x * TILE_SIZE, tile_x_max = Math::min(tile_x_min + TILE_SIZE, width)  - 1;
+	int tile_y_min = tile_y * TILE_SIZE, tile_y_max = Math::min(tile_y_min + TILE_SIZE, height) - 1;
+
+	float                 * depths          = tile_depths    + thread_index * TILE_SIZE * TILE_SIZE;
+	const RasterTriangle ** depth_triangles = tile_triangles + thread_index * TILE_SIZE * TILE_SIZE;
+
+	// Depth is cleared to the far plane, like glClear does with the default clear depth of 1
+	for (int i = 0; i < TILE_SIZE * TILE_SIZE; i++) {
+		depths         [i] = 1.0f;
+		depth_triangles[i] = nullptr;
+	}
+
+	float pixel_size_x = 2.0f / float(width);
+	float pixel_size_y = 2.0f / float(height);
+
+	int tile_count = tile_count_x * tile_count_y;
+
+	// Visibility pass, only the closest Triangle per pixel is recorded
+	for (int t = 0; t < thread_count; t++) {
+		const std::vector<RasterTriangle> & triangles = thread_triangles[t];
+		const std::vector<int>            & bin       = thread_bins[t * tile_count + tile_index];
+
+		for (int i = 0; i < int(bin.size()); i++) {
+			const RasterTriangle & triangle = triangles[bin[i]];
+
+			int x_min = Math::max(triangle.x_min, tile_x_min), x_max = Math::min(triangle.x_max, tile_x_max);
+			int y_min = Math::max(triangle.y_min, tile_y_min), y_max = Math::min(triangle.y_max, tile_y_max);
+
+			for (int y = y_min; y <= y_max; y++) {
+				float ndc_y = (float(y) + 0.5f) * pixel_size_y - 1.0f;
+
+				for (int x = x_min; x <= x_max; x++) {
+					float ndc_x = (float(x) + 0.5f) * pixel_size_x - 1.0f;
+
+					float a_0 = triangle.inv_clip[0] * ndc_x + triangle.inv_clip[1] * ndc_y + triangle.inv_clip[2];
+					float a_1 = triangle.inv_clip[3] * ndc_x + triangle.inv_clip[4] * ndc_y + triangle.inv_clip[5];
+					float a_2 = triangle.inv_clip[6] * ndc_x + triangle.inv_clip[7] * ndc_y + triangle.inv_clip[8];
+
+					// The pixel is covered if all barycentrics are positive and the point lies in front of the Camera (1 / w > 0)
+					if (a_0 < 0.0f || a_1 < 0.0f || a_2 < 0.0f || a_0 + a_1 + a_2 <= 0.0f) continue;
+
+					// NDC depth
+					float z = a_0 * triangle.clip_z[0] + a_1 * triangle.clip_z[1] + a_2 * triangle.clip_z[2];
+					if (z < -1.0f) continue;
+
+					int index = (x - tile_x_min) + (y - tile_y_min) * TILE_SIZE;
+
+					// Equal depths are resolved in draw order, so the result does not depend on how Triangles were distributed over threads
+					const RasterTriangle * closest = depth_triangles[index];
+					if (z < depths[index] || (z == depths[index] && closest && (
+						triangle.mesh_id <  closest->mesh_id ||
+						(triangle.mesh_id == closest->mesh_id && triangle.triangle_index < closest->triangle_index)
+					))) {
+						depths         [index] = z;
+						depth_triangles[index] = &triangle;
+					}
+				}
+			}
+		}
+	}
+
+	// Resolve pass, evaluate all GBuffer channels for the visible Triangles
+	for (int y = tile_y_min; y <= tile_y_max; y++) {
+		for (int x = tile_x_min; x <= tile_x_max; x++) {
+			const RasterTriangle * triangle = depth_triangles[(x - tile_x_min) + (y - tile_y_min) * TILE_SIZE];
+
+			if (triangle) {
+				resolve_pixel(scene, mesh_order, x, y, *triangle);
+			} else {
+				int index = x + y * width;
+
+				normal_and_depth[index] = Vector4(0.0f);
+				uv              [index] = Vector2(0.0f);
+				uv_gradient     [index] = Vector4(0.0f);
+				motion          [index] = Vector2(0.0f);
+				depth_gradient  [index] = Vector2(0.0f);
+
+				mesh_id_and_triangle_id[2 * index    ] = 0;
+				mesh_id_and_triangle_id[2 * index + 1] = 0;
+			}
+		}
+	}
+}
+
+void GBufferCPU::resolve_pixel(const Scene & scene, const int * mesh_order, int x, int y, const RasterTriangle & triangle) {
+	const Mesh     & mesh      = scene.meshes[mesh_order[triangle.mesh_id]];
+	const MeshData * mesh_data = MeshData::mesh_datas[mesh.mesh_data_index_lod];
+
+	const Triangle & mesh_triangle = mesh_data->triangles[triangle.triangle_index];
+
+	float pixel_size_x = 2.0f / float(width);
+	float pixel_size_y = 2.0f / float(height);
+
+	// Derivatives are computed as differences within 2x2 pixel quads, the same as fine derivatives in GLSL
+	int quad_x = x & ~1;
+	int quad_y = y & ~1;
+
+	float ndc_x       = (float(x)          + 0.5f) * pixel_size_x - 1.0f;
+	float ndc_y       = (float(y)          + 0.5f) * pixel_size_y - 1.0f;
+	float ndc_quad_x0 = (float(quad_x)     + 0.5f) * pixel_size_x - 1.0f;
+	float ndc_quad_x1 = (float(quad_x + 1) + 0.5f) * pixel_size_x - 1.0f;
+	float ndc_quad_y0 = (float(quad_y)     + 0.5f) * pixel_size_y - 1.0f;
+	float ndc_quad_y1 = (float(quad_y + 1) + 0.5f) * pixel_size_y - 1.0f;
+
+	float barycentrics[3]; get_barycentrics(triangle.inv_clip, ndc_x, ndc_y, barycentrics);
+
+	float barycentrics_x0[3]; get_barycentrics(triangle.inv_clip, ndc_quad_x0, ndc_y, barycentrics_x0);
+	float barycentrics_x1[3]; get_barycentrics(triangle.inv_clip, ndc_quad_x1, ndc_y, barycentrics_x1);
+	float barycentrics_y0[3]; get_barycentrics(triangle.inv_clip, ndc_x, ndc_quad_y0, barycentrics_y0);
+	float barycentrics_y1[3]; get_barycentrics(triangle.inv_clip, ndc_x, ndc_quad_y1, barycentrics_y1);
+
+	// Interpolate the same varyings as the primary shaders
+	Vector3 normal = Vector3::normalize(
+		barycentrics[0] * Matrix4::transform_direction(mesh.transform, mesh_triangle.normal_0) +
+		barycentrics[1] * Matrix4::transform_direction(mesh.transform, mesh_triangle.normal_1) +
+		barycentrics[2] * Matrix4::transform_direction(mesh.transform, mesh_triangle.normal_2)
+	);
+
+	const Matrix4 & view_projection_prev = mesh_view_projections_prev[triangle.mesh_id];
+
+	Vector4 screen_position_prev_0 = transform_position(view_projection_prev, mesh_triangle.position_0);
+	Vector4 screen_position_prev_1 = transform_position(view_projection_prev, mesh_triangle.position_1);
+	Vector4 screen_position_prev_2 = transform_position(view_projection_prev, mesh_triangle.position_2);
+
+	Vector4 screen_position_prev = Vector4(
+		barycentrics[0] * screen_position_prev_0.x + barycentrics[1] * screen_position_prev_1.x + barycentrics[2] * screen_position_prev_2.x,
+		barycentrics[0] * screen_position_prev_0.y + barycentrics[1] * screen_position_prev_1.y + barycentrics[2] * screen_position_prev_2.y,
+		barycentrics[0] * screen_position_prev_0.z + barycentrics[1] * screen_position_prev_1.z + barycentrics[2] * screen_position_prev_2.z,
+		barycentrics[0] * screen_position_prev_0.w + barycentrics[1] * screen_position_prev_1.w + barycentrics[2] * screen_position_prev_2.w
+	);
+
+	const float * z = triangle.clip_z; // Jitter does not affect z
+
+	float depth    = barycentrics   [0] * z[0] + barycentrics   [1] * z[1] + barycentrics   [2] * z[2];
+	float depth_x0 = barycentrics_x0[0] * z[0] + barycentrics_x0[1] * z[1] + barycentrics_x0[2] * z[2];
+	float depth_x1 = barycentrics_x1[0] * z[0] + barycentrics_x1[1] * z[1] + barycentrics_x1[2] * z[2];
+	float depth_y0 = barycentrics_y0[0] * z[0] + barycentrics_y0[1] * z[1] + barycentrics_y0[2] * z[2];
+	float depth_y1 = barycentrics_y1[0] * z[0] + barycentrics_y1[1] * z[1] + barycentrics_y1[2] * z[2];
+
+	int index = x + y * width;
+
+	Vector2 normal_encoded = oct_encode_normal(normal);
+
+	normal_and_depth[index] = Vector4(normal_encoded.x, normal_encoded.y, depth, screen_position_prev.z);
+
+	uv         [index] = Vector2(barycentrics[1], barycentrics[2]);
+	uv_gradient[index] = Vector4(
+		barycentrics_x1[1] - barycentrics_x0[1],
+		barycentrics_x1[2] - barycentrics_x0[2],
+		barycentrics_y1[1] - barycentrics_y0[1],
+		barycentrics_y1[2] - barycentrics_y0[2]
+	);
+
+	mesh_id_and_triangle_id[2 * index    ] = triangle.mesh_id;
+	mesh_id_and_triangle_id[2 * index + 1] = triangle_ids[mesh_data_triangle_offsets[mesh.mesh_data_index_lod] + triangle.triangle_index] + 1; // Add one so 0 means no hit
+
+	motion[index] = Vector2(
+		screen_position_prev.x / screen_position_prev.w,
+		screen_position_prev.y / screen_position_prev.w
+	);
+
+	depth_gradient[index] = Vector2(depth_x1 - depth_x0, depth_y1 - depth_y0);
+}
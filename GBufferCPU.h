@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+
+#include "Vector2.h"
+#include "Vector4.h"
+
+#include "Scene.h"
+#include "ThreadPool.h"
+
+// Software rasterizer that produces the same channels as the OpenGL GBuffer and primary shaders,
+// so that rasterized primary Rays do not require an OpenGL context.
+// All channels are stored bottom row first, matching the memory layout of the OpenGL textures
+struct GBufferCPU {
+	int width;
+	int height;
+
+	Vector4 * normal_and_depth;        // Octahedral normal in rg, clip space z in b, previous clip space z in a
+	Vector2 * uv;                      // Barycentric coordinates
+	Vector4 * uv_gradient;             // Screen space derivatives of the barycentric coordinates
+	int     * mesh_id_and_triangle_id; // Two ints per pixel, Triangle ID is offset by one so that 0 means no hit
+	Vector2 * motion;                  // Screen position in the previous frame
+	Vector2 * depth_gradient;          // Screen space derivatives of the clip space z
+
+	// 'triangle_ids' maps the Triangles of every MeshData (starting at mesh_data_triangle_offsets) to their global Triangle index
+	void init(const int * triangle_ids, int triangle_count, const int * mesh_data_triangle_offsets, int mesh_data_count);
+	void free();
+
+	void resize(int width, int height);
+
+	// Rasterizes all Meshes, the Mesh ID written for a Mesh is its position in 'mesh_order'
+	void render(const Scene & scene, const int * mesh_order, ThreadPool & thread_pool);
+
+private:
+	struct RasterTriangle {
+		float inv_clip[9]; // Inverse of the matrix with the jittered clip space x, y, w of the vertices as columns
+		float clip_z[3];
+
+		int x_min, y_min; // Bounding box in pixels, inclusive
+		int x_max, y_max;
+
+		int mesh_id;
+		int triangle_index; // Index into the Triangles of the MeshData
+	};
+
+	int * triangle_ids;
+	int * mesh_data_triangle_offsets;
+
+	int tile_count_x;
+	int tile_count_y;
+
+	int thread_count; // Number of threads the per thread buffers below were allocated for
+
+	std::vector<Matrix4> mesh_view_projections;
+	std::vector<Matrix4> mesh_view_projections_prev;
+	std::vector<int>     mesh_triangle_offsets;
+
+	// Per thread Triangle lists and per thread, per tile bins of indices into those lists
+	std::vector<RasterTriangle> * thread_triangles;
+	std::vector<int>            * thread_bins;
+
+	// Per thread depth and visibility buffers for a single tile
+	float                 * tile_depths;
+	const RasterTriangle ** tile_triangles;
+
+	void setup_triangles(const Scene & scene, const int * mesh_order, int first, int last, int thread_index);
+
+	void rasterize_tile(const Scene & scene, const int * mesh_order, int tile_index, int thread_index);
+	void resolve_pixel (const Scene & scene, const int * mesh_order, int x, int y, const RasterTriangle & triangle);
+};
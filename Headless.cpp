@@ -0,0 +1,403 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include "MeshData.h"
+#include "Material.h"
+#include "Texture.h"
+#include "Sky.h"
+
+#include "SBVHBuilder.h"
+#include "RaySortCPU.h"
+#include "TraversalHeatmap.h"
+#include "TileRendererCPU.h"
+#include "Numa.h"
+
+#include "Math.h"
+#include "Util.h"
+#include "ScopeTimer.h"
+
+// Gathers the Triangles of the loaded Meshes and builds a single binary BVH over them, which is what the Host traverses,
+// like the Ray sorting benchmark. Returns false if there are no Triangles
+static bool build_scene(const std::vector<int> & mesh_data_indices, std::vector<Triangle> & triangles, BVH & bvh) {
+	for (int mesh_data_index : mesh_data_indices) {
+		const MeshData * mesh_data = MeshData::mesh_datas[mesh_data_index];
+
+		int offset = int(triangles.size());
+		triangles.insert(triangles.end(), mesh_data->triangles, mesh_data->triangles + mesh_data->triangle_count);
+
+		// Material IDs of a MeshData are relative to its first Material
+		for (int t = offset; t < int(triangles.size()); t++) triangles[t].material_id += mesh_data->material_offset;
+	}
+
+	if (triangles.size() == 0) {
+		printf("ERROR: No Triangles to trace!\n");
+
+		return false;
+	}
+
+	SBVHBuilder sbvh_builder;
+	sbvh_builder.init(&bvh, triangles.size(), 1);
+	sbvh_builder.build(triangles.data(), triangles.size());
+	sbvh_builder.free();
+
+	return true;
+}
+
+// Looks down the negative z axis, from far enough away that the bounds of the BVH fit within the 60 degree field of view
+static TileRendererCPU::Camera get_camera(const BVH & bvh) {
+	const AABB & bounds = bvh.nodes[0].aabb;
+
+	Vector3 extent = bounds.max - bounds.min;
+	Vector3 center = 0.5f * (bounds.min + bounds.max);
+
+	TileRendererCPU::Camera camera;
+	camera.tan_half_fov = tanf(DEG_TO_RAD(30.0f));
+
+	float distance = 0.5f * fmaxf(extent.x, extent.y) / camera.tan_half_fov + 0.5f * extent.z;
+
+	camera.position = center + Vector3(0.0f, 0.0f, 1.01f * distance);
+
+	return camera;
+}
+
+// Traces a pinhole view of the loaded Meshes on the Host, and writes the number of visited Nodes
+// and tested Triangles per pixel as '<prefix>_nodes.ppm' and '<prefix>_triangles.ppm'
+static void write_traversal_heatmap(const char * prefix, const std::vector<int> & mesh_data_indices) {
+	ScopeTimer timer("Traversal Heatmap");
+
+	std::vector<Triangle> triangles;
+	BVH bvh;
+
+	if (!build_scene(mesh_data_indices, triangles, bvh)) return;
+
+	TileRendererCPU::Camera camera = get_camera(bvh);
+
+	float   tan_half_fov = camera.tan_half_fov;
+	Vector3 origin       = camera.position;
+
+	constexpr int width  = SCREEN_WIDTH;
+	constexpr int height = SCREEN_HEIGHT;
+
+	float aspect = float(width) / float(height);
+
+	std::vector<float> cost_nodes    (width * height);
+	std::vector<float> cost_triangles(width * height);
+
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			float u = (2.0f * (float(i) + 0.5f) / float(width)  - 1.0f) * tan_half_fov * aspect;
+			float v = (1.0f - 2.0f * (float(j) + 0.5f) / float(height)) * tan_half_fov;
+
+			Vector3 direction = Vector3::normalize(Vector3(u, v, -1.0f));
+
+			float t;
+			int   tests;
+			int   steps = RaySortCPU::trace(bvh, triangles.data(), origin, direction, t, &tests);
+
+			cost_nodes    [i + j * width] = float(steps);
+			cost_triangles[i + j * width] = float(tests);
+		}
+	}
+
+	char file_nodes    [512]; snprintf(file_nodes,     sizeof(file_nodes),     "%s_nodes.ppm",     prefix);
+	char file_triangles[512]; snprintf(file_triangles, sizeof(file_triangles), "%s_triangles.ppm", prefix);
+
+	TraversalHeatmap::export_ppm(file_nodes,     width, height, cost_nodes    .data());
+	TraversalHeatmap::export_ppm(file_triangles, width, height, cost_triangles.data());
+
+	TraversalHeatmap::print_histogram("Nodes per pixel",     cost_nodes    .data(), width * height);
+	TraversalHeatmap::print_histogram("Triangles per pixel", cost_triangles.data(), width * height);
+
+	delete [] bvh.indices;
+	delete [] bvh.nodes;
+}
+
+struct RenderOptions {
+	int tile_size         = TILE_SIZE_CPU;
+	int tile_order        = TILE_ORDER_CPU;
+	int samples_per_pixel = 4;
+	int thread_count      = 0; // If 0 the number of hardware threads is used
+
+	bool measure_scaling = false; // Renders with 1, 2, 4, ... up to thread_count threads
+	bool measure_numa    = false; // Also renders with the threads pinned per NUMA node, with and without a replicated scene
+};
+
+// Picks the CPUs for 'thread_count' pinned threads, spread evenly over the NUMA nodes.
+// Threads on the same node get consecutive indices, so that they start on neighbouring tiles
+static void get_thread_placement(int thread_count, std::vector<int> & thread_cpus, std::vector<int> & thread_nodes) {
+	struct Placement {
+		int cpu;
+		int node;
+	};
+	std::vector<Placement> placements;
+
+	int node_count = Numa::get_node_count();
+
+	for (int i = 0; int(placements.size()) < thread_count; i++) {
+		int node = i % node_count;
+
+		const std::vector<int> & cpus = Numa::get_node_cpus(node);
+
+		// Wraps around if there are more threads than CPUs
+		placements.push_back({ cpus[(i / node_count) % cpus.size()], node });
+	}
+
+	std::stable_sort(placements.begin(), placements.end(), [](const Placement & a, const Placement & b) { return a.node < b.node; });
+
+	thread_cpus .resize(thread_count);
+	thread_nodes.resize(thread_count);
+
+	for (int i = 0; i < thread_count; i++) {
+		thread_cpus [i] = placements[i].cpu;
+		thread_nodes[i] = placements[i].node;
+	}
+}
+
+// Path traces the loaded Meshes on the Host in tiles, see TileRendererCPU, and writes the image as '<prefix>.ppm'.
+// When measuring scaling the image is rendered again for every thread count, reporting the throughput relative to a single thread.
+// When measuring NUMA placement this is repeated for every configuration
+static void render_cpu(const char * prefix, const std::vector<int> & mesh_data_indices, const RenderOptions & options) {
+	std::vector<Triangle> triangles;
+	BVH bvh;
+
+	if (!build_scene(mesh_data_indices, triangles, bvh)) return;
+
+	TileRendererCPU::Camera camera = get_camera(bvh);
+
+	constexpr int width  = SCREEN_WIDTH;
+	constexpr int height = SCREEN_HEIGHT;
+
+	TileScheduler scheduler;
+	scheduler.init(width, height, options.tile_size, options.tile_order);
+
+	printf("Rendering %i x %i pixels at %i spp in %zu tiles of %i x %i pixels, Ray batches of %i KB per thread\n",
+		width, height, options.samples_per_pixel,
+		scheduler.tiles.size(), options.tile_size, options.tile_size,
+		TileRendererCPU::get_batch_size(options.tile_size) / 1024
+	);
+
+	int thread_count_max = options.thread_count > 0 ? options.thread_count : std::thread::hardware_concurrency();
+	if (thread_count_max <= 0) thread_count_max = 1;
+
+	std::vector<int> thread_counts;
+
+	if (options.measure_scaling) {
+		for (int thread_count = 1; thread_count < thread_count_max; thread_count *= 2) thread_counts.push_back(thread_count);
+	}
+	thread_counts.push_back(thread_count_max);
+
+	struct Configuration {
+		const char * name;
+
+		bool pin;
+		bool replicate_scene;
+	} configurations[] = {
+		{ "unpinned",                        false, false },
+		{ "pinned per node",                 true,  false },
+		{ "pinned per node, replicated BVH", true,  true  }
+	};
+	int configuration_count = options.measure_numa ? Util::array_element_count(configurations) : 1;
+
+	std::vector<Vector3> frame_buffer(width * height);
+	std::vector<Vector3> frame_buffer_reference;
+
+	for (int c = 0; c < configuration_count; c++) {
+		const Configuration & configuration = configurations[c];
+
+		if (options.measure_numa) printf("Configuration %s, %i NUMA nodes:\n", configuration.name, Numa::get_node_count());
+
+		double rays_per_second_single = 0.0;
+
+		for (int thread_count : thread_counts) {
+			std::vector<int> thread_cpus;
+			std::vector<int> thread_nodes;
+
+			TileRendererCPU::Placement placement;
+
+			if (configuration.pin) {
+				get_thread_placement(thread_count, thread_cpus, thread_nodes);
+
+				placement.thread_nodes    = thread_nodes.data();
+				placement.node_count      = Numa::get_node_count();
+				placement.replicate_scene = configuration.replicate_scene;
+			}
+
+			ThreadPool thread_pool;
+			thread_pool.init(thread_count, configuration.pin ? thread_cpus.data() : nullptr);
+
+			TileRendererCPU::Result result = TileRendererCPU::render(bvh, triangles.data(), triangles.size(), camera, width, height, options.samples_per_pixel, scheduler, thread_pool, placement, frame_buffer.data());
+
+			thread_pool.free();
+
+			double rays_per_second = double(result.ray_count) / result.seconds;
+			if (thread_count == 1) rays_per_second_single = rays_per_second;
+
+			printf("%3i threads: %8.1f ms, %7.2f MRays/s, %4i tiles stolen", thread_count, 1000.0 * result.seconds, 1e-6 * rays_per_second, result.tiles_stolen);
+
+			if (options.measure_scaling) {
+				double speedup = rays_per_second / rays_per_second_single;
+
+				printf(", speedup %5.2fx, efficiency %5.1f%%", speedup, 100.0 * speedup / double(thread_count));
+			}
+
+			// Every tile seeds its own random numbers, so all thread counts and configurations should produce exactly the same image
+			if (frame_buffer_reference.size() == 0) {
+				frame_buffer_reference = frame_buffer;
+			} else if (memcmp(frame_buffer.data(), frame_buffer_reference.data(), frame_buffer.size() * sizeof(Vector3)) != 0) {
+				printf(" INVALID: image differs from the first run");
+			}
+
+			printf("\n");
+		}
+	}
+
+	// Stored top row first, so unlike a screenshot the image does not need to be flipped
+	std::vector<unsigned char> data(width * height * 3);
+
+	for (int i = 0; i < width * height; i++) {
+		data[3 * i    ] = (unsigned char)(255.0f * Math::linear_to_gamma(frame_buffer[i].x) + 0.5f);
+		data[3 * i + 1] = (unsigned char)(255.0f * Math::linear_to_gamma(frame_buffer[i].y) + 0.5f);
+		data[3 * i + 2] = (unsigned char)(255.0f * Math::linear_to_gamma(frame_buffer[i].z) + 0.5f);
+	}
+
+	char file_name[512]; snprintf(file_name, sizeof(file_name), "%s.ppm", prefix);
+
+	Util::export_ppm(file_name, width, height, data.data());
+
+	delete [] bvh.indices;
+	delete [] bvh.nodes;
+}
+
+// Loads Meshes and a Sky without creating a Window or CUDA Context,
+// so that the BVH builders and asset loaders can be run and timed on machines without a GPU
+int main(int argument_count, char ** arguments) {
+	if (argument_count < 2) {
+		printf("Usage: %s [--sky file.hdr] [--heatmap prefix] [--render prefix] [--tile-size N] [--tile-order scanline|morton|hilbert] [--spp N] [--threads N] [--scaling] [--numa] mesh.obj [mesh.obj ...]\n", arguments[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	const char * sky_name     = nullptr;
+	const char * heatmap_name = nullptr;
+	const char * render_name  = nullptr;
+
+	RenderOptions render_options;
+
+	std::vector<int> mesh_data_indices;
+
+	// Set default Material before loading Meshes
+	Material default_material;
+	default_material.diffuse = Vector3(1.0f, 0.0f, 1.0f);
+	Material::materials.push_back(default_material);
+
+	{
+		ScopeTimer timer("Headless Load");
+
+		for (int i = 1; i < argument_count; i++) {
+			if (strcmp(arguments[i], "--sky") == 0) {
+				if (i + 1 < argument_count) sky_name = arguments[++i];
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--heatmap") == 0) {
+				if (i + 1 < argument_count) heatmap_name = arguments[++i];
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--render") == 0) {
+				if (i + 1 < argument_count) render_name = arguments[++i];
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--tile-size") == 0) {
+				if (i + 1 < argument_count) render_options.tile_size = Math::max(atoi(arguments[++i]), 1);
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--tile-order") == 0) {
+				if (i + 1 < argument_count) {
+					const char * order = arguments[++i];
+
+					if (strcmp(order, "scanline") == 0) {
+						render_options.tile_order = TILE_ORDER_SCANLINE;
+					} else if (strcmp(order, "morton") == 0) {
+						render_options.tile_order = TILE_ORDER_MORTON;
+					} else if (strcmp(order, "hilbert") == 0) {
+						render_options.tile_order = TILE_ORDER_HILBERT;
+					} else {
+						printf("ERROR: Unknown tile order %s!\n", order);
+
+						return EXIT_FAILURE;
+					}
+				}
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--spp") == 0) {
+				if (i + 1 < argument_count) render_options.samples_per_pixel = Math::max(atoi(arguments[++i]), 1);
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--threads") == 0) {
+				if (i + 1 < argument_count) render_options.thread_count = Math::max(atoi(arguments[++i]), 1);
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--scaling") == 0) {
+				render_options.measure_scaling = true;
+
+				continue;
+			}
+
+			if (strcmp(arguments[i], "--numa") == 0) {
+				render_options.measure_numa = true;
+
+				continue;
+			}
+
+			if (!Util::file_exists(arguments[i])) {
+				printf("ERROR: File %s does not exist!\n", arguments[i]);
+
+				return EXIT_FAILURE;
+			}
+
+			mesh_data_indices.push_back(MeshData::load(arguments[i]));
+		}
+
+		Texture::wait_until_textures_loaded();
+	}
+
+	for (int m = 0; m < int(MeshData::mesh_datas.size()); m++) {
+		const MeshData * mesh_data = MeshData::mesh_datas[m];
+
+		printf("MeshData %i: %i triangles, %i nodes, %i indices, lod_next %i\n", m,
+			mesh_data->triangle_count,
+			mesh_data->bvh.node_count,
+			mesh_data->bvh.index_count,
+			mesh_data->lod_next
+		);
+	}
+	printf("Materials: %zu, Textures: %zu\n", Material::materials.size(), Texture::textures.size());
+
+	if (sky_name) {
+		Sky sky;
+		sky.init(sky_name);
+
+		printf("Sky: %i x %i\n", sky.size, sky.size);
+	}
+
+	if (heatmap_name) write_traversal_heatmap(heatmap_name, mesh_data_indices);
+	if (render_name)  render_cpu(render_name, mesh_data_indices, render_options);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstring>
+#include <type_traits>
+
+#include "CUDA_Source/Common.h"
+
+// Host state that determines which Kernels a frame launches, the launch Graph is recorded again when it changes.
+// Every field is an int, so that the key has no padding and keys are compared bytewise.
+// A field that is added later is therefore always part of the comparison
+struct LaunchGraphKey {
+	int enable_rasterization;
+	int enable_material_sort;
+	int enable_radiance_cache;
+	int enable_indirect_upsample;
+	int enable_svgf;
+	int enable_spatial_variance;
+	int enable_taa;
+	int enable_reconstruction;
+
+	int atrous_iterations;
+
+	int has_diffuse;
+	int has_dielectric;
+	int has_glossy;
+	int has_lights;
+
+	int enable_concurrent_shading;
+	int enable_path_regeneration;
+	int enable_deterministic_compaction;
+	int enable_ray_sort;
+	int enable_path_guiding;
+
+	int samples_per_frame;
+
+	// The parts of the key that do not come from the Settings
+	struct State {
+		bool has_diffuse;
+		bool has_dielectric;
+		bool has_glossy;
+		bool has_lights;
+
+		bool enable_concurrent_shading;
+		bool enable_path_regeneration; // Whether regeneration is actually used, see Pathtracer::use_path_regeneration
+
+		int samples_per_frame; // As actually traced, see Pathtracer::get_samples_per_frame
+	};
+
+	inline static LaunchGraphKey get(const Settings & settings, const State & state) {
+		LaunchGraphKey key;
+		key.enable_rasterization     = settings.enable_rasterization;
+		key.enable_material_sort     = settings.enable_material_sort;
+		key.enable_radiance_cache    = settings.enable_radiance_cache;
+		key.enable_indirect_upsample = settings.indirect_downsample > 1;
+		key.enable_svgf              = settings.enable_svgf;
+		key.enable_spatial_variance  = settings.enable_spatial_variance;
+		key.enable_taa               = settings.enable_taa;
+		key.enable_reconstruction    = settings.reconstruction_filter != ReconstructionFilter::BOX;
+		key.atrous_iterations        = settings.atrous_iterations;
+
+		key.has_diffuse    = state.has_diffuse;
+		key.has_dielectric = state.has_dielectric;
+		key.has_glossy     = state.has_glossy;
+		key.has_lights     = state.has_lights;
+
+		key.enable_concurrent_shading       = state.enable_concurrent_shading;
+		key.enable_path_regeneration        = state.enable_path_regeneration;
+		key.enable_deterministic_compaction = settings.enable_deterministic_compaction;
+		key.enable_ray_sort                 = settings.enable_ray_sort;
+		key.enable_path_guiding             = settings.enable_path_guiding;
+
+		key.samples_per_frame = state.samples_per_frame;
+
+		return key;
+	}
+
+	inline bool operator==(const LaunchGraphKey & other) const {
+		return memcmp(this, &other, sizeof(LaunchGraphKey)) == 0;
+	}
+
+	inline bool operator!=(const LaunchGraphKey & other) const {
+		return !(*this == other);
+	}
+};
+
+static_assert(std::has_unique_object_representations_v<LaunchGraphKey>, "LaunchGraphKey is compared bytewise and must not contain padding");
@@ -83,6 +83,21 @@ int main(int argument_count, char ** arguments) {
 
 	Random::init(1337);
 
+	// Renders the first frame twice with deterministic compaction and exits, with EXIT_FAILURE unless both frames are bit-identical
+	if (argument_count > 1 && strcmp(arguments[1], "--test-determinism") == 0) {
+		pathtracer.settings.enable_deterministic_compaction = true;
+		pathtracer.settings.enable_path_regeneration        = false; // Regenerated samples are summed with float atomics
+		pathtracer.settings_changed = true;
+
+		pathtracer.update(0.0f);
+		bool deterministic = pathtracer.test_determinism();
+
+		pathtracer.free();
+		CUDAContext::destroy();
+
+		return deterministic ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	last = SDL_GetPerformanceCounter();
 
 	// Game loop
@@ -151,8 +166,13 @@ int main(int argument_count, char ** arguments) {
 			bool category_changed = true;
 			int  padding;
 
+			// Timings lag a few frames behind, so that reading them does not stall on the Device
+			const auto & timings = pathtracer.event_ring.timings;
+
+			int event_count = timings.events.size();
+
 			// Display Profile timings per category
-			for (int i = 0; i < pathtracer.events.size() - 1; i++) {
+			for (int i = 0; i < event_count - 1; i++) {
 				if (category_changed) {
 					padding = 0;
 
@@ -160,16 +180,16 @@ int main(int argument_count, char ** arguments) {
 					float time_sum = 0.0f;
 
 					int j;
-					for (j = i; j < pathtracer.events.size() - 1; j++) {
-						int length = strlen(pathtracer.events[j]->name);
+					for (j = i; j < event_count - 1; j++) {
+						int length = strlen(timings.events[j]->name);
 						if (length > padding) padding = length;
 
-						time_sum += CUDAEvent::time_elapsed_between(*pathtracer.events[j], *pathtracer.events[j + 1]);
+						time_sum += timings.times[j];
 
-						if (strcmp(pathtracer.events[j]->category, pathtracer.events[j + 1]->category) != 0) break;
+						if (strcmp(timings.events[j]->category, timings.events[j + 1]->category) != 0) break;
 					}
 
-					bool category_visible = ImGui::TreeNode(pathtracer.events[i]->category, "%s: %.2f ms", pathtracer.events[i]->category, time_sum);
+					bool category_visible = ImGui::TreeNode(timings.events[i]->category, "%s: %.2f ms", timings.events[i]->category, time_sum);
 					if (!category_visible) {
 						// Skip ahead to next category
 						i = j;
@@ -178,14 +198,11 @@ int main(int argument_count, char ** arguments) {
 					}
 				}
 
-				const CUDAEvent * event_curr = pathtracer.events[i];
-				const CUDAEvent * event_next = pathtracer.events[i + 1];
-
-				float time = CUDAEvent::time_elapsed_between(*event_curr, *event_next);
+				const EventDesc * event_curr = timings.events[i];
 
-				ImGui::Text("%s: %*.2f ms", event_curr->name, 5 + padding - strlen(event_curr->name), time);
+				ImGui::Text("%s: %*.2f ms", event_curr->name, 5 + padding - int(strlen(event_curr->name)), timings.times[i]);
 
-				category_changed = strcmp(pathtracer.events[i]->category, pathtracer.events[i + 1]->category);
+				category_changed = strcmp(timings.events[i]->category, timings.events[i + 1]->category);
 				if (category_changed) {
 					ImGui::TreePop();
 				}
@@ -205,6 +222,52 @@ int main(int argument_count, char ** arguments) {
 			settings_changed |= ImGui::Checkbox("Spatial Variance",       &pathtracer.settings.enable_spatial_variance);
 			settings_changed |= ImGui::Checkbox("TAA",                    &pathtracer.settings.enable_taa);
 			settings_changed |= ImGui::Checkbox("Demodulate Albedo",      &pathtracer.settings.demodulate_albedo);
+			settings_changed |= ImGui::Checkbox("Sort Materials",         &pathtracer.settings.enable_material_sort);
+			settings_changed |= ImGui::Checkbox("Sort Rays",              &pathtracer.settings.enable_ray_sort);
+
+			ImGui::Checkbox("Launch Graph",       &pathtracer.enable_launch_graph);
+			ImGui::Checkbox("Concurrent Shading", &pathtracer.enable_concurrent_shading);
+
+			if (ImGui::Button("Tune Batch Size")) pathtracer.tune_batch_size = true;
+
+			if (ImGui::Button("Measure Material Coherence")) pathtracer.measure_material_coherence = true;
+			if (ImGui::Button("Measure Ray Coherence"))      pathtracer.measure_ray_coherence      = true;
+
+			// Indirect lighting is traced at full, half or quarter resolution
+			int indirect_resolution = pathtracer.settings.indirect_downsample >> 1;
+			if (ImGui::Combo("Indirect Resolution", &indirect_resolution, "Full\0Half\0Quarter")) {
+				pathtracer.settings.indirect_downsample = 1 << indirect_resolution;
+				settings_changed = true;
+			}
+
+			if (ImGui::Button("Measure Indirect Upsampling")) pathtracer.measure_indirect_upsample = true;
+
+			settings_changed |= ImGui::SliderInt("Samples per Frame", &pathtracer.settings.samples_per_frame, 1, MAX_SAMPLES_PER_FRAME);
+			settings_changed |= ImGui::Checkbox("Path Regeneration", &pathtracer.settings.enable_path_regeneration);
+
+			if (ImGui::Button("Measure Path Regeneration")) pathtracer.measure_path_regeneration = true;
+
+			settings_changed |= ImGui::Checkbox("Deterministic Compaction", &pathtracer.settings.enable_deterministic_compaction);
+
+			if (ImGui::Button("Measure Compaction")) pathtracer.measure_compaction = true;
+
+#if ENABLE_RADIANCE_CACHE
+			settings_changed |= ImGui::Checkbox("Radiance Cache",       &pathtracer.settings.enable_radiance_cache);
+			settings_changed |= ImGui::Checkbox("Terminate into Cache", &pathtracer.settings.radiance_cache_terminate_paths);
+
+			if (ImGui::Button("Measure Radiance Cache"))   pathtracer.measure_radiance_cache   = true;
+			if (ImGui::Button("Benchmark Radiance Cache")) pathtracer.benchmark_radiance_cache = true;
+#endif
+
+#if ENABLE_PATH_GUIDING
+			settings_changed |= ImGui::Checkbox("Path Guiding", &pathtracer.settings.enable_path_guiding);
+
+			if (ImGui::Button("Measure Path Guiding")) pathtracer.measure_path_guiding = true;
+#endif
+
+#if ENABLE_TRAVERSAL_HEATMAP
+			if (ImGui::Button("Measure Traversal Cost")) pathtracer.measure_traversal_cost = true;
+#endif
 
 			settings_changed |= ImGui::Combo("Reconstruction Filter", reinterpret_cast<int *>(&pathtracer.settings.reconstruction_filter), "Box\0Mitchel-Netravali\0Gaussian");
 
@@ -225,6 +288,7 @@ int main(int argument_count, char ** arguments) {
 		window.swap();
 	}
 
+	pathtracer.free();
 	CUDAContext::destroy();
 
 	return EXIT_SUCCESS;
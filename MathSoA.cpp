@@ -0,0 +1,215 @@
+#include "MathSoA.h"
+
+#include "Math.h"
+#include "Util.h"
+
+// Wrappers that map to AVX, SSE or scalar code depending on SOA_WIDTH,
+// so that every batched operation only has to be written once
+#if SIMD_AVX
+typedef __m256 Float;
+
+static inline Float load    (const float * data)          { return _mm256_load_ps(data); }
+static inline void  store   (float * data, Float value)   { _mm256_store_ps(data, value); }
+static inline Float set1    (float value)                 { return _mm256_set1_ps(value); }
+static inline Float add     (Float a, Float b)            { return _mm256_add_ps(a, b); }
+static inline Float sub     (Float a, Float b)            { return _mm256_sub_ps(a, b); }
+static inline Float mul     (Float a, Float b)            { return _mm256_mul_ps(a, b); }
+static inline Float minimum (Float a, Float b)            { return _mm256_min_ps(a, b); }
+static inline Float maximum (Float a, Float b)            { return _mm256_max_ps(a, b); }
+#elif SIMD_SSE
+typedef __m128 Float;
+
+static inline Float load    (const float * data)          { return _mm_load_ps(data); }
+static inline void  store   (float * data, Float value)   { _mm_store_ps(data, value); }
+static inline Float set1    (float value)                 { return _mm_set1_ps(value); }
+static inline Float add     (Float a, Float b)            { return _mm_add_ps(a, b); }
+static inline Float sub     (Float a, Float b)            { return _mm_sub_ps(a, b); }
+static inline Float mul     (Float a, Float b)            { return _mm_mul_ps(a, b); }
+static inline Float minimum (Float a, Float b)            { return _mm_min_ps(a, b); }
+static inline Float maximum (Float a, Float b)            { return _mm_max_ps(a, b); }
+#else
+typedef float Float;
+
+static inline Float load    (const float * data)          { return *data; }
+static inline void  store   (float * data, Float value)   { *data = value; }
+static inline Float set1    (float value)                 { return value; }
+static inline Float add     (Float a, Float b)            { return a + b; }
+static inline Float sub     (Float a, Float b)            { return a - b; }
+static inline Float mul     (Float a, Float b)            { return a * b; }
+static inline Float minimum (Float a, Float b)            { return a < b ? a : b; }
+static inline Float maximum (Float a, Float b)            { return a > b ? a : b; }
+#endif
+
+static constexpr int SOA_ALIGNMENT = 32;
+
+static int get_capacity(int count) {
+	return Math::divide_round_up(count, SOA_WIDTH) * SOA_WIDTH;
+}
+
+static float * allocate(int capacity) {
+	return reinterpret_cast<float *>(ALLIGNED_MALLOC(capacity * sizeof(float), SOA_ALIGNMENT));
+}
+
+void Vector3SoA::init(int count) {
+	this->count    = count;
+	this->capacity = get_capacity(count);
+
+	x = allocate(capacity);
+	y = allocate(capacity);
+	z = allocate(capacity);
+
+	for (int i = count; i < capacity; i++) {
+		x[i] = 0.0f;
+		y[i] = 0.0f;
+		z[i] = 0.0f;
+	}
+}
+
+void Vector3SoA::free() {
+	ALLIGNED_FREE(x);
+	ALLIGNED_FREE(y);
+	ALLIGNED_FREE(z);
+}
+
+// Padding holds empty AABBs, so that it does not affect merges
+static void clear_padding(AABBSoA & aabbs) {
+	for (int i = aabbs.count; i < aabbs.capacity; i++) {
+		aabbs.min_x[i] = +INFINITY;
+		aabbs.min_y[i] = +INFINITY;
+		aabbs.min_z[i] = +INFINITY;
+		aabbs.max_x[i] = -INFINITY;
+		aabbs.max_y[i] = -INFINITY;
+		aabbs.max_z[i] = -INFINITY;
+	}
+}
+
+void AABBSoA::init(int count) {
+	this->count    = count;
+	this->capacity = get_capacity(count);
+
+	min_x = allocate(capacity);
+	min_y = allocate(capacity);
+	min_z = allocate(capacity);
+	max_x = allocate(capacity);
+	max_y = allocate(capacity);
+	max_z = allocate(capacity);
+
+	clear_padding(*this);
+}
+
+void AABBSoA::free() {
+	ALLIGNED_FREE(min_x);
+	ALLIGNED_FREE(min_y);
+	ALLIGNED_FREE(min_z);
+	ALLIGNED_FREE(max_x);
+	ALLIGNED_FREE(max_y);
+	ALLIGNED_FREE(max_z);
+}
+
+// Multiplies the matrix with (x, y, z, w)
+static inline void transform_vector(const Matrix4 & matrix, Float x, Float y, Float z, float w, Float & result_x, Float & result_y, Float & result_z) {
+	result_x = add(add(mul(set1(matrix(0, 0)), x), mul(set1(matrix(0, 1)), y)), add(mul(set1(matrix(0, 2)), z), set1(matrix(0, 3) * w)));
+	result_y = add(add(mul(set1(matrix(1, 0)), x), mul(set1(matrix(1, 1)), y)), add(mul(set1(matrix(1, 2)), z), set1(matrix(1, 3) * w)));
+	result_z = add(add(mul(set1(matrix(2, 0)), x), mul(set1(matrix(2, 1)), y)), add(mul(set1(matrix(2, 2)), z), set1(matrix(2, 3) * w)));
+}
+
+static void transform_vectors(const Matrix4 & matrix, const Vector3SoA & vectors, Vector3SoA & result, float w) {
+	assert(result.count == vectors.count);
+
+	for (int i = 0; i < vectors.capacity; i += SOA_WIDTH) {
+		Float x, y, z;
+		transform_vector(matrix, load(vectors.x + i), load(vectors.y + i), load(vectors.z + i), w, x, y, z);
+
+		store(result.x + i, x);
+		store(result.y + i, y);
+		store(result.z + i, z);
+	}
+}
+
+void MathSoA::transform_positions(const Matrix4 & matrix, const Vector3SoA & positions, Vector3SoA & result) {
+	transform_vectors(matrix, positions, result, 1.0f);
+}
+
+void MathSoA::transform_directions(const Matrix4 & matrix, const Vector3SoA & directions, Vector3SoA & result) {
+	transform_vectors(matrix, directions, result, 0.0f);
+}
+
+// Same method as AABB::transform
+void MathSoA::transform(const Matrix4 & matrix, const AABBSoA & aabbs, AABBSoA & result) {
+	assert(result.count == aabbs.count);
+
+	Matrix4 matrix_abs = Matrix4::abs(matrix);
+
+	Float half = set1(0.5f);
+
+	for (int i = 0; i < aabbs.capacity; i += SOA_WIDTH) {
+		Float min_x = load(aabbs.min_x + i), max_x = load(aabbs.max_x + i);
+		Float min_y = load(aabbs.min_y + i), max_y = load(aabbs.max_y + i);
+		Float min_z = load(aabbs.min_z + i), max_z = load(aabbs.max_z + i);
+
+		Float center_x, center_y, center_z;
+		Float extent_x, extent_y, extent_z;
+		transform_vector(matrix,     mul(half, add(min_x, max_x)), mul(half, add(min_y, max_y)), mul(half, add(min_z, max_z)), 1.0f, center_x, center_y, center_z);
+		transform_vector(matrix_abs, mul(half, sub(max_x, min_x)), mul(half, sub(max_y, min_y)), mul(half, sub(max_z, min_z)), 0.0f, extent_x, extent_y, extent_z);
+
+		store(result.min_x + i, sub(center_x, extent_x));
+		store(result.min_y + i, sub(center_y, extent_y));
+		store(result.min_z + i, sub(center_z, extent_z));
+		store(result.max_x + i, add(center_x, extent_x));
+		store(result.max_y + i, add(center_y, extent_y));
+		store(result.max_z + i, add(center_z, extent_z));
+	}
+
+	clear_padding(result);
+}
+
+AABB MathSoA::merge(const AABBSoA & aabbs) {
+	Float min_x = set1(+INFINITY), max_x = set1(-INFINITY);
+	Float min_y = set1(+INFINITY), max_y = set1(-INFINITY);
+	Float min_z = set1(+INFINITY), max_z = set1(-INFINITY);
+
+	for (int i = 0; i < aabbs.capacity; i += SOA_WIDTH) {
+		min_x = minimum(min_x, load(aabbs.min_x + i)); max_x = maximum(max_x, load(aabbs.max_x + i));
+		min_y = minimum(min_y, load(aabbs.min_y + i)); max_y = maximum(max_y, load(aabbs.max_y + i));
+		min_z = minimum(min_z, load(aabbs.min_z + i)); max_z = maximum(max_z, load(aabbs.max_z + i));
+	}
+
+	// Reduce the lanes
+	alignas(SOA_ALIGNMENT) float lanes[6][SOA_WIDTH];
+	store(lanes[0], min_x); store(lanes[3], max_x);
+	store(lanes[1], min_y); store(lanes[4], max_y);
+	store(lanes[2], min_z); store(lanes[5], max_z);
+
+	AABB result = AABB::create_empty();
+
+	for (int lane = 0; lane < SOA_WIDTH; lane++) {
+		result.min = Vector3::min(result.min, Vector3(lanes[0][lane], lanes[1][lane], lanes[2][lane]));
+		result.max = Vector3::max(result.max, Vector3(lanes[3][lane], lanes[4][lane], lanes[5][lane]));
+	}
+
+	return result;
+}
+
+void MathSoA::surface_areas(const AABBSoA & aabbs, float result[]) {
+	int count_full = aabbs.count - aabbs.count % SOA_WIDTH;
+
+	Float two = set1(2.0f);
+
+	for (int i = 0; i < count_full; i += SOA_WIDTH) {
+		Float diff_x = sub(load(aabbs.max_x + i), load(aabbs.min_x + i));
+		Float diff_y = sub(load(aabbs.max_y + i), load(aabbs.min_y + i));
+		Float diff_z = sub(load(aabbs.max_z + i), load(aabbs.min_z + i));
+
+		Float area = mul(two, add(add(mul(diff_x, diff_y), mul(diff_y, diff_z)), mul(diff_z, diff_x)));
+
+		// 'result' is not necessarily aligned
+		alignas(SOA_ALIGNMENT) float areas[SOA_WIDTH];
+		store(areas, area);
+
+		memcpy(result + i, areas, sizeof(areas));
+	}
+
+	for (int i = count_full; i < aabbs.count; i++) {
+		result[i] = aabbs.get(i).surface_area();
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "AABB.h"
+
+// Structure of Arrays variants of the math types, used for bulk operations that process
+// a full SIMD register of elements at a time. Arrays are padded to a multiple of SOA_WIDTH
+#if SIMD_AVX
+#define SOA_WIDTH 8
+#elif SIMD_SSE
+#define SOA_WIDTH 4
+#else
+#define SOA_WIDTH 1
+#endif
+
+struct Vector3SoA {
+	int count;
+	int capacity; // 'count' rounded up to a multiple of SOA_WIDTH
+
+	float * x;
+	float * y;
+	float * z;
+
+	void init(int count);
+	void free();
+
+	inline void set(int index, const Vector3 & vector) {
+		assert(index >= 0 && index < count);
+
+		x[index] = vector.x;
+		y[index] = vector.y;
+		z[index] = vector.z;
+	}
+
+	inline Vector3 get(int index) const {
+		assert(index >= 0 && index < count);
+
+		return Vector3(x[index], y[index], z[index]);
+	}
+};
+
+struct AABBSoA {
+	int count;
+	int capacity; // 'count' rounded up to a multiple of SOA_WIDTH, padding is filled with empty AABBs
+
+	float * min_x;
+	float * min_y;
+	float * min_z;
+	float * max_x;
+	float * max_y;
+	float * max_z;
+
+	void init(int count);
+	void free();
+
+	inline void set(int index, const AABB & aabb) {
+		assert(index >= 0 && index < count);
+
+		min_x[index] = aabb.min.x;
+		min_y[index] = aabb.min.y;
+		min_z[index] = aabb.min.z;
+		max_x[index] = aabb.max.x;
+		max_y[index] = aabb.max.y;
+		max_z[index] = aabb.max.z;
+	}
+
+	inline AABB get(int index) const {
+		assert(index >= 0 && index < count);
+
+		AABB aabb;
+		aabb.min = Vector3(min_x[index], min_y[index], min_z[index]);
+		aabb.max = Vector3(max_x[index], max_y[index], max_z[index]);
+
+		return aabb;
+	}
+};
+
+// Batched versions of the Matrix4 and AABB operations
+namespace MathSoA {
+	// 'result' must have been initialized with the same count as the input
+	void transform_positions (const Matrix4 & matrix, const Vector3SoA & positions,  Vector3SoA & result);
+	void transform_directions(const Matrix4 & matrix, const Vector3SoA & directions, Vector3SoA & result);
+
+	void transform(const Matrix4 & matrix, const AABBSoA & aabbs, AABBSoA & result);
+
+	// Smallest AABB enclosing all AABBs
+	AABB merge(const AABBSoA & aabbs);
+
+	// Writes 'aabbs.count' surface areas to 'result'
+	void surface_areas(const AABBSoA & aabbs, float result[]);
+}
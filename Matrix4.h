@@ -5,6 +5,7 @@
 #include "Quaternion.h"
 
 #include "Util.h"
+#include "SIMD.h"
 
 struct alignas(16) Matrix4 {
 	float cells[16];
@@ -29,6 +30,13 @@ struct alignas(16) Matrix4 {
 		return cells[col + (row << 2)];
 	}
 
+#if SIMD_SSE
+	// Unaligned, Matrices are not always allocated with their declared alignment
+	inline __m128 load_row(int row) const { return _mm_loadu_ps(cells + (row << 2)); }
+
+	inline void store_row(int row, __m128 value) { _mm_storeu_ps(cells + (row << 2), value); }
+#endif
+
 	inline static Matrix4 create_translation(const Vector3 & translation) {
 		Matrix4 result;
 		result(0, 3) = translation.x;
@@ -122,24 +130,40 @@ struct alignas(16) Matrix4 {
 
 	inline static Matrix4 transpose(const Matrix4 & matrix) {
 		Matrix4 result;
-
+#if SIMD_SSE
+		__m128 row_0 = matrix.load_row(0);
+		__m128 row_1 = matrix.load_row(1);
+		__m128 row_2 = matrix.load_row(2);
+		__m128 row_3 = matrix.load_row(3);
+
+		_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+
+		result.store_row(0, row_0);
+		result.store_row(1, row_1);
+		result.store_row(2, row_2);
+		result.store_row(3, row_3);
+#else
 		for (int j = 0; j < 4; j++) {
 			for (int i = 0; i < 4; i++) {
 				result(i, j) = matrix(j, i);
 			}
 		}
-
+#endif
 		return result;
 	}
 
 	// Component-wise absolute value
 	inline static Matrix4 abs(const Matrix4 & matrix) {
 		Matrix4 result;
-
+#if SIMD_SSE
+		for (int i = 0; i < 4; i++) {
+			result.store_row(i, SIMD::abs(matrix.load_row(i)));
+		}
+#else
 		for (int i = 0; i < 16; i++) {
 			result.cells[i] = fabsf(matrix.cells[i]);
 		}
-
+#endif
 		return result;
 	}
 };
@@ -147,6 +171,24 @@ struct alignas(16) Matrix4 {
 inline Matrix4 operator*(const Matrix4 & left, const Matrix4 & right) {
 	Matrix4 result;
 
+#if SIMD_SSE
+	__m128 right_row_0 = right.load_row(0);
+	__m128 right_row_1 = right.load_row(1);
+	__m128 right_row_2 = right.load_row(2);
+	__m128 right_row_3 = right.load_row(3);
+
+	// Every row of the result is a linear combination of the rows of 'right'
+	for (int i = 0; i < 4; i++) {
+		__m128 left_row = left.load_row(i);
+
+		__m128 row = _mm_mul_ps(SIMD::broadcast<0>(left_row), right_row_0);
+		row = _mm_add_ps(row, _mm_mul_ps(SIMD::broadcast<1>(left_row), right_row_1));
+		row = _mm_add_ps(row, _mm_mul_ps(SIMD::broadcast<2>(left_row), right_row_2));
+		row = _mm_add_ps(row, _mm_mul_ps(SIMD::broadcast<3>(left_row), right_row_3));
+
+		result.store_row(i, row);
+	}
+#else
 	for (int j = 0; j < 4; j++) {
 		for (int i = 0; i < 4; i++) {
 			result(i, j) = 
@@ -156,6 +198,7 @@ inline Matrix4 operator*(const Matrix4 & left, const Matrix4 & right) {
 				left(i, 3) * right(3, j);
 		}
 	}
+#endif
 
 	return result;
 }
@@ -1,14 +1,12 @@
 #include "Mesh.h"
 
-void Mesh::init(int mesh_data_index) {
-	this->mesh_data_index = mesh_data_index;
+#include "Util.h"
 
-	const MeshData * mesh_data = MeshData::mesh_datas[mesh_data_index];
+void Mesh::init(int mesh_data_index) {
+	this->mesh_data_index     = mesh_data_index;
+	this->mesh_data_index_lod = mesh_data_index;
 
-	aabb_untransformed = AABB::create_empty();
-	for (int i = 0; i < mesh_data->triangle_count; i++) {
-		aabb_untransformed.expand(mesh_data->triangles[i].aabb);
-	}
+	aabb_untransformed = MeshData::mesh_datas[mesh_data_index]->aabb;
 }
 
 void Mesh::update() {
@@ -28,3 +26,31 @@ void Mesh::update() {
 	aabb = AABB::transform(aabb_untransformed, transform);
 	assert(aabb.is_valid());
 }
+
+bool Mesh::update_lod(const Vector3 & camera_position, float pixel_spread_angle) {
+	// Distance from the Camera to the closest point on the AABB of the Mesh
+	Vector3 closest_point = Vector3::min(Vector3::max(camera_position, aabb.min), aabb.max);
+	float   distance      = Vector3::length(closest_point - camera_position);
+
+	// Width of the ray cone of a single pixel at the distance of the Mesh
+	float cone_width = distance * pixel_spread_angle;
+
+	int lod_index = mesh_data_index;
+
+	while (true) {
+		int lod_next = MeshData::mesh_datas[lod_index]->lod_next;
+		if (lod_next == INVALID) break;
+
+		// LOD errors are in object space
+		float error = MeshData::mesh_datas[lod_next]->lod_error * scale;
+		if (error > MESH_LOD_PIXEL_ERROR * cone_width) break;
+
+		lod_index = lod_next;
+	}
+
+	bool lod_changed = lod_index != mesh_data_index_lod;
+
+	mesh_data_index_lod = lod_index;
+
+	return lod_changed;
+}
@@ -6,6 +6,7 @@ struct Mesh {
 	AABB aabb;
 
 	int mesh_data_index;
+	int mesh_data_index_lod; // Index of the currently selected LOD in MeshData::mesh_datas
 	
 	Vector3    position;
 	Quaternion rotation;
@@ -22,5 +23,9 @@ struct Mesh {
 
 	void update();
 
+	// Selects the coarsest LOD whose error bound stays below MESH_LOD_PIXEL_ERROR pixels
+	// Returns true if the selected LOD changed
+	bool update_lod(const Vector3 & camera_position, float pixel_spread_angle);
+
 	inline Vector3 get_center() const { return aabb.get_center(); }
 };
@@ -1,10 +1,12 @@
 #include "MeshData.h"
 
-#include <GL/glew.h>
-
+#include <cstring>
+#include <string>
 #include <unordered_map>
 
 #include "OBJLoader.h"
+#include "MeshSimplifier.h"
+#include "Material.h"
 
 #include "BVHBuilder.h"
 #include "SBVHBuilder.h"
@@ -14,14 +16,29 @@
 #include "Util.h"
 #include "ScopeTimer.h"
 
-struct Vertex {
-	Vector3 position;
-	Vector3 normal;
-	Vector2 uv;
-	int     triangle_id;
+static std::unordered_map<std::string, int> cache;
+
+// Written at the start of every BVH file. A BVH built with different settings (for example a FAST build)
+// is not reused, but rebuilt with the current settings. BVHs cut short by their time budget are never saved, see build_bvh
+struct BVHFileHeader {
+	int version;
+	int bvh_type;
+	int sbvh_preset;
+
+	SBVHSettings sbvh_settings;
 };
 
-static std::unordered_map<std::string, int> cache;
+static constexpr int BVH_FILE_VERSION = 1;
+
+static BVHFileHeader get_file_header() {
+	BVHFileHeader header = { };
+	header.version       = BVH_FILE_VERSION;
+	header.bvh_type      = BVH_TYPE;
+	header.sbvh_preset   = SBVH_PRESET;
+	header.sbvh_settings = SBVHSettings::from_preset(SBVH_PRESET, SBVH_TIME_BUDGET);
+
+	return header;
+}
 
 static void save_to_disk(const BVH & bvh, const MeshData * mesh_data, const char * filename, const char * file_extension) {
 	assert(file_extension[0] == '.');
@@ -29,11 +46,9 @@ static void save_to_disk(const BVH & bvh, const MeshData * mesh_data, const char
 	int    bvh_filename_length = strlen(filename) + strlen(file_extension) + 1;
 	char * bvh_filename        = MALLOCA(char, bvh_filename_length);
 
-	strcpy_s(bvh_filename, bvh_filename_length, filename);
-	strcat_s(bvh_filename, bvh_filename_length, file_extension);
+	snprintf(bvh_filename, bvh_filename_length, "%s%s", filename, file_extension);
 
-	FILE * file;
-	fopen_s(&file, bvh_filename, "wb");
+	FILE * file = Util::file_open(bvh_filename, "wb");
 
 	if (file == nullptr) {
 		printf("WARNING: Unable to save BVH to file %s!\n", bvh_filename);
@@ -43,6 +58,9 @@ static void save_to_disk(const BVH & bvh, const MeshData * mesh_data, const char
 		return;
 	}
 
+	BVHFileHeader header = get_file_header();
+	fwrite(reinterpret_cast<const char *>(&header), sizeof(BVHFileHeader), 1, file);
+
 	fwrite(reinterpret_cast<const char *>(&mesh_data->triangle_count), sizeof(int),      1,                         file);
 	fwrite(reinterpret_cast<const char *>( mesh_data->triangles),      sizeof(Triangle), mesh_data->triangle_count, file);
 
@@ -52,6 +70,8 @@ static void save_to_disk(const BVH & bvh, const MeshData * mesh_data, const char
 	fwrite(reinterpret_cast<const char *>(&bvh.index_count), sizeof(int), 1,               file);
 	fwrite(reinterpret_cast<const char *>( bvh.indices),     sizeof(int), bvh.index_count, file);
 
+	fwrite(reinterpret_cast<const char *>(&mesh_data->lod_error), sizeof(float), 1, file);
+
 	fclose(file);
 
 	FREEA(bvh_filename);
@@ -63,8 +83,7 @@ static bool try_to_load_from_disk(BVH & bvh, MeshData * mesh_data, const char *
 	int    bvh_filename_size = strlen(filename) + strlen(file_extension) + 1;
 	char * bvh_filename      = MALLOCA(char, bvh_filename_size);
 
-	strcpy_s(bvh_filename, bvh_filename_size, filename);
-	strcat_s(bvh_filename, bvh_filename_size, file_extension);
+	snprintf(bvh_filename, bvh_filename_size, "%s%s", filename, file_extension);
 
 	if (!Util::file_exists(bvh_filename) || !Util::file_is_newer(filename, bvh_filename)) {
 		FREEA(bvh_filename);
@@ -72,8 +91,7 @@ static bool try_to_load_from_disk(BVH & bvh, MeshData * mesh_data, const char *
 		return false;
 	}
 
-	FILE * file;
-	fopen_s(&file, bvh_filename, "rb");
+	FILE * file = Util::file_open(bvh_filename, "rb");
 
 	if (!file) {
 		FREEA(bvh_filename);
@@ -81,6 +99,19 @@ static bool try_to_load_from_disk(BVH & bvh, MeshData * mesh_data, const char *
 		return false;
 	}
 
+	// The header is all ints and floats without padding, so it can be compared bytewise
+	BVHFileHeader header_expected = get_file_header();
+	BVHFileHeader header;
+
+	if (fread(reinterpret_cast<char *>(&header), sizeof(BVHFileHeader), 1, file) != 1 || memcmp(&header, &header_expected, sizeof(BVHFileHeader)) != 0) {
+		printf("BVH %s was built with different settings, rebuilding\n", bvh_filename);
+
+		fclose(file);
+		FREEA(bvh_filename);
+
+		return false;
+	}
+
 	fread(reinterpret_cast<char *>(&mesh_data->triangle_count), sizeof(int), 1, file);
 
 	mesh_data->triangles = new Triangle[mesh_data->triangle_count];
@@ -96,6 +127,8 @@ static bool try_to_load_from_disk(BVH & bvh, MeshData * mesh_data, const char *
 	bvh.indices = new int[bvh.index_count];
 	fread(reinterpret_cast<char *>(bvh.indices), sizeof(int), bvh.index_count, file);
 
+	fread(reinterpret_cast<char *>(&mesh_data->lod_error), sizeof(float), 1, file);
+
 	fclose(file);
 
 	printf("Loaded BVH  %s from disk\n", bvh_filename);
@@ -105,6 +138,119 @@ static bool try_to_load_from_disk(BVH & bvh, MeshData * mesh_data, const char *
 	return true;
 }
 
+// Returns false if the build was cut short by its time budget, such a BVH should not be saved to disk,
+// since loading it would skip the full quality build on every later run
+static bool build_bvh(BVH & bvh, const MeshData * mesh_data) {
+	int max_primitives_in_leaf = BVH_TYPE == BVH_CWBVH ? 1 : INT_MAX; 
+
+#if BVH_TYPE == BVH_BVH
+	ScopeTimer timer("BVH Construction");
+			
+	BVHBuilder bvh_builder;
+	bvh_builder.init(&bvh, mesh_data->triangle_count, max_primitives_in_leaf);
+	bvh_builder.build(mesh_data->triangles, mesh_data->triangle_count);
+	bvh_builder.free();
+
+	return true;
+#else // All other BVH types use SBVH as a starting point
+	ScopeTimer timer("SBVH Construction");
+
+	SBVHBuilder sbvh_builder;
+	sbvh_builder.init(&bvh, mesh_data->triangle_count, max_primitives_in_leaf, get_file_header().sbvh_settings);
+	sbvh_builder.build(mesh_data->triangles, mesh_data->triangle_count);
+	sbvh_builder.free();
+
+	return !sbvh_builder.was_cut_short();
+#endif
+}
+
+// Converts the binary BVH into the BVH type used for rendering
+static void init_bvh(MeshData * mesh_data, const BVH & bvh) {
+#if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
+	mesh_data->bvh = bvh;
+#elif BVH_TYPE == BVH_QBVH
+	QBVHBuilder qbvh_builder;
+	qbvh_builder.init(&mesh_data->bvh, bvh);
+	qbvh_builder.build(bvh);
+
+	delete [] bvh.nodes; // The QBVH shares its indices with the SBVH
+#elif BVH_TYPE == BVH_CWBVH
+	CWBVHBuilder cwbvh_builder;
+	cwbvh_builder.init(&mesh_data->bvh, bvh);
+	cwbvh_builder.build(bvh);
+	cwbvh_builder.free();
+
+	delete [] bvh.indices;
+	delete [] bvh.nodes;
+#endif
+}
+
+static void init_aabb(MeshData * mesh_data) {
+	mesh_data->aabb = AABB::create_empty();
+	for (int i = 0; i < mesh_data->triangle_count; i++) {
+		mesh_data->aabb.expand(mesh_data->triangles[i].aabb);
+	}
+}
+
+#if ENABLE_MESH_LODS
+// Appends a chain of simplified MeshDatas to 'mesh_datas', each with its own BVH
+// LODs are cached on disk next to the BVH of the full resolution MeshData
+static void generate_lods(MeshData * mesh_data, const char * filename, const char * file_extension) {
+	// Lights are not simplified, the Light sampling tables refer to the Triangles of the full resolution MeshData
+	for (int t = 0; t < mesh_data->triangle_count; t++) {
+		if (Material::materials[mesh_data->material_offset + mesh_data->triangles[t].material_id].type == Material::Type::LIGHT) return;
+	}
+
+	MeshData * lod_prev = mesh_data;
+
+	for (int lod = 1; lod < MESH_LOD_COUNT; lod++) {
+		int target_triangle_count = int(float(lod_prev->triangle_count) * MESH_LOD_REDUCTION);
+		if (target_triangle_count < MESH_LOD_MIN_TRIANGLE_COUNT) break;
+
+		char lod_file_extension[32];
+		snprintf(lod_file_extension, sizeof(lod_file_extension), ".lod%i%s", lod, file_extension);
+
+		MeshData * lod_mesh_data = new MeshData();
+		lod_mesh_data->material_offset = mesh_data->material_offset;
+
+		BVH bvh;
+		bool bvh_loaded = try_to_load_from_disk(bvh, lod_mesh_data, filename, lod_file_extension);
+
+		if (!bvh_loaded) {
+			float error;
+			{
+				ScopeTimer timer("Mesh Simplification");
+
+				lod_mesh_data->triangles = MeshSimplifier::simplify(lod_prev->triangles, lod_prev->triangle_count, target_triangle_count, lod_mesh_data->triangle_count, error);
+			}
+
+			// Stop if the simplifier could not make significant progress
+			if (lod_mesh_data->triangle_count > (lod_prev->triangle_count + target_triangle_count) / 2) {
+				delete [] lod_mesh_data->triangles;
+				delete lod_mesh_data;
+
+				break;
+			}
+
+			// Errors of subsequent simplifications accumulate
+			lod_mesh_data->lod_error = lod_prev->lod_error + error;
+
+			if (build_bvh(bvh, lod_mesh_data)) save_to_disk(bvh, lod_mesh_data, filename, lod_file_extension);
+		}
+
+		init_bvh (lod_mesh_data, bvh);
+		init_aabb(lod_mesh_data);
+
+		printf("LOD %i of %s: %i triangles, error bound %f\n", lod, filename, lod_mesh_data->triangle_count, lod_mesh_data->lod_error);
+
+		lod_prev->lod_next = MeshData::mesh_datas.size();
+		MeshData::mesh_datas.push_back(lod_mesh_data);
+
+		lod_prev = lod_mesh_data;
+	}
+}
+#endif
+
 int MeshData::load(const char * filename) {
 	int & mesh_data_index = cache[filename];
 
@@ -132,7 +278,7 @@ int MeshData::load(const char * filename) {
 		// Replace ".obj" in the filename with ".mtl"
 		int filename_length = strlen(filename);
 		char * mtl_filename = MALLOCA(char, filename_length + 1);
-		strcpy_s(mtl_filename, filename_length + 1, filename);
+		memcpy(mtl_filename, filename, filename_length + 1);
 		memcpy(mtl_filename + filename_length - 4, ".mtl", 4);
 
 		OBJLoader::load_mtl(mtl_filename, mesh_data);
@@ -141,89 +287,30 @@ int MeshData::load(const char * filename) {
 	} else {
 		OBJLoader::load_obj(filename, mesh_data);
 		
-		int max_primitives_in_leaf = BVH_TYPE == BVH_CWBVH ? 1 : INT_MAX; 
-
-#if BVH_TYPE == BVH_BVH
-		{
-			ScopeTimer timer("BVH Construction");
-			
-			BVHBuilder bvh_builder;
-			bvh_builder.init(&bvh, mesh_data->triangle_count, max_primitives_in_leaf);
-			bvh_builder.build(mesh_data->triangles, mesh_data->triangle_count);
-			bvh_builder.free();
-		}
-#else // All other BVH types use SBVH as a starting point
-		{
-			ScopeTimer timer("SBVH Construction");
-
-			SBVHBuilder sbvh_builder;
-			sbvh_builder.init(&bvh, mesh_data->triangle_count, max_primitives_in_leaf);
-			sbvh_builder.build(mesh_data->triangles, mesh_data->triangle_count);
-			sbvh_builder.free();
-		}
-#endif
-
-		save_to_disk(bvh, mesh_data, filename, file_extension);
+		if (build_bvh(bvh, mesh_data)) save_to_disk(bvh, mesh_data, filename, file_extension);
 	}
 
-#if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
-	mesh_data->bvh = bvh;
-#elif BVH_TYPE == BVH_QBVH
-	QBVHBuilder qbvh_builder;
-	qbvh_builder.init(&mesh_data->bvh, bvh);
-	qbvh_builder.build(bvh);
-#elif BVH_TYPE == BVH_CWBVH
-	CWBVHBuilder cwbvh_builder;
-	cwbvh_builder.init(&mesh_data->bvh, bvh);
-	cwbvh_builder.build(bvh);
-	cwbvh_builder.free();
+	init_bvh (mesh_data, bvh);
+	init_aabb(mesh_data);
+
+#if ENABLE_MESH_LODS
+	generate_lods(mesh_data, filename, file_extension);
 #endif
 
 	return mesh_data_index;
 }
 
-void MeshData::gl_init(int reverse_indices[]) const {
-	int      vertex_count = triangle_count * 3;
-	Vertex * vertices = new Vertex[vertex_count];
-
-	for (int t = 0; t < triangle_count; t++) {
-		int index_0 = 3 * t;
-		int index_1 = 3 * t + 1;
-		int index_2 = 3 * t + 2;
-
-		vertices[index_0].position = triangles[t].position_0;
-		vertices[index_1].position = triangles[t].position_1;
-		vertices[index_2].position = triangles[t].position_2;
+void MeshData::free_host_geometry(bool keep_triangles) {
+	for (MeshData * mesh_data : mesh_datas) {
+		delete [] mesh_data->bvh.nodes;
+		delete [] mesh_data->bvh.indices;
 
-		vertices[index_0].normal = triangles[t].normal_0;
-		vertices[index_1].normal = triangles[t].normal_1;
-		vertices[index_2].normal = triangles[t].normal_2;
+		mesh_data->bvh.nodes   = nullptr;
+		mesh_data->bvh.indices = nullptr;
 
-		// Barycentric coordinates
-		vertices[index_0].uv = Vector2(0.0f, 0.0f);
-		vertices[index_1].uv = Vector2(1.0f, 0.0f);
-		vertices[index_2].uv = Vector2(0.0f, 1.0f);
-
-		vertices[index_0].triangle_id = reverse_indices[t];
-		vertices[index_1].triangle_id = reverse_indices[t];
-		vertices[index_2].triangle_id = reverse_indices[t];
+		if (!keep_triangles) {
+			delete [] mesh_data->triangles;
+			mesh_data->triangles = nullptr;
+		}
 	}
-
-	glGenBuffers(1, &gl_vbo);
-
-	glBindBuffer(GL_ARRAY_BUFFER, gl_vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(Vertex), vertices, GL_STATIC_DRAW);
-
-	delete [] vertices;
-}
-
-void MeshData::gl_render() const {
-	glBindBuffer(GL_ARRAY_BUFFER, gl_vbo);
-
-	glVertexAttribPointer (0, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, position)));
-	glVertexAttribPointer (1, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, normal)));
-	glVertexAttribPointer (2, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, uv)));
-	glVertexAttribIPointer(3, 1, GL_INT,          sizeof(Vertex), reinterpret_cast<const GLvoid *>(offsetof(Vertex, triangle_id)));
-
-	glDrawArrays(GL_TRIANGLES, 0, triangle_count * 3);
 }
@@ -11,14 +11,19 @@ struct MeshData {
 
 	BVHType bvh;
 
+	AABB aabb; // Object space bounds, remain valid after the Host geometry is released
+
 	int material_offset;
-	
-	mutable unsigned gl_vbo;
 
-	void gl_init(int reverse_indices[]) const;
-	void gl_render() const;
+	// LODs form a chain of progressively simplified MeshDatas
+	int   lod_next  = -1;   // Index of the next coarser LOD in 'mesh_datas', -1 if this is the coarsest LOD
+	float lod_error = 0.0f; // Object space error bound with respect to the full resolution MeshData
 
 	static int load(const char * filename);
 
-	inline static std::vector<const MeshData *> mesh_datas;
+	// Releases the Host copies of the BVHs, and of the Triangles unless 'keep_triangles' is set.
+	// Called once the geometry has been uploaded to the Device
+	static void free_host_geometry(bool keep_triangles);
+
+	inline static std::vector<MeshData *> mesh_datas;
 };
@@ -0,0 +1,719 @@
+#include "MeshSimplifier.h"
+
+#include <cstring>
+#include <cmath>
+
+#include <queue>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Math.h"
+
+#include "Util.h"
+
+// Symmetric 4x4 matrix that represents the sum of squared distances to a set of planes
+struct Quadric {
+	double a2, ab, ac, ad;
+	double     b2, bc, bd;
+	double         c2, cd;
+	double             d2;
+
+	inline static Quadric from_plane(double a, double b, double c, double d, double weight) {
+		Quadric quadric;
+		quadric.a2 = weight * a * a; quadric.ab = weight * a * b; quadric.ac = weight * a * c; quadric.ad = weight * a * d;
+		quadric.b2 = weight * b * b; quadric.bc = weight * b * c; quadric.bd = weight * b * d;
+		quadric.c2 = weight * c * c; quadric.cd = weight * c * d;
+		quadric.d2 = weight * d * d;
+
+		return quadric;
+	}
+
+	inline void add(const Quadric & other) {
+		a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+		b2 += other.b2; bc += other.bc; bd += other.bd;
+		c2 += other.c2; cd += other.cd;
+		d2 += other.d2;
+	}
+
+	inline static Quadric sum(const Quadric & left, const Quadric & right) {
+		Quadric result = left;
+		result.add(right);
+
+		return result;
+	}
+
+	// Sum of squared distances of the given point to all planes
+	inline double evaluate(const Vector3 & point) const {
+		double x = point.x;
+		double y = point.y;
+		double z = point.z;
+
+		double result =
+			a2*x*x + 2.0*ab*x*y + 2.0*ac*x*z + 2.0*ad*x +
+			         b2*y*y     + 2.0*bc*y*z + 2.0*bd*y +
+			                      c2*z*z     + 2.0*cd*z +
+			                                   d2;
+
+		return result > 0.0 ? result : 0.0; // Guard against round off
+	}
+
+	// Finds the point that minimizes the error by solving the 3x3 linear system using Cramer's rule
+	// Returns false if the system is (close to) singular
+	inline bool optimize(Vector3 & point) const {
+		double det =
+			a2 * (b2 * c2 - bc * bc) -
+			ab * (ab * c2 - bc * ac) +
+			ac * (ab * bc - b2 * ac);
+
+		double scale = a2 * a2 + b2 * b2 + c2 * c2;
+		if (fabs(det) <= 1e-12 * scale * sqrt(scale)) return false;
+
+		double inv_det = 1.0 / det;
+
+		point.x = float(inv_det * (-ad * (b2 * c2 - bc * bc) + ab * (bd * c2 - bc * cd) - ac * (bd * bc - b2 * cd)));
+		point.y = float(inv_det * ( a2 * (-bd * c2 + cd * bc) + ad * (ab * c2 - bc * ac) - ac * (-ab * cd + bd * ac)));
+		point.z = float(inv_det * ( a2 * (-b2 * cd + bc * bd) - ab * (-ab * cd + bd * ac) - ad * (ab * bc - b2 * ac)));
+
+		return true;
+	}
+};
+
+// Candidate edge collapse, Vertex 1 is merged into Vertex 0 at the target position
+struct Collapse {
+	float cost;
+
+	int vertex_0, version_0;
+	int vertex_1, version_1;
+
+	Vector3 target;
+
+	inline bool operator>(const Collapse & other) const { return cost > other.cost; }
+};
+
+struct PositionKey {
+	unsigned bits[3];
+
+	inline bool operator==(const PositionKey & other) const {
+		return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+	}
+};
+
+struct PositionKeyHash {
+	inline size_t operator()(const PositionKey & key) const {
+		return (size_t(key.bits[0]) * 73856093u) ^ (size_t(key.bits[1]) * 19349663u) ^ (size_t(key.bits[2]) * 83492791u);
+	}
+};
+
+// Boundary edges are preserved by adding a heavily weighted plane perpendicular to the boundary Triangle
+static constexpr double BOUNDARY_WEIGHT = 100.0;
+
+// The error bound is refined until it lies within this fraction of the largest distance found, or within this fraction of the Mesh size
+static constexpr float ERROR_TOLERANCE_RELATIVE = 0.1f;
+static constexpr float ERROR_TOLERANCE_ABSOLUTE = 0.001f;
+static constexpr int   ERROR_MAX_DEPTH = 8;
+
+// Closest point on the Triangle (a, b, c) to p, see Real-Time Collision Detection (Ericson 2005) section 5.1.5
+static Vector3 closest_point_on_triangle(const Vector3 & p, const Vector3 & a, const Vector3 & b, const Vector3 & c) {
+	Vector3 ab = b - a;
+	Vector3 ac = c - a;
+
+	Vector3 ap = p - a;
+	float d1 = Vector3::dot(ab, ap);
+	float d2 = Vector3::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+	Vector3 bp = p - b;
+	float d3 = Vector3::dot(ab, bp);
+	float d4 = Vector3::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + (d1 / (d1 - d3)) * ab;
+
+	Vector3 cp = p - c;
+	float d5 = Vector3::dot(ab, cp);
+	float d6 = Vector3::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + (d2 / (d2 - d6)) * ac;
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+
+	float inv_denom = 1.0f / (va + vb + vc);
+	return a + (vb * inv_denom) * ab + (vc * inv_denom) * ac;
+}
+
+// Uniform grid over a set of Triangles, used to find the distance from a point to the closest Triangle
+struct TriangleGrid {
+	std::vector<Vector3> positions; // Three per Triangle
+
+	AABB  bounds;
+	float cell_size;
+	int   resolution[3];
+
+	// The Triangles overlapping cell i are cell_triangles[cell_offsets[i] .. cell_offsets[i + 1])
+	std::vector<int> cell_offsets;
+	std::vector<int> cell_triangles;
+
+	inline void get_cell_range(const Vector3 & min, const Vector3 & max, int cell_min[3], int cell_max[3]) const {
+		for (int dimension = 0; dimension < 3; dimension++) {
+			cell_min[dimension] = Math::clamp(int(floorf((min[dimension] - bounds.min[dimension]) / cell_size)), 0, resolution[dimension] - 1);
+			cell_max[dimension] = Math::clamp(int(floorf((max[dimension] - bounds.min[dimension]) / cell_size)), 0, resolution[dimension] - 1);
+		}
+	}
+
+	inline int get_cell_index(int x, int y, int z) const {
+		return x + resolution[0] * (y + resolution[1] * z);
+	}
+
+	void init(const Triangle * triangles, int triangle_count) {
+		bounds = AABB::create_empty();
+
+		float area = 0.0f;
+
+		// Degenerate Triangles are skipped, they do not add any surface
+		for (int t = 0; t < triangle_count; t++) {
+			Vector3 normal = Vector3::cross(triangles[t].position_1 - triangles[t].position_0, triangles[t].position_2 - triangles[t].position_0);
+			if (Vector3::length_squared(normal) == 0.0f) continue;
+
+			positions.push_back(triangles[t].position_0);
+			positions.push_back(triangles[t].position_1);
+			positions.push_back(triangles[t].position_2);
+
+			bounds.expand(triangles[t].position_0);
+			bounds.expand(triangles[t].position_1);
+			bounds.expand(triangles[t].position_2);
+
+			area += 0.5f * Vector3::length(normal);
+		}
+
+		int count = int(positions.size()) / 3;
+		if (count == 0) {
+			bounds.min = Vector3(0.0f);
+			bounds.max = Vector3(0.0f);
+		}
+
+		Vector3 extent = bounds.max - bounds.min;
+		float   extent_max = Math::max(Math::max(extent.x, extent.y), Math::max(extent.z, 1e-6f));
+
+		// Cells are about twice the size of an average Triangle, but there are at most a few cells per Triangle
+		cell_size = Math::max(2.0f * sqrtf(area / float(Math::max(count, 1))), 1e-3f * extent_max);
+
+		while (true) {
+			for (int dimension = 0; dimension < 3; dimension++) {
+				resolution[dimension] = Math::max(int(ceilf(extent[dimension] / cell_size)), 1);
+			}
+			if (double(resolution[0]) * double(resolution[1]) * double(resolution[2]) <= 4.0 * double(count) + 64.0) break;
+
+			cell_size *= 1.25f;
+		}
+
+		int cell_count = resolution[0] * resolution[1] * resolution[2];
+
+		// Count the Triangles per cell, then scatter them
+		cell_offsets.assign(cell_count + 1, 0);
+
+		auto for_each_cell = [&](int t, auto visit) {
+			const Vector3 * triangle = &positions[3 * t];
+
+			int cell_min[3], cell_max[3];
+			get_cell_range(
+				Vector3::min(Vector3::min(triangle[0], triangle[1]), triangle[2]),
+				Vector3::max(Vector3::max(triangle[0], triangle[1]), triangle[2]),
+				cell_min, cell_max
+			);
+
+			for (int z = cell_min[2]; z <= cell_max[2]; z++) {
+				for (int y = cell_min[1]; y <= cell_max[1]; y++) {
+					for (int x = cell_min[0]; x <= cell_max[0]; x++) {
+						visit(get_cell_index(x, y, z));
+					}
+				}
+			}
+		};
+
+		for (int t = 0; t < count; t++) {
+			for_each_cell(t, [&](int cell) { cell_offsets[cell + 1]++; });
+		}
+		for (int i = 0; i < cell_count; i++) {
+			cell_offsets[i + 1] += cell_offsets[i];
+		}
+
+		cell_triangles.resize(cell_offsets[cell_count]);
+
+		std::vector<int> cell_fill(cell_offsets.begin(), cell_offsets.end() - 1);
+
+		for (int t = 0; t < count; t++) {
+			for_each_cell(t, [&](int cell) { cell_triangles[cell_fill[cell]++] = t; });
+		}
+	}
+
+	inline float distance_to_triangle(const Vector3 & point, int triangle_index) const {
+		const Vector3 * triangle = &positions[3 * triangle_index];
+
+		return Vector3::length(closest_point_on_triangle(point, triangle[0], triangle[1], triangle[2]) - point);
+	}
+
+	// Distance from the point to the closest Triangle, searches rings of cells around the point until no closer Triangle can exist
+	float distance(const Vector3 & point, int & closest_triangle) const {
+		closest_triangle = -1;
+
+		if (positions.empty()) return INFINITY;
+
+		int cell[3], cell_unused[3];
+		get_cell_range(point, point, cell, cell_unused);
+
+		float distance_squared = INFINITY;
+
+		int ring_max = Math::max(Math::max(resolution[0], resolution[1]), resolution[2]);
+
+		for (int ring = 0; ring < ring_max; ring++) {
+			for (int z = Math::max(cell[2] - ring, 0); z <= Math::min(cell[2] + ring, resolution[2] - 1); z++) {
+				for (int y = Math::max(cell[1] - ring, 0); y <= Math::min(cell[1] + ring, resolution[1] - 1); y++) {
+					for (int x = Math::max(cell[0] - ring, 0); x <= Math::min(cell[0] + ring, resolution[0] - 1); x++) {
+						// Only visit the shell of the ring, the inside was visited by previous rings
+						if (abs(x - cell[0]) != ring && abs(y - cell[1]) != ring && abs(z - cell[2]) != ring) continue;
+
+						int cell_index = get_cell_index(x, y, z);
+
+						for (int i = cell_offsets[cell_index]; i < cell_offsets[cell_index + 1]; i++) {
+							const Vector3 * triangle = &positions[3 * cell_triangles[i]];
+
+							Vector3 closest = closest_point_on_triangle(point, triangle[0], triangle[1], triangle[2]);
+
+							float closest_distance_squared = Vector3::length_squared(closest - point);
+							if (closest_distance_squared < distance_squared) {
+								distance_squared = closest_distance_squared;
+								closest_triangle = cell_triangles[i];
+							}
+						}
+					}
+				}
+			}
+
+			// Stop if the closest Triangle is closer than any cell that has not been searched yet
+			float reach = INFINITY;
+
+			for (int dimension = 0; dimension < 3; dimension++) {
+				if (cell[dimension] - ring > 0) {
+					reach = Math::min(reach, point[dimension] - (bounds.min[dimension] + float(cell[dimension] - ring) * cell_size));
+				}
+				if (cell[dimension] + ring < resolution[dimension] - 1) {
+					reach = Math::min(reach, (bounds.min[dimension] + float(cell[dimension] + ring + 1) * cell_size) - point[dimension]);
+				}
+			}
+
+			if (distance_squared <= reach * reach || reach == INFINITY) break;
+		}
+
+		return sqrtf(distance_squared);
+	}
+};
+
+// Upper bound on the distance from any point on the given Triangles to the closest Triangle in the grid, using two bounds per Patch:
+// - The distance to a single Triangle is convex, so on a Patch it is at most the largest distance from its corners to that Triangle
+// - The distance to a surface changes by at most the distance a point moves, and every point of a Patch lies within
+//   (longest edge / sqrt(3)) of one of its corners
+// Patches are subdivided until their bound is close to the largest distance found
+static float distance_bound(const Triangle * triangles, int triangle_count, const TriangleGrid & grid, float tolerance_absolute) {
+	struct Patch {
+		Vector3 position[3];
+		float   distance[3];
+		int     closest [3];
+		int     depth;
+	};
+
+	std::vector<Patch> patches(triangle_count);
+
+	float distance_max = 0.0f;
+
+	// Distances at the corners are exact, they provide the lower bound that decides how far to refine
+	for (int t = 0; t < triangle_count; t++) {
+		patches[t].position[0] = triangles[t].position_0;
+		patches[t].position[1] = triangles[t].position_1;
+		patches[t].position[2] = triangles[t].position_2;
+		patches[t].depth = 0;
+
+		for (int c = 0; c < 3; c++) {
+			patches[t].distance[c] = grid.distance(patches[t].position[c], patches[t].closest[c]);
+			distance_max = Math::max(distance_max, patches[t].distance[c]);
+		}
+	}
+
+	float bound = distance_max;
+
+	while (!patches.empty()) {
+		Patch patch = patches.back();
+		patches.pop_back();
+
+		float edge_length_squared = Math::max(Math::max(
+			Vector3::length_squared(patch.position[1] - patch.position[0]),
+			Vector3::length_squared(patch.position[2] - patch.position[1])),
+			Vector3::length_squared(patch.position[0] - patch.position[2])
+		);
+
+		float patch_bound = Math::max(Math::max(patch.distance[0], patch.distance[1]), patch.distance[2]) + 0.57735027f * sqrtf(edge_length_squared);
+
+		// Try the closest Triangles of the corners and of the center, corners often lie on an edge shared by several closest Triangles
+		int candidates[4] = { patch.closest[0], patch.closest[1], patch.closest[2], -1 };
+
+		bool same_closest = patch.closest[0] == patch.closest[1] && patch.closest[1] == patch.closest[2];
+		if (!same_closest) {
+			grid.distance((patch.position[0] + patch.position[1] + patch.position[2]) / 3.0f, candidates[3]);
+		}
+
+		for (int i = 0; i < 4; i++) {
+			if (candidates[i] == -1) continue;
+			if (same_closest && i > 0) break;
+
+			float triangle_bound = 0.0f;
+
+			for (int c = 0; c < 3 && triangle_bound < patch_bound; c++) {
+				triangle_bound = Math::max(triangle_bound, patch.closest[c] == candidates[i] ? patch.distance[c] : grid.distance_to_triangle(patch.position[c], candidates[i]));
+			}
+
+			patch_bound = Math::min(patch_bound, triangle_bound);
+		}
+
+		float tolerance = Math::max(ERROR_TOLERANCE_RELATIVE * distance_max, tolerance_absolute);
+
+		if (patch_bound <= distance_max + tolerance || patch.depth == ERROR_MAX_DEPTH) {
+			bound = Math::max(bound, patch_bound);
+			continue;
+		}
+
+		// Split into four Patches at the edge midpoints
+		Vector3 midpoint[3];
+		float   midpoint_distance[3];
+		int     midpoint_closest [3];
+
+		for (int c = 0; c < 3; c++) {
+			midpoint[c]          = 0.5f * (patch.position[c] + patch.position[(c + 1) % 3]);
+			midpoint_distance[c] = grid.distance(midpoint[c], midpoint_closest[c]);
+
+			distance_max = Math::max(distance_max, midpoint_distance[c]);
+		}
+
+		for (int c = 0; c < 3; c++) {
+			int c_prev = (c + 2) % 3;
+
+			patches.push_back({
+				{ patch.position[c], midpoint[c],          midpoint[c_prev] },
+				{ patch.distance[c], midpoint_distance[c], midpoint_distance[c_prev] },
+				{ patch.closest [c], midpoint_closest [c], midpoint_closest [c_prev] },
+				patch.depth + 1
+			});
+		}
+		patches.push_back({
+			{ midpoint[0],          midpoint[1],          midpoint[2] },
+			{ midpoint_distance[0], midpoint_distance[1], midpoint_distance[2] },
+			{ midpoint_closest [0], midpoint_closest [1], midpoint_closest [2] },
+			patch.depth + 1
+		});
+	}
+
+	return bound;
+}
+
+Triangle * MeshSimplifier::simplify(const Triangle * triangles, int triangle_count, int target_triangle_count, int & result_triangle_count, float & error) {
+	std::vector<Vector3> positions;
+	std::vector<int>     triangle_vertices(3 * triangle_count);
+
+	// Weld vertices based on their exact position
+	{
+		std::unordered_map<PositionKey, int, PositionKeyHash> vertex_map;
+		vertex_map.reserve(triangle_count * 3);
+
+		for (int t = 0; t < triangle_count; t++) {
+			const Vector3 * corners[3] = { &triangles[t].position_0, &triangles[t].position_1, &triangles[t].position_2 };
+
+			for (int c = 0; c < 3; c++) {
+				PositionKey key;
+				memcpy(key.bits, corners[c]->data, sizeof(key.bits));
+
+				auto [it, inserted] = vertex_map.try_emplace(key, int(positions.size()));
+				if (inserted) positions.push_back(*corners[c]);
+
+				triangle_vertices[3*t + c] = it->second;
+			}
+		}
+	}
+
+	int vertex_count = positions.size();
+
+	std::vector<bool> triangle_removed(triangle_count, false);
+	std::vector<bool> vertex_removed  (vertex_count,   false);
+	std::vector<int>  vertex_version  (vertex_count,   0);
+
+	std::vector<std::vector<int>> vertex_triangles(vertex_count);
+
+	// The Quadrics include boundary constraints, they only guide the order of the collapses.
+	// The geometric error is measured afterwards, see distance_bound
+	std::vector<Quadric> quadrics(vertex_count, Quadric::from_plane(0.0, 0.0, 0.0, 0.0, 0.0));
+
+	int triangles_alive = 0;
+
+	for (int t = 0; t < triangle_count; t++) {
+		int v0 = triangle_vertices[3*t    ];
+		int v1 = triangle_vertices[3*t + 1];
+		int v2 = triangle_vertices[3*t + 2];
+
+		Vector3 normal = Vector3::cross(positions[v1] - positions[v0], positions[v2] - positions[v0]);
+		float   length = Vector3::length(normal);
+
+		// Remove degenerate Triangles up front
+		if (v0 == v1 || v1 == v2 || v2 == v0 || length == 0.0f) {
+			triangle_removed[t] = true;
+
+			continue;
+		}
+
+		normal /= length;
+
+		Quadric plane = Quadric::from_plane(normal.x, normal.y, normal.z, -Vector3::dot(normal, positions[v0]), 1.0);
+
+		for (int c = 0; c < 3; c++) {
+			int v = triangle_vertices[3*t + c];
+
+			quadrics[v].add(plane);
+
+			vertex_triangles[v].push_back(t);
+		}
+
+		triangles_alive++;
+	}
+
+	// Find boundary edges, these are referenced by exactly one Triangle
+	std::unordered_map<unsigned long long, int> edge_counts;
+	edge_counts.reserve(triangle_count * 3);
+
+	auto edge_key = [](int a, int b) {
+		if (a > b) Util::swap(a, b);
+		return (unsigned long long)(a) << 32 | (unsigned long long)(b);
+	};
+
+	for (int t = 0; t < triangle_count; t++) {
+		if (triangle_removed[t]) continue;
+
+		for (int c = 0; c < 3; c++) {
+			edge_counts[edge_key(triangle_vertices[3*t + c], triangle_vertices[3*t + (c + 1) % 3])]++;
+		}
+	}
+
+	for (int t = 0; t < triangle_count; t++) {
+		if (triangle_removed[t]) continue;
+
+		const Vector3 & p0 = positions[triangle_vertices[3*t    ]];
+		const Vector3 & p1 = positions[triangle_vertices[3*t + 1]];
+		const Vector3 & p2 = positions[triangle_vertices[3*t + 2]];
+
+		Vector3 normal = Vector3::normalize(Vector3::cross(p1 - p0, p2 - p0));
+
+		for (int c = 0; c < 3; c++) {
+			int a = triangle_vertices[3*t + c];
+			int b = triangle_vertices[3*t + (c + 1) % 3];
+
+			if (edge_counts[edge_key(a, b)] != 1) continue;
+
+			Vector3 edge = positions[b] - positions[a];
+			Vector3 boundary_normal = Vector3::cross(edge, normal);
+
+			float length = Vector3::length(boundary_normal);
+			if (length == 0.0f) continue;
+
+			boundary_normal /= length;
+
+			Quadric constraint = Quadric::from_plane(boundary_normal.x, boundary_normal.y, boundary_normal.z, -Vector3::dot(boundary_normal, positions[a]), BOUNDARY_WEIGHT);
+
+			quadrics[a].add(constraint);
+			quadrics[b].add(constraint);
+		}
+	}
+
+	auto calculate_collapse = [&](int v0, int v1) {
+		Quadric quadric = Quadric::sum(quadrics[v0], quadrics[v1]);
+
+		Vector3 midpoint = 0.5f * (positions[v0] + positions[v1]);
+
+		Collapse collapse;
+		collapse.vertex_0  = v0;
+		collapse.version_0 = vertex_version[v0];
+		collapse.vertex_1  = v1;
+		collapse.version_1 = vertex_version[v1];
+
+		Vector3 optimum;
+		float   edge_length = Vector3::length(positions[v1] - positions[v0]);
+
+		// Use the optimal position only if it is well defined and lies close to the edge,
+		// otherwise pick the best of the two endpoints and the midpoint
+		if (quadric.optimize(optimum) && Vector3::length(optimum - midpoint) <= edge_length) {
+			collapse.target = optimum;
+			collapse.cost   = float(quadric.evaluate(optimum));
+		} else {
+			const Vector3 candidates[3] = { positions[v0], positions[v1], midpoint };
+
+			collapse.cost = INFINITY;
+
+			for (int i = 0; i < 3; i++) {
+				float cost = float(quadric.evaluate(candidates[i]));
+				if (cost < collapse.cost) {
+					collapse.cost   = cost;
+					collapse.target = candidates[i];
+				}
+			}
+		}
+
+		return collapse;
+	};
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+	for (int t = 0; t < triangle_count; t++) {
+		if (triangle_removed[t]) continue;
+
+		for (int c = 0; c < 3; c++) {
+			int a = triangle_vertices[3*t + c];
+			int b = triangle_vertices[3*t + (c + 1) % 3];
+
+			// Every interior edge is shared by two Triangles, only add it once
+			if (a < b || edge_counts[edge_key(a, b)] == 1) heap.push(calculate_collapse(a, b));
+		}
+	}
+
+	edge_counts.clear();
+
+	// Checks whether moving vertex 'v' to 'target' would flip or degenerate any Triangle that is not removed by the collapse
+	auto collapse_flips_triangles = [&](int v, int v_other, const Vector3 & target) {
+		for (int t : vertex_triangles[v]) {
+			if (triangle_removed[t]) continue;
+
+			int corner = -1;
+			bool contains_other = false;
+
+			for (int c = 0; c < 3; c++) {
+				if (triangle_vertices[3*t + c] == v)       corner = c;
+				if (triangle_vertices[3*t + c] == v_other) contains_other = true;
+			}
+
+			// Triangles containing both vertices will be removed
+			if (contains_other) continue;
+
+			assert(corner != -1);
+
+			const Vector3 & p_a = positions[triangle_vertices[3*t + (corner + 1) % 3]];
+			const Vector3 & p_b = positions[triangle_vertices[3*t + (corner + 2) % 3]];
+
+			Vector3 normal_old = Vector3::cross(p_a - positions[v], p_b - positions[v]);
+			Vector3 normal_new = Vector3::cross(p_a - target,       p_b - target);
+
+			if (Vector3::dot(normal_old, normal_new) <= 0.0f) return true;
+		}
+
+		return false;
+	};
+
+	std::vector<int> neighbours;
+
+	while (triangles_alive > target_triangle_count && !heap.empty()) {
+		Collapse collapse = heap.top();
+		heap.pop();
+
+		int v0 = collapse.vertex_0;
+		int v1 = collapse.vertex_1;
+
+		// Skip collapses that were invalidated by earlier collapses
+		if (vertex_removed[v0] || vertex_removed[v1]) continue;
+		if (vertex_version[v0] != collapse.version_0 || vertex_version[v1] != collapse.version_1) continue;
+
+		if (collapse_flips_triangles(v0, v1, collapse.target) || collapse_flips_triangles(v1, v0, collapse.target)) continue;
+
+		// Merge v1 into v0
+		positions[v0] = collapse.target;
+
+		quadrics[v0].add(quadrics[v1]);
+
+		for (int t : vertex_triangles[v1]) {
+			if (triangle_removed[t]) continue;
+
+			bool contains_v0 =
+				triangle_vertices[3*t    ] == v0 ||
+				triangle_vertices[3*t + 1] == v0 ||
+				triangle_vertices[3*t + 2] == v0;
+
+			if (contains_v0) {
+				// Triangle collapses onto the edge
+				triangle_removed[t] = true;
+				triangles_alive--;
+			} else {
+				for (int c = 0; c < 3; c++) {
+					if (triangle_vertices[3*t + c] == v1) triangle_vertices[3*t + c] = v0;
+				}
+
+				vertex_triangles[v0].push_back(t);
+			}
+		}
+
+		vertex_removed[v1] = true;
+		vertex_triangles[v1].clear();
+		vertex_triangles[v1].shrink_to_fit();
+
+		vertex_version[v0]++;
+
+		// Remove references to removed Triangles and gather the neighbouring vertices of v0
+		std::vector<int> & adjacent = vertex_triangles[v0];
+		adjacent.erase(std::remove_if(adjacent.begin(), adjacent.end(), [&](int t) { return triangle_removed[t]; }), adjacent.end());
+
+		neighbours.clear();
+		for (int t : adjacent) {
+			for (int c = 0; c < 3; c++) {
+				int v = triangle_vertices[3*t + c];
+
+				if (v != v0 && std::find(neighbours.begin(), neighbours.end(), v) == neighbours.end()) {
+					neighbours.push_back(v);
+				}
+			}
+		}
+
+		for (int v : neighbours) {
+			heap.push(calculate_collapse(v0, v));
+		}
+	}
+
+	// Construct the simplified Triangles, moved corners keep their original attributes
+	Triangle * result = new Triangle[triangles_alive];
+	result_triangle_count = 0;
+
+	for (int t = 0; t < triangle_count; t++) {
+		if (triangle_removed[t]) continue;
+
+		Triangle & triangle = result[result_triangle_count++];
+		triangle = triangles[t];
+
+		triangle.position_0 = positions[triangle_vertices[3*t    ]];
+		triangle.position_1 = positions[triangle_vertices[3*t + 1]];
+		triangle.position_2 = positions[triangle_vertices[3*t + 2]];
+
+		Vector3 vertices[3] = { triangle.position_0, triangle.position_1, triangle.position_2 };
+		triangle.aabb = AABB::from_points(vertices, 3);
+	}
+
+	assert(result_triangle_count == triangles_alive);
+
+	// Two sided Hausdorff distance between the original and the simplified surface
+	TriangleGrid grid_original;
+	TriangleGrid grid_result;
+	grid_original.init(triangles, triangle_count);
+	grid_result  .init(result,    result_triangle_count);
+
+	float tolerance_absolute = ERROR_TOLERANCE_ABSOLUTE * Vector3::length(grid_original.bounds.max - grid_original.bounds.min);
+
+	error = Math::max(
+		distance_bound(result,    result_triangle_count, grid_original, tolerance_absolute),
+		distance_bound(triangles, triangle_count,        grid_result,   tolerance_absolute)
+	);
+
+	return result;
+}
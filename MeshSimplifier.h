@@ -0,0 +1,11 @@
+#pragma once
+#include "Triangle.h"
+
+// Host side Mesh simplification, used to generate the LOD chain of a MeshData
+namespace MeshSimplifier {
+	// Simplifies the given Triangles using Quadric Error Metric edge collapses (Garland and Heckbert 1997).
+	// Vertices are welded based on their position, per corner attributes (normals, tex coords) are preserved.
+	// Edges are collapsed until at most 'target_triangle_count' Triangles remain or no valid collapses are left.
+	// 'error' is set to an upper bound on the (two sided) Hausdorff distance between the original and the simplified surface
+	Triangle * simplify(const Triangle * triangles, int triangle_count, int target_triangle_count, int & result_triangle_count, float & error);
+}
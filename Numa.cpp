@@ -0,0 +1,192 @@
+#include "Numa.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef _WIN32
+static_assert(8 * sizeof(KAFFINITY) == Numa::CPUS_PER_GROUP, "A processor group holds as many CPUs as there are bits in its mask");
+#endif
+
+void Numa::parse_list(const char * list, std::vector<int> & ids) {
+	while (*list) {
+		char * end;
+		int first = strtol(list, &end, 10);
+		if (end == list) break;
+
+		int last = first;
+		if (*end == '-') {
+			list = end + 1;
+			last = strtol(list, &end, 10);
+		}
+
+		for (int id = first; id <= last; id++) ids.push_back(id);
+
+		list = end;
+		if (*list == ',') list++;
+	}
+}
+
+std::vector<std::vector<int>> Numa::get_topology_linux(const char * online, const std::function<std::string(int node)> & get_cpulist) {
+	std::vector<std::vector<int>> nodes;
+
+	// Node ids can have gaps, for instance when a node is offline, so only the nodes listed as online are visited
+	std::vector<int> node_ids;
+	parse_list(online, node_ids);
+
+	for (int node : node_ids) {
+		std::vector<int> cpus;
+		parse_list(get_cpulist(node).c_str(), cpus);
+
+		// Nodes with only memory and no CPUs do not run any threads
+		if (cpus.size() > 0) nodes.push_back(cpus);
+	}
+
+	return nodes;
+}
+
+std::vector<std::vector<int>> Numa::get_topology_windows(const std::vector<GroupAffinity> & affinities) {
+	std::vector<std::vector<int>> nodes;
+
+	// Node numbers can have gaps, nodes that do not exist simply have no processors.
+	// Every node lies within a single processor group, which may hold up to CPUS_PER_GROUP of its CPUs
+	for (const GroupAffinity & affinity : affinities) {
+		std::vector<int> cpus;
+		for (int bit = 0; bit < CPUS_PER_GROUP; bit++) {
+			if (affinity.mask & (1ull << bit)) cpus.push_back(affinity.group * CPUS_PER_GROUP + bit);
+		}
+
+		if (cpus.size() > 0) nodes.push_back(cpus);
+	}
+
+	return nodes;
+}
+
+#ifdef __linux__
+// Returns an empty string if the file does not exist
+static std::string read_file(const char * file_path) {
+	FILE * file = fopen(file_path, "r");
+	if (!file) return { };
+
+	char list[4096] = { };
+	fgets(list, sizeof(list), file);
+	fclose(file);
+
+	return list;
+}
+#endif
+
+static std::vector<std::vector<int>> detect_topology() {
+	std::vector<std::vector<int>> nodes;
+
+#ifdef _WIN32
+	ULONG node_highest;
+	if (GetNumaHighestNodeNumber(&node_highest)) {
+		std::vector<Numa::GroupAffinity> affinities;
+
+		for (ULONG node = 0; node <= node_highest; node++) {
+			GROUP_AFFINITY affinity = { };
+			if (!GetNumaNodeProcessorMaskEx(USHORT(node), &affinity)) affinity.Mask = 0;
+
+			affinities.push_back({ int(affinity.Group), (unsigned long long)affinity.Mask });
+		}
+
+		nodes = Numa::get_topology_windows(affinities);
+	}
+#elif defined(__linux__)
+	nodes = Numa::get_topology_linux(read_file("/sys/devices/system/node/online").c_str(), [](int node) {
+		char file_path[128];
+		snprintf(file_path, sizeof(file_path), "/sys/devices/system/node/node%i/cpulist", node);
+
+		return read_file(file_path);
+	});
+#endif
+
+	if (nodes.size() == 0) {
+		int thread_count = std::thread::hardware_concurrency();
+		if (thread_count <= 0) thread_count = 1;
+
+		std::vector<int> cpus(thread_count);
+		for (int i = 0; i < thread_count; i++) cpus[i] = i;
+
+		nodes.push_back(cpus);
+	}
+
+	return nodes;
+}
+
+static const std::vector<std::vector<int>> & get_topology() {
+	static const std::vector<std::vector<int>> nodes = detect_topology();
+
+	return nodes;
+}
+
+int Numa::get_node_count() {
+	return get_topology().size();
+}
+
+const std::vector<int> & Numa::get_node_cpus(int node) {
+	return get_topology()[node];
+}
+
+static bool pin_thread_to(const std::vector<int> & cpus) {
+#ifdef _WIN32
+	if (cpus.size() == 0) return false;
+
+	// A thread runs within a single processor group, so it is pinned to the CPUs that share the group of the first CPU
+	GROUP_AFFINITY affinity = { };
+	affinity.Group = WORD(cpus[0] / Numa::CPUS_PER_GROUP);
+
+	for (int cpu : cpus) {
+		if (cpu / Numa::CPUS_PER_GROUP == affinity.Group) affinity.Mask |= KAFFINITY(1) << (cpu % Numa::CPUS_PER_GROUP);
+	}
+
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+
+	for (int cpu : cpus) {
+		if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpu_set);
+	}
+
+	return CPU_COUNT(&cpu_set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+	return false;
+#endif
+}
+
+bool Numa::pin_thread(int cpu) {
+	if (cpu < 0) return false;
+
+	return pin_thread_to({ cpu });
+}
+
+void Numa::unpin_thread() {
+	std::vector<int> cpus;
+
+	for (const std::vector<int> & node_cpus : get_topology()) {
+		cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+	}
+
+	pin_thread_to(cpus);
+}
+
+void Numa::run_on_node(int node, const std::function<void()> & task) {
+	std::thread thread([&]() {
+		if (!pin_thread_to(get_node_cpus(node))) {
+			printf("WARNING: Unable to pin thread to NUMA node %i!\n", node);
+		}
+
+		task();
+	});
+	thread.join();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+
+// NUMA topology of the machine and pinning of threads to its CPUs.
+// Memory is placed on the node of the thread that touches it first, so data that a node reads a lot
+// should be allocated and initialized by a thread that is pinned to that node, see run_on_node.
+// If the topology cannot be determined the machine is treated as a single node holding every hardware thread.
+// On Windows CPUs are numbered across processor groups of 64, a thread can only be pinned to CPUs of a single group
+namespace Numa {
+	int get_node_count();
+
+	const std::vector<int> & get_node_cpus(int node);
+
+	// Pins the calling thread to a single CPU, returns false if that is not possible
+	bool pin_thread(int cpu);
+
+	// Allows the calling thread to run on every CPU again, on Windows every CPU of the group of the first node
+	void unpin_thread();
+
+	// Runs 'task' on a new thread that may only run on the CPUs of 'node', and waits for it to finish
+	void run_on_node(int node, const std::function<void()> & task);
+
+	// The topology is built from what the OS reports by the functions below, which do not query the OS themselves.
+	// They are available on every platform. Every returned node holds the CPUs of one node, nodes without CPUs are left out
+
+	// Parses a list of ids like "0-3,8-11", as found in /sys/devices/system/node/online and node*/cpulist
+	void parse_list(const char * list, std::vector<int> & ids);
+
+	// Linux: 'online' is the list of online node ids, get_cpulist(node) returns the cpulist of a node or an empty string if it has none
+	std::vector<std::vector<int>> get_topology_linux(const char * online, const std::function<std::string(int node)> & get_cpulist);
+
+	constexpr int CPUS_PER_GROUP = 64;
+
+	// Windows: processor group of a node and the mask of its CPUs within that group, as reported by GetNumaNodeProcessorMaskEx
+	struct GroupAffinity {
+		int                group;
+		unsigned long long mask;
+	};
+
+	// 'affinities' holds an entry for every node id. CPUs are numbered across processor groups as group * CPUS_PER_GROUP + the bit of the CPU within its group
+	std::vector<std::vector<int>> get_topology_windows(const std::vector<GroupAffinity> & affinities);
+}
@@ -1,6 +1,8 @@
 #include "Pathtracer.h"
 
 #include <algorithm>
+#include <string>
+#include <thread>
 
 #include "CUDAContext.h"
 
@@ -10,8 +12,22 @@
 #include "Random.h"
 #include "BlueNoise.h"
 
+#include "FlatScene.h"
 #include "Util.h"
 #include "ScopeTimer.h"
+#include "CountingSort.h"
+#include "RadianceCacheCPU.h"
+#include "UpsampleCPU.h"
+#include "RegenerationCPU.h"
+#include "TraversalHeatmap.h"
+
+#include "CUDA_Source/Packing.h"
+#include "CUDA_Source/RadianceCache.h"
+#include "CUDA_Source/Upsample.h"
+#include "CUDA_Source/Regeneration.h"
+
+// Events are not recorded while the launch Graph is active, because its Kernels only run once the Graph is launched
+#define RECORD_EVENT(e) if (CUDAGraph::active == nullptr && event_recording) event_ring.record(e)
 
 struct CUDAVector3_SoA {
 	CUDAMemory::Ptr<float> x;
@@ -25,22 +41,52 @@ struct CUDAVector3_SoA {
 	}
 };
 
+// Octahedral encoded directions, see Packing::oct_encode_direction
+struct CUDADirection_Packed {
+	CUDAMemory::Ptr<unsigned> data;
+
+	inline void init(int buffer_size) {
+		data = CUDAMemory::malloc<unsigned>(buffer_size);
+	}
+};
+
+// Three half floats padded to 8 bytes, see Packing::float_to_half
+struct CUDAVector3_Half {
+	CUDAMemory::Ptr<uint2> data;
+
+	inline void init(int buffer_size) {
+		data = CUDAMemory::malloc<uint2>(buffer_size);
+	}
+};
+
+// Hit records, see HitBuffer in CUDA_Source/Pathtracer.cu
+struct CUDAHitBuffer {
+	CUDAMemory::Ptr<uint2>    hits;
+	CUDAMemory::Ptr<unsigned> mesh_t;
+
+	inline void init(int buffer_size) {
+		hits   = CUDAMemory::malloc<uint2>   (buffer_size);
+		mesh_t = CUDAMemory::malloc<unsigned>(buffer_size);
+	}
+};
+
 struct TraceBuffer {
-	CUDAVector3_SoA origin;
-	CUDAVector3_SoA direction;
+	CUDAVector3_SoA      origin;
+	CUDADirection_Packed direction;
 
 #if ENABLE_MIPMAPPING
 	CUDAMemory::Ptr<float> cone_width;
 #endif
-	CUDAMemory::Ptr<float>  hit_ts;
-	CUDAMemory::Ptr<float4> hits;
+	CUDAHitBuffer hits;
 
-	CUDAMemory::Ptr<int> pixel_index;
-	CUDAVector3_SoA      throughput;
+	CUDAMemory::Ptr<unsigned> pixel_state;
+	CUDAVector3_Half          throughput;
 
-	CUDAMemory::Ptr<char>  last_material_type;
 	CUDAMemory::Ptr<float> last_pdf;
 
+	CUDAMemory::Ptr<int> sort_key;
+	CUDAMemory::Ptr<int> sorted_index;
+
 	inline void init(int buffer_size) {
 		origin   .init(buffer_size);
 		direction.init(buffer_size);
@@ -48,28 +94,45 @@ struct TraceBuffer {
 #if ENABLE_MIPMAPPING
 		cone_width = CUDAMemory::malloc<float>(buffer_size);
 #endif
-		hit_ts = CUDAMemory::malloc<float> (buffer_size);
-		hits   = CUDAMemory::malloc<float4>(buffer_size);
+		hits.init(buffer_size);
+
+		pixel_state = CUDAMemory::malloc<unsigned>(buffer_size);
+		throughput.init(buffer_size);
+
+		last_pdf = CUDAMemory::malloc<float>(buffer_size);
+
+		sort_key     = CUDAMemory::malloc<int>(buffer_size);
+		sorted_index = CUDAMemory::malloc<int>(buffer_size);
+	}
+
+	// Only the fields that the shade Kernels write, see ray_buffer_trace_staged
+	inline void init_staged(int buffer_size) {
+		origin   .init(buffer_size);
+		direction.init(buffer_size);
 
-		pixel_index = CUDAMemory::malloc<int>(buffer_size);
+#if ENABLE_MIPMAPPING
+		cone_width = CUDAMemory::malloc<float>(buffer_size);
+#endif
+		pixel_state = CUDAMemory::malloc<unsigned>(buffer_size);
 		throughput.init(buffer_size);
 
-		last_material_type = CUDAMemory::malloc<char> (buffer_size);
-		last_pdf           = CUDAMemory::malloc<float>(buffer_size);
+		last_pdf = CUDAMemory::malloc<float>(buffer_size);
 	}
 };
 
 struct MaterialBuffer {
-	CUDAVector3_SoA direction;
+	CUDADirection_Packed direction;
 	
 #if ENABLE_MIPMAPPING
 	CUDAMemory::Ptr<float> cone_width;
 #endif
-	CUDAMemory::Ptr<float>  hit_ts;
-	CUDAMemory::Ptr<float4> hits;
+	CUDAHitBuffer hits;
+
+	CUDAMemory::Ptr<unsigned> pixel_state;
+	CUDAVector3_Half          throughput;
 
-	CUDAMemory::Ptr<int> pixel_index;
-	CUDAVector3_SoA      throughput;
+	CUDAMemory::Ptr<int> sort_key;
+	CUDAMemory::Ptr<int> sorted_index;
 
 	inline void init(int buffer_size) {
 		direction.init(buffer_size);
@@ -77,11 +140,13 @@ struct MaterialBuffer {
 #if ENABLE_MIPMAPPING
 		cone_width = CUDAMemory::malloc<float>(buffer_size);
 #endif
-		hit_ts = CUDAMemory::malloc<float> (buffer_size);
-		hits   = CUDAMemory::malloc<float4>(buffer_size);
+		hits.init(buffer_size);
 
-		pixel_index  = CUDAMemory::malloc<int>(buffer_size);
+		pixel_state = CUDAMemory::malloc<unsigned>(buffer_size);
 		throughput.init(buffer_size);
+
+		sort_key     = CUDAMemory::malloc<int>(buffer_size);
+		sorted_index = CUDAMemory::malloc<int>(buffer_size);
 	}
 };
 
@@ -91,8 +156,8 @@ struct ShadowRayBuffer {
 
 	CUDAMemory::Ptr<float> max_distance;
 
-	CUDAMemory::Ptr<int> pixel_index;
-	CUDAVector3_SoA      illumination;
+	CUDAMemory::Ptr<unsigned> pixel_state;
+	CUDAVector3_SoA           illumination;
 
 	inline void init(int buffer_size) {
 		ray_origin   .init(buffer_size);
@@ -100,20 +165,24 @@ struct ShadowRayBuffer {
 
 		max_distance = CUDAMemory::malloc<float>(buffer_size);
 
-		pixel_index = CUDAMemory::malloc<int>(buffer_size);
+		pixel_state = CUDAMemory::malloc<unsigned>(buffer_size);
 		illumination.init(buffer_size);
 	}
 };
 
 struct BufferSizes {
-	int trace     [NUM_BOUNCES];
-	int diffuse   [NUM_BOUNCES];
-	int dielectric[NUM_BOUNCES];
-	int glossy    [NUM_BOUNCES];
-	int shadow    [NUM_BOUNCES];
-
-	int rays_retired       [NUM_BOUNCES];
-	int rays_retired_shadow[NUM_BOUNCES];
+	int trace     [MAX_WAVEFRONT_ITERATIONS];
+	int diffuse   [MAX_WAVEFRONT_ITERATIONS];
+	int dielectric[MAX_WAVEFRONT_ITERATIONS];
+	int glossy    [MAX_WAVEFRONT_ITERATIONS];
+	int shadow    [MAX_WAVEFRONT_ITERATIONS];
+
+	int rays_retired       [MAX_WAVEFRONT_ITERATIONS];
+	int rays_retired_shadow[MAX_WAVEFRONT_ITERATIONS];
+
+	int rays_cached[MAX_WAVEFRONT_ITERATIONS];
+
+	int regenerated[MAX_WAVEFRONT_ITERATIONS];
 };
 static BufferSizes * buffer_sizes; // Pinned memory (Non-Pageable)
 
@@ -125,6 +194,28 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 
 	CUDAContext::init();
 
+	thread_pool.init();
+
+	// Tuned batch sizes are specific to the scene and the Device
+	std::string batch_tuner_key = std::string(CUDAContext::device_name) + " sm_" + std::to_string(CUDAContext::compute_capability) + " |";
+	for (int i = 0; i < mesh_count; i++) {
+		batch_tuner_key += " ";
+		batch_tuner_key += mesh_names[i];
+	}
+	batch_tuner_key += " ";
+	batch_tuner_key += sky_name;
+
+	// The ray buffers are allocated for BATCH_SIZE Rays, which caps the batch size the tuner can pick
+	batch_tuner.init(batch_tuner_key.c_str(), BATCH_SIZE, WARP_SIZE * 32);
+
+	fork_shade.init(3);
+
+	// Hit records store the Mesh id in HIT_MESH_ID_BITS bits, see Packing::pack_hit_mesh_t
+	if (mesh_count > int(HIT_MESH_ID_MASK + 1)) {
+		printf("ERROR: Scene contains %i Meshes, at most %u are supported!\n", mesh_count, HIT_MESH_ID_MASK + 1);
+		abort();
+	}
+
 	scene.init(mesh_count, mesh_names, sky_name);
 
 	// Init CUDA Module and its Kernel
@@ -132,6 +223,44 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 
 	// Set global Material table
 	module.get_global("materials").set_buffer(Material::materials);
+
+	// Assign sort keys to Materials, ordered by Texture so that Materials sharing a Texture are shaded next to each other
+	int material_count = Material::materials.size();
+
+	std::vector<int> material_order(material_count);
+	for (int i = 0; i < material_count; i++) material_order[i] = i;
+
+	std::stable_sort(material_order.begin(), material_order.end(), [](int a, int b) {
+		return Material::materials[a].texture_id < Material::materials[b].texture_id;
+	});
+
+	int * material_sort_keys = new int[material_count];
+	for (int i = 0; i < material_count; i++) {
+		material_sort_keys[material_order[i]] = i;
+	}
+
+	material_sort_key_count = material_count;
+
+	module.get_global("material_sort_keys")     .set_buffer(material_sort_keys, material_count);
+	module.get_global("material_sort_key_count").set_value (material_sort_key_count);
+
+	delete [] material_sort_keys;
+
+	CUDAMemory::Ptr<int> ptr_material_sort_histogram = CUDAMemory::malloc<int>(3 * material_sort_key_count);
+	CUDAMemory::Ptr<int> ptr_material_sort_offsets   = CUDAMemory::malloc<int>(3 * material_sort_key_count);
+
+	CUDAMemory::memset(ptr_material_sort_histogram, 0, 3 * material_sort_key_count);
+
+	module.get_global("material_sort_histogram").set_value(ptr_material_sort_histogram);
+	module.get_global("material_sort_offsets")  .set_value(ptr_material_sort_offsets);
+
+	CUDAMemory::Ptr<int> ptr_ray_sort_histogram = CUDAMemory::malloc<int>(RAY_SORT_KEY_COUNT);
+	CUDAMemory::Ptr<int> ptr_ray_sort_offsets   = CUDAMemory::malloc<int>(RAY_SORT_KEY_COUNT);
+
+	CUDAMemory::memset(ptr_ray_sort_histogram, 0, RAY_SORT_KEY_COUNT);
+
+	module.get_global("ray_sort_histogram").set_value(ptr_ray_sort_histogram);
+	module.get_global("ray_sort_offsets")  .set_value(ptr_ray_sort_offsets);
 	
 	Texture::wait_until_textures_loaded();
 
@@ -151,7 +280,7 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 				texture.width,
 				texture.height,
 				texture.channels,
-				texture.get_cuda_array_format(),
+				CUDAMemory::get_array_format(texture),
 				texture.mip_levels
 			);
 
@@ -184,11 +313,14 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 			tex_desc.maxMipmapLevelClamp = texture.mip_levels - 1;
 			tex_desc.flags = CU_TRSF_NORMALIZED_COORDINATES;
 
+			// 8 bit Textures are read as normalized floats, their colour is converted from sRGB to linear like the float Textures
+			if (texture.format == Texture::Format::RGBA8) tex_desc.flags |= CU_TRSF_SRGB;
+
 			// Describe the Texture View
 			CUDA_RESOURCE_VIEW_DESC view_desc = { };
-			view_desc.format = texture.get_cuda_resource_view_format();
-			view_desc.width  = texture.get_cuda_resource_view_width();
-			view_desc.height = texture.get_cuda_resource_view_height();
+			view_desc.format = CUDAMemory::get_resource_view_format(texture);
+			view_desc.width  = CUDAMemory::get_resource_view_width (texture);
+			view_desc.height = CUDAMemory::get_resource_view_height(texture);
 			view_desc.firstMipmapLevel = 0;
 			view_desc.lastMipmapLevel  = texture.mip_levels - 1;
 
@@ -204,67 +336,12 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 
 	int mesh_data_count = MeshData::mesh_datas.size();
 
-	mesh_data_bvh_offsets = new int[mesh_data_count];
-
-	int * mesh_data_index_offsets    = MALLOCA(int, mesh_data_count);
-	int * mesh_data_triangle_offsets = MALLOCA(int, mesh_data_count);
-
-	int global_bvh_node_count = 2 * scene.mesh_count; // Reserve 2 times Mesh count for TLAS
-	int global_index_count    = 0;
-	int global_triangle_count = 0;
-
-	for (int i = 0; i < mesh_data_count; i++) {
-		mesh_data_bvh_offsets     [i] = global_bvh_node_count;
-		mesh_data_index_offsets   [i] = global_index_count;
-		mesh_data_triangle_offsets[i] = global_triangle_count;
-
-		global_bvh_node_count += MeshData::mesh_datas[i]->bvh.node_count;
-		global_index_count    += MeshData::mesh_datas[i]->bvh.index_count;
-		global_triangle_count += MeshData::mesh_datas[i]->triangle_count;
-	}
-
-	BVHNodeType * global_bvh_nodes = new BVHNodeType[global_bvh_node_count];
-	int         * global_indices   = new int        [global_index_count];
-	Triangle    * global_triangles = new Triangle   [global_triangle_count];
-
-	for (int m = 0; m < mesh_data_count; m++) {
-		const MeshData * mesh_data = MeshData::mesh_datas[m];
+	// Flatten all MeshDatas into the layout used on the Device, reserve 2 times Mesh count for TLAS
+	FlatScene flat_scene;
+	flat_scene.init(2 * scene.mesh_count, thread_pool);
 
-		for (int n = 0; n < mesh_data->bvh.node_count; n++) {
-			BVHNodeType & node = global_bvh_nodes[mesh_data_bvh_offsets[m] + n];
-
-			node = mesh_data->bvh.nodes[n];
-
-#if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
-			if (node.is_leaf()) {
-				node.first += mesh_data_index_offsets[m];
-			} else {
-				node.left += mesh_data_bvh_offsets[m];
-			}
-#elif BVH_TYPE == BVH_QBVH
-			int child_count = node.get_child_count();
-			for (int c = 0; c < child_count; c++) {
-				if (node.is_leaf(c)) {
-					node.get_index(c) += mesh_data_index_offsets[m];
-				} else {
-					node.get_index(c) += mesh_data_bvh_offsets[m];
-				}
-			}
-#elif BVH_TYPE == BVH_CWBVH
-			node.base_index_child    += mesh_data_bvh_offsets[m];
-			node.base_index_triangle += mesh_data_index_offsets[m];
-#endif
-		}
-
-		for (int i = 0; i < mesh_data->bvh.index_count; i++) {
-			global_indices[mesh_data_index_offsets[m] + i] = mesh_data->bvh.indices[i] + mesh_data_triangle_offsets[m];
-		}
-
-		for (int t = 0; t < mesh_data->triangle_count; t++) {
-			global_triangles[mesh_data_triangle_offsets[m] + t]              = mesh_data->triangles[t];
-			global_triangles[mesh_data_triangle_offsets[m] + t].material_id += mesh_data->material_offset;
-		}
-	}
+	mesh_data_bvh_offsets = new int[mesh_data_count];
+	memcpy(mesh_data_bvh_offsets, flat_scene.mesh_data_bvh_offsets, mesh_data_count * sizeof(int));
 
 	pinned_mesh_bvh_root_indices        = CUDAMemory::malloc_pinned<int>      (scene.mesh_count);
 	pinned_mesh_transforms              = CUDAMemory::malloc_pinned<Matrix3x4>(scene.mesh_count);
@@ -280,8 +357,8 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	module.get_global("mesh_transforms")      .set_value(ptr_mesh_transforms);
 	module.get_global("mesh_transforms_inv")  .set_value(ptr_mesh_transforms_inv);
 	
-	ptr_bvh_nodes = CUDAMemory::malloc<BVHNodeType>(global_bvh_node_count);
-	CUDAMemory::memcpy(ptr_bvh_nodes, global_bvh_nodes, global_bvh_node_count);
+	ptr_bvh_nodes = CUDAMemory::malloc<BVHNodeType>(flat_scene.bvh_node_count);
+	CUDAMemory::memcpy(ptr_bvh_nodes, flat_scene.bvh_nodes, flat_scene.bvh_node_count);
 
 #if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
 	module.get_global("bvh_nodes").set_value(ptr_bvh_nodes);
@@ -298,73 +375,16 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	tlas_converter.init(&tlas, tlas_raw);
 #endif
 
-	struct CUDATriangle {
-		Vector3 position_0;
-		Vector3 position_edge_1;
-		Vector3 position_edge_2;
-
-		Vector3 normal_0;
-		Vector3 normal_edge_1;
-		Vector3 normal_edge_2;
-
-		Vector2 tex_coord_0;
-		Vector2 tex_coord_edge_1;
-		Vector2 tex_coord_edge_2;
-	};
-	
-	CUDATriangle * triangles             = new CUDATriangle[global_index_count];
-	int          * triangle_material_ids = new int         [global_index_count];
-	float        * triangle_lods         = new float       [global_index_count];
-
-	int * reverse_indices = new int[global_index_count];
-
-	for (int i = 0; i < global_index_count; i++) {
-		int index = global_indices[i];
-
-		triangles[i].position_0      = global_triangles[index].position_0;
-		triangles[i].position_edge_1 = global_triangles[index].position_1 - global_triangles[index].position_0;
-		triangles[i].position_edge_2 = global_triangles[index].position_2 - global_triangles[index].position_0;
-
-		triangles[i].normal_0      = global_triangles[index].normal_0;
-		triangles[i].normal_edge_1 = global_triangles[index].normal_1 - global_triangles[index].normal_0;
-		triangles[i].normal_edge_2 = global_triangles[index].normal_2 - global_triangles[index].normal_0;
-
-		triangles[i].tex_coord_0      = global_triangles[index].tex_coord_0;
-		triangles[i].tex_coord_edge_1 = global_triangles[index].tex_coord_1 - global_triangles[index].tex_coord_0;
-		triangles[i].tex_coord_edge_2 = global_triangles[index].tex_coord_2 - global_triangles[index].tex_coord_0;
-
-		int material_id = global_triangles[index].material_id;
-		triangle_material_ids[i] = material_id;
-
-		int texture_id = Material::materials[material_id].texture_id;
-		if (texture_id != -1) {
-			const Texture & texture = Texture::textures[texture_id];
-
-			// Triangle texture base LOD as described in "Texture Level of Detail Strategies for Real-Time Ray Tracing"
-			float t_a = float(texture.width * texture.height) * fabsf(
-				triangles[i].tex_coord_edge_1.x * triangles[i].tex_coord_edge_2.y -
-				triangles[i].tex_coord_edge_2.x * triangles[i].tex_coord_edge_1.y
-			); 
-			float p_a = Vector3::length(Vector3::cross(triangles[i].position_edge_1, triangles[i].position_edge_2));
-
-			triangle_lods[i] = 0.5f * log2f(t_a / p_a);
-		} else {
-			triangle_lods[i] = 0.0f;
-		}
-
-		reverse_indices[index] = i;
-	}
-
-	module.get_global("triangles")            .set_buffer(triangles,             global_index_count);
-	module.get_global("triangle_material_ids").set_buffer(triangle_material_ids, global_index_count);
-
-	module.get_global("triangle_lods").set_buffer(triangle_lods, global_index_count);
-	delete [] triangle_lods;
+	module.get_global("triangles")            .set_buffer(flat_scene.triangles,             flat_scene.index_count);
+	module.get_global("triangle_material_ids").set_buffer(flat_scene.triangle_material_ids, flat_scene.index_count);
+	module.get_global("triangle_lods")        .set_buffer(flat_scene.triangle_lods,         flat_scene.index_count);
 
+#if GBUFFER_CPU
+	// Init software rasterizer, it needs the same Triangle ID mapping as the OpenGL path
+	gbuffer_cpu.init(flat_scene.reverse_indices, flat_scene.triangle_count, flat_scene.mesh_data_triangle_offsets, mesh_data_count);
+#else
 	// Init OpenGL MeshData for rasterization
-	for (int m = 0; m < mesh_data_count; m++) {
-		MeshData::mesh_datas[m]->gl_init(reverse_indices + mesh_data_triangle_offsets[m]);
-	}
+	gbuffer.init_mesh_datas(flat_scene.reverse_indices, flat_scene.mesh_data_triangle_offsets);
 
 	// Initialize OpenGL Shaders
 	shader = Shader::load(
@@ -381,90 +401,14 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	uniform_transform_prev = shader.get_uniform("transform_prev");
 
 	uniform_mesh_id = shader.get_uniform("mesh_id");
+#endif
 
 	if (scene.has_lights) {
 		// Initialize Lights
-		struct LightTriangle {
-			int   index;
-			float area;
-		};
-		std::vector<LightTriangle> light_triangles;
-
-		struct LightMesh {
-			int triangle_first_index;
-			int triangle_count;
-
-			float area;
-		};
-		std::vector<LightMesh> light_meshes;
-
-		int * light_mesh_data_indices = MALLOCA(int, mesh_data_count);
-		memset(light_mesh_data_indices, -1, mesh_data_count * sizeof(int));
-
-		// Loop over every MeshData and check whether it has at least 1 Triangle that is a Light
-		for (int m = 0; m < mesh_data_count; m++) {
-			const MeshData * mesh_data = MeshData::mesh_datas[m];
-
-			LightMesh * light_mesh = nullptr;
-
-			// For every Triangle, check whether it is a Light based on its Material
-			for (int t = 0; t < mesh_data->triangle_count; t++) {
-				const Triangle & triangle = mesh_data->triangles[t];
-
-				if (Material::materials[mesh_data->material_offset + triangle.material_id].type == Material::Type::LIGHT) {
-					float area = 0.5f * Vector3::length(Vector3::cross(
-						triangle.position_1 - triangle.position_0,
-						triangle.position_2 - triangle.position_0
-					));
-
-					if (light_mesh == nullptr) {
-						light_mesh_data_indices[m] = light_meshes.size();
-
-						light_mesh = &light_meshes.emplace_back();
-						light_mesh->triangle_first_index = light_triangles.size();
-						light_mesh->triangle_count = 0;
-					}
-
-					light_triangles.push_back({ reverse_indices[mesh_data_triangle_offsets[m] + t], area });
-
-					light_mesh->triangle_count++;
-				}
-			}
-
-			if (light_mesh) {		
-				// Sort Lights on area within each Mesh
-				LightTriangle * triangles_begin = light_triangles.data() + light_mesh->triangle_first_index;
-				LightTriangle * triangles_end   = triangles_begin        + light_mesh->triangle_count;
-
-				assert(triangles_end > triangles_begin);
-
-				std::sort(triangles_begin, triangles_end, [](const LightTriangle & a, const LightTriangle & b) { return a.area < b.area; });
-			}
-		}
-
-		int   * light_indices          = new int  [light_triangles.size()];
-		float * light_areas_cumulative = new float[light_triangles.size()];
-
-		for (int m = 0; m < light_meshes.size(); m++) {
-			LightMesh & light_mesh = light_meshes[m];
-
-			float cumulative_area = 0.0f;
-
-			for (int i = light_mesh.triangle_first_index; i < light_mesh.triangle_first_index + light_mesh.triangle_count; i++) {
-				light_indices[i] = light_triangles[i].index;
-
-				cumulative_area += light_triangles[i].area;
-				light_areas_cumulative[i] = cumulative_area;
-			}
+		flat_scene.init_lights(thread_pool);
 
-			light_mesh.area = cumulative_area;
-		}
-
-		module.get_global("light_indices")         .set_buffer(light_indices,          light_triangles.size());
-		module.get_global("light_areas_cumulative").set_buffer(light_areas_cumulative, light_triangles.size());
-
-		delete [] light_indices;
-		delete [] light_areas_cumulative;
+		module.get_global("light_indices")         .set_buffer(flat_scene.light_indices);
+		module.get_global("light_areas_cumulative").set_buffer(flat_scene.light_areas_cumulative);
 
 		float * light_mesh_area_unscaled        = MALLOCA(float, mesh_count);
 		int   * light_mesh_triangle_count       = MALLOCA(int,   mesh_count);
@@ -474,10 +418,10 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 		int light_mesh_count  = 0;
 		
 		for (int m = 0; m < mesh_count; m++) {
-			int light_mesh_data_index = light_mesh_data_indices[scene.meshes[m].mesh_data_index];
+			int light_mesh_data_index = flat_scene.light_mesh_data_indices[scene.meshes[m].mesh_data_index];
 
 			if (light_mesh_data_index != -1) {
-				const LightMesh & light_mesh = light_meshes[light_mesh_data_index];
+				const FlatScene::LightMesh & light_mesh = flat_scene.light_meshes[light_mesh_data_index];
 
 				scene.meshes[m].light_index = light_mesh_count;
 				scene.meshes[m].light_area  = light_mesh.area;
@@ -510,17 +454,19 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 		FREEA(light_mesh_area_unscaled);
 		FREEA(light_mesh_triangle_count);
 		FREEA(light_mesh_triangle_first_index);
-
-		FREEA(light_mesh_data_indices);
 	} else {
 		module.get_global("light_total_count_inv").set_value(INFINITY); // 1 / 0
 	}
 	
-	delete [] triangles;
-	delete [] reverse_indices;
+	flat_scene.free();
+
+	// The geometry now lives on the Device, only the software rasterizer still reads the Triangles on the Host
+	MeshData::free_host_geometry(GBUFFER_CPU);
 
 	module.get_global("sky_size").set_value (scene.sky.size);
 	module.get_global("sky_data").set_buffer(scene.sky.data, scene.sky.size * scene.sky.size);
+
+	scene.sky.free();
 	
 	// Set Blue Noise Sampler globals
 	module.get_global("sobol_256spp_256d").set_buffer(sobol_256spp_256d);
@@ -540,6 +486,15 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	module.get_global("ray_buffer_shade_glossy")    .set_value(ray_buffer_shade_glossy);
 	module.get_global("ray_buffer_shadow")          .set_value(ray_buffer_shadow);
 
+	// Rays that continue their path are staged here before the deterministic compaction appends them to the trace queue
+	TraceBuffer ray_buffer_trace_staged; ray_buffer_trace_staged.init_staged(batch_size);
+
+	module.get_global("ray_buffer_trace_staged").set_value(ray_buffer_trace_staged);
+
+	// The output queue of every Ray that is compacted, and the offsets per block of the deterministic compaction
+	module.get_global("compaction_queue")        .set_value(CUDAMemory::malloc<unsigned char>(batch_size));
+	module.get_global("compaction_block_offsets").set_value(CUDAMemory::malloc<int>(3 * Math::divide_round_up(batch_size, COMPACTION_BLOCK_SIZE)));
+
 	buffer_sizes = CUDAMemory::malloc_pinned<BufferSizes>();
 	memset(buffer_sizes, 0, sizeof(BufferSizes));
 	buffer_sizes->trace[0] = batch_size;
@@ -551,6 +506,29 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 
 	global_settings = module.get_global("settings");
 
+#if ENABLE_RADIANCE_CACHE
+	ptr_radiance_cache_keys        = CUDAMemory::malloc<unsigned>(RADIANCE_CACHE_SIZE);
+	ptr_radiance_cache_radiance    = CUDAMemory::malloc<float4>  (RADIANCE_CACHE_SIZE);
+	ptr_radiance_cache_accumulator = CUDAMemory::malloc<float4>  (RADIANCE_CACHE_SIZE);
+
+	CUDAMemory::memset(ptr_radiance_cache_keys,        0, RADIANCE_CACHE_SIZE);
+	CUDAMemory::memset(ptr_radiance_cache_radiance,    0, RADIANCE_CACHE_SIZE);
+	CUDAMemory::memset(ptr_radiance_cache_accumulator, 0, RADIANCE_CACHE_SIZE);
+
+	module.get_global("radiance_cache_keys")       .set_value(ptr_radiance_cache_keys);
+	module.get_global("radiance_cache_radiance")   .set_value(ptr_radiance_cache_radiance);
+	module.get_global("radiance_cache_accumulator").set_value(ptr_radiance_cache_accumulator);
+#endif
+
+#if ENABLE_PATH_GUIDING
+	ptr_path_guiding_samples = CUDAMemory::malloc<PathGuiding::Sample>(PATH_GUIDING_MAX_SAMPLES);
+
+	module.get_global("path_guiding_samples").set_value(ptr_path_guiding_samples);
+
+	global_path_guiding_sample_count = module.get_global("path_guiding_sample_count");
+	global_path_guiding_sample_count.set_value(0);
+#endif
+
 	unsigned long long bytes_available = CUDAContext::get_available_memory();
 	unsigned long long bytes_allocated = CUDAContext::total_memory - bytes_available;
 
@@ -560,6 +538,8 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 
 	kernel_primary         .init(&module, "kernel_primary");
 	kernel_generate        .init(&module, "kernel_generate");
+	kernel_buffer_sizes_reset.init(&module, "kernel_buffer_sizes_reset");
+	kernel_regenerate      .init(&module, "kernel_regenerate");
 	kernel_trace           .init(&module, "kernel_trace");
 	kernel_sort            .init(&module, "kernel_sort");
 	kernel_shade_diffuse   .init(&module, "kernel_shade_diffuse");
@@ -572,9 +552,38 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	kernel_svgf_finalize   .init(&module, "kernel_svgf_finalize");
 	kernel_taa             .init(&module, "kernel_taa");
 	kernel_taa_finalize    .init(&module, "kernel_taa_finalize");
+	kernel_indirect_upsample.init(&module, "kernel_indirect_upsample");
 	kernel_reconstruct     .init(&module, "kernel_reconstruct");
 	kernel_accumulate      .init(&module, "kernel_accumulate");
 
+	kernel_material_sort_count  .init(&module, "kernel_material_sort_count");
+	kernel_material_sort_scan   .init(&module, "kernel_material_sort_scan");
+	kernel_material_sort_scatter.init(&module, "kernel_material_sort_scatter");
+
+	kernel_compaction_count  .init(&module, "kernel_compaction_count");
+	kernel_compaction_scan   .init(&module, "kernel_compaction_scan");
+	kernel_compaction_scatter.init(&module, "kernel_compaction_scatter");
+
+	kernel_ray_sort_count  .init(&module, "kernel_ray_sort_count");
+	kernel_ray_sort_scan   .init(&module, "kernel_ray_sort_scan");
+	kernel_ray_sort_scatter.init(&module, "kernel_ray_sort_scatter");
+
+#if ENABLE_RADIANCE_CACHE
+	kernel_radiance_cache_update .init(&module, "kernel_radiance_cache_update");
+	kernel_radiance_cache_resolve.init(&module, "kernel_radiance_cache_resolve");
+
+	kernel_radiance_cache_update.occupancy_max_block_size_2d();
+
+	kernel_radiance_cache_resolve.set_block_dim(WARP_SIZE * 2, 1, 1);
+	kernel_radiance_cache_resolve.set_grid_dim(Math::divide_round_up(RADIANCE_CACHE_SIZE, kernel_radiance_cache_resolve.block_dim_x), 1, 1);
+#endif
+
+#if ENABLE_PATH_GUIDING
+	kernel_path_guiding_update.init(&module, "kernel_path_guiding_update");
+
+	kernel_path_guiding_update.occupancy_max_block_size_2d();
+#endif
+
 	// Set Block dimensions for all Kernels
 	kernel_svgf_temporal.occupancy_max_block_size_2d();
 	kernel_svgf_variance.occupancy_max_block_size_2d();
@@ -582,15 +591,40 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	kernel_svgf_finalize.occupancy_max_block_size_2d();
 	kernel_taa          .occupancy_max_block_size_2d();
 	kernel_taa_finalize .occupancy_max_block_size_2d();
+	kernel_indirect_upsample.occupancy_max_block_size_2d();
 	kernel_reconstruct  .occupancy_max_block_size_2d();
 	kernel_accumulate   .occupancy_max_block_size_2d();
 
 	kernel_primary         .set_block_dim(WARP_SIZE * 2, 1, 1);
 	kernel_generate        .set_block_dim(WARP_SIZE * 2, 1, 1);
+	kernel_buffer_sizes_reset.set_block_dim(WARP_SIZE, 1, 1);
+	kernel_buffer_sizes_reset.set_grid_dim (1, 1, 1);
+	kernel_regenerate      .set_block_dim(WARP_SIZE * 2, 1, 1);
 	kernel_sort            .set_block_dim(WARP_SIZE * 2, 1, 1);
 	kernel_shade_diffuse   .set_block_dim(WARP_SIZE * 2, 1, 1);
 	kernel_shade_dielectric.set_block_dim(WARP_SIZE * 2, 1, 1);
 	kernel_shade_glossy    .set_block_dim(WARP_SIZE * 2, 1, 1);
+
+	kernel_material_sort_count  .set_block_dim(WARP_SIZE * 2, 1, 1);
+	kernel_material_sort_scatter.set_block_dim(WARP_SIZE * 2, 1, 1);
+
+	// Scan uses one Warp per shading queue
+	kernel_material_sort_scan.set_block_dim(WARP_SIZE, 1, 1);
+	kernel_material_sort_scan.set_grid_dim(3, 1, 1);
+
+	// The block size of count and scatter determines the granularity of the block offsets
+	kernel_compaction_count  .set_block_dim(COMPACTION_BLOCK_SIZE, 1, 1);
+	kernel_compaction_scatter.set_block_dim(COMPACTION_BLOCK_SIZE, 1, 1);
+
+	kernel_compaction_scan.set_block_dim(WARP_SIZE, 1, 1);
+	kernel_compaction_scan.set_grid_dim(3, 1, 1);
+
+	kernel_ray_sort_count  .set_block_dim(WARP_SIZE * 2, 1, 1);
+	kernel_ray_sort_scatter.set_block_dim(WARP_SIZE * 2, 1, 1);
+
+	// Scan uses a single Warp
+	kernel_ray_sort_scan.set_block_dim(WARP_SIZE, 1, 1);
+	kernel_ray_sort_scan.set_grid_dim(1, 1, 1);
 	
 #if BVH_TYPE == BVH_CWBVH
 	static constexpr int bvh_stack_element_size = 8; // CWBVH uses a stack of int2's (8 bytes)
@@ -620,21 +654,31 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	printf("\nConfiguration picked for Tracing kernels:\n    Block Size: %i x %i\n    Grid Size:  %i\n\n", block_x, block_y, grid);
 
 	// Initialize timers
+	event_ring.init();
+
 	event_primary.init("Primary", "Primary");
+	event_samples.init("Samples", "Additional Samples");
 
-	for (int i = 0; i < NUM_BOUNCES; i++) {
+	for (int i = 0; i < MAX_WAVEFRONT_ITERATIONS; i++) {
 		const int len = 16;
 		char    * category = new char[len];
 		sprintf_s(category, len, "Bounce %i", i);
 
+		event_regenerate      [i].init(category, "Regenerate");
+		event_ray_sort        [i].init(category, "Ray Sort");
 		event_trace           [i].init(category, "Trace");
 		event_sort            [i].init(category, "Sort");
+		event_material_sort   [i].init(category, "Material Sort");
 		event_shade_diffuse   [i].init(category, "Diffuse");
 		event_shade_dielectric[i].init(category, "Dielectric");
 		event_shade_glossy    [i].init(category, "Glossy");
+		event_shade           [i].init(category, "Shade");
 		event_shadow_trace    [i].init(category, "Shadow");
 	}
 
+	event_radiance_cache_update.init("Radiance Cache", "Update");
+	event_path_guiding_update  .init("Path Guiding",   "Update");
+
 	event_svgf_temporal.init("SVGF", "Temporal");
 	event_svgf_variance.init("SVGF", "Variance");
 	for (int i = 0; i < MAX_ATROUS_ITERATIONS; i++) {
@@ -646,12 +690,16 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	}
 	event_svgf_finalize.init("SVGF", "Finalize");
 
+	event_indirect_upsample.init("Post", "Upsample Indirect");
+
 	event_taa        .init("Post", "TAA");
 	event_reconstruct.init("Post", "Reconstruct");
 	event_accumulate .init("Post", "Accumulate");
 
 	event_end.init("END", "END");
 
+	event_launch_graph.init("Graph", "Launch");
+
 	resize_init(frame_buffer_handle, SCREEN_WIDTH, SCREEN_HEIGHT);
 	
 	// Realloc as pinned memory
@@ -662,9 +710,17 @@ void Pathtracer::init(int mesh_count, char const ** mesh_names, char const * sky
 	build_tlas();
 }
 
+void Pathtracer::free() {
+#if ENABLE_PATH_GUIDING
+	// The worker may still be training the SD-tree, which it accesses through 'this'
+	if (path_guiding_worker.joinable()) path_guiding_worker.join();
+#endif
+
+	thread_pool.free();
+}
+
 void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height) {
 	pixel_count = width * height;
-	batch_size  = Math::min(BATCH_SIZE, pixel_count);
 
 	int pitch = Math::divide_round_up(width, WARP_SIZE) * WARP_SIZE;
 
@@ -673,6 +729,17 @@ void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height
 	module.get_global("screen_height").set_value(height);
 
 	// Resize GBuffers
+#if GBUFFER_CPU
+	gbuffer_cpu.resize(width, height);
+
+	// The software rasterizer output is copied into plain CUDA Arrays every frame
+	array_gbuffer_normal_and_depth = CUDAMemory::create_array(width, height, 4, CU_AD_FORMAT_FLOAT);
+	array_gbuffer_uv               = CUDAMemory::create_array(width, height, 2, CU_AD_FORMAT_FLOAT);
+	array_gbuffer_uv_gradient      = CUDAMemory::create_array(width, height, 4, CU_AD_FORMAT_FLOAT);
+	array_gbuffer_triangle_id      = CUDAMemory::create_array(width, height, 2, CU_AD_FORMAT_SIGNED_INT32);
+	array_gbuffer_motion           = CUDAMemory::create_array(width, height, 2, CU_AD_FORMAT_FLOAT);
+	array_gbuffer_z_gradient       = CUDAMemory::create_array(width, height, 2, CU_AD_FORMAT_FLOAT);
+#else
 	gbuffer.resize(width, height);
 
 	resource_gbuffer_normal_and_depth = CUDAMemory::resource_register(gbuffer.buffer_normal_and_depth,        CU_GRAPHICS_MAP_RESOURCE_FLAGS_READ_ONLY);
@@ -682,12 +749,20 @@ void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height
 	resource_gbuffer_motion     	  = CUDAMemory::resource_register(gbuffer.buffer_motion,                  CU_GRAPHICS_MAP_RESOURCE_FLAGS_READ_ONLY);
 	resource_gbuffer_z_gradient    	  = CUDAMemory::resource_register(gbuffer.buffer_z_gradient,              CU_GRAPHICS_MAP_RESOURCE_FLAGS_READ_ONLY);
 
-	module.set_texture("gbuffer_normal_and_depth",        CUDAMemory::resource_get_array(resource_gbuffer_normal_and_depth), CU_TR_FILTER_MODE_POINT);
-	module.set_texture("gbuffer_uv",                      CUDAMemory::resource_get_array(resource_gbuffer_uv),               CU_TR_FILTER_MODE_POINT);
-	module.set_texture("gbuffer_uv_gradient",             CUDAMemory::resource_get_array(resource_gbuffer_uv_gradient),      CU_TR_FILTER_MODE_POINT);
-	module.set_texture("gbuffer_mesh_id_and_triangle_id", CUDAMemory::resource_get_array(resource_gbuffer_triangle_id),      CU_TR_FILTER_MODE_POINT);
-	module.set_texture("gbuffer_screen_position_prev",    CUDAMemory::resource_get_array(resource_gbuffer_motion),           CU_TR_FILTER_MODE_POINT);
-	module.set_texture("gbuffer_depth_gradient",          CUDAMemory::resource_get_array(resource_gbuffer_z_gradient),       CU_TR_FILTER_MODE_POINT);
+	array_gbuffer_normal_and_depth = CUDAMemory::resource_get_array(resource_gbuffer_normal_and_depth);
+	array_gbuffer_uv               = CUDAMemory::resource_get_array(resource_gbuffer_uv);
+	array_gbuffer_uv_gradient      = CUDAMemory::resource_get_array(resource_gbuffer_uv_gradient);
+	array_gbuffer_triangle_id      = CUDAMemory::resource_get_array(resource_gbuffer_triangle_id);
+	array_gbuffer_motion           = CUDAMemory::resource_get_array(resource_gbuffer_motion);
+	array_gbuffer_z_gradient       = CUDAMemory::resource_get_array(resource_gbuffer_z_gradient);
+#endif
+
+	module.set_texture("gbuffer_normal_and_depth",        array_gbuffer_normal_and_depth, CU_TR_FILTER_MODE_POINT);
+	module.set_texture("gbuffer_uv",                      array_gbuffer_uv,               CU_TR_FILTER_MODE_POINT);
+	module.set_texture("gbuffer_uv_gradient",             array_gbuffer_uv_gradient,      CU_TR_FILTER_MODE_POINT);
+	module.set_texture("gbuffer_mesh_id_and_triangle_id", array_gbuffer_triangle_id,      CU_TR_FILTER_MODE_POINT);
+	module.set_texture("gbuffer_screen_position_prev",    array_gbuffer_motion,           CU_TR_FILTER_MODE_POINT);
+	module.set_texture("gbuffer_depth_gradient",          array_gbuffer_z_gradient,       CU_TR_FILTER_MODE_POINT);
 
 	// Create Frame Buffers
 	module.get_global("frame_buffer_albedo").set_value(CUDAMemory::malloc<float4>(pitch * height).ptr);
@@ -698,12 +773,30 @@ void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height
 	ptr_direct_alt   = CUDAMemory::malloc<float4>(pitch * height);
 	ptr_indirect_alt = CUDAMemory::malloc<float4>(pitch * height);
 
+	// The Kernels add to the Frame Buffers, so they start out cleared. After that kernel_svgf_finalize and kernel_accumulate clear them every frame
+	CUDAMemory::memset(ptr_direct,   0, pitch * height);
+	CUDAMemory::memset(ptr_indirect, 0, pitch * height);
+
 	module.get_global("frame_buffer_direct")  .set_value(ptr_direct  .ptr);
 	module.get_global("frame_buffer_indirect").set_value(ptr_indirect.ptr);
 
 	module.get_global("sample_xy")     .set_value(CUDAMemory::malloc<float2>(pitch * height).ptr);
 	module.get_global("reconstruction").set_value(CUDAMemory::malloc<float4>(pitch * height).ptr);
 
+	CUDAMemory::Ptr<float4> ptr_indirect_guide = CUDAMemory::malloc<float4>(pitch * height);
+	CUDAMemory::memset(ptr_indirect_guide, 0, pitch * height);
+
+	module.get_global("indirect_guide").set_value(ptr_indirect_guide);
+
+	// Regenerated samples are summed separately, so that every pixel can be weighted by its own sample count
+	CUDAMemory::Ptr<float4> ptr_frame_buffer_regenerated = CUDAMemory::malloc<float4>(pitch * height);
+	CUDAMemory::memset(ptr_frame_buffer_regenerated, 0, pitch * height);
+
+	module.get_global("frame_buffer_regenerated").set_value(ptr_frame_buffer_regenerated);
+	module.get_global("path_regeneration_cursor").set_value(0);
+
+	path_regeneration_stride = Regeneration::get_stride(pixel_count);
+
 	// Set Accumulator to a CUDA resource mapping of the GL frame buffer texture
 	resource_accumulator = CUDAMemory::resource_register(frame_buffer_handle, CU_GRAPHICS_REGISTER_FLAGS_SURFACE_LDST);
 	module.set_surface("accumulator", CUDAMemory::resource_get_array(resource_accumulator));
@@ -719,6 +812,40 @@ void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height
 	module.get_global("taa_frame_prev").set_value(CUDAMemory::malloc<float4>(pitch * height));
 	module.get_global("taa_frame_curr").set_value(CUDAMemory::malloc<float4>(pitch * height));
 
+#if ENABLE_RADIANCE_CACHE
+	// Path vertices can be recorded on every bounce except the last
+	int record_count = (NUM_BOUNCES - 1) * pitch * height;
+
+	radiance_cache_records.snapshot   = CUDAMemory::malloc<float4>(record_count);
+	radiance_cache_records.throughput = CUDAMemory::malloc<uint2> (record_count);
+
+	CUDAMemory::memset(radiance_cache_records.snapshot, 0xff, record_count); // Slot of -1 means no vertex was recorded
+
+	module.get_global("radiance_cache_records").set_value(radiance_cache_records);
+#endif
+
+#if ENABLE_PATH_GUIDING
+	// Path vertices can be recorded on every bounce except the last
+	int path_guiding_record_count = (NUM_BOUNCES - 1) * pitch * height;
+
+	path_guiding_records.position   = CUDAMemory::malloc<float4>(path_guiding_record_count);
+	path_guiding_records.direction  = CUDAMemory::malloc<float4>(path_guiding_record_count);
+	path_guiding_records.throughput = CUDAMemory::malloc<float> (path_guiding_record_count);
+	path_guiding_records.direct     = CUDAMemory::malloc<float> (path_guiding_record_count);
+
+	CUDAMemory::memset(path_guiding_records.position, 0, path_guiding_record_count); // A pdf of 0 means no vertex was recorded
+
+	module.get_global("path_guiding_records").set_value(path_guiding_records);
+#endif
+
+#if ENABLE_TRAVERSAL_HEATMAP
+	// Trace and shadow Rays are counted separately for every path depth
+	traversal_cost_count = 2 * NUM_BOUNCES * pitch * height;
+	ptr_traversal_cost   = CUDAMemory::malloc<TraversalCost>(traversal_cost_count);
+
+	module.get_global("traversal_cost").set_value(ptr_traversal_cost);
+#endif
+
 	// Set Grid dimensions for screen size dependent Kernels
 	kernel_svgf_temporal.set_grid_dim(pitch / kernel_svgf_temporal.block_dim_x, Math::divide_round_up(height, kernel_svgf_temporal.block_dim_y), 1);
 	kernel_svgf_variance.set_grid_dim(pitch / kernel_svgf_variance.block_dim_x, Math::divide_round_up(height, kernel_svgf_variance.block_dim_y), 1);
@@ -726,15 +853,21 @@ void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height
 	kernel_svgf_finalize.set_grid_dim(pitch / kernel_svgf_finalize.block_dim_x, Math::divide_round_up(height, kernel_svgf_finalize.block_dim_y), 1);
 	kernel_taa          .set_grid_dim(pitch / kernel_taa          .block_dim_x, Math::divide_round_up(height, kernel_taa          .block_dim_y), 1);
 	kernel_taa_finalize .set_grid_dim(pitch / kernel_taa_finalize .block_dim_x, Math::divide_round_up(height, kernel_taa_finalize .block_dim_y), 1);
+	kernel_indirect_upsample.set_grid_dim(pitch / kernel_indirect_upsample.block_dim_x, Math::divide_round_up(height, kernel_indirect_upsample.block_dim_y), 1);
 	kernel_reconstruct  .set_grid_dim(pitch / kernel_reconstruct  .block_dim_x, Math::divide_round_up(height, kernel_reconstruct  .block_dim_y), 1);
 	kernel_accumulate   .set_grid_dim(pitch / kernel_accumulate   .block_dim_x, Math::divide_round_up(height, kernel_accumulate   .block_dim_y), 1);
 
-	kernel_primary         .set_grid_dim(Math::divide_round_up(batch_size, kernel_primary         .block_dim_x), 1, 1);
-	kernel_generate        .set_grid_dim(Math::divide_round_up(batch_size, kernel_generate        .block_dim_x), 1, 1);
-	kernel_sort            .set_grid_dim(Math::divide_round_up(batch_size, kernel_sort            .block_dim_x), 1, 1);
-	kernel_shade_diffuse   .set_grid_dim(Math::divide_round_up(batch_size, kernel_shade_diffuse   .block_dim_x), 1, 1);
-	kernel_shade_dielectric.set_grid_dim(Math::divide_round_up(batch_size, kernel_shade_dielectric.block_dim_x), 1, 1);
-	kernel_shade_glossy    .set_grid_dim(Math::divide_round_up(batch_size, kernel_shade_glossy    .block_dim_x), 1, 1);
+#if ENABLE_RADIANCE_CACHE
+	kernel_radiance_cache_update.set_grid_dim(pitch / kernel_radiance_cache_update.block_dim_x, Math::divide_round_up(height, kernel_radiance_cache_update.block_dim_y), 1);
+#endif
+
+#if ENABLE_PATH_GUIDING
+	kernel_path_guiding_update.set_grid_dim(pitch / kernel_path_guiding_update.block_dim_x, Math::divide_round_up(height, kernel_path_guiding_update.block_dim_y), 1);
+#endif
+
+	// Use the tuned batch size for this pixel count, or start tuning it
+	batch_tuner.begin(pixel_count);
+	set_batch_size(batch_tuner.get_batch_size());
 	
 	scene.camera.resize(width, height);
 	frames_accumulated = 0;
@@ -744,13 +877,49 @@ void Pathtracer::resize_init(unsigned frame_buffer_handle, int width, int height
 	upload_camera();
 }
 
+// Sets the number of pixels traced per batch, at most BATCH_SIZE
+void Pathtracer::set_batch_size(int batch_size) {
+	this->batch_size = Math::min(batch_size, pixel_count);
+
+	kernel_primary         .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_primary         .block_dim_x), 1, 1);
+	kernel_generate        .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_generate        .block_dim_x), 1, 1);
+	kernel_regenerate      .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_regenerate      .block_dim_x), 1, 1);
+	kernel_sort            .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_sort            .block_dim_x), 1, 1);
+	kernel_shade_diffuse   .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_shade_diffuse   .block_dim_x), 1, 1);
+	kernel_shade_dielectric.set_grid_dim(Math::divide_round_up(this->batch_size, kernel_shade_dielectric.block_dim_x), 1, 1);
+	kernel_shade_glossy    .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_shade_glossy    .block_dim_x), 1, 1);
+
+	kernel_material_sort_count  .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_material_sort_count  .block_dim_x), 1, 1);
+	kernel_material_sort_scatter.set_grid_dim(Math::divide_round_up(this->batch_size, kernel_material_sort_scatter.block_dim_x), 1, 1);
+
+	kernel_compaction_count  .set_grid_dim(Math::divide_round_up(this->batch_size, COMPACTION_BLOCK_SIZE), 1, 1);
+	kernel_compaction_scatter.set_grid_dim(Math::divide_round_up(this->batch_size, COMPACTION_BLOCK_SIZE), 1, 1);
+
+	kernel_ray_sort_count  .set_grid_dim(Math::divide_round_up(this->batch_size, kernel_ray_sort_count  .block_dim_x), 1, 1);
+	kernel_ray_sort_scatter.set_grid_dim(Math::divide_round_up(this->batch_size, kernel_ray_sort_scatter.block_dim_x), 1, 1);
+
+	buffer_sizes->trace[0] = this->batch_size;
+	global_buffer_sizes.set_value(*buffer_sizes);
+}
+
 void Pathtracer::resize_free() {
+	launch_graph.invalidate();
+
+#if GBUFFER_CPU
+	CUDACALL(cuArrayDestroy(array_gbuffer_normal_and_depth));
+	CUDACALL(cuArrayDestroy(array_gbuffer_uv));
+	CUDACALL(cuArrayDestroy(array_gbuffer_uv_gradient));
+	CUDACALL(cuArrayDestroy(array_gbuffer_triangle_id));
+	CUDACALL(cuArrayDestroy(array_gbuffer_motion));
+	CUDACALL(cuArrayDestroy(array_gbuffer_z_gradient));
+#else
 	CUDAMemory::resource_unregister(resource_gbuffer_normal_and_depth);
 	CUDAMemory::resource_unregister(resource_gbuffer_uv);
 	CUDAMemory::resource_unregister(resource_gbuffer_uv_gradient);
 	CUDAMemory::resource_unregister(resource_gbuffer_triangle_id);
 	CUDAMemory::resource_unregister(resource_gbuffer_motion);
 	CUDAMemory::resource_unregister(resource_gbuffer_z_gradient);
+#endif
 
 	CUDACALL(cuTexObjectDestroy(module.get_global("gbuffer_normal_and_depth")	    .get_value<CUtexObject>()));
 	CUDACALL(cuTexObjectDestroy(module.get_global("gbuffer_uv")					    .get_value<CUtexObject>()));
@@ -764,6 +933,8 @@ void Pathtracer::resize_free() {
 
 	CUDAMemory::free(module.get_global("sample_xy")     .get_value<CUDAMemory::Ptr<float2>>());
 	CUDAMemory::free(module.get_global("reconstruction").get_value<CUDAMemory::Ptr<float4>>());
+	CUDAMemory::free(module.get_global("indirect_guide").get_value<CUDAMemory::Ptr<float4>>());
+	CUDAMemory::free(module.get_global("frame_buffer_regenerated").get_value<CUDAMemory::Ptr<float4>>());
 	
 	CUDAMemory::resource_unregister(resource_accumulator);
 	CUDACALL(cuSurfObjectDestroy(module.get_global("accumulator").get_value<CUsurfObject>()));
@@ -781,6 +952,22 @@ void Pathtracer::resize_free() {
 	
 	CUDAMemory::free(module.get_global("taa_frame_prev").get_value<CUDAMemory::Ptr<float4>>());
 	CUDAMemory::free(module.get_global("taa_frame_curr").get_value<CUDAMemory::Ptr<float4>>());
+
+#if ENABLE_RADIANCE_CACHE
+	CUDAMemory::free(radiance_cache_records.snapshot);
+	CUDAMemory::free(radiance_cache_records.throughput);
+#endif
+
+#if ENABLE_PATH_GUIDING
+	CUDAMemory::free(path_guiding_records.position);
+	CUDAMemory::free(path_guiding_records.direction);
+	CUDAMemory::free(path_guiding_records.throughput);
+	CUDAMemory::free(path_guiding_records.direct);
+#endif
+
+#if ENABLE_TRAVERSAL_HEATMAP
+	CUDAMemory::free(ptr_traversal_cost);
+#endif
 }
 
 void Pathtracer::upload_camera() {
@@ -824,7 +1011,7 @@ void Pathtracer::build_tlas() {
 	for (int i = 0; i < scene.mesh_count; i++) {
 		const Mesh & mesh = scene.meshes[tlas.indices[i]];
 
-		pinned_mesh_bvh_root_indices[i] = mesh_data_bvh_offsets[mesh.mesh_data_index];
+		pinned_mesh_bvh_root_indices[i] = mesh_data_bvh_offsets[mesh.mesh_data_index_lod];
 
 		memcpy(pinned_mesh_transforms    [i].cells, mesh.transform    .cells, sizeof(Matrix3x4));
 		memcpy(pinned_mesh_transforms_inv[i].cells, mesh.transform_inv.cells, sizeof(Matrix3x4));
@@ -855,6 +1042,11 @@ void Pathtracer::build_tlas() {
 }
 
 void Pathtracer::update(float delta) {
+	// The Camera is updated first, so that the LODs are selected for its current position
+	scene.camera.update(delta, settings.enable_rasterization);
+
+	if (scene.camera.moved) upload_camera();
+
 	if (settings.enable_scene_update) {
 		scene.update(delta);
 
@@ -867,11 +1059,44 @@ void Pathtracer::update(float delta) {
 		}
 	} else {
 		scene.update(0.0f); // Update with 0 delta to make sure previous Transforms match current Transforms
+
+		// A different LOD changes the BLAS that the TLAS refers to, which is a Scene update like any other
+		if (scene.lods_changed) {
+			build_tlas();
+
+			if (!settings.enable_svgf) {
+				frames_accumulated = 0;
+			}
+		}
 	}
 
-	scene.camera.update(delta, settings.enable_rasterization);
+#if ENABLE_RADIANCE_CACHE
+	if (benchmark_radiance_cache && radiance_cache_benchmark.phase == -1) {
+		radiance_cache_benchmark.phase = 0;
+		radiance_cache_benchmark.frame = 0;
 
-	if (scene.camera.moved) upload_camera();
+		radiance_cache_benchmark.settings = settings;
+
+		for (int i = 0; i < 2; i++) {
+			radiance_cache_benchmark.time[i] = 0.0;
+			radiance_cache_benchmark.rays[i] = 0.0;
+
+			radiance_cache_benchmark.image[i].assign(pixel_count, Vector3(0.0f));
+		}
+		radiance_cache_benchmark.cached = 0.0;
+
+		// The first phase still updates the cache, so that the second phase starts with a warm cache
+		settings.enable_radiance_cache          = true;
+		settings.radiance_cache_terminate_paths = false;
+		settings_changed = true;
+	}
+	benchmark_radiance_cache = false;
+#endif
+
+#if ENABLE_PATH_GUIDING
+	// Training starts over the next time path guiding is enabled
+	if (!settings.enable_path_guiding) path_guiding_reset = true;
+#endif
 
 	if (settings_changed) {
 		frames_accumulated = 0;
@@ -886,121 +1111,1154 @@ void Pathtracer::update(float delta) {
 	}
 }
 
-#define RECORD_EVENT(e) (e.record(), events.push_back(&e))
-
-void Pathtracer::render() {
-	events.clear();
+void Pathtracer::material_sort(int bounce) {
+	kernel_material_sort_count  .execute(bounce);
+	kernel_material_sort_scan   .execute();
+	kernel_material_sort_scatter.execute(bounce);
+}
 
-	if (settings.enable_rasterization) {
-		gbuffer.bind();
+// Validates the sorted shading queues against the Host reference sort and prints how coherent they are
+void Pathtracer::material_sort_report(int bounce) const {
+	BufferSizes sizes = global_buffer_sizes.get_value<BufferSizes>();
+
+	struct Queue {
+		const char * name;
+		const char * global_name;
+		int          size;
+	} queues[3] = {
+		{ "Diffuse",    "ray_buffer_shade_diffuse",    sizes.diffuse   [bounce] },
+		{ "Dielectric", "ray_buffer_shade_dielectric", sizes.dielectric[bounce] },
+		{ "Glossy",     "ray_buffer_shade_glossy",     sizes.glossy    [bounce] }
+	};
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	printf("Material coherence at bounce %i (distinct Materials per Warp):\n", bounce);
 
-		shader.bind();
+	for (int q = 0; q < Util::array_element_count(queues); q++) {
+		const Queue & queue = queues[q];
+		if (queue.size == 0) continue;
 
-		glUniform2f(uniform_jitter, scene.camera.jitter.x, scene.camera.jitter.y);
+		MaterialBuffer buffer = module.get_global(queue.global_name).get_value<MaterialBuffer>();
 
-		glUniformMatrix4fv(uniform_view_projection,      1, GL_TRUE, reinterpret_cast<const GLfloat *>(&scene.camera.view_projection));
-		glUniformMatrix4fv(uniform_view_projection_prev, 1, GL_TRUE, reinterpret_cast<const GLfloat *>(&scene.camera.view_projection_prev));
+		int * keys         = new int[queue.size];
+		int * indices      = new int[queue.size];
+		int * indices_host = new int[queue.size];
 
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
-		glEnableVertexAttribArray(2);
-		glEnableVertexAttribArray(3);
-		
-		for (int m = 0; m < scene.mesh_count; m++) {
-			const Mesh & mesh = scene.meshes[tlas.indices[m]];
-			
-			glUniformMatrix4fv(uniform_transform,      1, GL_TRUE, reinterpret_cast<const GLfloat *>(&mesh.transform));
-			glUniformMatrix4fv(uniform_transform_prev, 1, GL_TRUE, reinterpret_cast<const GLfloat *>(&mesh.transform_prev));
+		CUDAMemory::memcpy(keys,    buffer.sort_key,     queue.size);
+		CUDAMemory::memcpy(indices, buffer.sorted_index, queue.size);
 
-			glUniform1i(uniform_mesh_id, m);
+		CountingSort::sort(keys, queue.size, material_sort_key_count, indices_host);
 
-			MeshData::mesh_datas[mesh.mesh_data_index]->gl_render();
-		}
+		bool  valid            = CountingSort::is_sorted_permutation(keys, queue.size, material_sort_key_count, indices);
+		float coherence_before = CountingSort::distinct_keys_per_warp(keys, queue.size);
+		float coherence_after  = CountingSort::distinct_keys_per_warp(keys, queue.size, indices);
+		float coherence_host   = CountingSort::distinct_keys_per_warp(keys, queue.size, indices_host);
 
-		glDisableVertexAttribArray(3);
-		glDisableVertexAttribArray(2);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(0);
+		printf("    %-10s %8i Rays: %5.2f -> %5.2f (Host reference: %5.2f)%s\n", queue.name, queue.size, coherence_before, coherence_after, coherence_host, valid ? "" : " INVALID SORT");
 
-		shader .unbind();
-		gbuffer.unbind();
+		delete [] keys;
+		delete [] indices;
+		delete [] indices_host;
+	}
+}
 
-		glFinish();
+// Sorts the trace queue by Ray origin and direction, the origins are quantised within the bounds of the scene
+void Pathtracer::ray_sort(int bounce) {
+	const AABB & bounds = tlas_raw.nodes[0].aabb;
+
+	float3 bounds_min = { bounds.min.x, bounds.min.y, bounds.min.z };
+	float3 bounds_inv_extent;
+	bounds_inv_extent.x = bounds.max.x > bounds.min.x ? 1.0f / (bounds.max.x - bounds.min.x) : 0.0f;
+	bounds_inv_extent.y = bounds.max.y > bounds.min.y ? 1.0f / (bounds.max.y - bounds.min.y) : 0.0f;
+	bounds_inv_extent.z = bounds.max.z > bounds.min.z ? 1.0f / (bounds.max.z - bounds.min.z) : 0.0f;
+
+	kernel_ray_sort_count  .execute(bounce, bounds_min, bounds_inv_extent);
+	kernel_ray_sort_scan   .execute();
+	kernel_ray_sort_scatter.execute(bounce);
+}
+
+// Validates the sorted trace queue against the Host reference sort, prints how coherent it is,
+// and times the trace of the current bounce in both the original and the sorted order
+void Pathtracer::ray_sort_report(int bounce) {
+	BufferSizes sizes = global_buffer_sizes.get_value<BufferSizes>();
+
+	int count = sizes.trace[bounce] + sizes.regenerated[bounce];
+	if (count == 0) return;
+
+	TraceBuffer ray_buffer_trace = module.get_global("ray_buffer_trace").get_value<TraceBuffer>();
+
+	int * keys         = new int[count];
+	int * indices      = new int[count];
+	int * indices_host = new int[count];
+
+	CUDAMemory::memcpy(keys,    ray_buffer_trace.sort_key,     count);
+	CUDAMemory::memcpy(indices, ray_buffer_trace.sorted_index, count);
+
+	CountingSort::sort(keys, count, RAY_SORT_KEY_COUNT, indices_host);
+
+	bool  valid            = CountingSort::is_sorted_permutation(keys, count, RAY_SORT_KEY_COUNT, indices);
+	float coherence_before = CountingSort::distinct_keys_per_warp(keys, count);
+	float coherence_after  = CountingSort::distinct_keys_per_warp(keys, count, indices);
+	float coherence_host   = CountingSort::distinct_keys_per_warp(keys, count, indices_host);
+
+	delete [] keys;
+	delete [] indices;
+	delete [] indices_host;
+
+	// Tracing again only rewrites the same hits, the Rays of the bounce are handed out again by resetting the retirement counter
+	auto reset_rays_retired = [&]() {
+		BufferSizes sizes_device = global_buffer_sizes.get_value<BufferSizes>();
+		sizes_device.rays_retired[bounce] = 0;
+		global_buffer_sizes.set_value(sizes_device);
+	};
+
+	CUDAEventTimer timer;
+	CUevent events[5];
+	for (int i = 0; i < Util::array_element_count(events); i++) events[i] = timer.create();
+
+	reset_rays_retired();
+	timer.record(events[0]);
+	kernel_trace.execute(bounce, false);
+	timer.record(events[1]);
+	ray_sort(bounce);
+	timer.record(events[2]);
+
+	reset_rays_retired();
+	timer.record(events[3]);
+	kernel_trace.execute(bounce, true);
+	timer.record(events[4]);
+
+	timer.synchronize(events[4]);
+	reset_rays_retired();
+
+	float time_unsorted = timer.time_elapsed_between(events[0], events[1]);
+	float time_sort     = timer.time_elapsed_between(events[1], events[2]);
+	float time_sorted   = timer.time_elapsed_between(events[3], events[4]);
+
+	for (int i = 0; i < Util::array_element_count(events); i++) timer.destroy(events[i]);
+
+	printf("Ray coherence at bounce %i: %i Rays\n", bounce, count);
+	printf("    Distinct keys per Warp: %5.2f -> %5.2f (Host reference: %5.2f)%s\n", coherence_before, coherence_after, coherence_host, valid ? "" : " INVALID SORT");
+	printf("    Trace: %.3f ms unsorted, %.3f ms sorted + %.3f ms sort (%+.1f%% net)\n",
+		time_unsorted,
+		time_sorted,
+		time_sort,
+		100.0f * (time_sorted + time_sort - time_unsorted) / time_unsorted
+	);
+}
+
+// Runs the indirect upsampling of the current frame on both the Host reference and the Device and compares the results
+void Pathtracer::indirect_upsample_report() {
+	int width  = module.get_global("screen_width") .get_value<int>();
+	int height = module.get_global("screen_height").get_value<int>();
+	int pitch  = module.get_global("screen_pitch") .get_value<int>();
+
+	int frame_size = pitch * height;
+
+	float4 * guide    = new float4[frame_size];
+	float4 * albedo   = new float4[frame_size];
+	float4 * indirect = new float4[frame_size];
+	float4 * result   = new float4[frame_size];
+
+	CUDAMemory::memcpy(guide,    module.get_global("indirect_guide")     .get_value<CUDAMemory::Ptr<float4>>(), frame_size);
+	CUDAMemory::memcpy(albedo,   module.get_global("frame_buffer_albedo").get_value<CUDAMemory::Ptr<float4>>(), frame_size);
+	CUDAMemory::memcpy(indirect, ptr_indirect, frame_size);
+
+	UpsampleCPU::upsample(
+		width, height, pitch,
+		settings.indirect_downsample, frames_accumulated,
+		&guide[0].x, &albedo[0].x, &indirect[0].x,
+		&result[0].x
+	);
+
+	kernel_indirect_upsample.execute(frames_accumulated);
+
+	CUDAMemory::memcpy(indirect, ptr_indirect, frame_size);
+
+	int source_count    = 0;
+	int upsampled_count = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			if (guide[x + y * pitch].w == 0.0f) continue;
+
+			if (Upsample::is_source(x, y, settings.indirect_downsample, frames_accumulated)) {
+				source_count++;
+			} else {
+				upsampled_count++;
+			}
+		}
+	}
+
+	float max_difference = UpsampleCPU::max_relative_difference(width, height, pitch, &result[0].x, &indirect[0].x);
+
+	printf("Indirect upsampling at 1/%i resolution: %i pixels traced, %i pixels upsampled\n", settings.indirect_downsample, source_count, upsampled_count);
+	printf("    Host reference: max relative difference %.2e%s\n", max_difference, max_difference < 1e-3f ? "" : " INVALID UPSAMPLE");
+
+	delete [] guide;
+	delete [] albedo;
+	delete [] indirect;
+	delete [] result;
+}
+
+// Checks the regenerated sample counts of the current frame against the Host reference and reports how full the trace queues were.
+// Also validates on a synthetic scene that averaging the regenerated samples per pixel does not bias the image
+void Pathtracer::path_regeneration_report() {
+	int width  = module.get_global("screen_width") .get_value<int>();
+	int height = module.get_global("screen_height").get_value<int>();
+	int pitch  = module.get_global("screen_pitch") .get_value<int>();
+
+	BufferSizes sizes = global_buffer_sizes.get_value<BufferSizes>();
+
+	// kernel_accumulate advances the cursor, so it still points at the start of this frame
+	int cursor = module.get_global("path_regeneration_cursor").get_value<int>();
+
+	float4 * regenerated = new float4[pitch * height];
+	int    * counts_host = new int   [pixel_count];
+
+	CUDAMemory::memcpy(regenerated, module.get_global("frame_buffer_regenerated").get_value<CUDAMemory::Ptr<float4>>(), pitch * height);
+
+	memset(counts_host, 0, pixel_count * sizeof(int));
+	RegenerationCPU::get_sample_counts(pixel_count, path_regeneration_stride, cursor, sizes.regenerated, counts_host);
+
+	int count_mismatches = 0;
+	int count_total      = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int count_device = int(regenerated[x + y * pitch].w);
+			if (count_device != counts_host[x + y * width]) count_mismatches++;
+
+			count_total += count_device;
+		}
+	}
+
+	printf("Path regeneration: %i samples regenerated (%.2f per pixel)\n", count_total, float(count_total) / float(pixel_count));
+	for (int i = 0; i < MAX_WAVEFRONT_ITERATIONS; i++) {
+		int size = sizes.trace[i] + sizes.regenerated[i];
+		printf("    Iteration %i: %8i Rays (%5.1f%% of the queue), %8i regenerated\n", i, size, 100.0f * float(size) / float(batch_size), sizes.regenerated[i]);
+	}
+	printf("    Host reference: %i sample count mismatches%s\n", count_mismatches, count_mismatches == 0 ? "" : " INVALID REGENERATION");
+
+	RegenerationCPU::Validation validation = RegenerationCPU::validate(64 * 64, 1024, 1337);
+
+	printf("    Synthetic scene: %.2f samples per pixel, max deviation %.2f, mean deviation %.2f standard errors%s\n",
+		validation.samples_per_pixel,
+		validation.max_error,
+		validation.mean_error,
+		validation.mean_error < 4.0f ? "" : " BIASED"
+	);
+	printf("    Against a reference without regeneration at equal spp: max deviation %.2f, mean deviation %.2f standard errors%s\n",
+		validation.reference_max_error,
+		validation.reference_mean_error,
+		validation.reference_mean_error < 4.0f ? "" : " BIASED"
+	);
+	for (int i = 0; i < MAX_WAVEFRONT_ITERATIONS; i++) {
+		printf("        Iteration %i: %5.1f%% of the queue (%5.1f%% without regeneration)\n", i, 100.0f * validation.occupancy[i], 100.0f * validation.occupancy_no_regeneration[i]);
+	}
+
+	delete [] regenerated;
+	delete [] counts_host;
+}
+
+// Validates the shading queues built by the deterministic compaction against the Host reference
+void Pathtracer::compaction_report(int bounce) {
+	if (!settings.enable_deterministic_compaction) return;
+
+	BufferSizes sizes = global_buffer_sizes.get_value<BufferSizes>();
+
+	int count = sizes.trace[bounce] + sizes.regenerated[bounce];
+	if (count == 0) return;
+
+	TraceBuffer ray_buffer_trace = module.get_global("ray_buffer_trace").get_value<TraceBuffer>();
+
+	unsigned char * queues       = new unsigned char[count];
+	unsigned      * pixel_states = new unsigned     [count];
+	int           * keys         = new int          [count];
+	int           * destinations = new int          [count];
+
+	CUDAMemory::memcpy(queues,       module.get_global("compaction_queue").get_value<CUDAMemory::Ptr<unsigned char>>(), count);
+	CUDAMemory::memcpy(pixel_states, ray_buffer_trace.pixel_state, count);
+
+	for (int i = 0; i < count; i++) {
+		keys[i] = queues[i] < 3 ? queues[i] : -1;
+	}
+
+	int sizes_host[3];
+	CountingSort::compact(keys, count, 3, COMPACTION_BLOCK_SIZE, destinations, sizes_host);
+
+	struct Queue {
+		const char * name;
+		const char * global_name;
+		int          size;
+	} queue_list[3] = {
+		{ "Diffuse",    "ray_buffer_shade_diffuse",    sizes.diffuse   [bounce] },
+		{ "Dielectric", "ray_buffer_shade_dielectric", sizes.dielectric[bounce] },
+		{ "Glossy",     "ray_buffer_shade_glossy",     sizes.glossy    [bounce] }
+	};
+
+	printf("Queue compaction at bounce %i: %i Rays\n", bounce, count);
+
+	for (int q = 0; q < Util::array_element_count(queue_list); q++) {
+		const Queue & queue = queue_list[q];
+		if (queue.size == 0 && sizes_host[q] == 0) continue;
+
+		// A Ray that is not at its Host reference position in the queue is a mismatch
+		int mismatches = 0;
+
+		if (queue.size == sizes_host[q]) {
+			MaterialBuffer buffer = module.get_global(queue.global_name).get_value<MaterialBuffer>();
+
+			unsigned * queue_pixel_states = new unsigned[queue.size];
+			CUDAMemory::memcpy(queue_pixel_states, buffer.pixel_state, queue.size);
+
+			for (int i = 0; i < count; i++) {
+				if (keys[i] == q && queue_pixel_states[destinations[i]] != pixel_states[i]) mismatches++;
+			}
+
+			delete [] queue_pixel_states;
+		}
+
+		bool valid = queue.size == sizes_host[q] && mismatches == 0;
+
+		printf("    %-10s %8i Rays (Host reference: %8i), %i mismatches%s\n", queue.name, queue.size, sizes_host[q], mismatches, valid ? "" : " INVALID COMPACTION");
+	}
+
+	delete [] queues;
+	delete [] pixel_states;
+	delete [] keys;
+	delete [] destinations;
+}
+
+// Traces the current frame twice with the same random seeds, returns whether every pixel came out bit-identical
+bool Pathtracer::trace_paths_twice() {
+	int width  = module.get_global("screen_width") .get_value<int>();
+	int height = module.get_global("screen_height").get_value<int>();
+	int pitch  = module.get_global("screen_pitch") .get_value<int>();
+
+	int frame_size = pitch * height;
+
+	// Both runs start from the same Frame Buffers, they are accumulated into rather than overwritten
+	struct FrameBuffer {
+		CUDAMemory::Ptr<float4> ptr;
+		float4 * initial = nullptr;
+		float4 * result  = nullptr;
+	} frame_buffers[] = {
+		{ ptr_direct },
+		{ ptr_indirect },
+		{ module.get_global("frame_buffer_albedo")     .get_value<CUDAMemory::Ptr<float4>>() },
+		{ module.get_global("indirect_guide")          .get_value<CUDAMemory::Ptr<float4>>() },
+		{ module.get_global("frame_buffer_regenerated").get_value<CUDAMemory::Ptr<float4>>() }
+	};
+
+	for (int i = 0; i < Util::array_element_count(frame_buffers); i++) {
+		frame_buffers[i].initial = new float4[frame_size];
+		frame_buffers[i].result  = new float4[frame_size];
+
+		CUDAMemory::memcpy(frame_buffers[i].initial, frame_buffers[i].ptr, frame_size);
+	}
+
+	unsigned seed = Random::get_value();
+
+	Random::init(seed);
+	trace_paths();
+
+	for (int i = 0; i < Util::array_element_count(frame_buffers); i++) {
+		CUDAMemory::memcpy(frame_buffers[i].result,  frame_buffers[i].ptr, frame_size);
+		CUDAMemory::memcpy(frame_buffers[i].ptr, frame_buffers[i].initial, frame_size);
+	}
+
+	buffer_sizes->trace[0] = batch_size;
+	global_buffer_sizes.set_value(*buffer_sizes);
+
+	// The second run is not timed, trace_paths() enables recording again when it is done
+	event_recording = false;
+
+	Random::init(seed);
+	trace_paths();
+
+	float4 * direct   = frame_buffers[0].initial;
+	float4 * indirect = frame_buffers[1].initial;
+
+	CUDAMemory::memcpy(direct,   ptr_direct,   frame_size);
+	CUDAMemory::memcpy(indirect, ptr_indirect, frame_size);
+
+	int identical_count = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int index = x + y * pitch;
+
+			bool identical =
+				memcmp(&direct  [index], &frame_buffers[0].result[index], sizeof(float4)) == 0 &&
+				memcmp(&indirect[index], &frame_buffers[1].result[index], sizeof(float4)) == 0;
+
+			if (identical) identical_count++;
+		}
+	}
+
+	printf("Deterministic compaction %s: %i of %i pixels bit-identical between two runs\n",
+		settings.enable_deterministic_compaction ? "enabled" : "disabled",
+		identical_count,
+		width * height
+	);
+	if (use_path_regeneration()) {
+		printf("    Path regeneration accumulates floats atomically, disable it for bit-identical frames\n");
+	}
+
+	for (int i = 0; i < Util::array_element_count(frame_buffers); i++) {
+		delete [] frame_buffers[i].initial;
+		delete [] frame_buffers[i].result;
 	}
 
-	int pixels_left = pixel_count;
+	return identical_count == width * height;
+}
+
+bool Pathtracer::test_determinism() {
+	determinism_test = true;
+	render();
+	determinism_test = false;
 
-	// Render in batches of BATCH_SIZE pixels at a time
-	while (pixels_left > 0) {
-		int pixel_offset = pixel_count - pixels_left;
-		int pixel_count  = pixels_left > batch_size ? batch_size : pixels_left;
+	return determinism_test_passed;
+}
 
-		RECORD_EVENT(event_primary);
+#if ENABLE_RADIANCE_CACHE
+void Pathtracer::radiance_cache_update() {
+	kernel_radiance_cache_update .execute();
+	kernel_radiance_cache_resolve.execute();
+}
 
-		if (settings.enable_rasterization) {
-			// Convert rasterized GBuffers into primary Rays
-			kernel_primary.execute(
-				Random::get_value(),
-				frames_accumulated,
-				pixel_offset,
-				pixel_count,
-				settings.enable_taa
+// Replays the update of the current frame on the Host reference and compares the result with the Device.
+// Also reports how well the cache predicts the outgoing radiance of the recorded path vertices
+void Pathtracer::radiance_cache_report() {
+	int width  = module.get_global("screen_width") .get_value<int>();
+	int height = module.get_global("screen_height").get_value<int>();
+	int pitch  = module.get_global("screen_pitch") .get_value<int>();
+
+	int frame_size   = pitch * height;
+	int record_count = (NUM_BOUNCES - 1) * frame_size;
+
+	RadianceCacheCPU cache;
+	cache.init();
+
+	CUDAMemory::memcpy(cache.keys,                                       ptr_radiance_cache_keys,        RADIANCE_CACHE_SIZE);
+	CUDAMemory::memcpy(reinterpret_cast<float4 *>(cache.radiance),    ptr_radiance_cache_radiance,    RADIANCE_CACHE_SIZE);
+	CUDAMemory::memcpy(reinterpret_cast<float4 *>(cache.accumulator), ptr_radiance_cache_accumulator, RADIANCE_CACHE_SIZE);
+
+	float4 * direct     = new float4[frame_size];
+	float4 * indirect   = new float4[frame_size];
+	float4 * snapshot   = new float4[record_count];
+	uint2  * throughput = new uint2 [record_count];
+
+	CUDAMemory::memcpy(direct,     ptr_direct,                        frame_size);
+	CUDAMemory::memcpy(indirect,   ptr_indirect,                      frame_size);
+	CUDAMemory::memcpy(snapshot,   radiance_cache_records.snapshot,   record_count);
+	CUDAMemory::memcpy(throughput, radiance_cache_records.throughput, record_count);
+
+	int    record_counts[NUM_BOUNCES - 1] = { };
+	int    cached_count  = 0;
+	double error_sum     = 0.0;
+	double error_squared = 0.0;
+	double sample_sum    = 0.0;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int pixel_index = x + y * pitch;
+
+			Vector3 radiance_pixel(
+				direct[pixel_index].x + indirect[pixel_index].x,
+				direct[pixel_index].y + indirect[pixel_index].y,
+				direct[pixel_index].z + indirect[pixel_index].z
 			);
-		} else {
-			// Generate primary Rays from the current Camera orientation
-			kernel_generate.execute(
-				Random::get_value(),
-				frames_accumulated,
-				pixel_offset,
-				pixel_count
+
+			for (int bounce = 0; bounce < NUM_BOUNCES - 1; bounce++) {
+				int index = bounce * frame_size + pixel_index;
+
+				int slot;
+				memcpy(&slot, &snapshot[index].w, sizeof(int));
+
+				if (slot == -1) continue;
+
+				Vector3 vertex_throughput(
+					Packing::half_to_float(throughput[index].x & 0xffff),
+					Packing::half_to_float(throughput[index].x >> 16),
+					Packing::half_to_float(throughput[index].y & 0xffff)
+				);
+				Vector3 sample(
+					RadianceCache::get_sample(snapshot[index].x, radiance_pixel.x, vertex_throughput.x),
+					RadianceCache::get_sample(snapshot[index].y, radiance_pixel.y, vertex_throughput.y),
+					RadianceCache::get_sample(snapshot[index].z, radiance_pixel.z, vertex_throughput.z)
+				);
+
+				// Error of the estimate the cache had before this frame against the traced sample
+				const float * estimate = cache.radiance + 4 * slot;
+				if (estimate[3] >= RADIANCE_CACHE_MIN_SAMPLES) {
+					Vector3 error = Vector3(estimate[0], estimate[1], estimate[2]) - sample;
+
+					error_sum     += error.x + error.y + error.z;
+					error_squared += Vector3::dot(error, error);
+					sample_sum    += sample.x + sample.y + sample.z;
+
+					cached_count++;
+				}
+
+				cache.add_sample(slot, sample);
+
+				record_counts[bounce]++;
+			}
+		}
+	}
+
+	cache.resolve();
+
+	// Run the same update on the Device
+	radiance_cache_update();
+
+	float4 * radiance_device = new float4[RADIANCE_CACHE_SIZE];
+	CUDAMemory::memcpy(radiance_device, ptr_radiance_cache_radiance, RADIANCE_CACHE_SIZE);
+
+	int   cells_used       = 0;
+	float max_difference   = 0.0f;
+	int   count_mismatches = 0;
+
+	for (int i = 0; i < RADIANCE_CACHE_SIZE; i++) {
+		if (cache.keys[i] == 0) continue;
+		cells_used++;
+
+		const float * estimate_host   = cache.radiance + 4 * i;
+		const float * estimate_device = &radiance_device[i].x;
+
+		// Float atomics on the Device sum in a different order, so only compare up to a relative tolerance
+		for (int c = 0; c < 3; c++) {
+			float difference = fabsf(estimate_host[c] - estimate_device[c]) / fmaxf(fabsf(estimate_host[c]), 1e-3f);
+			max_difference = fmaxf(max_difference, difference);
+		}
+		if (estimate_host[3] != estimate_device[3]) count_mismatches++;
+	}
+
+	BufferSizes sizes = global_buffer_sizes.get_value<BufferSizes>();
+
+	printf("Radiance Cache: %i / %i cells used\n", cells_used, RADIANCE_CACHE_SIZE);
+	for (int bounce = 0; bounce < NUM_BOUNCES - 1; bounce++) {
+		printf("    Bounce %i: %8i vertices recorded, %8i paths terminated into the cache\n", bounce, record_counts[bounce], sizes.rays_cached[bounce]);
+	}
+	if (cached_count > 0) {
+		printf("    Cached vs traced radiance: relative bias %+.4f, RMSE %.4f over %i vertices\n",
+			error_sum / fmax(sample_sum, 1e-8),
+			sqrt(error_squared / double(cached_count)),
+			cached_count
+		);
+	}
+	printf("    Host reference: max relative difference %.2e, %i sample count mismatches%s\n", max_difference, count_mismatches, max_difference < 1e-3f && count_mismatches == 0 ? "" : " INVALID UPDATE");
+
+	delete [] direct;
+	delete [] indirect;
+	delete [] snapshot;
+	delete [] throughput;
+	delete [] radiance_device;
+
+	cache.free();
+}
+
+// Called after the paths of a frame have been traced while a benchmark is running
+void Pathtracer::radiance_cache_benchmark_frame() {
+	RadianceCacheBenchmark & benchmark = radiance_cache_benchmark;
+
+	int width  = module.get_global("screen_width") .get_value<int>();
+	int height = module.get_global("screen_height").get_value<int>();
+	int pitch  = module.get_global("screen_pitch") .get_value<int>();
+
+	// The Rays of all bounces are counted, this assumes the whole frame fits in a single batch
+	BufferSizes sizes = global_buffer_sizes.get_value<BufferSizes>();
+	for (int bounce = 0; bounce < NUM_BOUNCES; bounce++) {
+		benchmark.rays[benchmark.phase] += sizes.trace[bounce] + sizes.shadow[bounce];
+		if (benchmark.phase == 1) benchmark.cached += sizes.rays_cached[bounce];
+	}
+	benchmark.time[benchmark.phase] += event_ring.time_elapsed_in_frame();
+
+	float4 * direct   = new float4[pitch * height];
+	float4 * indirect = new float4[pitch * height];
+
+	CUDAMemory::memcpy(direct,   ptr_direct,   pitch * height);
+	CUDAMemory::memcpy(indirect, ptr_indirect, pitch * height);
+
+	std::vector<Vector3> & image = benchmark.image[benchmark.phase];
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int pixel_index = x + y * pitch;
+
+			image[x + y * width] += Vector3(
+				direct[pixel_index].x + indirect[pixel_index].x,
+				direct[pixel_index].y + indirect[pixel_index].y,
+				direct[pixel_index].z + indirect[pixel_index].z
 			);
 		}
+	}
 
-		for (int bounce = 0; bounce < NUM_BOUNCES; bounce++) {
-			// When rasterizing primary rays we can skip tracing rays on bounce 0
-			if (!(bounce == 0 && settings.enable_rasterization)) {
-				// Extend all Rays that are still alive to their next Triangle intersection
-				RECORD_EVENT(event_trace[bounce]);
-				kernel_trace.execute(bounce);
-			
-				RECORD_EVENT(event_sort[bounce]);
-				kernel_sort.execute(Random::get_value(), bounce);
-			}
+	delete [] direct;
+	delete [] indirect;
+
+	if (++benchmark.frame < RADIANCE_CACHE_BENCHMARK_FRAMES) return;
+
+	if (benchmark.phase == 0) {
+		benchmark.phase = 1;
+		benchmark.frame = 0;
+
+		settings.radiance_cache_terminate_paths = true;
+
+		global_settings.set_value(settings);
+
+		return;
+	}
+
+	// Compare the average images, the error includes the noise of both averages
+	double error_sum     = 0.0;
+	double error_squared = 0.0;
+	double reference_sum = 0.0;
+
+	for (int i = 0; i < width * height; i++) {
+		Vector3 reference = benchmark.image[0][i] / float(RADIANCE_CACHE_BENCHMARK_FRAMES);
+		Vector3 error     = benchmark.image[1][i] / float(RADIANCE_CACHE_BENCHMARK_FRAMES) - reference;
+
+		error_sum     += error.x + error.y + error.z;
+		error_squared += Vector3::dot(error, error) / fmaxf(Vector3::dot(reference, reference), 1e-4f);
+		reference_sum += reference.x + reference.y + reference.z;
+	}
+
+	double time_traced = benchmark.time[0] / RADIANCE_CACHE_BENCHMARK_FRAMES;
+	double time_cached = benchmark.time[1] / RADIANCE_CACHE_BENCHMARK_FRAMES;
+
+	printf("Radiance Cache benchmark over %i frames:\n", RADIANCE_CACHE_BENCHMARK_FRAMES);
+	printf("    Traced: %7.2f ms, %5.2f Rays per pixel\n", time_traced, benchmark.rays[0] / (double(RADIANCE_CACHE_BENCHMARK_FRAMES) * width * height));
+	printf("    Cached: %7.2f ms, %5.2f Rays per pixel, %5.2f cache terminations per pixel\n", time_cached, benchmark.rays[1] / (double(RADIANCE_CACHE_BENCHMARK_FRAMES) * width * height), benchmark.cached / (double(RADIANCE_CACHE_BENCHMARK_FRAMES) * width * height));
+	printf("    Time saved: %5.1f%%\n", 100.0 * (1.0 - time_cached / time_traced));
+	printf("    Error: relative bias %+.4f, relative RMSE %.4f\n", error_sum / fmax(reference_sum, 1e-8), sqrt(error_squared / double(width * height)));
+
+	settings = benchmark.settings;
+
+	global_settings.set_value(settings);
+
+	benchmark.phase = -1;
+	benchmark.image[0].clear();
+	benchmark.image[1].clear();
+}
+#endif
+
+#if ENABLE_PATH_GUIDING
+// Hands the samples of this frame to the worker thread, and uploads the SD-tree once the worker has refined it
+void Pathtracer::path_guiding_update() {
+	kernel_path_guiding_update.execute();
+
+	int sample_count = std::min(global_path_guiding_sample_count.get_value<int>(), PATH_GUIDING_MAX_SAMPLES);
+	global_path_guiding_sample_count.set_value(0);
+
+	// Frames that finish while the worker is still busy do not train the SD-tree, so that rendering never waits for it
+	if (path_guiding_busy) return;
+
+	// The worker has finished, joining it only releases the thread
+	if (path_guiding_worker.joinable()) path_guiding_worker.join();
+
+	if (path_guiding_reset) {
+		sd_tree.init(tlas_raw.nodes[0].aabb);
+		path_guiding_upload();
+
+		path_guiding_reset = false;
+
+		return;
+	}
+
+	if (path_guiding_refined) {
+		path_guiding_upload();
+		path_guiding_refined = false;
+	}
+
+	path_guiding_samples.resize(sample_count);
+	if (sample_count > 0) CUDAMemory::memcpy(path_guiding_samples.data(), ptr_path_guiding_samples, sample_count);
+
+	// Iteration k of the SD-tree trains it for 2^k frames
+	bool refine = sd_tree.frame_done();
+
+	path_guiding_busy = true;
+
+	path_guiding_worker = std::thread([this, refine]() {
+		for (const PathGuiding::Sample & sample : path_guiding_samples) {
+			sd_tree.record(sample);
+		}
+
+		if (refine) {
+			sd_tree.refine();
+			path_guiding_refined = true;
+		}
 
-			// Process the various Material types in different Kernels
-			if (scene.has_diffuse) {
-				RECORD_EVENT(event_shade_diffuse[bounce]);
-				kernel_shade_diffuse.execute(Random::get_value(), bounce, frames_accumulated);
+		path_guiding_busy = false;
+	});
+}
+
+// Uploads the sampling quadtrees of the SD-tree, the Device only guides once the tree has been refined
+void Pathtracer::path_guiding_upload() {
+	if (path_guiding_tree.spatial_nodes    .ptr) CUDAMemory::free(path_guiding_tree.spatial_nodes);
+	if (path_guiding_tree.directional_nodes.ptr) CUDAMemory::free(path_guiding_tree.directional_nodes);
+
+	path_guiding_tree.spatial_nodes     = { };
+	path_guiding_tree.directional_nodes = { };
+
+	if (sd_tree.iteration > 0) {
+		path_guiding_tree.spatial_nodes     = CUDAMemory::malloc<PathGuiding::SpatialNode>    (sd_tree.spatial_nodes    .size());
+		path_guiding_tree.directional_nodes = CUDAMemory::malloc<PathGuiding::DirectionalNode>(sd_tree.directional_nodes.size());
+
+		CUDAMemory::memcpy(path_guiding_tree.spatial_nodes,     sd_tree.spatial_nodes    .data(), sd_tree.spatial_nodes    .size());
+		CUDAMemory::memcpy(path_guiding_tree.directional_nodes, sd_tree.directional_nodes.data(), sd_tree.directional_nodes.size());
+	}
+
+	path_guiding_tree.bounds_min        = { sd_tree.bounds_min       [0], sd_tree.bounds_min       [1], sd_tree.bounds_min       [2] };
+	path_guiding_tree.bounds_inv_extent = { sd_tree.bounds_inv_extent[0], sd_tree.bounds_inv_extent[1], sd_tree.bounds_inv_extent[2] };
+
+	module.get_global("path_guiding_tree").set_value(path_guiding_tree);
+}
+
+// Validates the construction and sampling of the SD-tree on a synthetic scene, and prints the state of the SD-tree of the scene
+void Pathtracer::path_guiding_report() {
+	SDTree::Validation validation = SDTree::validate(PATH_GUIDING_MAX_ITERATION, 1337);
+
+	printf("Path guiding: synthetic scene after %i iterations, %i spatial leaves, %i directional nodes\n", PATH_GUIDING_MAX_ITERATION, validation.spatial_leaves, validation.directional_nodes);
+	printf("    Largest deviation of the integral of the pdf from 1: %.2e%s\n", validation.pdf_integral_error, validation.pdf_integral_error < 1e-3f ? "" : " INVALID PDF");
+	printf("    Largest deviation of sampled directions from the pdf: %.2f standard errors%s\n", validation.sample_error, validation.sample_error < 5.0f ? "" : " INVALID SAMPLING");
+	printf("    Variance relative to uniform sampling: %.3f%s\n", validation.variance_ratio, validation.variance_ratio < 1.0f ? "" : " INVALID TRAINING");
+
+	if (path_guiding_busy) {
+		printf("    Scene: the worker is busy training the SD-tree\n");
+		return;
+	}
+
+	int leaf_count = 0;
+	for (const PathGuiding::SpatialNode & node : sd_tree.spatial_nodes) {
+		if (node.child == 0) leaf_count++;
+	}
+
+	printf("    Scene: iteration %i (frame %i / %i), %i spatial leaves, %i directional nodes\n", sd_tree.iteration, sd_tree.frame, sd_tree.get_iteration_length(), leaf_count, int(sd_tree.directional_nodes.size()));
+}
+#endif
+
+#if ENABLE_TRAVERSAL_HEATMAP
+// Prints the traversal cost of this frame per path depth, and writes the cost per pixel summed over all Rays as heatmaps
+void Pathtracer::traversal_heatmap_report() {
+	int width  = module.get_global("screen_width") .get_value<int>();
+	int height = module.get_global("screen_height").get_value<int>();
+	int pitch  = module.get_global("screen_pitch") .get_value<int>();
+
+	std::vector<TraversalCost> cost(traversal_cost_count);
+	CUDAMemory::memcpy(cost.data(), ptr_traversal_cost, traversal_cost_count);
+
+	std::vector<float> pixel_nodes    (width * height, 0.0f);
+	std::vector<float> pixel_triangles(width * height, 0.0f);
+
+	printf("Traversal cost:\n");
+
+	for (int shadow = 0; shadow < 2; shadow++) {
+		for (int depth = 0; depth < NUM_BOUNCES; depth++) {
+			const TraversalCost * layer = cost.data() + (shadow * NUM_BOUNCES + depth) * pitch * height;
+
+			long long rays      = 0;
+			long long nodes     = 0;
+			long long triangles = 0;
+
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					const TraversalCost & pixel_cost = layer[x + y * pitch];
+
+					rays      += pixel_cost.rays;
+					nodes     += pixel_cost.nodes;
+					triangles += pixel_cost.triangles;
+
+					// Rows are stored bottom up, the image is written top down
+					int index = x + (height - 1 - y) * width;
+
+					pixel_nodes    [index] += float(pixel_cost.nodes);
+					pixel_triangles[index] += float(pixel_cost.triangles);
+				}
 			}
 
-			if (scene.has_dielectric) {
-				RECORD_EVENT(event_shade_dielectric[bounce]);
-				kernel_shade_dielectric.execute(Random::get_value(), bounce);
+			if (rays == 0) continue;
+
+			printf("    %s Rays, depth %i: %8lld Rays, %6.1f Nodes and %6.1f Triangles per Ray\n",
+				shadow ? "Shadow" : "Trace ",
+				depth,
+				rays,
+				double(nodes)     / double(rays),
+				double(triangles) / double(rays)
+			);
+		}
+	}
+
+	TraversalHeatmap::export_ppm("traversal_heatmap_nodes.ppm",     width, height, pixel_nodes    .data());
+	TraversalHeatmap::export_ppm("traversal_heatmap_triangles.ppm", width, height, pixel_triangles.data());
+
+	TraversalHeatmap::print_histogram("Nodes per pixel",     pixel_nodes    .data(), width * height);
+	TraversalHeatmap::print_histogram("Triangles per pixel", pixel_triangles.data(), width * height);
+}
+#endif
+
+LaunchGraphKey Pathtracer::get_launch_graph_key() const {
+	LaunchGraphKey::State state;
+	state.has_diffuse    = scene.has_diffuse;
+	state.has_dielectric = scene.has_dielectric;
+	state.has_glossy     = scene.has_glossy;
+	state.has_lights     = scene.has_lights;
+
+	state.enable_concurrent_shading = enable_concurrent_shading;
+	state.enable_path_regeneration  = use_path_regeneration();
+
+	state.samples_per_frame = get_samples_per_frame();
+
+	return LaunchGraphKey::get(settings, state);
+}
+
+// Frames that read back results on the Host in between Kernels, or that need multiple batches, are launched directly
+bool Pathtracer::can_use_launch_graph() const {
+	if (!enable_launch_graph) return false;
+	if (pixel_count > batch_size) return false;
+
+	if (measure_material_coherence || measure_ray_coherence || measure_indirect_upsample || measure_path_regeneration || measure_compaction || determinism_test) return false;
+#if ENABLE_RADIANCE_CACHE
+	if (measure_radiance_cache || radiance_cache_benchmark.phase != -1) return false;
+#endif
+#if ENABLE_PATH_GUIDING
+	// The samples that train the SD-tree are read back every frame
+	if (settings.enable_path_guiding) return false;
+#endif
+#if ENABLE_TRAVERSAL_HEATMAP
+	if (measure_traversal_cost) return false;
+#endif
+
+	return true;
+}
+
+// Regenerated samples are averaged per pixel in kernel_accumulate, so regeneration is only used when nothing else consumes the Frame Buffers.
+// The stream of regenerated samples covers the whole screen, so the frame needs to fit in a single batch
+bool Pathtracer::use_path_regeneration() const {
+	if (!settings.enable_path_regeneration) return false;
+	if (pixel_count > batch_size) return false;
+
+	// The stream of regenerated samples advances once per frame
+	if (get_samples_per_frame() > 1) return false;
+
+	return frame_buffers_are_plain_sums();
+}
+
+// Multiple samples per frame are summed in the Frame Buffers and divided out in kernel_accumulate
+int Pathtracer::get_samples_per_frame() const {
+	return frame_buffers_are_plain_sums() ? Math::clamp(settings.samples_per_frame, 1, MAX_SAMPLES_PER_FRAME) : 1;
+}
+
+// Whether the Frame Buffers only hold the sum of the samples of a pixel, to be averaged by kernel_accumulate.
+// The filters, the Radiance Cache and path guiding expect a single sample per pixel, so they exclude both
+// multiple samples per frame and path regeneration
+bool Pathtracer::frame_buffers_are_plain_sums() const {
+	return
+		!settings.enable_svgf &&
+		!settings.demodulate_albedo &&
+		!settings.enable_radiance_cache &&
+		!settings.enable_path_guiding &&
+		settings.indirect_downsample == 1 &&
+		settings.reconstruction_filter == ReconstructionFilter::BOX;
+}
+
+// The shading Kernels read disjoint queues and only append to the shared output queues atomically, so they can run concurrently
+void Pathtracer::shade(int bounce, int sample_index) {
+	bool concurrent = enable_concurrent_shading && int(scene.has_diffuse) + int(scene.has_dielectric) + int(scene.has_glossy) > 1;
+	if (concurrent) {
+		// Events on the default stream cannot time the individual branches
+		RECORD_EVENT(event_shade[bounce]);
+
+		fork_shade.fork();
+	}
+
+	if (scene.has_diffuse) {
+		if (concurrent) {
+			fork_shade.branch();
+		} else {
+			RECORD_EVENT(event_shade_diffuse[bounce]);
+		}
+		kernel_shade_diffuse.execute(Random::get_value(), bounce, sample_index);
+	}
+
+	if (scene.has_dielectric) {
+		if (concurrent) {
+			fork_shade.branch();
+		} else {
+			RECORD_EVENT(event_shade_dielectric[bounce]);
+		}
+		kernel_shade_dielectric.execute(Random::get_value(), bounce, sample_index);
+	}
+
+	if (scene.has_glossy) {
+		if (concurrent) {
+			fork_shade.branch();
+		} else {
+			RECORD_EVENT(event_shade_glossy[bounce]);
+		}
+		kernel_shade_glossy.execute(Random::get_value(), bounce, sample_index);
+	}
+
+	if (concurrent) fork_shade.join();
+}
+
+// Traces all samples of the current frame into the Frame Buffers
+void Pathtracer::trace_paths() {
+	// Every sample of the frame is traced as a full pass over the screen, the Frame Buffers sum all samples and are only resolved once
+	int samples_per_frame = get_samples_per_frame();
+
+	for (int sample = 0; sample < samples_per_frame; sample++) {
+		// Each sample continues the blue noise sequence of the pixel
+		int sample_index = frames_accumulated * samples_per_frame + sample;
+
+		if (sample > 0) {
+			// The additional samples are timed as a whole
+			if (sample == 1) RECORD_EVENT(event_samples);
+			event_recording = false;
+
+			// The reset is a Kernel rather than a copy from the Host, so that it can be part of the launch Graph
+			kernel_buffer_sizes_reset.execute(batch_size);
+		}
+
+		int pixels_left = pixel_count;
+
+		// Render in batches of BATCH_SIZE pixels at a time
+		while (pixels_left > 0) {
+			int pixel_offset = pixel_count - pixels_left;
+			int pixel_count  = pixels_left > batch_size ? batch_size : pixels_left;
+
+			RECORD_EVENT(event_primary);
+
+			if (settings.enable_rasterization) {
+				// Convert rasterized GBuffers into primary Rays
+				kernel_primary.execute(
+					Random::get_value(),
+					sample_index,
+					pixel_offset,
+					pixel_count,
+					settings.enable_taa || samples_per_frame > 1 // Samples of the same frame should cover the pixel
+				);
+			} else {
+				// Generate primary Rays from the current Camera orientation
+				kernel_generate.execute(
+					Random::get_value(),
+					sample_index,
+					pixel_offset,
+					pixel_count
+				);
 			}
 
-			if (scene.has_glossy) {
-				RECORD_EVENT(event_shade_glossy[bounce]);
-				kernel_shade_glossy.execute(Random::get_value(), bounce, frames_accumulated);
+			// With path regeneration the paths that start later in the frame need additional iterations to complete their bounces
+			bool regenerate = use_path_regeneration();
+			int  iteration_count = regenerate ? MAX_WAVEFRONT_ITERATIONS : NUM_BOUNCES;
+
+			for (int bounce = 0; bounce < iteration_count; bounce++) {
+				// Fill the slots of paths that terminated in the previous iteration with new camera samples
+				if (regenerate && Regeneration::is_regeneration_iteration(bounce)) {
+					RECORD_EVENT(event_regenerate[bounce]);
+					kernel_regenerate.execute(Random::get_value(), bounce, batch_size, path_regeneration_stride);
+				}
+
+				// When rasterizing primary rays we can skip tracing rays on bounce 0
+				if (!(bounce == 0 && settings.enable_rasterization)) {
+					// Reorder the trace queue so that Warps trace Rays with similar origins and directions, primary Rays are coherent already
+					bool sort_rays = bounce > 0 && settings.enable_ray_sort;
+
+					if (bounce > 0 && (settings.enable_ray_sort || measure_ray_coherence)) {
+						RECORD_EVENT(event_ray_sort[bounce]);
+						ray_sort(bounce);
+
+						if (measure_ray_coherence && pixel_offset == 0 && sample == 0) ray_sort_report(bounce);
+					}
+
+					// Extend all Rays that are still alive to their next Triangle intersection
+					RECORD_EVENT(event_trace[bounce]);
+					kernel_trace.execute(bounce, sort_rays);
+			
+					RECORD_EVENT(event_sort[bounce]);
+					kernel_sort.execute(Random::get_value(), bounce, sample_index);
+				}
+
+				// Append to the shading queues in the order of the trace queue, kernel_sort or kernel_primary marked the queue of every Ray
+				if (settings.enable_deterministic_compaction) {
+					kernel_compaction_count  .execute(bounce, false);
+					kernel_compaction_scan   .execute(bounce, kernel_compaction_count.grid_dim_x, false);
+					kernel_compaction_scatter.execute(bounce, false);
+				}
+
+				if (measure_compaction && pixel_offset == 0 && sample == 0) compaction_report(bounce);
+
+				// Reorder the shading queues so that Rays hitting the same Material are shaded by the same Warps
+				if (settings.enable_material_sort || measure_material_coherence) {
+					RECORD_EVENT(event_material_sort[bounce]);
+					material_sort(bounce);
+
+					if (measure_material_coherence && pixel_offset == 0 && sample == 0) material_sort_report(bounce);
+				}
+
+				// Process the various Material types in different Kernels
+				shade(bounce, sample_index);
+
+				// Append the Rays that continue their path to the trace queue of the next iteration, in the order of the shading queues
+				if (settings.enable_deterministic_compaction && bounce < iteration_count - 1) {
+					kernel_compaction_count  .execute(bounce, true);
+					kernel_compaction_scan   .execute(bounce, kernel_compaction_count.grid_dim_x, true);
+					kernel_compaction_scatter.execute(bounce, true);
+				}
+
+				// Trace shadow Rays
+				if (scene.has_lights) {
+					RECORD_EVENT(event_shadow_trace[bounce]);
+					kernel_trace_shadow.execute(bounce);
+				}
 			}
 
-			// Trace shadow Rays
-			if (scene.has_lights) {
-				RECORD_EVENT(event_shadow_trace[bounce]);
-				kernel_trace_shadow.execute(bounce);
+			pixels_left -= batch_size;
+
+			if (pixels_left > 0) {
+				// Set buffer sizes to appropriate pixel count for next Batch
+				buffer_sizes->trace[0] = Math::min(batch_size, pixels_left);
+				global_buffer_sizes.set_value(*buffer_sizes);
 			}
 		}
+	}
+	event_recording = true;
+}
+
+void Pathtracer::render() {
+	if (tune_batch_size) {
+		batch_tuner.begin(pixel_count, true);
+		set_batch_size(batch_tuner.get_batch_size());
+
+		tune_batch_size = false;
+	}
+
+	event_ring.begin_frame();
 
-		pixels_left -= batch_size;
+	bool use_launch_graph = can_use_launch_graph();
+	if (use_launch_graph) {
+		LaunchGraphKey key = get_launch_graph_key();
 
-		if (pixels_left > 0) {
-			// Set buffer sizes to appropriate pixel count for next Batch
-			buffer_sizes->trace[0] = Math::min(batch_size, pixels_left);
-			global_buffer_sizes.set_value(*buffer_sizes);
+		if (!launch_graph.is_recorded() || key != launch_graph_key) {
+			launch_graph.invalidate();
+			launch_graph_key = key;
 		}
 	}
 
+	if (settings.enable_rasterization) {
+#if GBUFFER_CPU
+		gbuffer_cpu.render(scene, tlas.indices, thread_pool);
+
+		int width  = gbuffer_cpu.width;
+		int height = gbuffer_cpu.height;
+
+		CUDAMemory::copy_array(array_gbuffer_normal_and_depth, width * sizeof(Vector4),  height, gbuffer_cpu.normal_and_depth);
+		CUDAMemory::copy_array(array_gbuffer_uv,               width * sizeof(Vector2),  height, gbuffer_cpu.uv);
+		CUDAMemory::copy_array(array_gbuffer_uv_gradient,      width * sizeof(Vector4),  height, gbuffer_cpu.uv_gradient);
+		CUDAMemory::copy_array(array_gbuffer_triangle_id,      width * sizeof(int) * 2,  height, gbuffer_cpu.mesh_id_and_triangle_id);
+		CUDAMemory::copy_array(array_gbuffer_motion,           width * sizeof(Vector2),  height, gbuffer_cpu.motion);
+		CUDAMemory::copy_array(array_gbuffer_z_gradient,       width * sizeof(Vector2),  height, gbuffer_cpu.depth_gradient);
+#else
+		gbuffer.bind();
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		shader.bind();
+
+		glUniform2f(uniform_jitter, scene.camera.jitter.x, scene.camera.jitter.y);
+
+		glUniformMatrix4fv(uniform_view_projection,      1, GL_TRUE, reinterpret_cast<const GLfloat *>(&scene.camera.view_projection));
+		glUniformMatrix4fv(uniform_view_projection_prev, 1, GL_TRUE, reinterpret_cast<const GLfloat *>(&scene.camera.view_projection_prev));
+
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glEnableVertexAttribArray(3);
+		
+		for (int m = 0; m < scene.mesh_count; m++) {
+			const Mesh & mesh = scene.meshes[tlas.indices[m]];
+			
+			glUniformMatrix4fv(uniform_transform,      1, GL_TRUE, reinterpret_cast<const GLfloat *>(&mesh.transform));
+			glUniformMatrix4fv(uniform_transform_prev, 1, GL_TRUE, reinterpret_cast<const GLfloat *>(&mesh.transform_prev));
+
+			glUniform1i(uniform_mesh_id, m);
+
+			gbuffer.render_mesh_data(mesh.mesh_data_index_lod);
+		}
+
+		glDisableVertexAttribArray(3);
+		glDisableVertexAttribArray(2);
+		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(0);
+
+		shader .unbind();
+		gbuffer.unbind();
+
+		glFinish();
+#endif
+	}
+
+	if (use_launch_graph) {
+		RECORD_EVENT(event_launch_graph);
+		launch_graph.begin();
+	}
+
+#if ENABLE_TRAVERSAL_HEATMAP
+	if (measure_traversal_cost) CUDAMemory::memset(ptr_traversal_cost, 0, traversal_cost_count);
+#endif
+
+	if (determinism_test) {
+		determinism_test_passed = trace_paths_twice();
+	} else {
+		trace_paths();
+	}
+	measure_compaction = false;
+
+#if ENABLE_TRAVERSAL_HEATMAP
+	if (measure_traversal_cost) traversal_heatmap_report();
+	measure_traversal_cost = false;
+#endif
+
+#if ENABLE_RADIANCE_CACHE
+	if (settings.enable_radiance_cache) {
+		// Add the path vertices of this frame to the cache before the Frame Buffers are filtered and cleared
+		RECORD_EVENT(event_radiance_cache_update);
+
+		if (radiance_cache_benchmark.phase != -1) {
+			radiance_cache_benchmark_frame();
+		}
+
+		if (measure_radiance_cache) {
+			radiance_cache_report();
+		} else {
+			radiance_cache_update();
+		}
+	}
+	measure_radiance_cache = false;
+#endif
+
+#if ENABLE_PATH_GUIDING
+	if (settings.enable_path_guiding) {
+		// Hand the path vertices of this frame to the SD-tree before the Frame Buffers are filtered and cleared
+		RECORD_EVENT(event_path_guiding_update);
+
+		if (measure_path_guiding) path_guiding_report();
+
+		path_guiding_update();
+	}
+	measure_path_guiding = false;
+#endif
+
+	if (settings.indirect_downsample > 1) {
+		// Fill in the indirect lighting of pixels that did not trace it, before it gets filtered
+		RECORD_EVENT(event_indirect_upsample);
+
+		if (measure_indirect_upsample) {
+			indirect_upsample_report();
+		} else {
+			kernel_indirect_upsample.execute(frames_accumulated);
+		}
+	}
+	measure_indirect_upsample = false;
+
 	if (settings.enable_svgf) {
 		// Integrate temporally
 		RECORD_EVENT(event_svgf_temporal);
@@ -1047,11 +2305,30 @@ void Pathtracer::render() {
 			kernel_reconstruct.execute();
 		}
 
+		if (measure_path_regeneration) path_regeneration_report();
+
 		RECORD_EVENT(event_accumulate);
-		kernel_accumulate.execute(float(frames_accumulated));
+		kernel_accumulate.execute(float(frames_accumulated), get_samples_per_frame());
+	}
+	measure_path_regeneration = false;
+
+	if (use_launch_graph) {
+		launch_graph.end();
 	}
 
 	RECORD_EVENT(event_end);
+
+	if (batch_tuner.is_tuning()) {
+		// Waits for the Device, but only during the few frames it takes to tune
+		if (batch_tuner.frame_done(event_ring.time_elapsed_in_frame())) {
+			set_batch_size(batch_tuner.get_batch_size());
+		}
+	}
+
+	event_ring.end_frame();
+
+	measure_material_coherence = false;
+	measure_ray_coherence      = false;
 	
 	// Reset buffer sizes to default for next frame
 	buffer_sizes->trace[0] = batch_size;
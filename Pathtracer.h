@@ -1,13 +1,21 @@
 #pragma once
 #include <vector>
+#include <atomic>
+#include <thread>
 
 #include "CUDAModule.h"
 #include "CUDAKernel.h"
 #include "CUDAMemory.h"
 #include "CUDAEvent.h"
+#include "EventRing.h"
 
 #include "GBuffer.h"
+#include "GBufferCPU.h"
 #include "Shader.h"
+#include "ThreadPool.h"
+#include "BatchTuner.h"
+#include "LaunchGraphKey.h"
+#include "SDTree.h"
 
 #include "BVHBuilder.h"
 #include "SBVHBuilder.h"
@@ -21,6 +29,8 @@ struct alignas(8)  float2 { float x, y; };
 struct             float3 { float x, y, z; };
 struct alignas(16) float4 { float x, y, z, w; };
 
+struct alignas(8) uint2 { unsigned x, y; };
+
 struct Pathtracer {
 	Scene scene;
 
@@ -29,9 +39,34 @@ struct Pathtracer {
 	Settings settings;
 	bool     settings_changed = true;
 
-	std::vector<const CUDAEvent *> events;
+	bool measure_material_coherence = false; // If set, the next frame reports how coherent the shading queues are before and after sorting
+	bool measure_ray_coherence      = false; // If set, the next frame reports how coherent the trace queues are before and after sorting, and how long they take to trace
+	bool measure_indirect_upsample  = false; // If set, the next frame validates the indirect upsampling against the Host reference
+	bool measure_path_regeneration  = false; // If set, the next frame validates the path regeneration against the Host reference
+	bool measure_compaction         = false; // If set, the next frame validates the queue compaction against the Host reference
+
+	bool tune_batch_size = false; // If set, the batch size is tuned again even if a tuned batch size was cached
+
+	bool enable_launch_graph       = true; // Launch the Kernels of a frame as a single CUDA Graph, the profiler then only shows the Graph as a whole
+	bool enable_concurrent_shading = true; // Run the shading Kernels of the different Material types concurrently, the profiler then shows them as a whole
+
+#if ENABLE_RADIANCE_CACHE
+	bool measure_radiance_cache   = false; // If set, the next frame validates the Radiance Cache update against the Host reference
+	bool benchmark_radiance_cache = false; // If set, compares RADIANCE_CACHE_BENCHMARK_FRAMES frames with and without terminating paths into the Radiance Cache
+#endif
+
+#if ENABLE_PATH_GUIDING
+	bool measure_path_guiding = false; // If set, the next frame validates the SD-tree on a synthetic scene and reports the state of the trained SD-tree
+#endif
+
+#if ENABLE_TRAVERSAL_HEATMAP
+	bool measure_traversal_cost = false; // If set, the next frame counts the Nodes and Triangles visited per pixel and writes them as heatmaps
+#endif
+
+	EventRing<CUDAEventTimer> event_ring;
 
 	void init(int mesh_count, char const ** mesh_names, char const * sky_name, unsigned frame_buffer_handle);
+	void free(); // Waits for the Host worker threads, must be called before the CUDA context is destroyed
 
 	void resize_init(unsigned frame_buffer_handle, int width, int height); // Part of resize that initializes new size
 	void resize_free();                                                    // Part of resize that cleans up old size
@@ -39,19 +74,46 @@ struct Pathtracer {
 	void update(float delta);
 	void render();
 
+	// Renders the next frame twice from the same state with the same random seeds and returns whether both came out bit-identical.
+	// Used by the --test-determinism command line option
+	bool test_determinism();
+
 private:
+	void trace_paths();
+
 	int pixel_count;
 	int batch_size;
+
+	BatchTuner batch_tuner;
+
+	void set_batch_size(int batch_size);
 	
 	GBuffer gbuffer;
 
+#if GBUFFER_CPU
+	GBufferCPU gbuffer_cpu;
+#endif
+
+	ThreadPool thread_pool;
+
 	CUDAModule module;
 
 	CUDAKernel kernel_primary;
 
 	CUDAKernel kernel_generate;
+	CUDAKernel kernel_buffer_sizes_reset;
+	CUDAKernel kernel_regenerate;
+	CUDAKernel kernel_ray_sort_count;
+	CUDAKernel kernel_ray_sort_scan;
+	CUDAKernel kernel_ray_sort_scatter;
 	CUDAKernel kernel_trace;
 	CUDAKernel kernel_sort;
+	CUDAKernel kernel_compaction_count;
+	CUDAKernel kernel_compaction_scan;
+	CUDAKernel kernel_compaction_scatter;
+	CUDAKernel kernel_material_sort_count;
+	CUDAKernel kernel_material_sort_scan;
+	CUDAKernel kernel_material_sort_scatter;
 	CUDAKernel kernel_shade_diffuse;
 	CUDAKernel kernel_shade_dielectric;
 	CUDAKernel kernel_shade_glossy;
@@ -65,9 +127,20 @@ private:
 	CUDAKernel kernel_taa;
 	CUDAKernel kernel_taa_finalize;
 
+	CUDAKernel kernel_indirect_upsample;
+
 	CUDAKernel kernel_reconstruct;
 	CUDAKernel kernel_accumulate;
 
+#if ENABLE_RADIANCE_CACHE
+	CUDAKernel kernel_radiance_cache_update;
+	CUDAKernel kernel_radiance_cache_resolve;
+#endif
+
+#if ENABLE_PATH_GUIDING
+	CUDAKernel kernel_path_guiding_update;
+#endif
+
 	CUgraphicsResource resource_gbuffer_normal_and_depth;
 	CUgraphicsResource resource_gbuffer_uv;
 	CUgraphicsResource resource_gbuffer_uv_gradient;
@@ -76,6 +149,13 @@ private:
 	CUgraphicsResource resource_gbuffer_z_gradient;
 	CUgraphicsResource resource_gbuffer_depth;
 
+	CUarray array_gbuffer_normal_and_depth;
+	CUarray array_gbuffer_uv;
+	CUarray array_gbuffer_uv_gradient;
+	CUarray array_gbuffer_triangle_id;
+	CUarray array_gbuffer_motion;
+	CUarray array_gbuffer_z_gradient;
+
 	CUgraphicsResource resource_accumulator;
 
 	CUDAModule::Global global_camera;
@@ -97,21 +177,31 @@ private:
 	CUDAMemory::Ptr<float4> ptr_indirect_alt;
 
 	// Timing Events
-	CUDAEvent event_primary;
-	CUDAEvent event_trace[NUM_BOUNCES];
-	CUDAEvent event_sort [NUM_BOUNCES];
-	CUDAEvent event_shade_diffuse   [NUM_BOUNCES];
-	CUDAEvent event_shade_dielectric[NUM_BOUNCES];
-	CUDAEvent event_shade_glossy    [NUM_BOUNCES];
-	CUDAEvent event_shadow_trace[NUM_BOUNCES];
-	CUDAEvent event_svgf_temporal;
-	CUDAEvent event_svgf_variance;
-	CUDAEvent event_svgf_atrous[MAX_ATROUS_ITERATIONS];
-	CUDAEvent event_svgf_finalize;
-	CUDAEvent event_taa;
-	CUDAEvent event_reconstruct;
-	CUDAEvent event_accumulate;
-	CUDAEvent event_end;
+	bool event_recording = true; // Cleared while launching the additional samples of a frame, they are timed as a whole
+
+	EventDesc event_primary;
+	EventDesc event_samples;
+	EventDesc event_regenerate[MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_ray_sort[MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_trace[MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_sort [MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_material_sort[MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_shade_diffuse   [MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_shade_dielectric[MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_shade_glossy    [MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_shade           [MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_shadow_trace[MAX_WAVEFRONT_ITERATIONS];
+	EventDesc event_radiance_cache_update;
+	EventDesc event_path_guiding_update;
+	EventDesc event_indirect_upsample;
+	EventDesc event_svgf_temporal;
+	EventDesc event_svgf_variance;
+	EventDesc event_svgf_atrous[MAX_ATROUS_ITERATIONS];
+	EventDesc event_svgf_finalize;
+	EventDesc event_taa;
+	EventDesc event_reconstruct;
+	EventDesc event_accumulate;
+	EventDesc event_end;
 
 	BVH        tlas_raw;
 	BVHBuilder tlas_bvh_builder;
@@ -144,7 +234,114 @@ private:
 	CUDAMemory::Ptr<float> ptr_light_mesh_area_scaled;
 	CUDAMemory::Ptr<int>   ptr_light_mesh_transform_indices;
 
+	int material_sort_key_count;
+
+	int path_regeneration_stride; // Stride through the pixels of the stream of regenerated samples, see Regeneration::get_stride
+
+#if ENABLE_RADIANCE_CACHE
+	CUDAMemory::Ptr<unsigned> ptr_radiance_cache_keys;
+	CUDAMemory::Ptr<float4>   ptr_radiance_cache_radiance;
+	CUDAMemory::Ptr<float4>   ptr_radiance_cache_accumulator;
+
+	struct RadianceCacheRecords {
+		CUDAMemory::Ptr<float4> snapshot;
+		CUDAMemory::Ptr<uint2>  throughput;
+	} radiance_cache_records;
+
+	// State of a benchmark started with 'benchmark_radiance_cache',
+	// phase 0 renders without and phase 1 with terminating paths into the Radiance Cache
+	struct RadianceCacheBenchmark {
+		int phase = -1; // -1 if no benchmark is running
+		int frame;
+
+		Settings settings; // Settings to restore when the benchmark is done
+
+		double time [2]; // Total time spent tracing paths in ms
+		double rays [2]; // Total number of Rays traced, including shadow Rays
+		double cached;   // Total number of paths terminated into the Radiance Cache
+
+		std::vector<Vector3> image[2]; // Sum of the radiance of all frames
+	} radiance_cache_benchmark;
+
+	void radiance_cache_update();
+	void radiance_cache_report();
+	void radiance_cache_benchmark_frame();
+#endif
+
+#if ENABLE_PATH_GUIDING
+	struct PathGuidingRecords {
+		CUDAMemory::Ptr<float4> position;
+		CUDAMemory::Ptr<float4> direction;
+		CUDAMemory::Ptr<float>  throughput;
+		CUDAMemory::Ptr<float>  direct;
+	} path_guiding_records;
+
+	struct PathGuidingTree {
+		CUDAMemory::Ptr<PathGuiding::SpatialNode>     spatial_nodes;
+		CUDAMemory::Ptr<PathGuiding::DirectionalNode> directional_nodes;
+
+		float3 bounds_min;
+		float3 bounds_inv_extent;
+	} path_guiding_tree;
+
+	CUDAMemory::Ptr<PathGuiding::Sample> ptr_path_guiding_samples;
+	CUDAModule::Global                   global_path_guiding_sample_count;
+
+	// The SD-tree is trained on a worker thread while the next frames are rendered,
+	// 'sd_tree' and 'path_guiding_samples' belong to the worker while 'path_guiding_busy' is set
+	SDTree                           sd_tree;
+	std::vector<PathGuiding::Sample> path_guiding_samples;
+
+	std::thread path_guiding_worker; // Joined before the SD-tree is touched again by the render thread, and in free
+
+	std::atomic<bool> path_guiding_busy    { false };
+	std::atomic<bool> path_guiding_refined { false }; // Set by the worker when the refined SD-tree needs to be uploaded
+
+	bool path_guiding_reset = true; // The SD-tree is trained from scratch once the worker is idle
+
+	void path_guiding_update();
+	void path_guiding_upload();
+	void path_guiding_report();
+#endif
+
+#if ENABLE_TRAVERSAL_HEATMAP
+	CUDAMemory::Ptr<TraversalCost> ptr_traversal_cost;
+	int                            traversal_cost_count;
+
+	void traversal_heatmap_report();
+#endif
+
 	void upload_camera();
 
+	void material_sort(int bounce);
+	void shade(int bounce, int sample_index);
+	void material_sort_report(int bounce) const;
+
+	void ray_sort(int bounce);
+	void ray_sort_report(int bounce);
+
+	void indirect_upsample_report();
+
+	bool frame_buffers_are_plain_sums() const;
+	int  get_samples_per_frame() const;
+	bool use_path_regeneration() const;
+	void path_regeneration_report();
+
+	void compaction_report(int bounce);
+	bool determinism_test        = false;
+	bool determinism_test_passed = false;
+
+	bool trace_paths_twice();
+
+	CUDAGraph      launch_graph;
+	LaunchGraphKey launch_graph_key;
+
+	CUDAFork fork_shade; // One branch per Material type
+
+	EventDesc event_launch_graph;
+
+	LaunchGraphKey get_launch_graph_key() const;
+	bool           can_use_launch_graph() const;
+
 	void build_tlas();
 };
@@ -4,11 +4,19 @@
 #include "Math.h"
 #include "Vector3.h"
 
+#include "SIMD.h"
+
 struct Quaternion {
 	float x, y, z, w;
 
 	inline Quaternion() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) { }
 	inline Quaternion(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) { }
+
+#if SIMD_SSE
+	inline explicit Quaternion(__m128 value) { _mm_storeu_ps(&x, value); }
+
+	inline __m128 load() const { return _mm_loadu_ps(&x); }
+#endif
 	
 	inline static float length(const Quaternion & quaternion) {
 		return sqrtf(quaternion.x*quaternion.x + quaternion.y*quaternion.y + quaternion.z*quaternion.z + quaternion.w*quaternion.w);
@@ -115,13 +123,29 @@ struct Quaternion {
 	}
 };
 
-inline Quaternion operator*(const Quaternion & left, Quaternion & right) {
+inline Quaternion operator*(const Quaternion & left, const Quaternion & right) {
+#if SIMD_SSE
+	__m128 l = left .load();
+	__m128 r = right.load();
+
+	// Same terms as the scalar version below, grouped by the shuffles of 'left' and 'right'
+	__m128 a = _mm_mul_ps(l, SIMD::broadcast<3>(r));
+	__m128 b = _mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 3, 3, 3)), _mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 2, 1, 0)));
+	__m128 c = _mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 0, 2, 1)), _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 0, 2)));
+	__m128 d = _mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 1, 0, 2)), _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 0, 2, 1)));
+
+	// The w component subtracts the products that the xyz components add
+	__m128 sign_w = _mm_set_ps(-0.0f, 0.0f, 0.0f, 0.0f);
+
+	return Quaternion(_mm_sub_ps(_mm_add_ps(a, _mm_xor_ps(_mm_add_ps(b, c), sign_w)), d));
+#else
 	return Quaternion(
 		left.x * right.w + left.w * right.x + left.y * right.z - left.z * right.y,
 		left.y * right.w + left.w * right.y + left.z * right.x - left.x * right.z,
 		left.z * right.w + left.w * right.z + left.x * right.y - left.y * right.x,
 		left.w * right.w - left.x * right.x - left.y * right.y - left.z * right.z
 	);
+#endif
 }
 
 inline Vector3 operator*(const Quaternion & quaternion, const Vector3 & vector) {
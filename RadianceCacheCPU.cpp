@@ -0,0 +1,95 @@
+#include "RadianceCacheCPU.h"
+
+#include <cstring>
+
+#include "CUDA_Source/RadianceCache.h"
+
+void RadianceCacheCPU::init() {
+	keys        = new unsigned[RADIANCE_CACHE_SIZE];
+	radiance    = new float   [RADIANCE_CACHE_SIZE * 4];
+	accumulator = new float   [RADIANCE_CACHE_SIZE * 4];
+
+	memset(keys,        0, RADIANCE_CACHE_SIZE     * sizeof(unsigned));
+	memset(radiance,    0, RADIANCE_CACHE_SIZE * 4 * sizeof(float));
+	memset(accumulator, 0, RADIANCE_CACHE_SIZE * 4 * sizeof(float));
+}
+
+void RadianceCacheCPU::free() {
+	delete [] keys;
+	delete [] radiance;
+	delete [] accumulator;
+}
+
+int RadianceCacheCPU::insert(unsigned hash, unsigned fingerprint) {
+	unsigned slot = hash & (RADIANCE_CACHE_SIZE - 1);
+
+	for (int probe = 0; probe < RADIANCE_CACHE_MAX_PROBES; probe++) {
+		if (keys[slot] == 0) keys[slot] = fingerprint;
+		if (keys[slot] == fingerprint) return slot;
+
+		slot = (slot + 1) & (RADIANCE_CACHE_SIZE - 1);
+	}
+
+	return -1;
+}
+
+int RadianceCacheCPU::find(unsigned hash, unsigned fingerprint) const {
+	unsigned slot = hash & (RADIANCE_CACHE_SIZE - 1);
+
+	for (int probe = 0; probe < RADIANCE_CACHE_MAX_PROBES; probe++) {
+		if (keys[slot] == fingerprint) return slot;
+		if (keys[slot] == 0)           return -1;
+
+		slot = (slot + 1) & (RADIANCE_CACHE_SIZE - 1);
+	}
+
+	return -1;
+}
+
+void RadianceCacheCPU::add_sample(int slot, const Vector3 & sample) {
+	accumulator[4 * slot    ] += sample.x;
+	accumulator[4 * slot + 1] += sample.y;
+	accumulator[4 * slot + 2] += sample.z;
+	accumulator[4 * slot + 3] += 1.0f;
+}
+
+void RadianceCacheCPU::resolve() {
+	for (int i = 0; i < RADIANCE_CACHE_SIZE; i++) {
+		float * accumulated = accumulator + 4 * i;
+		if (accumulated[3] == 0.0f) continue;
+
+		float * estimate = radiance + 4 * i;
+
+		RadianceCache::blend(
+			estimate[0], estimate[1], estimate[2], estimate[3],
+			accumulated[0], accumulated[1], accumulated[2], accumulated[3]
+		);
+
+		memset(accumulated, 0, 4 * sizeof(float));
+	}
+}
+
+int RadianceCacheCPU::insert(const Vector3 & position, const Vector3 & normal, float distance_to_camera, float pixel_spread_angle) {
+	int level = RadianceCache::get_level(distance_to_camera, pixel_spread_angle);
+
+	unsigned hash, fingerprint;
+	RadianceCache::get_key(position.x, position.y, position.z, normal.x, normal.y, normal.z, level, hash, fingerprint);
+
+	return insert(hash, fingerprint);
+}
+
+bool RadianceCacheCPU::lookup(const Vector3 & position, const Vector3 & normal, float distance_to_camera, float pixel_spread_angle, Vector3 & result) const {
+	int level = RadianceCache::get_level(distance_to_camera, pixel_spread_angle);
+
+	unsigned hash, fingerprint;
+	RadianceCache::get_key(position.x, position.y, position.z, normal.x, normal.y, normal.z, level, hash, fingerprint);
+
+	int slot = find(hash, fingerprint);
+	if (slot == -1) return false;
+
+	const float * estimate = radiance + 4 * slot;
+	if (estimate[3] < RADIANCE_CACHE_MIN_SAMPLES) return false;
+
+	result = Vector3(estimate[0], estimate[1], estimate[2]);
+	return true;
+}
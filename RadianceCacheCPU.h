@@ -0,0 +1,27 @@
+#pragma once
+#include "Vector3.h"
+
+// Host side reference implementation of the Radiance Cache hash grid.
+// Uses the same keys, probing sequence and blending as the Device, see CUDA_Source/RadianceCache.h
+struct RadianceCacheCPU {
+	unsigned * keys;        // 0 marks an empty slot
+	float    * radiance;    // Four floats per slot, radiance estimate in xyz and sample count in w
+	float    * accumulator; // Four floats per slot, sum of the samples of the current frame in xyz and their count in w
+
+	void init();
+	void free();
+
+	// Returns the slot of the cell, allocating it if needed, or -1 if the probing sequence is full
+	int insert(unsigned hash, unsigned fingerprint);
+	// Returns the slot of the cell, or -1 if it is not in the table
+	int find(unsigned hash, unsigned fingerprint) const;
+
+	void add_sample(int slot, const Vector3 & sample);
+
+	// Blends the accumulated samples into the radiance estimates and clears the accumulator
+	void resolve();
+
+	// Position based interface, the cell level is determined by the distance to the Camera
+	int  insert(const Vector3 & position, const Vector3 & normal, float distance_to_camera, float pixel_spread_angle);
+	bool lookup(const Vector3 & position, const Vector3 & normal, float distance_to_camera, float pixel_spread_angle, Vector3 & result) const;
+};
@@ -0,0 +1,147 @@
+#include "RaySortCPU.h"
+
+#include <cmath>
+#include <cassert>
+
+#include "CUDA_Source/RaySort.h"
+
+void RaySortCPU::get_keys(
+	int count,
+	const float * origin_x,    const float * origin_y,    const float * origin_z,
+	const float * direction_x, const float * direction_y, const float * direction_z,
+	const AABB & bounds,
+	int * keys
+) {
+	float bounds_min       [3] = { bounds.min.x, bounds.min.y, bounds.min.z };
+	float bounds_inv_extent[3];
+
+	for (int dimension = 0; dimension < 3; dimension++) {
+		float extent = bounds.max[dimension] - bounds.min[dimension];
+
+		bounds_inv_extent[dimension] = extent > 0.0f ? 1.0f / extent : 0.0f;
+	}
+
+	for (int i = 0; i < count; i++) {
+		keys[i] = RaySort::get_key(
+			origin_x   [i], origin_y   [i], origin_z   [i],
+			direction_x[i], direction_y[i], direction_z[i],
+			bounds_min, bounds_inv_extent
+		);
+	}
+}
+
+static bool intersects(const AABB & aabb, const Vector3 & origin, const Vector3 & direction_inv, float max_distance) {
+	Vector3 t0 = (aabb.min - origin) * direction_inv;
+	Vector3 t1 = (aabb.max - origin) * direction_inv;
+
+	float t_near = fmaxf(fmaxf(fminf(t0.x, t1.x), fminf(t0.y, t1.y)), fmaxf(fminf(t0.z, t1.z), 0.0f));
+	float t_far  = fminf(fminf(fmaxf(t0.x, t1.x), fmaxf(t0.y, t1.y)), fminf(fmaxf(t0.z, t1.z), max_distance));
+
+	return t_near <= t_far;
+}
+
+// Möller-Trumbore intersection, same as triangle_trace on the Device. Returns whether 't' was updated
+static bool triangle_trace(const Triangle & triangle, const Vector3 & origin, const Vector3 & direction, float & t) {
+	Vector3 edge_1 = triangle.position_1 - triangle.position_0;
+	Vector3 edge_2 = triangle.position_2 - triangle.position_0;
+
+	Vector3 h = Vector3::cross(direction, edge_2);
+	float   a = Vector3::dot(edge_1, h);
+
+	float   f = 1.0f / a;
+	Vector3 s = origin - triangle.position_0;
+	float   u = f * Vector3::dot(s, h);
+
+	if (u >= 0.0f && u <= 1.0f) {
+		Vector3 q = Vector3::cross(s, edge_1);
+		float   v = f * Vector3::dot(direction, q);
+
+		if (v >= 0.0f && u + v <= 1.0f) {
+			float t_hit = f * Vector3::dot(edge_2, q);
+
+			if (t_hit > 0.0f && t_hit < t) {
+				t = t_hit;
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Same order as BVHNode::should_visit_left_first on the Device
+static bool should_visit_left_first(const BVHNode & node, const Vector3 & direction) {
+	switch (node.count & BVH_AXIS_MASK) {
+		case BVH_AXIS_X_BITS: return direction.x > 0.0f;
+		case BVH_AXIS_Y_BITS: return direction.y > 0.0f;
+		case BVH_AXIS_Z_BITS: return direction.z > 0.0f;
+	}
+
+	return true;
+}
+
+int RaySortCPU::trace(const BVH & bvh, const Triangle * triangles, const Vector3 & origin, const Vector3 & direction, float & t, int * triangle_tests, int * triangle_hit) {
+	Vector3 direction_inv(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	// Unlike the Device the Host traverses a single BVH over all Triangles, which can be deeper than BVH_STACK_SIZE
+	constexpr int STACK_SIZE = 128;
+
+	int stack[STACK_SIZE];
+	int stack_size = 1;
+	stack[0] = 0;
+
+	int steps = 0;
+	int tests = 0;
+	int hit   = -1;
+
+	t = INFINITY;
+
+	while (stack_size > 0) {
+		const BVHNode & node = bvh.nodes[stack[--stack_size]];
+		steps++;
+
+		if (!intersects(node.aabb, origin, direction_inv, t)) continue;
+
+		if (node.is_leaf()) {
+			for (int i = node.first; i < node.first + node.get_count(); i++) {
+				if (triangle_trace(triangles[bvh.indices[i]], origin, direction, t)) hit = bvh.indices[i];
+			}
+			tests += node.get_count();
+		} else {
+			assert(stack_size + 2 <= STACK_SIZE);
+
+			// The child that is visited first is pushed last
+			if (should_visit_left_first(node, direction)) {
+				stack[stack_size++] = node.left + 1;
+				stack[stack_size++] = node.left;
+			} else {
+				stack[stack_size++] = node.left;
+				stack[stack_size++] = node.left + 1;
+			}
+		}
+	}
+
+	if (triangle_tests) *triangle_tests = tests;
+	if (triangle_hit)   *triangle_hit   = hit;
+
+	return steps;
+}
+
+long long RaySortCPU::warp_steps(const int * steps, int count, const int * indices) {
+	long long result = 0;
+
+	for (int base = 0; base < count; base += WARP_SIZE) {
+		int steps_max = 0;
+
+		for (int i = base; i < base + WARP_SIZE && i < count; i++) {
+			int index = indices ? indices[i] : i;
+
+			if (steps[index] > steps_max) steps_max = steps[index];
+		}
+
+		result += steps_max;
+	}
+
+	return result;
+}
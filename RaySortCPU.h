@@ -0,0 +1,24 @@
+#pragma once
+#include "BVH.h"
+
+// Host side reference implementation of the trace queue reordering,
+// see kernel_ray_sort_* and CUDA_Source/RaySort.h
+namespace RaySortCPU {
+	// Computes the sort key of 'count' Rays in SoA layout, with the origins quantised within 'bounds'
+	void get_keys(
+		int count,
+		const float * origin_x,    const float * origin_y,    const float * origin_z,
+		const float * direction_x, const float * direction_y, const float * direction_z,
+		const AABB & bounds,
+		int * keys
+	);
+
+	// Closest hit traversal of a binary BVH over 'triangles', returns the number of Nodes that were visited.
+	// 't' receives the distance to the closest hit, or INFINITY if there is none. If given, 'triangle_tests' receives the number of Triangles that were tested
+	// and 'triangle_hit' the index of the closest Triangle that was hit, or -1 if there is none
+	int trace(const BVH & bvh, const Triangle * triangles, const Vector3 & origin, const Vector3 & direction, float & t, int * triangle_tests = nullptr, int * triangle_hit = nullptr);
+
+	// Warps traverse in lockstep, so every group of WARP_SIZE consecutive Rays costs as many steps as its longest traversal.
+	// Returns the sum of those over all groups when the Rays are visited in the order given by 'indices'
+	long long warp_steps(const int * steps, int count, const int * indices);
+}
@@ -0,0 +1,224 @@
+#include "RegenerationCPU.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "CUDA_Source/Regeneration.h"
+
+void RegenerationCPU::get_sample_counts(int pixel_count, int stride, int cursor, const int regenerated[MAX_WAVEFRONT_ITERATIONS], int * sample_counts) {
+	int stream_index = cursor;
+
+	for (int i = 0; i < MAX_WAVEFRONT_ITERATIONS; i++) {
+		if (!Regeneration::is_regeneration_iteration(i)) continue;
+
+		for (int j = 0; j < regenerated[i]; j++) {
+			sample_counts[Regeneration::get_pixel(stream_index + j, stride, pixel_count)]++;
+		}
+		stream_index += regenerated[i];
+	}
+}
+
+struct SyntheticPath {
+	int   pixel;
+	int   start; // Wavefront iteration at which the path was started
+	float throughput;
+};
+
+// Emission and albedo of the synthetic scene as seen through a pixel
+static float get_emission(int pixel) { return 0.25f + float(pixel % 7) / 7.0f; }
+static float get_albedo  (int pixel) { return 0.2f  + 0.7f * float((pixel * 13) % 10) / 10.0f; }
+
+// Same as random_float_xorshift on the Device
+static float random_float_xorshift(unsigned & seed) {
+	seed ^= (seed << 13);
+	seed ^= (seed >> 17);
+	seed ^= (seed << 5);
+
+	return float(seed) * 2.3283064365387e-10f;
+}
+
+// Renders one frame, the first sample of every pixel is written to 'first', regenerated samples are summed into 'regenerated_sum'.
+// Random numbers are seeded per path like on the Device with deterministic compaction, see Regeneration::get_path_seed
+static void render_frame(
+	int pixel_count, int stride, int & cursor, bool regenerate, int sample_index, std::mt19937 & engine,
+	float * first, float * regenerated_sum, float * regenerated_count, int * queue_sizes
+) {
+	std::vector<SyntheticPath> queue;
+	std::vector<SyntheticPath> queue_next;
+
+	for (int p = 0; p < pixel_count; p++) {
+		queue.push_back({ p, 0, 1.0f });
+
+		first            [p] = 0.0f;
+		regenerated_sum  [p] = 0.0f;
+		regenerated_count[p] = 0.0f;
+	}
+
+	int capacity  = pixel_count;
+	int regenerated_total = 0;
+
+	int iteration_count = regenerate ? MAX_WAVEFRONT_ITERATIONS : NUM_BOUNCES;
+
+	for (int iteration = 0; iteration < iteration_count; iteration++) {
+		if (regenerate && Regeneration::is_regeneration_iteration(iteration)) {
+			int count = Regeneration::get_count(int(queue.size()), capacity);
+
+			for (int i = 0; i < count; i++) {
+				int pixel = Regeneration::get_pixel(cursor + regenerated_total + i, stride, pixel_count);
+
+				queue.push_back({ pixel, iteration, 1.0f });
+				regenerated_count[pixel] += 1.0f;
+			}
+			regenerated_total += count;
+		}
+
+		queue_sizes[iteration] += int(queue.size());
+
+		queue_next.clear();
+
+		// Drawn per Kernel launch on the Device
+		unsigned rand_seed = engine();
+
+		for (SyntheticPath & path : queue) {
+			unsigned seed = Regeneration::get_path_seed(path.pixel, path.start, sample_index, rand_seed);
+
+			// Russian Roulette, as in kernel_sort
+			float p_survive = fminf(path.throughput, 1.0f);
+			if (random_float_xorshift(seed) > p_survive) continue;
+
+			path.throughput /= p_survive;
+
+			float illumination = path.throughput * get_emission(path.pixel);
+			if (path.start > 0) {
+				regenerated_sum[path.pixel] += illumination;
+			} else {
+				first[path.pixel] += illumination;
+			}
+
+			if (iteration - path.start == NUM_BOUNCES - 1) continue;
+
+			path.throughput *= get_albedo(path.pixel);
+			queue_next.push_back(path);
+		}
+
+		std::swap(queue, queue_next);
+	}
+
+	cursor = Regeneration::advance_cursor(cursor, regenerated_total, pixel_count);
+}
+
+// Mean and variance of the mean of the per frame estimates of every pixel
+struct Estimates {
+	std::vector<double> sum;
+	std::vector<double> sum_squared;
+
+	int frame_count = 0;
+
+	Estimates(int pixel_count) : sum(pixel_count, 0.0), sum_squared(pixel_count, 0.0) { }
+
+	double get_mean(int pixel) const {
+		return sum[pixel] / double(frame_count);
+	}
+
+	double get_variance_of_mean(int pixel) const {
+		double mean = get_mean(pixel);
+		return fmax(sum_squared[pixel] / double(frame_count) - mean * mean, 0.0) / double(frame_count - 1);
+	}
+};
+
+// Deviation of the estimates from the expected values, in standard errors of the difference. The largest per pixel deviation is written to 'max_error',
+// the deviation of the sum over all pixels to 'mean_error'. If 'reference' is nullptr the expected values are the analytic ones
+static void compare(int pixel_count, const Estimates & estimates, const Estimates * reference, float & max_error, float & mean_error) {
+	double error_sum          = 0.0;
+	double error_variance_sum = 0.0;
+
+	max_error = 0.0f;
+
+	for (int p = 0; p < pixel_count; p++) {
+		double expected          = 0.0;
+		double expected_variance = 0.0;
+
+		if (reference) {
+			expected          = reference->get_mean(p);
+			expected_variance = reference->get_variance_of_mean(p);
+		} else {
+			// Russian Roulette keeps the estimator unbiased, so every bounce adds the emission attenuated by the albedo of the previous bounces
+			double throughput = 1.0;
+			for (int bounce = 0; bounce < NUM_BOUNCES; bounce++) {
+				expected   += throughput * get_emission(p);
+				throughput *= get_albedo(p);
+			}
+		}
+
+		double difference = estimates.get_mean(p) - expected;
+		double variance   = estimates.get_variance_of_mean(p) + expected_variance;
+
+		max_error = fmaxf(max_error, float(fabs(difference) / sqrt(fmax(variance, 1e-12))));
+
+		error_sum          += difference;
+		error_variance_sum += variance;
+	}
+
+	mean_error = float(fabs(error_sum) / sqrt(fmax(error_variance_sum, 1e-12)));
+}
+
+RegenerationCPU::Validation RegenerationCPU::validate(int pixel_count, int frame_count, unsigned seed) {
+	std::mt19937 engine(seed);
+
+	int stride = Regeneration::get_stride(pixel_count);
+	int cursor = 0;
+
+	std::vector<float> first            (pixel_count);
+	std::vector<float> regenerated_sum  (pixel_count);
+	std::vector<float> regenerated_count(pixel_count);
+
+	int queue_sizes               [MAX_WAVEFRONT_ITERATIONS] = { };
+	int queue_sizes_no_regeneration[MAX_WAVEFRONT_ITERATIONS] = { };
+
+	Validation result = { };
+
+	// Render with regeneration, every frame gives one estimate per pixel that averages all its samples
+	Estimates estimates(pixel_count);
+
+	double sample_count = 0.0;
+
+	for (int f = 0; f < frame_count; f++) {
+		render_frame(pixel_count, stride, cursor, true, f, engine, first.data(), regenerated_sum.data(), regenerated_count.data(), queue_sizes);
+
+		for (int p = 0; p < pixel_count; p++) {
+			double estimate = Regeneration::resolve(first[p], regenerated_sum[p], regenerated_count[p]);
+
+			estimates.sum        [p] += estimate;
+			estimates.sum_squared[p] += estimate * estimate;
+
+			sample_count += 1.0 + regenerated_count[p];
+		}
+	}
+	estimates.frame_count = frame_count;
+
+	result.samples_per_pixel = float(sample_count / (double(frame_count) * double(pixel_count)));
+
+	// Render the reference without regeneration, with as many samples per pixel in total
+	Estimates reference(pixel_count);
+	reference.frame_count = int(roundf(float(frame_count) * result.samples_per_pixel));
+
+	for (int f = 0; f < reference.frame_count; f++) {
+		render_frame(pixel_count, stride, cursor, false, frame_count + f, engine, first.data(), regenerated_sum.data(), regenerated_count.data(), queue_sizes_no_regeneration);
+
+		for (int p = 0; p < pixel_count; p++) {
+			reference.sum        [p] += first[p];
+			reference.sum_squared[p] += first[p] * first[p];
+		}
+	}
+
+	compare(pixel_count, estimates, nullptr,    result.max_error,           result.mean_error);
+	compare(pixel_count, estimates, &reference, result.reference_max_error, result.reference_mean_error);
+
+	for (int i = 0; i < MAX_WAVEFRONT_ITERATIONS; i++) {
+		result.occupancy               [i] = float(queue_sizes               [i]) / float(frame_count           * pixel_count);
+		result.occupancy_no_regeneration[i] = float(queue_sizes_no_regeneration[i]) / float(reference.frame_count * pixel_count);
+	}
+
+	return result;
+}
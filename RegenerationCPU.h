@@ -0,0 +1,29 @@
+#pragma once
+#include "CUDA_Source/Common.h"
+
+// Host side reference implementation of streaming path regeneration,
+// see kernel_regenerate and CUDA_Source/Regeneration.h
+namespace RegenerationCPU {
+	// Adds the number of regenerated samples every pixel received in a frame to 'sample_counts',
+	// given the cursor at the start of the frame and the number of samples regenerated at every wavefront iteration
+	void get_sample_counts(int pixel_count, int stride, int cursor, const int regenerated[MAX_WAVEFRONT_ITERATIONS], int * sample_counts);
+
+	struct Validation {
+		float max_error;  // Largest deviation of a per pixel estimate from its expected value, in standard errors
+		float mean_error; // Deviation of the estimates averaged over all pixels, in standard errors
+
+		// The same, but against a reference rendered without regeneration that has the same number of samples per pixel
+		float reference_max_error;
+		float reference_mean_error;
+
+		float samples_per_pixel; // Average number of samples per pixel per frame, including the first
+
+		float occupancy               [MAX_WAVEFRONT_ITERATIONS]; // Average fraction of the trace queue that holds a live path, per wavefront iteration
+		float occupancy_no_regeneration[MAX_WAVEFRONT_ITERATIONS];
+	};
+
+	// Renders a synthetic scene with the same wavefront schedule, Russian Roulette, random number seeding and accumulation as the Device,
+	// and compares the per pixel estimates with their analytic expected values and with a reference rendered without regeneration.
+	// Every path vertex adds the emission of its pixel and continues with the albedo of its pixel
+	Validation validate(int pixel_count, int frame_count, unsigned seed);
+}
@@ -7,7 +7,23 @@
 #include "Util.h"
 #include "ScopeTimer.h"
 
-int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * indices[3], int & node_index, int first_index, int index_count, float inv_root_surface_area) {
+bool SBVHBuilder::allow_spatial_split(int depth) {
+	if (depth > settings.max_spatial_split_depth) return false;
+
+	if (settings.time_budget > 0.0f && !time_budget_exceeded) {
+		std::chrono::duration<float, std::milli> duration = std::chrono::high_resolution_clock::now() - start_time;
+
+		if (duration.count() > settings.time_budget) {
+			time_budget_exceeded = true;
+
+			printf("SBVH time budget of %.1f ms exceeded, falling back to Object Splits\n", settings.time_budget);
+		}
+	}
+
+	return !time_budget_exceeded;
+}
+
+int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * indices[3], int & node_index, int first_index, int index_count, float inv_root_surface_area, int depth) {
 	if (index_count == 1) {
 		// Leaf Node, terminate recursion
 		node.first = first_index;
@@ -34,6 +50,9 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 	int   spatial_split_count_right;
 	int   spatial_split_index;
 
+	// Adapt the amount of bins to the amount of primitives in the Node
+	int spatial_split_bin_count = Math::clamp(index_count, settings.bin_count_min, settings.bin_count_max);
+
 	// Calculate the overlap between the child bounding boxes resulting from the Object Split
 	float lamba = 0.0f;
 	AABB overlap = AABB::overlap(object_split_aabb_left, object_split_aabb_right);
@@ -41,21 +60,19 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 		lamba = overlap.surface_area();
 	}
 
-	// Alpha == 1 means regular BVH, Alpha == 0 means full SBVH
-	const float alpha = 10e-5; 
-
 	// Divide by the surface area of the bounding box of the root Node
 	float ratio = lamba * inv_root_surface_area;
 		
 	assert(ratio >= 0.0f && ratio <= 1.0f);
 
 	// If ratio between overlap area and root area is large enough, consider a Spatial Split
-	if (ratio > alpha) { 
-		spatial_split_index = BVHPartitions::partition_spatial(triangles, indices, first_index, index_count, sah,
+	if (ratio > settings.alpha && allow_spatial_split(depth)) { 
+		spatial_split_index = BVHPartitions::partition_spatial(triangles, indices, first_index, index_count,
 			spatial_split_dimension,  spatial_split_cost,
 			spatial_split_aabb_left,  spatial_split_aabb_right,
 			spatial_split_count_left, spatial_split_count_right,
-			node.aabb
+			node.aabb,
+			spatial_split_bin_count
 		);
 	}
 
@@ -158,9 +175,8 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 		float n_1 = float(spatial_split_count_left);
 		float n_2 = float(spatial_split_count_right);
 
-		float bounds_min  = node.aabb.min[spatial_split_dimension] - 0.001f;
-		float bounds_max  = node.aabb.max[spatial_split_dimension] + 0.001f;
-		float bounds_step = (bounds_max - bounds_min) / BVHPartitions::SBVH_BIN_COUNT;
+		float bounds_min = node.aabb.min[spatial_split_dimension] - 0.001f;
+		float bounds_max = node.aabb.max[spatial_split_dimension] + 0.001f;
 		
 		float inv_bounds_delta = 1.0f / (bounds_max - bounds_min);
 
@@ -184,8 +200,8 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 			float vertex_min = vertices[0][spatial_split_dimension];
 			float vertex_max = vertices[2][spatial_split_dimension];
 				
-			int bin_min = int(BVHPartitions::SBVH_BIN_COUNT * ((triangle_aabb.min[spatial_split_dimension] - bounds_min) * inv_bounds_delta));
-			int bin_max = int(BVHPartitions::SBVH_BIN_COUNT * ((triangle_aabb.max[spatial_split_dimension] - bounds_min) * inv_bounds_delta));
+			int bin_min = int(spatial_split_bin_count * ((triangle_aabb.min[spatial_split_dimension] - bounds_min) * inv_bounds_delta));
+			int bin_max = int(spatial_split_bin_count * ((triangle_aabb.max[spatial_split_dimension] - bounds_min) * inv_bounds_delta));
 
 			bool goes_left  = bin_min <  spatial_split_index;
 			bool goes_right = bin_max >= spatial_split_index;
@@ -295,7 +311,7 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 	sbvh->nodes[node.left + 1].aabb = child_aabb_right;
 
 	// Do a depth first traversal, so that we know the amount of indices that were recursively created by the left child
-	int num_leaves_left = build_sbvh(sbvh->nodes[node.left], triangles, indices, node_index, first_index, n_left, inv_root_surface_area);
+	int num_leaves_left = build_sbvh(sbvh->nodes[node.left], triangles, indices, node_index, first_index, n_left, inv_root_surface_area, depth + 1);
 
 	// Using the depth first offset, we can now copy over the right references
 	memcpy(indices[0] + first_index + num_leaves_left, children_right[0], n_right * sizeof(int));
@@ -303,7 +319,7 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 	memcpy(indices[2] + first_index + num_leaves_left, children_right[2], n_right * sizeof(int));
 			
 	// Now recurse on the right side
-	int num_leaves_right = build_sbvh(sbvh->nodes[node.left + 1], triangles, indices, node_index, first_index + num_leaves_left, n_right, inv_root_surface_area);
+	int num_leaves_right = build_sbvh(sbvh->nodes[node.left + 1], triangles, indices, node_index, first_index + num_leaves_left, n_right, inv_root_surface_area, depth + 1);
 		
 	delete [] children_right[0];
 	delete [] children_right[1];
@@ -315,6 +331,11 @@ int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * in
 void SBVHBuilder::build(const Triangle * triangles, int triangle_count) {
 	puts("Construcing SBVH, this may take a few seconds for large scenes...");
 
+	assert(settings.bin_count_max <= BVHPartitions::SBVH_MAX_BIN_COUNT);
+
+	start_time = std::chrono::high_resolution_clock::now();
+	time_budget_exceeded = false;
+
 	std::sort(indices_x, indices_x + triangle_count, [&](int a, int b) { return triangles[a].get_center().x < triangles[b].get_center().x; });
 	std::sort(indices_y, indices_y + triangle_count, [&](int a, int b) { return triangles[a].get_center().y < triangles[b].get_center().y; });
 	std::sort(indices_z, indices_z + triangle_count, [&](int a, int b) { return triangles[a].get_center().z < triangles[b].get_center().z; });
@@ -325,7 +346,7 @@ void SBVHBuilder::build(const Triangle * triangles, int triangle_count) {
 	sbvh->nodes[0].aabb = root_aabb;
 
 	int node_index = 2;
-	sbvh->index_count = build_sbvh(sbvh->nodes[0], triangles, indices, node_index, 0, triangle_count, 1.0f / root_aabb.surface_area());
+	sbvh->index_count = build_sbvh(sbvh->nodes[0], triangles, indices, node_index, 0, triangle_count, 1.0f / root_aabb.surface_area(), 0);
 		
 	if (node_index > SBVH_OVERALLOCATION * triangle_count) abort();
 
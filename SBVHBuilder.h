@@ -1,6 +1,39 @@
 #pragma once
+#include <chrono>
+#include <climits>
+#include <cassert>
+#include <cstdlib>
+
 #include "BVH.h"
 
+// Controls the trade-off between SBVH construction time and quality
+struct SBVHSettings {
+	float alpha; // Alpha == 1 means regular BVH, Alpha == 0 means full SBVH
+
+	// The amount of Spatial Split bins is adapted to the amount of primitives in a Node,
+	// clamped to the range [bin_count_min, bin_count_max]
+	int bin_count_min;
+	int bin_count_max;
+
+	int max_spatial_split_depth; // Nodes deeper than this only consider Object Splits
+
+	float time_budget; // In milliseconds, once exceeded only Object Splits are performed. Zero means no budget
+
+	// The bin count of a Node is clamp(primitive count, bin_count_min, bin_count_max). This is intended:
+	// under BALANCED, Nodes with 16 to 256 primitives get one bin per primitive, so that the cost of binning
+	// stays linear in the size of the Node, while Nodes with fewer primitives still get 16 bins.
+	// FAST caps the bins at 32 everywhere and MAX always uses 256
+	inline static SBVHSettings from_preset(int preset, float time_budget = 0.0f) {
+		switch (preset) {
+			case SBVH_PRESET_FAST:     return { 10e-4f,   8,  32,      16, time_budget };
+			case SBVH_PRESET_BALANCED: return { 10e-5f,  16, 256,      64, time_budget };
+			case SBVH_PRESET_MAX:      return { 10e-6f, 256, 256, INT_MAX, time_budget };
+
+			default: abort();
+		}
+	}
+};
+
 struct SBVHBuilder {
 private:
 	static constexpr int SBVH_OVERALLOCATION = 4; // SBVH requires more space
@@ -16,12 +49,22 @@ private:
 
 	int max_primitives_in_leaf;
 
-	int SBVHBuilder::build_sbvh(BVHNode & node, const Triangle * triangles, int * indices[3], int & node_index, int first_index, int index_count, float inv_root_surface_area);
+	SBVHSettings settings;
+
+	std::chrono::high_resolution_clock::time_point start_time;
+	bool time_budget_exceeded;
+
+	bool allow_spatial_split(int depth);
+
+	int build_sbvh(BVHNode & node, const Triangle * triangles, int * indices[3], int & node_index, int first_index, int index_count, float inv_root_surface_area, int depth);
 
 public:
-	inline void init(BVH * sbvh, int triangle_count, int max_primitives_in_leaf) {
+	inline void init(BVH * sbvh, int triangle_count, int max_primitives_in_leaf, const SBVHSettings & settings = SBVHSettings::from_preset(SBVH_PRESET, SBVH_TIME_BUDGET)) {
 		this->sbvh = sbvh;
 		this->max_primitives_in_leaf = max_primitives_in_leaf;
+		this->settings = settings;
+
+		assert(settings.bin_count_min >= 2 && settings.bin_count_min <= settings.bin_count_max);
 
 		indices_x = new int[SBVH_OVERALLOCATION * triangle_count];
 		indices_y = new int[SBVH_OVERALLOCATION * triangle_count];
@@ -51,4 +94,9 @@ public:
 	}
 
 	void build(const Triangle * triangles, int triangle_count); // SAH-based object + spatial splits, Stich et al. 2009 (Triangles only)
+
+	// True if the last build ran out of its time budget and fell back to Object Splits
+	inline bool was_cut_short() const {
+		return time_budget_exceeded;
+	}
 };
@@ -0,0 +1,376 @@
+#include "SDTree.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+void SDTree::DTree::init() {
+	nodes.assign(1, PathGuiding::DirectionalNode { });
+
+	sample_count = 0;
+}
+
+void SDTree::DTree::record(float u, float v, float radiance) {
+	int node = 0;
+
+	while (true) {
+		int quadrant = PathGuiding::get_quadrant(u, v);
+		nodes[node].sum[quadrant] += radiance;
+
+		int child = nodes[node].child[quadrant];
+		if (child == 0) break;
+
+		node = child;
+	}
+
+	sample_count++;
+}
+
+void SDTree::DTree::refine_from(const DTree & source) {
+	init();
+
+	float total = PathGuiding::get_total(source.nodes[0]);
+	if (total <= 0.0f) return;
+
+	struct Entry {
+		int   source; // Node of 'source' that covers the same quadrants, or -1 if 'source' has no node there
+		float sum[4];
+		int   node;
+		int   depth;
+	};
+
+	Entry root = { 0, { }, 0, 1 };
+	memcpy(root.sum, source.nodes[0].sum, sizeof(root.sum));
+
+	std::vector<Entry> stack;
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+
+		for (int quadrant = 0; quadrant < 4; quadrant++) {
+			if (entry.sum[quadrant] <= PATH_GUIDING_DIRECTIONAL_THRESHOLD * total || entry.depth >= PATH_GUIDING_DIRECTIONAL_MAX_DEPTH) continue;
+
+			int child = nodes.size();
+			nodes.emplace_back();
+			nodes[entry.node].child[quadrant] = child;
+
+			Entry next = { -1, { }, child, entry.depth + 1 };
+
+			int source_child = entry.source != -1 ? source.nodes[entry.source].child[quadrant] : 0;
+			if (source_child != 0) {
+				next.source = source_child;
+				memcpy(next.sum, source.nodes[source_child].sum, sizeof(next.sum));
+			} else {
+				// The energy of a quadrant that was a leaf in 'source' is assumed to be spread evenly over its children
+				for (int i = 0; i < 4; i++) next.sum[i] = 0.25f * entry.sum[quadrant];
+			}
+
+			stack.push_back(next);
+		}
+	}
+}
+
+void SDTree::init(const AABB & bounds) {
+	iteration = 0;
+	frame     = 0;
+
+	for (int dimension = 0; dimension < 3; dimension++) {
+		bounds_min       [dimension] = bounds.min[dimension];
+		bounds_inv_extent[dimension] = 1.0f / fmaxf(bounds.max[dimension] - bounds.min[dimension], 1e-6f);
+	}
+
+	nodes.assign(1, PathGuiding::SpatialNode { 0, 0 });
+	leaves.resize(1);
+
+	leaves[0].sampling.init();
+	leaves[0].building.init();
+
+	flatten();
+}
+
+void SDTree::record(const PathGuiding::Sample & sample) {
+	float position[3];
+	for (int dimension = 0; dimension < 3; dimension++) {
+		position[dimension] = (sample.position[dimension] - bounds_min[dimension]) * bounds_inv_extent[dimension];
+	}
+
+	float u, v;
+	PathGuiding::direction_to_square(sample.direction, u, v);
+
+	// Subtracting the direct light of the vertex can leave slightly negative estimates
+	float radiance = std::isfinite(sample.radiance) ? fmaxf(sample.radiance, 0.0f) : 0.0f;
+
+	leaves[PathGuiding::find_dtree(nodes.data(), position)].building.record(u, v, radiance);
+}
+
+void SDTree::split(int node, int depth, int threshold) {
+	int child = nodes[node].child;
+	if (child == 0) {
+		int leaf = nodes[node].dtree;
+		if (leaves[leaf].building.sample_count <= threshold || depth >= PATH_GUIDING_SPATIAL_MAX_DEPTH) return;
+
+		// Both halves start out with a copy of the quadtrees, and each is assumed to receive half of the samples
+		leaves[leaf].building.sample_count /= 2;
+
+		Leaf copy = leaves[leaf];
+		leaves.push_back(std::move(copy));
+
+		child = nodes.size();
+		nodes.push_back({ 0, leaf });
+		nodes.push_back({ 0, int(leaves.size()) - 1 });
+
+		nodes[node] = { child, -1 };
+	}
+
+	split(child,     depth + 1, threshold);
+	split(child + 1, depth + 1, threshold);
+}
+
+void SDTree::refine() {
+	// The threshold grows with the square root of the number of samples per iteration (Mueller et al. 2017)
+	int threshold = int(float(PATH_GUIDING_SPATIAL_THRESHOLD) * sqrtf(float(get_iteration_length())));
+
+	split(0, 0, threshold);
+
+	for (Leaf & leaf : leaves) {
+		DTree refined;
+		refined.refine_from(leaf.building);
+
+		leaf.sampling = std::move(leaf.building);
+		leaf.building = std::move(refined);
+	}
+
+	iteration++;
+
+	flatten();
+}
+
+void SDTree::flatten() {
+	spatial_nodes = nodes;
+	directional_nodes.clear();
+
+	for (PathGuiding::SpatialNode & node : spatial_nodes) {
+		if (node.child != 0) continue;
+
+		int offset = directional_nodes.size();
+
+		for (PathGuiding::DirectionalNode directional_node : leaves[node.dtree].sampling.nodes) {
+			for (int quadrant = 0; quadrant < 4; quadrant++) {
+				if (directional_node.child[quadrant] != 0) directional_node.child[quadrant] += offset;
+			}
+			directional_nodes.push_back(directional_node);
+		}
+
+		node.dtree = offset;
+	}
+}
+
+int SDTree::get_iteration_length() const {
+	return 1 << std::min(iteration, PATH_GUIDING_MAX_ITERATION);
+}
+
+bool SDTree::frame_done() {
+	if (++frame < get_iteration_length()) return false;
+
+	frame = 0;
+	return true;
+}
+
+void SDTree::sample(const float position[3], float r0, float r1, float direction[3]) const {
+	float p[3];
+	for (int dimension = 0; dimension < 3; dimension++) {
+		p[dimension] = (position[dimension] - bounds_min[dimension]) * bounds_inv_extent[dimension];
+	}
+
+	PathGuiding::sample(directional_nodes.data(), PathGuiding::find_dtree(spatial_nodes.data(), p), r0, r1, direction);
+}
+
+float SDTree::pdf(const float position[3], const float direction[3]) const {
+	float p[3];
+	for (int dimension = 0; dimension < 3; dimension++) {
+		p[dimension] = (position[dimension] - bounds_min[dimension]) * bounds_inv_extent[dimension];
+	}
+
+	return PathGuiding::pdf(directional_nodes.data(), PathGuiding::find_dtree(spatial_nodes.data(), p), direction);
+}
+
+// Incident radiance of the synthetic scene, a bright cone around the diagonal of the octant of the position
+static float get_radiance(const float position[3], const float direction[3]) {
+	float cos_theta = 0.0f;
+	for (int dimension = 0; dimension < 3; dimension++) {
+		cos_theta += (position[dimension] >= 0.0f ? direction[dimension] : -direction[dimension]) * 0.57735026919f;
+	}
+
+	return cos_theta > 0.9f ? 100.0f : 1.0f;
+}
+
+// Probability mass of the square cell of size 2^-depth around (u, v)
+static double get_cell_mass(const PathGuiding::DirectionalNode * nodes, int root, float u, float v, int depth) {
+	double mass = 1.0;
+	int    node = root;
+
+	for (int level = 0; level < depth; level++) {
+		float total = PathGuiding::get_total(nodes[node]);
+		if (total <= 0.0f) return mass * pow(0.25, depth - level);
+
+		int quadrant = PathGuiding::get_quadrant(u, v);
+		mass *= double(nodes[node].sum[quadrant]) / double(total);
+
+		int child = nodes[node].child[quadrant];
+		if (child == 0) return mass * pow(0.25, depth - level - 1);
+
+		node = child;
+	}
+
+	return mass;
+}
+
+SDTree::Validation SDTree::validate(int iteration_count, unsigned seed) {
+	std::mt19937 engine(seed);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	AABB bounds;
+	bounds.min = Vector3(-1.0f);
+	bounds.max = Vector3(+1.0f);
+
+	SDTree tree;
+	tree.init(bounds);
+
+	auto random_position = [&](float position[3]) {
+		for (int dimension = 0; dimension < 3; dimension++) position[dimension] = 2.0f * uniform(engine) - 1.0f;
+	};
+
+	// Same as a guided bounce on the Device, but with uniform sampling in place of the BSDF. Returns the pdf of the mixture
+	auto sample_mixture = [&](const float position[3], float direction[3]) {
+		float r0 = uniform(engine);
+		float r1 = uniform(engine);
+
+		if (tree.iteration > 0 && uniform(engine) >= PATH_GUIDING_BSDF_FRACTION) {
+			tree.sample(position, r0, r1, direction);
+		} else {
+			PathGuiding::square_to_direction(r0, r1, direction);
+		}
+
+		if (tree.iteration == 0) return ONE_OVER_FOUR_PI;
+
+		return PATH_GUIDING_BSDF_FRACTION * ONE_OVER_FOUR_PI + (1.0f - PATH_GUIDING_BSDF_FRACTION) * tree.pdf(position, direction);
+	};
+
+	for (int i = 0; i < iteration_count; i++) {
+		int sample_count = tree.get_iteration_length() * 20000;
+
+		for (int s = 0; s < sample_count; s++) {
+			PathGuiding::Sample sample;
+			random_position(sample.position);
+
+			float pdf = sample_mixture(sample.position, sample.direction);
+			sample.radiance = get_radiance(sample.position, sample.direction) / pdf;
+
+			tree.record(sample);
+		}
+
+		tree.refine();
+	}
+
+	Validation result = { };
+
+	// Integrate the pdf of every leaf with the midpoint rule
+	const int grid_size = 512;
+
+	for (const PathGuiding::SpatialNode & node : tree.spatial_nodes) {
+		if (node.child != 0) continue;
+
+		result.spatial_leaves++;
+
+		double integral = 0.0;
+
+		for (int j = 0; j < grid_size; j++) {
+			for (int i = 0; i < grid_size; i++) {
+				float direction[3];
+				PathGuiding::square_to_direction((float(i) + 0.5f) / float(grid_size), (float(j) + 0.5f) / float(grid_size), direction);
+
+				integral += PathGuiding::pdf(tree.directional_nodes.data(), node.dtree, direction);
+			}
+		}
+		integral *= 4.0 * PI / double(grid_size * grid_size);
+
+		result.pdf_integral_error = fmaxf(result.pdf_integral_error, float(fabs(integral - 1.0)));
+	}
+
+	result.directional_nodes = tree.directional_nodes.size();
+
+	// Histogram of sampled directions at one position, compared to the exact mass of every cell
+	const int histogram_depth   = 4;
+	const int histogram_size    = 1 << histogram_depth;
+	const int histogram_samples = 1 << 20;
+
+	float histogram_position[3] = { 0.3f, 0.6f, 0.2f };
+
+	float p[3];
+	for (int dimension = 0; dimension < 3; dimension++) p[dimension] = (histogram_position[dimension] - tree.bounds_min[dimension]) * tree.bounds_inv_extent[dimension];
+
+	int root = PathGuiding::find_dtree(tree.spatial_nodes.data(), p);
+
+	std::vector<int> histogram(histogram_size * histogram_size, 0);
+
+	for (int s = 0; s < histogram_samples; s++) {
+		float direction[3];
+		tree.sample(histogram_position, uniform(engine), uniform(engine), direction);
+
+		float u, v;
+		PathGuiding::direction_to_square(direction, u, v);
+
+		histogram[int(u * histogram_size) + int(v * histogram_size) * histogram_size]++;
+	}
+
+	for (int j = 0; j < histogram_size; j++) {
+		for (int i = 0; i < histogram_size; i++) {
+			float u = (float(i) + 0.5f) / float(histogram_size);
+			float v = (float(j) + 0.5f) / float(histogram_size);
+
+			double expected = double(histogram_samples) * get_cell_mass(tree.directional_nodes.data(), root, u, v, histogram_depth);
+			if (expected < 1.0) continue;
+
+			float error = float(fabs(double(histogram[i + j * histogram_size]) - expected) / sqrt(expected));
+
+			result.sample_error = fmaxf(result.sample_error, error);
+		}
+	}
+
+	// Variance of the one sample estimate of the irradiance, with and without guiding
+	const int variance_samples = 1 << 18;
+
+	double sum_guided  = 0.0, sum_squared_guided  = 0.0;
+	double sum_uniform = 0.0, sum_squared_uniform = 0.0;
+
+	for (int s = 0; s < variance_samples; s++) {
+		float position[3];
+		random_position(position);
+
+		float direction[3];
+		float pdf = sample_mixture(position, direction);
+
+		double estimate = get_radiance(position, direction) / pdf;
+		sum_guided         += estimate;
+		sum_squared_guided += estimate * estimate;
+
+		PathGuiding::square_to_direction(uniform(engine), uniform(engine), direction);
+
+		estimate = get_radiance(position, direction) / ONE_OVER_FOUR_PI;
+		sum_uniform         += estimate;
+		sum_squared_uniform += estimate * estimate;
+	}
+
+	double mean_guided  = sum_guided  / double(variance_samples);
+	double mean_uniform = sum_uniform / double(variance_samples);
+
+	double variance_guided  = sum_squared_guided  / double(variance_samples) - mean_guided  * mean_guided;
+	double variance_uniform = sum_squared_uniform / double(variance_samples) - mean_uniform * mean_uniform;
+
+	result.variance_ratio = float(variance_guided / variance_uniform);
+
+	return result;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+
+#include "AABB.h"
+
+#include "CUDA_Source/PathGuiding.h"
+
+// Host side of path guiding: the SD-tree is trained from the incident radiance samples of the Device,
+// see kernel_path_guiding_update and CUDA_Source/PathGuiding.h.
+// Every leaf holds two quadtrees, samples are recorded in the building quadtree while the sampling quadtree is used by the Device.
+// At the end of an iteration the leaves that received enough samples are split, the building quadtrees become the sampling quadtrees
+// and new building quadtrees are subdivided where the old ones received enough energy
+struct SDTree {
+	int iteration; // Number of times the tree was refined
+	int frame;     // Number of frames recorded in the current iteration
+
+	// Flattened tree as it is uploaded to the Device, the quadtrees of all leaves are stored in one array
+	std::vector<PathGuiding::SpatialNode>     spatial_nodes;
+	std::vector<PathGuiding::DirectionalNode> directional_nodes;
+
+	float bounds_min       [3];
+	float bounds_inv_extent[3];
+
+	void init(const AABB & bounds);
+
+	void record(const PathGuiding::Sample & sample);
+	void refine();
+
+	// Number of frames the current iteration trains the tree for
+	int get_iteration_length() const;
+
+	// Counts a frame of recorded samples, returns true once the current iteration has trained for get_iteration_length() frames.
+	// The tree should then be refined
+	bool frame_done();
+
+	// Same as the guided samples and their pdf on the Device, 'position' is in world space
+	void  sample(const float position[3], float r0, float r1, float direction[3]) const;
+	float pdf   (const float position[3], const float direction[3]) const;
+
+	struct Validation {
+		float pdf_integral_error; // Largest deviation of the integral of the pdf of a leaf from 1
+		float sample_error;       // Largest deviation of a histogram of sampled directions from the pdf, in standard errors
+
+		float variance_ratio; // Variance of estimating the synthetic irradiance with guided samples, relative to uniform samples
+
+		int spatial_leaves;
+		int directional_nodes;
+	};
+
+	// Trains a tree for 'iteration_count' iterations on a synthetic scene, whose incident radiance is bright within a cone
+	// that points in a different direction in every octant of the bounds, and checks that sampling matches the pdf
+	static Validation validate(int iteration_count, unsigned seed);
+
+private:
+	struct DTree {
+		std::vector<PathGuiding::DirectionalNode> nodes;
+
+		int sample_count;
+
+		void init();
+
+		void record(float u, float v, float radiance);
+
+		// Subdivides the nodes of 'source' that received more than PATH_GUIDING_DIRECTIONAL_THRESHOLD of its energy,
+		// the result has the structure of the refined tree but no energy
+		void refine_from(const DTree & source);
+	};
+
+	struct Leaf {
+		DTree sampling;
+		DTree building;
+	};
+
+	// The 'dtree' of a leaf refers to 'leaves' here, flatten() replaces it by the offset into 'directional_nodes'
+	std::vector<PathGuiding::SpatialNode> nodes;
+	std::vector<Leaf>                     leaves;
+
+	void split(int node, int depth, int threshold);
+	void flatten();
+};
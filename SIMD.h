@@ -0,0 +1,56 @@
+#pragma once
+
+// Detects the instruction sets available to the Host compiler.
+// SSE2 is part of x64, AVX has to be enabled explicitly (/arch:AVX or -mavx)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#else
+#define SIMD_SSE 0
+#endif
+
+#if SIMD_SSE && defined(__AVX__)
+#define SIMD_AVX 1
+#else
+#define SIMD_AVX 0
+#endif
+
+#if SIMD_SSE
+#include <immintrin.h>
+
+// Thin helpers around SSE intrinsics shared by the math headers
+namespace SIMD {
+	// Loads three floats without reading past them, the fourth lane is zero
+	inline __m128 load3(const float * data) {
+		__m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(data)));
+		__m128 z  = _mm_load_ss(data + 2);
+
+		return _mm_movelh_ps(xy, z);
+	}
+
+	// Stores the first three lanes without writing past them
+	inline void store3(float * data, __m128 value) {
+		_mm_store_sd(reinterpret_cast<double *>(data), _mm_castps_pd(value));
+		_mm_store_ss(data + 2, _mm_movehl_ps(value, value));
+	}
+
+	inline __m128 abs(__m128 value) {
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+	}
+
+	template<int Lane>
+	inline __m128 broadcast(__m128 value) {
+		return _mm_shuffle_ps(value, value, _MM_SHUFFLE(Lane, Lane, Lane, Lane));
+	}
+
+	// Sum of all four lanes
+	inline float horizontal_sum(__m128 value) {
+		__m128 shuffled = _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums     = _mm_add_ps(value, shuffled);
+
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		sums     = _mm_add_ss(sums, shuffled);
+
+		return _mm_cvtss_f32(sums);
+	}
+}
+#endif
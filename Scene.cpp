@@ -113,7 +113,11 @@ void Scene::update(float delta) {
 		}
 	}
 
+	lods_changed = false;
+
 	for (int i = 0; i < mesh_count; i++) {
 		meshes[i].update();
+
+		lods_changed |= meshes[i].update_lod(camera.position, camera.pixel_spread_angle);
 	}
 }
@@ -16,6 +16,8 @@ struct Scene {
 	bool has_glossy;
 	bool has_lights;
 
+	bool lods_changed; // Whether any Mesh selected a different LOD during the last update
+
 	void init(int mesh_count, const char * mesh_names[], const char * sky_name);
 
 	void update(float delta);
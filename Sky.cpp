@@ -1,10 +1,12 @@
 #include "Sky.h"
 
 #include <cstdio>
+#include <cassert>
+
+#include "Util.h"
 
 void Sky::init(const char * file_path) {
-	FILE * file; 
-	fopen_s(&file, file_path, "rb");
+	FILE * file = Util::file_open(file_path, "rb");
 
 	if (file == nullptr) {
 		printf("ERROR: Failed to load Sky file %s!", file_path);
@@ -25,3 +27,8 @@ void Sky::init(const char * file_path) {
 	fread(reinterpret_cast<char *>(data), sizeof(Vector3), size_squared, file);
 	fclose(file);
 }
+
+void Sky::free() {
+	delete [] data;
+	data = nullptr;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+
+// Timer backend for EventRing that simulates a Device, which runs behind the Host.
+// Events are recorded with the current value of 'clock', and only complete once the test lets the Device
+// catch up with MockDevice::complete. Every call is counted so that tests can check how the ring uses its Events
+struct MockDevice {
+	struct EventState {
+		bool alive;
+
+		int   sequence; // Position in the stream of all recorded Events, -1 if the Event was never recorded
+		float time;
+	};
+	std::vector<EventState> events;
+
+	float clock = 0.0f;
+
+	int recorded  = 0; // Number of Events recorded so far
+	int completed = 0; // Events with a sequence below this have completed on the Device
+
+	int create_count      = 0;
+	int destroy_count     = 0;
+	int synchronize_count = 0;
+	int invalid_use_count = 0; // Uses of Events that were destroyed or never recorded
+
+	// Lets the Device catch up, so that all but the last 'count_behind' recorded Events are complete
+	void complete(int count_behind = 0) {
+		if (recorded - count_behind > completed) completed = recorded - count_behind;
+	}
+
+	bool is_valid(int event, bool must_be_recorded) {
+		bool valid = event >= 0 && event < int(events.size()) && events[event].alive && (!must_be_recorded || events[event].sequence != -1);
+		if (!valid) invalid_use_count++;
+
+		return valid;
+	}
+};
+
+struct MockTimer {
+	typedef int Event;
+
+	MockDevice * device = nullptr;
+
+	Event create() {
+		device->create_count++;
+		device->events.push_back({ true, -1, 0.0f });
+
+		return int(device->events.size()) - 1;
+	}
+
+	void destroy(Event event) {
+		if (!device->is_valid(event, false)) return;
+
+		device->destroy_count++;
+		device->events[event].alive = false;
+	}
+
+	void record(Event event) {
+		if (!device->is_valid(event, false)) return;
+
+		device->events[event].sequence = device->recorded++;
+		device->events[event].time     = device->clock;
+	}
+
+	bool is_complete(Event event) {
+		if (!device->is_valid(event, true)) return false;
+
+		return device->events[event].sequence < device->completed;
+	}
+
+	void synchronize(Event event) {
+		if (!device->is_valid(event, true)) return;
+
+		device->synchronize_count++;
+
+		if (device->events[event].sequence >= device->completed) device->completed = device->events[event].sequence + 1;
+	}
+
+	float time_elapsed_between(Event start, Event end) {
+		if (!device->is_valid(start, true) || !device->is_valid(end, true)) return 0.0f;
+
+		// Reading a time of an incomplete Event would block on a real Device, the ring must synchronize first
+		if (!is_complete(end)) device->invalid_use_count++;
+
+		return device->events[end].time - device->events[start].time;
+	}
+};
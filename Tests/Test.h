@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdio>
+#include <climits>
+
+#include "Random.h"
+
+// Minimal support for the host tests. Every test is an executable registered with CTest,
+// a failing CHECK reports its location and makes the executable return a non-zero exit code
+namespace Test {
+	inline int failure_count = 0;
+
+	inline float random_float() {
+		return float(Random::get_value()) / float(UINT_MAX);
+	}
+
+	// Returns the exit code of the test executable
+	inline int report(const char * name) {
+		if (failure_count == 0) {
+			printf("%s: all checks passed\n", name);
+			return 0;
+		}
+
+		printf("%s: %i checks failed\n", name, failure_count);
+		return 1;
+	}
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s(%i): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			Test::failure_count++; \
+		} \
+	} while (false)
+
+// Like CHECK, but also prints the two values that were compared
+#define CHECK_LESS_EQUAL(a, b) \
+	do { \
+		double a_value = double(a); \
+		double b_value = double(b); \
+		if (!(a_value <= b_value)) { \
+			printf("%s(%i): CHECK(%s <= %s) failed, %g > %g\n", __FILE__, __LINE__, #a, #b, a_value, b_value); \
+			Test::failure_count++; \
+		} \
+	} while (false)
@@ -0,0 +1,194 @@
+#include "Test.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "CountingSort.h"
+
+#include "CUDA_Source/Common.h"
+#include "CUDA_Source/Regeneration.h"
+
+// Renders a synthetic scene with the same wavefront structure as the Device: the trace queue is split into three shading queues,
+// and the shading queues append the paths that continue to the trace queue of the next iteration.
+// Both appends either go through the deterministic compaction (CountingSort::compact, the Host reference of kernel_compaction_*)
+// or through atomic appends, emulated by running the Warps in the order of a random schedule
+
+static constexpr int PIXEL_COUNT = 64 * 64;
+static constexpr int QUEUE_COUNT = 3;
+
+// Same as wang_hash and random_float_xorshift on the Device
+static unsigned wang_hash(unsigned seed) {
+	seed = (seed ^ 61) ^ (seed >> 16);
+	seed *= 9;
+	seed = seed ^ (seed >> 4);
+	seed *= 0x27d4eb2d;
+	seed = seed ^ (seed >> 15);
+
+	return seed;
+}
+
+static float random_float_xorshift(unsigned & seed) {
+	seed ^= (seed << 13);
+	seed ^= (seed >> 17);
+	seed ^= (seed << 5);
+
+	return float(seed) * 2.3283064365387e-10f;
+}
+
+struct Path {
+	int   pixel;
+	float throughput;
+};
+
+// Destination of every element in the queue of its key, or -1 if its key is negative.
+// Atomic appends hand out the slots in the order in which the Warps happen to run, lanes within a Warp are aggregated in order
+static void append(const std::vector<int> & keys, int key_count, bool deterministic, std::mt19937 & schedule, std::vector<int> & destinations, int * sizes) {
+	int count = int(keys.size());
+
+	destinations.assign(count, -1);
+
+	if (deterministic) {
+		CountingSort::compact(keys.data(), count, key_count, COMPACTION_BLOCK_SIZE, destinations.data(), sizes);
+		return;
+	}
+
+	std::vector<int> warps((count + WARP_SIZE - 1) / WARP_SIZE);
+	for (int w = 0; w < int(warps.size()); w++) warps[w] = w;
+
+	std::shuffle(warps.begin(), warps.end(), schedule);
+
+	for (int k = 0; k < key_count; k++) sizes[k] = 0;
+
+	for (int warp : warps) {
+		for (int i = warp * WARP_SIZE; i < std::min((warp + 1) * WARP_SIZE, count); i++) {
+			if (keys[i] >= 0) destinations[i] = sizes[keys[i]]++;
+		}
+	}
+}
+
+// Renders one sample per pixel, 'schedule_seed' only changes the order of the atomic appends.
+// The pixels of the trace queue of every iteration are written to 'queue_order', one iteration after the other
+static std::vector<float> render(bool deterministic, unsigned schedule_seed, std::vector<int> & queue_order) {
+	std::mt19937 schedule(schedule_seed);
+
+	std::vector<float> image(PIXEL_COUNT, 0.0f);
+
+	queue_order.clear();
+
+	std::vector<Path> trace(PIXEL_COUNT);
+	for (int p = 0; p < PIXEL_COUNT; p++) trace[p] = { p, 1.0f };
+
+	for (int bounce = 0; bounce < NUM_BOUNCES && trace.size() > 0; bounce++) {
+		unsigned rand_seed = wang_hash(bounce + 1);
+
+		for (const Path & path : trace) queue_order.push_back(path.pixel);
+
+		// kernel_sort: the queue of every path depends on the surface it hit, some paths leave the scene
+		std::vector<int> keys(trace.size());
+		for (int i = 0; i < int(trace.size()); i++) {
+			unsigned hash = wang_hash(trace[i].pixel * 7 + bounce);
+			keys[i] = hash % 8 == 0 ? -1 : int(hash % QUEUE_COUNT);
+
+			if (keys[i] == -1) image[trace[i].pixel] += trace[i].throughput;
+		}
+
+		std::vector<int> destinations;
+		int sizes[QUEUE_COUNT];
+		append(keys, QUEUE_COUNT, deterministic, schedule, destinations, sizes);
+
+		std::vector<Path> queues[QUEUE_COUNT];
+		for (int q = 0; q < QUEUE_COUNT; q++) queues[q].resize(sizes[q]);
+
+		for (int i = 0; i < int(trace.size()); i++) {
+			if (keys[i] >= 0) queues[keys[i]][destinations[i]] = trace[i];
+		}
+
+		// Shade Kernels: the paths that continue are staged at their entry of the shading queues laid out one after the other,
+		// their random numbers are seeded by their slot unless the compaction is deterministic, like get_seed on the Device
+		std::vector<Path> staged;
+		std::vector<int>  staged_keys;
+
+		for (int q = 0; q < QUEUE_COUNT; q++) {
+			for (int i = 0; i < int(queues[q].size()); i++) {
+				Path path = queues[q][i];
+
+				unsigned seed = deterministic ? Regeneration::get_path_seed(path.pixel, 0, 0, rand_seed) : wang_hash(unsigned(i) ^ rand_seed);
+
+				float albedo = 0.25f + 0.25f * float(q) + 0.2f * random_float_xorshift(seed);
+				image[path.pixel] += path.throughput * (1.0f - albedo);
+
+				path.throughput *= albedo;
+
+				bool survives = random_float_xorshift(seed) < 0.8f;
+				if (survives) path.throughput /= 0.8f;
+
+				staged     .push_back(path);
+				staged_keys.push_back(survives ? 0 : -1);
+			}
+		}
+
+		int trace_size;
+		append(staged_keys, 1, deterministic, schedule, destinations, &trace_size);
+
+		trace.assign(trace_size, { });
+		for (int i = 0; i < int(staged.size()); i++) {
+			if (staged_keys[i] >= 0) trace[destinations[i]] = staged[i];
+		}
+	}
+
+	return image;
+}
+
+template<typename T>
+static bool bit_identical(const std::vector<T> & a, const std::vector<T> & b) {
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+static void test_compact() {
+	// The compaction keeps the input order within every queue
+	std::vector<int> keys(1000);
+	for (int i = 0; i < int(keys.size()); i++) keys[i] = int(wang_hash(i) % 4) - 1;
+
+	std::vector<int> destinations(keys.size());
+	int sizes[3];
+	CountingSort::compact(keys.data(), int(keys.size()), 3, COMPACTION_BLOCK_SIZE, destinations.data(), sizes);
+
+	int next[3] = { };
+	for (int i = 0; i < int(keys.size()); i++) {
+		if (keys[i] < 0) {
+			CHECK(destinations[i] == -1);
+		} else {
+			CHECK(destinations[i] == next[keys[i]]++);
+		}
+	}
+	for (int q = 0; q < 3; q++) CHECK(sizes[q] == next[q]);
+}
+
+static void test_determinism() {
+	std::vector<int> queue_order_0;
+	std::vector<int> queue_order_1;
+
+	// Two renders with different schedules come out bit-identical with the deterministic compaction.
+	// Seeding per path already makes the image independent of the queue order, so the order of the trace queues is checked as well
+	std::vector<float> image_0 = render(true, 1, queue_order_0);
+	std::vector<float> image_1 = render(true, 2, queue_order_1);
+
+	CHECK(bit_identical(image_0, image_1));
+	CHECK(bit_identical(queue_order_0, queue_order_1));
+
+	// The schedule does change the image and the queues with atomic appends, otherwise the checks above would not test anything
+	std::vector<float> image_atomic_0 = render(false, 1, queue_order_0);
+	std::vector<float> image_atomic_1 = render(false, 2, queue_order_1);
+
+	CHECK(!bit_identical(image_atomic_0, image_atomic_1));
+	CHECK(!bit_identical(queue_order_0, queue_order_1));
+}
+
+int main() {
+	test_compact();
+	test_determinism();
+
+	return Test::report("Compaction");
+}
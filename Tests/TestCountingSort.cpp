@@ -0,0 +1,146 @@
+#include "Test.h"
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "CountingSort.h"
+
+#include "Math.h"
+
+#include "CUDA_Source/Common.h"
+
+static std::vector<int> random_keys(int count, int key_count) {
+	std::vector<int> keys(count);
+	for (int i = 0; i < count; i++) {
+		keys[i] = Math::min(int(Test::random_float() * float(key_count)), key_count - 1);
+	}
+	return keys;
+}
+
+// The stable order of the indices, computed independently of the counting sort
+static std::vector<int> reference_sort(const std::vector<int> & keys) {
+	std::vector<int> indices(keys.size());
+	std::iota(indices.begin(), indices.end(), 0);
+	std::stable_sort(indices.begin(), indices.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+
+	return indices;
+}
+
+static void test_stable() {
+	// Few keys, so that every key is shared by many elements whose relative order has to be kept
+	const int counts[] = { 1, 31, 32, 33, 1000, 4096 };
+
+	for (int count : counts) {
+		std::vector<int> keys = random_keys(count, 5);
+
+		std::vector<int> indices(count);
+		CountingSort::sort(keys.data(), count, 5, indices.data());
+
+		CHECK(indices == reference_sort(keys));
+		CHECK(CountingSort::is_sorted_permutation(keys.data(), count, 5, indices.data()));
+	}
+}
+
+static void test_empty_buckets() {
+	// Only a few of the keys are used, including the first and the last one
+	const int key_count = 64;
+	const int used_keys[] = { 0, 7, 8, 40, key_count - 1 };
+
+	const int count = 500;
+
+	std::vector<int> keys(count);
+	for (int i = 0; i < count; i++) {
+		keys[i] = used_keys[Math::min(int(Test::random_float() * 5.0f), 4)];
+	}
+
+	std::vector<int> indices(count);
+	CountingSort::sort(keys.data(), count, key_count, indices.data());
+
+	CHECK(indices == reference_sort(keys));
+
+	// All elements of one key are contiguous, even though the keys in between have no elements
+	for (int i = 1; i < count; i++) {
+		CHECK(keys[indices[i - 1]] <= keys[indices[i]]);
+	}
+
+	// No elements at all
+	CountingSort::sort(keys.data(), 0, key_count, indices.data());
+	CHECK(CountingSort::is_sorted_permutation(keys.data(), 0, key_count, indices.data()));
+	CHECK(CountingSort::distinct_keys_per_warp(keys.data(), 0) == 0.0f);
+}
+
+static void test_single_key() {
+	// With a single key the sort does not move anything
+	const int count = 100;
+
+	std::vector<int> keys(count, 0);
+	std::vector<int> indices(count, -1);
+
+	CountingSort::sort(keys.data(), count, 1, indices.data());
+
+	for (int i = 0; i < count; i++) {
+		CHECK(indices[i] == i);
+	}
+
+	CHECK(CountingSort::distinct_keys_per_warp(keys.data(), count, indices.data()) == 1.0f);
+}
+
+static void test_is_sorted_permutation() {
+	const int count = 200;
+
+	std::vector<int> keys = random_keys(count, 8);
+	std::vector<int> indices(count);
+	CountingSort::sort(keys.data(), count, 8, indices.data());
+
+	CHECK(CountingSort::is_sorted_permutation(keys.data(), count, 8, indices.data()));
+
+	// The order within a group of equal keys does not matter
+	std::vector<int> reversed_groups = indices;
+	for (int first = 0; first < count; ) {
+		int last = first;
+		while (last < count && keys[indices[last]] == keys[indices[first]]) last++;
+
+		std::reverse(reversed_groups.begin() + first, reversed_groups.begin() + last);
+		first = last;
+	}
+	CHECK(CountingSort::is_sorted_permutation(keys.data(), count, 8, reversed_groups.data()));
+
+	// Unordered keys, a duplicate index and an index out of range are rejected
+	std::vector<int> unordered = indices;
+	std::reverse(unordered.begin(), unordered.end());
+	CHECK(!CountingSort::is_sorted_permutation(keys.data(), count, 8, unordered.data()));
+
+	std::vector<int> duplicate = indices;
+	duplicate[1] = duplicate[0];
+	CHECK(!CountingSort::is_sorted_permutation(keys.data(), count, 8, duplicate.data()));
+
+	std::vector<int> out_of_range = indices;
+	out_of_range[count - 1] = count;
+	CHECK(!CountingSort::is_sorted_permutation(keys.data(), count, 8, out_of_range.data()));
+}
+
+static void test_distinct_keys_per_warp() {
+	const int count = 64 * WARP_SIZE;
+
+	std::vector<int> keys = random_keys(count, 16);
+	std::vector<int> indices(count);
+	CountingSort::sort(keys.data(), count, 16, indices.data());
+
+	float distinct_unsorted = CountingSort::distinct_keys_per_warp(keys.data(), count);
+	float distinct_sorted   = CountingSort::distinct_keys_per_warp(keys.data(), count, indices.data());
+
+	// Random keys touch most of the keys in a Warp, sorted keys span at most two keys per Warp with these counts
+	CHECK(distinct_unsorted > 10.0f);
+	CHECK_LESS_EQUAL(distinct_sorted, 2.0f);
+}
+
+int main() {
+	test_stable();
+	test_empty_buckets();
+	test_single_key();
+	test_is_sorted_permutation();
+	test_distinct_keys_per_warp();
+
+	return Test::report("CountingSort");
+}
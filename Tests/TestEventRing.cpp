@@ -0,0 +1,191 @@
+#include "Test.h"
+
+#include "EventRing.h"
+
+#include "MockTimer.h"
+
+typedef EventRing<MockTimer> Ring;
+
+static constexpr int MAX_EVENTS_PER_FRAME = 8;
+
+static EventDesc descs[MAX_EVENTS_PER_FRAME];
+
+// Number of Events recorded in a frame, varies so that slots grow and shrink as they are reused
+static int get_event_count(int frame) {
+	return 2 + frame % (MAX_EVENTS_PER_FRAME - 1);
+}
+
+// The time between Event i and i + 1 of a frame, unique per frame so that a mixup of slots is noticed
+static float get_time(int frame, int i) {
+	return float(frame % 10) + float(i + 1) * 0.125f;
+}
+
+static void record_frame(Ring & ring, MockDevice & device, int frame) {
+	ring.begin_frame();
+
+	int event_count = get_event_count(frame);
+
+	for (int i = 0; i < event_count; i++) {
+		if (i > 0) device.clock += get_time(frame, i - 1);
+
+		ring.record(descs[i]);
+	}
+
+	ring.end_frame();
+}
+
+// The timings must hold all Events of the frame they claim to be from
+static void check_timings(const Ring & ring) {
+	int frame = ring.timings.frame;
+	if (frame == -1) return;
+
+	int event_count = get_event_count(frame);
+
+	CHECK(int(ring.timings.events.size()) == event_count);
+	CHECK(int(ring.timings.times .size()) == event_count - 1);
+
+	for (int i = 0; i < int(ring.timings.events.size()) && i < event_count; i++) {
+		CHECK(ring.timings.events[i] == &descs[i]);
+	}
+	for (int i = 0; i < int(ring.timings.times.size()) && i < event_count - 1; i++) {
+		CHECK(ring.timings.times[i] == get_time(frame, i));
+	}
+}
+
+static Ring create_ring(MockDevice & device) {
+	MockTimer timer;
+	timer.device = &device;
+
+	Ring ring;
+	ring.init(timer);
+
+	return ring;
+}
+
+// A Device that keeps up is read back one frame later, without ever blocking
+static void test_no_lag() {
+	MockDevice device;
+	Ring ring = create_ring(device);
+
+	for (int frame = 0; frame < 100; frame++) {
+		record_frame(ring, device, frame);
+		device.complete();
+
+		check_timings(ring);
+		CHECK(ring.timings.frame == frame - 1);
+	}
+
+	CHECK(device.synchronize_count == 0);
+	CHECK(device.invalid_use_count == 0);
+
+	ring.free();
+}
+
+// A Device that lags one and a half frames behind is never waited on, and frames are still reported in order
+static void test_lag() {
+	MockDevice device;
+	Ring ring = create_ring(device);
+
+	int frame_prev = -1;
+
+	for (int frame = 0; frame < 100; frame++) {
+		record_frame(ring, device, frame);
+
+		// Leave the last frame and half of the one before it incomplete
+		device.complete(get_event_count(frame) + get_event_count(frame - 1 < 0 ? 0 : frame - 1) / 2);
+
+		check_timings(ring);
+		CHECK(ring.timings.frame >= frame_prev);
+		CHECK(ring.timings.frame >= frame - 3);
+
+		frame_prev = ring.timings.frame;
+	}
+
+	CHECK(frame_prev >= 96);
+
+	CHECK(device.synchronize_count == 0);
+	CHECK(device.invalid_use_count == 0);
+
+	ring.free();
+}
+
+// Once the Device falls FRAME_COUNT frames behind, reusing a slot must wait for it, and every wait reads back the oldest frame
+static void test_overflow() {
+	MockDevice device;
+	Ring ring = create_ring(device);
+
+	for (int frame = 0; frame < Ring::FRAME_COUNT; frame++) {
+		record_frame(ring, device, frame);
+
+		CHECK(ring.timings.frame == -1);
+	}
+	CHECK(device.synchronize_count == 0);
+
+	for (int frame = Ring::FRAME_COUNT; frame < 50; frame++) {
+		int synchronize_count = device.synchronize_count;
+
+		record_frame(ring, device, frame);
+
+		CHECK(device.synchronize_count == synchronize_count + 1);
+		CHECK(ring.timings.frame == frame - Ring::FRAME_COUNT);
+		check_timings(ring);
+	}
+
+	CHECK(device.invalid_use_count == 0);
+
+	ring.free();
+}
+
+// Slots reuse their Events as they wrap around, so Events are only created when a slot needs more than before
+static void test_event_reuse() {
+	MockDevice device;
+	Ring ring = create_ring(device);
+
+	for (int frame = 0; frame < 200; frame++) {
+		record_frame(ring, device, frame);
+		device.complete();
+	}
+
+	CHECK(device.create_count <= Ring::FRAME_COUNT * MAX_EVENTS_PER_FRAME);
+
+	ring.free();
+
+	CHECK(device.destroy_count == device.create_count);
+	CHECK(device.invalid_use_count == 0);
+}
+
+// time_elapsed_in_frame waits for the last Event recorded so far
+static void test_time_elapsed_in_frame() {
+	MockDevice device;
+	Ring ring = create_ring(device);
+
+	ring.begin_frame();
+	ring.record(descs[0]);
+	device.clock += 1.5f;
+	ring.record(descs[1]);
+	device.clock += 2.0f;
+	ring.record(descs[2]);
+
+	CHECK(ring.time_elapsed_in_frame() == 3.5f);
+	CHECK(device.synchronize_count == 1);
+	CHECK(device.completed == device.recorded);
+
+	ring.end_frame();
+	ring.free();
+
+	CHECK(device.invalid_use_count == 0);
+}
+
+int main() {
+	for (int i = 0; i < MAX_EVENTS_PER_FRAME; i++) {
+		descs[i].init("Test", "Event");
+	}
+
+	test_no_lag();
+	test_lag();
+	test_overflow();
+	test_event_reuse();
+	test_time_elapsed_in_frame();
+
+	return Test::report("TestEventRing");
+}
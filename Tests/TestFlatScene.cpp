@@ -0,0 +1,260 @@
+#include "Test.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "FlatScene.h"
+#include "MeshData.h"
+#include "Material.h"
+#include "Texture.h"
+
+#include "Math.h"
+
+#include "SBVHBuilder.h"
+#include "QBVHBuilder.h"
+#include "CWBVHBuilder.h"
+
+static float random_range(float min, float max) {
+	return min + (max - min) * Test::random_float();
+}
+
+static Vector3 random_vector(float range) {
+	return Vector3(random_range(-range, range), random_range(-range, range), random_range(-range, range));
+}
+
+// Random Triangles of varying size, the long ones make the SBVH reference some Triangles more than once
+static Triangle * random_triangles(int count, int material_count) {
+	Triangle * triangles = new Triangle[count];
+
+	for (int i = 0; i < count; i++) {
+		Triangle & triangle = triangles[i];
+
+		float size = Test::random_float() < 0.02f ? 5.0f : 0.5f;
+
+		triangle.position_0 = random_vector(50.0f);
+		triangle.position_1 = triangle.position_0 + random_vector(size);
+		triangle.position_2 = triangle.position_0 + random_vector(size);
+
+		triangle.normal_0 = Vector3::normalize(random_vector(1.0f));
+		triangle.normal_1 = Vector3::normalize(random_vector(1.0f));
+		triangle.normal_2 = Vector3::normalize(random_vector(1.0f));
+
+		triangle.tex_coord_0 = Vector2(Test::random_float(), Test::random_float());
+		triangle.tex_coord_1 = Vector2(Test::random_float(), Test::random_float());
+		triangle.tex_coord_2 = Vector2(Test::random_float(), Test::random_float());
+
+		triangle.material_id = Math::min(int(Test::random_float() * float(material_count)), material_count - 1);
+
+		Vector3 positions[3] = { triangle.position_0, triangle.position_1, triangle.position_2 };
+		triangle.aabb = AABB::from_points(positions, 3);
+	}
+
+	return triangles;
+}
+
+// Builds the BVH the same way as MeshData::load does
+static void build_bvh(MeshData * mesh_data) {
+	int max_primitives_in_leaf = BVH_TYPE == BVH_CWBVH ? 1 : INT_MAX;
+
+	BVH bvh;
+
+#if BVH_TYPE == BVH_BVH
+	BVHBuilder bvh_builder;
+	bvh_builder.init(&bvh, mesh_data->triangle_count, max_primitives_in_leaf);
+	bvh_builder.build(mesh_data->triangles, mesh_data->triangle_count);
+	bvh_builder.free();
+#else
+	SBVHBuilder sbvh_builder;
+	sbvh_builder.init(&bvh, mesh_data->triangle_count, max_primitives_in_leaf);
+	sbvh_builder.build(mesh_data->triangles, mesh_data->triangle_count);
+	sbvh_builder.free();
+#endif
+
+#if BVH_TYPE == BVH_BVH || BVH_TYPE == BVH_SBVH
+	mesh_data->bvh = bvh;
+#elif BVH_TYPE == BVH_QBVH
+	QBVHBuilder qbvh_builder;
+	qbvh_builder.init(&mesh_data->bvh, bvh);
+	qbvh_builder.build(bvh);
+
+	delete [] bvh.nodes;
+#elif BVH_TYPE == BVH_CWBVH
+	CWBVHBuilder cwbvh_builder;
+	cwbvh_builder.init(&mesh_data->bvh, bvh);
+	cwbvh_builder.build(bvh);
+	cwbvh_builder.free();
+
+	delete [] bvh.indices;
+	delete [] bvh.nodes;
+#endif
+}
+
+// Materials: diffuse, light, textured. MeshDatas use offsets into them like the loaded scenes do
+static void init_scene() {
+	Material diffuse;
+
+	Material light;
+	light.type     = Material::Type::LIGHT;
+	light.emission = Vector3(10.0f);
+
+	Material textured;
+	textured.texture_id = 0;
+
+	Material::materials = { diffuse, light, textured, diffuse, light };
+
+	Texture texture = { };
+	texture.width  = 512;
+	texture.height = 256;
+	Texture::textures = { texture };
+
+	// The first MeshData spans several Chunks, the second consists only of Lights, the third has no Lights and the last is small
+	struct { int triangle_count; int material_offset; int material_count; } mesh_data_descs[] = {
+		{ 40000, 0, 3 },
+		{   100, 1, 1 },
+		{  5000, 2, 2 },
+		{    30, 3, 2 }
+	};
+
+	for (const auto & desc : mesh_data_descs) {
+		MeshData * mesh_data = new MeshData();
+		mesh_data->triangle_count  = desc.triangle_count;
+		mesh_data->triangles       = random_triangles(desc.triangle_count, desc.material_count);
+		mesh_data->material_offset = desc.material_offset;
+
+		build_bvh(mesh_data);
+
+		MeshData::mesh_datas.push_back(mesh_data);
+	}
+}
+
+static FlatScene flatten(int thread_count) {
+	ThreadPool thread_pool;
+	thread_pool.init(thread_count);
+
+	FlatScene flat_scene;
+	flat_scene.init(1, thread_pool);
+	flat_scene.init_lights(thread_pool);
+
+	thread_pool.free();
+
+	return flat_scene;
+}
+
+template<typename T>
+static bool equal(const T * a, const T * b, int count) {
+	return memcmp(a, b, count * sizeof(T)) == 0;
+}
+
+static void compare(const FlatScene & a, const FlatScene & b) {
+	CHECK(a.mesh_data_count == b.mesh_data_count);
+	CHECK(a.bvh_node_count  == b.bvh_node_count);
+	CHECK(a.index_count     == b.index_count);
+	CHECK(a.triangle_count  == b.triangle_count);
+
+	CHECK(equal(a.mesh_data_bvh_offsets,      b.mesh_data_bvh_offsets,      a.mesh_data_count));
+	CHECK(equal(a.mesh_data_index_offsets,    b.mesh_data_index_offsets,    a.mesh_data_count));
+	CHECK(equal(a.mesh_data_triangle_offsets, b.mesh_data_triangle_offsets, a.mesh_data_count));
+
+	// The first Node is reserved for the TLAS and left uninitialized
+	CHECK(equal(a.bvh_nodes + 1, b.bvh_nodes + 1, a.bvh_node_count - 1));
+
+	CHECK(equal(a.triangles,             b.triangles,             a.index_count));
+	CHECK(equal(a.triangle_material_ids, b.triangle_material_ids, a.index_count));
+	CHECK(equal(a.triangle_lods,         b.triangle_lods,         a.index_count));
+
+	CHECK(equal(a.reverse_indices, b.reverse_indices, a.triangle_count));
+
+	CHECK(a.light_meshes.size() == b.light_meshes.size());
+	for (size_t i = 0; i < a.light_meshes.size() && i < b.light_meshes.size(); i++) {
+		CHECK(a.light_meshes[i].triangle_first_index == b.light_meshes[i].triangle_first_index);
+		CHECK(a.light_meshes[i].triangle_count       == b.light_meshes[i].triangle_count);
+		CHECK(a.light_meshes[i].area                 == b.light_meshes[i].area);
+	}
+
+	CHECK(a.light_mesh_data_indices == b.light_mesh_data_indices);
+	CHECK(a.light_indices           == b.light_indices);
+	CHECK(a.light_areas_cumulative  == b.light_areas_cumulative);
+}
+
+// Checks the serial result against the MeshDatas it was made from, so that the comparison is not between two equally wrong results
+static void check_serial(const FlatScene & flat_scene) {
+	int light_triangle_count = 0;
+
+	for (int m = 0; m < flat_scene.mesh_data_count; m++) {
+		const MeshData * mesh_data = MeshData::mesh_datas[m];
+
+		int light_count = 0;
+
+		for (int t = 0; t < mesh_data->triangle_count; t++) {
+			const Triangle & triangle = mesh_data->triangles[t];
+
+			int index = flat_scene.reverse_indices[flat_scene.mesh_data_triangle_offsets[m] + t];
+			CHECK(index >= flat_scene.mesh_data_index_offsets[m] && index < flat_scene.mesh_data_index_offsets[m] + mesh_data->bvh.index_count);
+
+			const CUDATriangle & triangle_device = flat_scene.triangles[index];
+			CHECK(triangle_device.position_0 == triangle.position_0);
+			CHECK(triangle_device.position_edge_1 == triangle.position_1 - triangle.position_0);
+
+			int material_id = mesh_data->material_offset + triangle.material_id;
+			CHECK(flat_scene.triangle_material_ids[index] == material_id);
+
+			if (Material::materials[material_id].type == Material::Type::LIGHT) light_count++;
+		}
+
+		int light_mesh_index = flat_scene.light_mesh_data_indices[m];
+		if (light_count == 0) {
+			CHECK(light_mesh_index == -1);
+			continue;
+		}
+
+		CHECK(light_mesh_index != -1);
+		if (light_mesh_index == -1) continue;
+
+		const FlatScene::LightMesh & light_mesh = flat_scene.light_meshes[light_mesh_index];
+		CHECK(light_mesh.triangle_count == light_count);
+
+		// Lights are sorted on area and the cumulative areas increase
+		float area_prev = 0.0f;
+		for (int i = 0; i < light_mesh.triangle_count; i++) {
+			int light_index = flat_scene.light_indices[light_mesh.triangle_first_index + i];
+			CHECK(Material::materials[flat_scene.triangle_material_ids[light_index]].type == Material::Type::LIGHT);
+
+			const CUDATriangle & light = flat_scene.triangles[light_index];
+			float area = 0.5f * Vector3::length(Vector3::cross(light.position_edge_1, light.position_edge_2));
+
+			CHECK(area >= area_prev);
+			area_prev = area;
+
+			if (i > 0) CHECK(flat_scene.light_areas_cumulative[light_mesh.triangle_first_index + i] >= flat_scene.light_areas_cumulative[light_mesh.triangle_first_index + i - 1]);
+		}
+		CHECK(light_mesh.area == flat_scene.light_areas_cumulative[light_mesh.triangle_first_index + light_mesh.triangle_count - 1]);
+
+		light_triangle_count += light_count;
+	}
+
+	CHECK(int(flat_scene.light_indices.size()) == light_triangle_count);
+}
+
+int main() {
+	init_scene();
+
+	FlatScene serial = flatten(1);
+	check_serial(serial);
+
+	// Spatial splits have to reference some Triangles more than once, otherwise the order of the reverse indices is not tested
+	CHECK(serial.index_count > serial.triangle_count);
+
+	// More threads than Chunks for some of the loops and fewer for others
+	const int thread_counts[] = { 2, 3, 8 };
+
+	for (int thread_count : thread_counts) {
+		FlatScene parallel = flatten(thread_count);
+		compare(serial, parallel);
+		parallel.free();
+	}
+
+	serial.free();
+
+	return Test::report("FlatScene");
+}
@@ -0,0 +1,122 @@
+#include "Test.h"
+
+#include <functional>
+
+#include "LaunchGraphKey.h"
+
+struct Change {
+	const char * name;
+
+	std::function<void(Settings & settings, LaunchGraphKey::State & state)> apply;
+};
+
+// One change per field of the key, every one of them must cause the launch Graph to be recorded again
+static const Change changes[] = {
+	{ "enable_rasterization",            [](Settings & settings, LaunchGraphKey::State &) { settings.enable_rasterization = !settings.enable_rasterization; } },
+	{ "enable_material_sort",            [](Settings & settings, LaunchGraphKey::State &) { settings.enable_material_sort = !settings.enable_material_sort; } },
+	{ "enable_radiance_cache",           [](Settings & settings, LaunchGraphKey::State &) { settings.enable_radiance_cache = !settings.enable_radiance_cache; } },
+	{ "enable_indirect_upsample",        [](Settings & settings, LaunchGraphKey::State &) { settings.indirect_downsample = 2; } },
+	{ "enable_svgf",                     [](Settings & settings, LaunchGraphKey::State &) { settings.enable_svgf = !settings.enable_svgf; } },
+	{ "enable_spatial_variance",         [](Settings & settings, LaunchGraphKey::State &) { settings.enable_spatial_variance = !settings.enable_spatial_variance; } },
+	{ "enable_taa",                      [](Settings & settings, LaunchGraphKey::State &) { settings.enable_taa = !settings.enable_taa; } },
+	{ "enable_reconstruction",           [](Settings & settings, LaunchGraphKey::State &) { settings.reconstruction_filter = ReconstructionFilter::GAUSSIAN; } },
+	{ "atrous_iterations",               [](Settings & settings, LaunchGraphKey::State &) { settings.atrous_iterations++; } },
+	{ "has_diffuse",                     [](Settings &, LaunchGraphKey::State & state) { state.has_diffuse = !state.has_diffuse; } },
+	{ "has_dielectric",                  [](Settings &, LaunchGraphKey::State & state) { state.has_dielectric = !state.has_dielectric; } },
+	{ "has_glossy",                      [](Settings &, LaunchGraphKey::State & state) { state.has_glossy = !state.has_glossy; } },
+	{ "has_lights",                      [](Settings &, LaunchGraphKey::State & state) { state.has_lights = !state.has_lights; } },
+	{ "enable_concurrent_shading",       [](Settings &, LaunchGraphKey::State & state) { state.enable_concurrent_shading = !state.enable_concurrent_shading; } },
+	{ "enable_path_regeneration",        [](Settings &, LaunchGraphKey::State & state) { state.enable_path_regeneration = !state.enable_path_regeneration; } },
+	{ "enable_deterministic_compaction", [](Settings & settings, LaunchGraphKey::State &) { settings.enable_deterministic_compaction = !settings.enable_deterministic_compaction; } },
+	{ "enable_ray_sort",                 [](Settings & settings, LaunchGraphKey::State &) { settings.enable_ray_sort = !settings.enable_ray_sort; } },
+	{ "enable_path_guiding",             [](Settings & settings, LaunchGraphKey::State &) { settings.enable_path_guiding = !settings.enable_path_guiding; } },
+	{ "samples_per_frame",               [](Settings &, LaunchGraphKey::State & state) { state.samples_per_frame = 4; } }
+};
+
+// Fails to compile when a field is added to the key without a matching change above
+static_assert(sizeof(LaunchGraphKey) == sizeof(changes) / sizeof(Change) * sizeof(int), "Every field of LaunchGraphKey needs a Change");
+
+// Settings that only reach the Kernels through the Settings buffer, changing them must not record the Graph again
+static const Change changes_ignored[] = {
+	{ "enable_next_event_estimation", [](Settings & settings, LaunchGraphKey::State &) { settings.enable_next_event_estimation = !settings.enable_next_event_estimation; } },
+	{ "demodulate_albedo",            [](Settings & settings, LaunchGraphKey::State &) { settings.demodulate_albedo = !settings.demodulate_albedo; } },
+	{ "alpha_colour",                 [](Settings & settings, LaunchGraphKey::State &) { settings.alpha_colour = 0.5f; } },
+	{ "sigma_l",                      [](Settings & settings, LaunchGraphKey::State &) { settings.sigma_l = 1.0f; } },
+	{ "reconstruction_filter",        [](Settings & settings, LaunchGraphKey::State &) { settings.reconstruction_filter = ReconstructionFilter::MITCHELL_NETRAVALI; } }
+};
+
+static LaunchGraphKey::State get_default_state() {
+	LaunchGraphKey::State state;
+	state.has_diffuse    = true;
+	state.has_dielectric = false;
+	state.has_glossy     = true;
+	state.has_lights     = true;
+
+	state.enable_concurrent_shading = true;
+	state.enable_path_regeneration  = false;
+
+	state.samples_per_frame = 1;
+
+	return state;
+}
+
+static void test_changes() {
+	Settings              settings_base;
+	LaunchGraphKey::State state_base = get_default_state();
+
+	LaunchGraphKey key_base = LaunchGraphKey::get(settings_base, state_base);
+
+	// The same inputs give the same key
+	CHECK(LaunchGraphKey::get(settings_base, state_base) == key_base);
+
+	for (const Change & change : changes) {
+		Settings              settings = settings_base;
+		LaunchGraphKey::State state    = state_base;
+		change.apply(settings, state);
+
+		bool recorded = LaunchGraphKey::get(settings, state) != key_base;
+		if (!recorded) printf("    Changing %s does not record the launch Graph again\n", change.name);
+		CHECK(recorded);
+	}
+
+	// Changing a setting that is not part of the key, here the filter from Gaussian to Mitchell-Netravali, keeps the Graph
+	Settings settings_gaussian = settings_base;
+	settings_gaussian.reconstruction_filter = ReconstructionFilter::GAUSSIAN;
+
+	LaunchGraphKey key_gaussian = LaunchGraphKey::get(settings_gaussian, state_base);
+
+	for (const Change & change : changes_ignored) {
+		Settings              settings = settings_gaussian;
+		LaunchGraphKey::State state    = state_base;
+		change.apply(settings, state);
+
+		bool recorded = LaunchGraphKey::get(settings, state) != key_gaussian;
+		if (recorded) printf("    Changing %s records the launch Graph again\n", change.name);
+		CHECK(!recorded);
+	}
+}
+
+// Every field on its own makes two keys differ, also when a copy is compared
+static void test_comparison() {
+	Settings              settings = { };
+	LaunchGraphKey::State state    = get_default_state();
+
+	LaunchGraphKey key = LaunchGraphKey::get(settings, state);
+
+	for (int i = 0; i < int(sizeof(LaunchGraphKey) / sizeof(int)); i++) {
+		LaunchGraphKey key_changed = key;
+		reinterpret_cast<int *>(&key_changed)[i] ^= 1;
+
+		CHECK(key_changed != key);
+
+		LaunchGraphKey key_copy = key_changed;
+		CHECK(key_copy == key_changed);
+	}
+}
+
+int main() {
+	test_changes();
+	test_comparison();
+
+	return Test::report("TestLaunchGraphKey");
+}
@@ -0,0 +1,159 @@
+#include "Test.h"
+
+#include <cmath>
+#include <vector>
+
+#include "MathSoA.h"
+#include "Matrix4.h"
+#include "Quaternion.h"
+
+// Counts around multiples of the SIMD width, so that both the full registers and the padding are covered
+static const int counts[] = { 1, 2, SOA_WIDTH - 1, SOA_WIDTH, SOA_WIDTH + 1, 3 * SOA_WIDTH + 5, 1000 };
+
+static float random_range(float min, float max) {
+	return min + (max - min) * Test::random_float();
+}
+
+static Vector3 random_vector(float range) {
+	return Vector3(random_range(-range, range), random_range(-range, range), random_range(-range, range));
+}
+
+static AABB random_aabb() {
+	Vector3 center = random_vector(100.0f);
+	Vector3 extent = Vector3(random_range(0.0f, 10.0f), random_range(0.0f, 10.0f), random_range(0.0f, 10.0f));
+
+	AABB aabb;
+	aabb.min = center - extent;
+	aabb.max = center + extent;
+
+	return aabb;
+}
+
+static Matrix4 random_matrix() {
+	Quaternion rotation = Quaternion::axis_angle(Vector3::normalize(random_vector(1.0f)), random_range(0.0f, 6.28318530718f));
+
+	return Matrix4::create_translation(random_vector(50.0f)) * Matrix4::create_rotation(rotation) * Matrix4::create_scale(random_range(0.1f, 4.0f));
+}
+
+// The batched operations may evaluate the sums in a different order than the scalar ones
+static bool approx_equal(float a, float b) {
+	return fabsf(a - b) <= 1e-5f * fmaxf(1.0f, fmaxf(fabsf(a), fabsf(b)));
+}
+
+static bool approx_equal(const Vector3 & a, const Vector3 & b) {
+	return approx_equal(a.x, b.x) && approx_equal(a.y, b.y) && approx_equal(a.z, b.z);
+}
+
+static void test_transform_vectors() {
+	for (int count : counts) {
+		Matrix4 matrix = random_matrix();
+
+		Vector3SoA vectors;
+		Vector3SoA positions;
+		Vector3SoA directions;
+		vectors   .init(count);
+		positions .init(count);
+		directions.init(count);
+
+		for (int i = 0; i < count; i++) vectors.set(i, random_vector(100.0f));
+
+		MathSoA::transform_positions (matrix, vectors, positions);
+		MathSoA::transform_directions(matrix, vectors, directions);
+
+		for (int i = 0; i < count; i++) {
+			CHECK(approx_equal(positions .get(i), Matrix4::transform_position (matrix, vectors.get(i))));
+			CHECK(approx_equal(directions.get(i), Matrix4::transform_direction(matrix, vectors.get(i))));
+		}
+
+		vectors   .free();
+		positions .free();
+		directions.free();
+	}
+}
+
+static void test_transform_aabbs() {
+	for (int count : counts) {
+		Matrix4 matrix = random_matrix();
+
+		AABBSoA aabbs;
+		AABBSoA result;
+		aabbs .init(count);
+		result.init(count);
+
+		for (int i = 0; i < count; i++) aabbs.set(i, random_aabb());
+
+		MathSoA::transform(matrix, aabbs, result);
+
+		for (int i = 0; i < count; i++) {
+			AABB expected = AABB::transform(aabbs.get(i), matrix);
+
+			CHECK(approx_equal(result.get(i).min, expected.min));
+			CHECK(approx_equal(result.get(i).max, expected.max));
+		}
+
+		// The padding of the result stays empty, so that it can be merged directly
+		AABB merged_expected = AABB::create_empty();
+		for (int i = 0; i < count; i++) merged_expected.expand(result.get(i));
+
+		AABB merged = MathSoA::merge(result);
+		CHECK(merged.min == merged_expected.min && merged.max == merged_expected.max);
+
+		aabbs .free();
+		result.free();
+	}
+}
+
+static void test_merge() {
+	for (int count : counts) {
+		AABBSoA aabbs;
+		aabbs.init(count);
+
+		AABB expected = AABB::create_empty();
+
+		for (int i = 0; i < count; i++) {
+			AABB aabb = random_aabb();
+			aabbs.set(i, aabb);
+
+			expected.expand(aabb);
+		}
+
+		// Min and max are exact, the result does not depend on the order of the lanes
+		AABB merged = MathSoA::merge(aabbs);
+		CHECK(merged.min == expected.min && merged.max == expected.max);
+
+		aabbs.free();
+	}
+}
+
+static void test_surface_areas() {
+	for (int count : counts) {
+		AABBSoA aabbs;
+		aabbs.init(count);
+
+		for (int i = 0; i < count; i++) aabbs.set(i, random_aabb());
+
+		// One element past the end checks that the remainder does not write a full register, the offset of one makes the output unaligned
+		std::vector<float> areas(count + 2, -1.0f);
+		MathSoA::surface_areas(aabbs, areas.data() + 1);
+
+		CHECK(areas[0] == -1.0f);
+		CHECK(areas[count + 1] == -1.0f);
+
+		for (int i = 0; i < count; i++) {
+			CHECK(approx_equal(areas[i + 1], aabbs.get(i).surface_area()));
+		}
+
+		aabbs.free();
+	}
+}
+
+int main() {
+	printf("    SOA_WIDTH = %i\n", SOA_WIDTH);
+
+	test_transform_vectors();
+	test_transform_aabbs();
+	test_merge();
+	test_surface_areas();
+
+	return Test::report("MathSoA");
+}
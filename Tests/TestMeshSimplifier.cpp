@@ -0,0 +1,230 @@
+#include "Test.h"
+
+#include <cmath>
+#include <vector>
+
+#include "MeshSimplifier.h"
+
+static Triangle make_triangle(const Vector3 & p0, const Vector3 & p1, const Vector3 & p2) {
+	Triangle triangle;
+	triangle.position_0 = p0;
+	triangle.position_1 = p1;
+	triangle.position_2 = p2;
+
+	Vector3 normal = Vector3::normalize(Vector3::cross(p1 - p0, p2 - p0));
+	triangle.normal_0 = normal;
+	triangle.normal_1 = normal;
+	triangle.normal_2 = normal;
+
+	Vector3 positions[3] = { p0, p1, p2 };
+	triangle.aabb = AABB::from_points(positions, 3);
+
+	return triangle;
+}
+
+// Unit sphere made by subdividing an octahedron, 8 * 4^subdivisions Triangles
+static std::vector<Triangle> make_sphere(int subdivisions) {
+	const Vector3 axes[6] = {
+		Vector3(+1.0f, 0.0f, 0.0f), Vector3(0.0f, +1.0f, 0.0f), Vector3(0.0f, 0.0f, +1.0f),
+		Vector3(-1.0f, 0.0f, 0.0f), Vector3(0.0f, -1.0f, 0.0f), Vector3(0.0f, 0.0f, -1.0f)
+	};
+
+	std::vector<Triangle> triangles;
+
+	for (int octant = 0; octant < 8; octant++) {
+		Vector3 x = axes[(octant & 1) ? 3 : 0];
+		Vector3 y = axes[(octant & 2) ? 4 : 1];
+		Vector3 z = axes[(octant & 4) ? 5 : 2];
+
+		// Keep the winding consistent, mirroring an odd number of axes flips it
+		bool flip = ((octant & 1) + ((octant >> 1) & 1) + ((octant >> 2) & 1)) & 1;
+		if (flip) { Vector3 tmp = y; y = z; z = tmp; }
+
+		int n = 1 << subdivisions;
+
+		// Points on the face of the octahedron, (i, j) with i + j <= n, projected onto the sphere
+		auto point = [&](int i, int j) {
+			int k = n - i - j;
+			return Vector3::normalize(float(i) * x + float(j) * y + float(k) * z);
+		};
+
+		for (int j = 0; j < n; j++) {
+			for (int i = 0; i < n - j; i++) {
+				triangles.push_back(make_triangle(point(i, j), point(i + 1, j), point(i, j + 1)));
+
+				if (i + j + 2 <= n) {
+					triangles.push_back(make_triangle(point(i + 1, j), point(i + 1, j + 1), point(i, j + 1)));
+				}
+			}
+		}
+	}
+
+	return triangles;
+}
+
+// Flat unit square in the xz plane made of size x size quads
+static std::vector<Triangle> make_plane(int size) {
+	std::vector<Triangle> triangles;
+
+	auto point = [size](int i, int j) {
+		return Vector3(float(i) / float(size), 0.0f, float(j) / float(size));
+	};
+
+	for (int j = 0; j < size; j++) {
+		for (int i = 0; i < size; i++) {
+			triangles.push_back(make_triangle(point(i, j), point(i, j + 1), point(i + 1, j)));
+			triangles.push_back(make_triangle(point(i + 1, j), point(i, j + 1), point(i + 1, j + 1)));
+		}
+	}
+
+	return triangles;
+}
+
+static float distance_to_segment(const Vector3 & p, const Vector3 & a, const Vector3 & b) {
+	Vector3 ab = b - a;
+
+	float t = Vector3::dot(p - a, ab) / Vector3::length_squared(ab);
+	t = fminf(fmaxf(t, 0.0f), 1.0f);
+
+	return Vector3::length(p - (a + t * ab));
+}
+
+// Brute force distance from a point to a Triangle: the distance to the plane if the projection lies inside, otherwise the distance to the closest edge
+static float distance_to_triangle(const Vector3 & p, const Triangle & triangle) {
+	const Vector3 & a = triangle.position_0;
+	const Vector3 & b = triangle.position_1;
+	const Vector3 & c = triangle.position_2;
+
+	Vector3 normal = Vector3::normalize(Vector3::cross(b - a, c - a));
+	Vector3 projected = p - Vector3::dot(p - a, normal) * normal;
+
+	bool inside =
+		Vector3::dot(Vector3::cross(b - a, projected - a), normal) >= 0.0f &&
+		Vector3::dot(Vector3::cross(c - b, projected - b), normal) >= 0.0f &&
+		Vector3::dot(Vector3::cross(a - c, projected - c), normal) >= 0.0f;
+
+	if (inside) return fabsf(Vector3::dot(p - a, normal));
+
+	return fminf(fminf(distance_to_segment(p, a, b), distance_to_segment(p, b, c)), distance_to_segment(p, c, a));
+}
+
+static float distance_to_mesh(const Vector3 & p, const Triangle * triangles, int triangle_count) {
+	float distance = INFINITY;
+	for (int t = 0; t < triangle_count; t++) {
+		distance = fminf(distance, distance_to_triangle(p, triangles[t]));
+	}
+	return distance;
+}
+
+// Largest distance from the corners and 'sample_count' random points of every Triangle in 'from' to the surface made by 'to'
+static float measure_distance(const Triangle * from, int from_count, const Triangle * to, int to_count, int sample_count) {
+	float distance_max = 0.0f;
+
+	for (int t = 0; t < from_count; t++) {
+		const Triangle & triangle = from[t];
+
+		distance_max = fmaxf(distance_max, distance_to_mesh(triangle.position_0, to, to_count));
+		distance_max = fmaxf(distance_max, distance_to_mesh(triangle.position_1, to, to_count));
+		distance_max = fmaxf(distance_max, distance_to_mesh(triangle.position_2, to, to_count));
+
+		for (int s = 0; s < sample_count; s++) {
+			float u = Test::random_float();
+			float v = Test::random_float();
+			if (u + v > 1.0f) {
+				u = 1.0f - u;
+				v = 1.0f - v;
+			}
+
+			Vector3 p = triangle.position_0 + u * (triangle.position_1 - triangle.position_0) + v * (triangle.position_2 - triangle.position_0);
+			distance_max = fmaxf(distance_max, distance_to_mesh(p, to, to_count));
+		}
+	}
+
+	return distance_max;
+}
+
+static float get_area(const Triangle * triangles, int triangle_count) {
+	float area = 0.0f;
+	for (int t = 0; t < triangle_count; t++) {
+		area += 0.5f * Vector3::length(Vector3::cross(triangles[t].position_1 - triangles[t].position_0, triangles[t].position_2 - triangles[t].position_0));
+	}
+	return area;
+}
+
+static void test_sphere() {
+	std::vector<Triangle> sphere = make_sphere(4);
+	int target_count = int(sphere.size()) / 8;
+
+	int   result_count;
+	float error;
+	Triangle * result = MeshSimplifier::simplify(sphere.data(), int(sphere.size()), target_count, result_count, error);
+
+	CHECK(result_count <= target_count);
+	CHECK(result_count >= target_count / 2);
+
+	// The simplified surface is measured in both directions, with extra samples inside the large simplified Triangles
+	float distance_simplified = measure_distance(result,        result_count,       sphere.data(), int(sphere.size()), 32);
+	float distance_original   = measure_distance(sphere.data(), int(sphere.size()), result,        result_count,       4);
+	float distance = fmaxf(distance_simplified, distance_original);
+
+	printf("    %i -> %i triangles, error bound %f, measured %f\n", int(sphere.size()), result_count, error, distance);
+
+	CHECK_LESS_EQUAL(distance, error);
+
+	// The bound should also be tight, otherwise LODs are selected far too late
+	CHECK(distance > 0.0f);
+	CHECK_LESS_EQUAL(error, 1.5f * distance);
+
+	delete [] result;
+}
+
+static void test_plane() {
+	std::vector<Triangle> plane = make_plane(32);
+	int target_count = 32;
+
+	int   result_count;
+	float error;
+	Triangle * result = MeshSimplifier::simplify(plane.data(), int(plane.size()), target_count, result_count, error);
+
+	CHECK(result_count <= target_count);
+
+	// A flat plane simplifies without changing the surface, the boundary is kept so the area stays the same
+	float distance = fmaxf(
+		measure_distance(result,       result_count,      plane.data(), int(plane.size()), 64),
+		measure_distance(plane.data(), int(plane.size()), result,       result_count,      4)
+	);
+
+	// The bound on a flat surface only consists of the tolerance to which it is refined
+	CHECK_LESS_EQUAL(distance, 1e-5f);
+	CHECK_LESS_EQUAL(distance, error);
+	CHECK_LESS_EQUAL(error, 0.005f);
+	CHECK_LESS_EQUAL(fabsf(get_area(result, result_count) - 1.0f), 1e-4f);
+
+	for (int t = 0; t < result_count; t++) {
+		CHECK(result[t].position_0.y == 0.0f && result[t].position_1.y == 0.0f && result[t].position_2.y == 0.0f);
+	}
+
+	delete [] result;
+}
+
+static void test_no_collapse() {
+	// With a target above the Triangle count nothing changes and there is no error
+	std::vector<Triangle> sphere = make_sphere(2);
+
+	int   result_count;
+	float error;
+	Triangle * result = MeshSimplifier::simplify(sphere.data(), int(sphere.size()), int(sphere.size()), result_count, error);
+
+	CHECK(result_count == int(sphere.size()));
+	CHECK(error == 0.0f);
+
+	delete [] result;
+}
+
+int main() {
+	test_sphere();
+	test_plane();
+	test_no_collapse();
+
+	return Test::report("MeshSimplifier");
+}
@@ -0,0 +1,128 @@
+#include "Test.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Numa.h"
+
+static std::vector<int> parse(const char * list) {
+	std::vector<int> ids;
+	Numa::parse_list(list, ids);
+
+	return ids;
+}
+
+static void test_parse_list() {
+	CHECK(parse("0-3,8-11\n") == std::vector<int>({ 0, 1, 2, 3, 8, 9, 10, 11 }));
+	CHECK(parse("5")          == std::vector<int>({ 5 }));
+	CHECK(parse("0,2,4-5")    == std::vector<int>({ 0, 2, 4, 5 }));
+	CHECK(parse("7-7\n")      == std::vector<int>({ 7 }));
+
+	// Memory only nodes have an empty cpulist, a missing file is read as an empty string
+	CHECK(parse("\n").empty());
+	CHECK(parse("").empty());
+
+	// Appends to the ids that are already there
+	std::vector<int> ids = { 42 };
+	Numa::parse_list("1-2", ids);
+	CHECK(ids == std::vector<int>({ 42, 1, 2 }));
+}
+
+static void test_linux() {
+	// Node 1 is offline, node 2 only has memory and node 5 is listed as online but has no cpulist
+	std::map<int, std::string> cpulists = {
+		{ 0, "0-3,64-67\n" },
+		{ 1, "4-7\n" },
+		{ 2, "\n" },
+		{ 3, "8-11,68\n" },
+		{ 4, "128-129\n" }
+	};
+
+	std::vector<int> nodes_queried;
+
+	std::vector<std::vector<int>> nodes = Numa::get_topology_linux("0,2-5\n", [&](int node) {
+		nodes_queried.push_back(node);
+
+		auto cpulist = cpulists.find(node);
+		return cpulist != cpulists.end() ? cpulist->second : std::string();
+	});
+
+	// Only the online nodes are read
+	CHECK(nodes_queried == std::vector<int>({ 0, 2, 3, 4, 5 }));
+
+	CHECK(nodes.size() == 3);
+	if (nodes.size() == 3) {
+		CHECK(nodes[0] == std::vector<int>({ 0, 1, 2, 3, 64, 65, 66, 67 }));
+		CHECK(nodes[1] == std::vector<int>({ 8, 9, 10, 11, 68 }));
+		CHECK(nodes[2] == std::vector<int>({ 128, 129 }));
+	}
+
+	// Without the node directories the topology is empty, so that the caller falls back to a single node
+	CHECK(Numa::get_topology_linux("", [](int) { return std::string(); }).empty());
+}
+
+static void test_windows() {
+	// Four processor groups: node 1 does not exist, node 3 uses the highest bit of its group and node 4 shares group 2 with node 5
+	std::vector<Numa::GroupAffinity> affinities = {
+		{ 0, 0xffull },
+		{ 0, 0 },
+		{ 1, 0x3ull },
+		{ 3, 0x1ull | (1ull << 63) },
+		{ 2, 0xf0ull },
+		{ 2, 0x0full }
+	};
+
+	std::vector<std::vector<int>> nodes = Numa::get_topology_windows(affinities);
+
+	CHECK(nodes.size() == 5);
+	if (nodes.size() == 5) {
+		CHECK(nodes[0] == std::vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7 }));
+		CHECK(nodes[1] == std::vector<int>({ 64, 65 }));
+		CHECK(nodes[2] == std::vector<int>({ 3 * 64, 3 * 64 + 63 }));
+		CHECK(nodes[3] == std::vector<int>({ 2 * 64 + 4, 2 * 64 + 5, 2 * 64 + 6, 2 * 64 + 7 }));
+		CHECK(nodes[4] == std::vector<int>({ 2 * 64, 2 * 64 + 1, 2 * 64 + 2, 2 * 64 + 3 }));
+	}
+
+	// Every CPU maps back to its group and bit
+	for (const std::vector<int> & cpus : nodes) {
+		for (int cpu : cpus) {
+			int group = cpu / Numa::CPUS_PER_GROUP;
+			int bit   = cpu % Numa::CPUS_PER_GROUP;
+
+			bool found = false;
+			for (const Numa::GroupAffinity & affinity : affinities) {
+				if (affinity.group == group && (affinity.mask & (1ull << bit))) found = true;
+			}
+			CHECK(found);
+		}
+	}
+
+	CHECK(Numa::get_topology_windows({ }).empty());
+}
+
+static void test_machine() {
+	// Whatever the machine looks like, there is at least one node and every CPU belongs to a single node
+	int node_count = Numa::get_node_count();
+	CHECK(node_count >= 1);
+
+	std::map<int, int> cpu_nodes;
+
+	for (int node = 0; node < node_count; node++) {
+		CHECK(!Numa::get_node_cpus(node).empty());
+
+		for (int cpu : Numa::get_node_cpus(node)) {
+			CHECK(cpu_nodes.find(cpu) == cpu_nodes.end());
+			cpu_nodes[cpu] = node;
+		}
+	}
+}
+
+int main() {
+	test_parse_list();
+	test_linux();
+	test_windows();
+	test_machine();
+
+	return Test::report("Numa");
+}
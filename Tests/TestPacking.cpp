@@ -0,0 +1,143 @@
+#include "Test.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "CUDA_Source/Packing.h"
+
+// Worst case angular error of the octahedral encoding in radians, as documented in Packing.h
+static constexpr float OCT_MAX_ANGULAR_ERROR = 7e-5f;
+
+static void test_half_round_trip() {
+	// Every finite half float survives a round trip through float exactly
+	for (unsigned bits = 0; bits < 0x10000; bits++) {
+		unsigned exponent = (bits >> 10) & 0x1f;
+		if (exponent == 31) continue; // Infinity and NaN are never produced by float_to_half
+
+		float f = Packing::half_to_float((unsigned short)bits);
+
+		unsigned short result = Packing::float_to_half(f);
+		CHECK(result == bits);
+		if (result != bits) printf("    half 0x%04x -> %g -> 0x%04x\n", bits, f, result);
+	}
+
+	// Normal range: rounding to nearest gives a relative error of at most 2^-11
+	for (int i = 0; i < 1000000; i++) {
+		float f = std::ldexp(1.0f + Test::random_float(), int(Test::random_float() * 29.0f) - 14);
+		if (Test::random_float() < 0.5f) f = -f;
+		if (fabsf(f) > HALF_MAX) continue;
+
+		float result = Packing::half_to_float(Packing::float_to_half(f));
+
+		CHECK_LESS_EQUAL(fabsf(result - f), fabsf(f) * (1.0f / 2048.0f));
+	}
+
+	// Denormal range: the absolute error is at most half the smallest denormal, 2^-25
+	for (int i = 0; i < 100000; i++) {
+		float f = Test::random_float() * 6.1e-5f;
+
+		float result = Packing::half_to_float(Packing::float_to_half(f));
+
+		CHECK_LESS_EQUAL(fabsf(result - f), 1.0f / 33554432.0f);
+	}
+
+	// Out of range values are clamped and NaN maps to zero
+	CHECK(Packing::half_to_float(Packing::float_to_half( 1e10f)) ==  HALF_MAX);
+	CHECK(Packing::half_to_float(Packing::float_to_half(-1e10f)) == -HALF_MAX);
+	CHECK(Packing::float_to_half(NAN) == 0);
+}
+
+static void test_oct_round_trip() {
+	float error_max = 0.0f;
+
+	for (int i = 0; i < 1000000; i++) {
+		// Uniform direction on the sphere
+		float z   = 2.0f * Test::random_float() - 1.0f;
+		float phi = 6.28318530718f * Test::random_float();
+		float r   = sqrtf(fmaxf(1.0f - z*z, 0.0f));
+
+		float x = r * cosf(phi);
+		float y = r * sinf(phi);
+
+		float result_x, result_y, result_z;
+		Packing::oct_decode_direction(Packing::oct_encode_direction(x, y, z), result_x, result_y, result_z);
+
+		float length = sqrtf(result_x*result_x + result_y*result_y + result_z*result_z);
+		CHECK_LESS_EQUAL(fabsf(length - 1.0f), 1e-6f);
+
+		// The cross product is accurate for small angles, unlike acos of the dot product
+		float cross_x = y * result_z - z * result_y;
+		float cross_y = z * result_x - x * result_z;
+		float cross_z = x * result_y - y * result_x;
+
+		float error = atan2f(sqrtf(cross_x*cross_x + cross_y*cross_y + cross_z*cross_z), x*result_x + y*result_y + z*result_z);
+		if (error > error_max) error_max = error;
+	}
+
+	printf("    Octahedral encoding: max angular error %g radians\n", error_max);
+	CHECK_LESS_EQUAL(error_max, OCT_MAX_ANGULAR_ERROR);
+
+	// The axes are represented exactly, including both poles where the lower hemisphere is folded
+	const float axes[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+	for (const float * axis : axes) {
+		float x, y, z;
+		Packing::oct_decode_direction(Packing::oct_encode_direction(axis[0], axis[1], axis[2]), x, y, z);
+
+		CHECK_LESS_EQUAL(fabsf(x - axis[0]) + fabsf(y - axis[1]) + fabsf(z - axis[2]), 1e-4f);
+	}
+}
+
+static void test_hit_round_trip() {
+	// Barycentrics are unorms with an error of at most half a step
+	for (int i = 0; i < 1000000; i++) {
+		float u = Test::random_float();
+		float v = Test::random_float() * (1.0f - u);
+
+		float result_u, result_v;
+		Packing::unpack_barycentrics(Packing::pack_barycentrics(u, v), result_u, result_v);
+
+		CHECK_LESS_EQUAL(fabsf(result_u - u), 0.5f / 65535.0f + 1e-7f);
+		CHECK_LESS_EQUAL(fabsf(result_v - v), 0.5f / 65535.0f + 1e-7f);
+	}
+
+	float u, v;
+	Packing::unpack_barycentrics(Packing::pack_barycentrics(1.0f, 0.0f), u, v);
+	CHECK(u == 1.0f && v == 0.0f);
+
+	// The Mesh id is exact, the distance has the precision of a half float
+	for (int mesh_id = 0; mesh_id <= int(HIT_MESH_ID_MASK); mesh_id += 257) {
+		float t = std::ldexp(1.0f + Test::random_float(), int(Test::random_float() * 20.0f) - 8);
+
+		unsigned packed = Packing::pack_hit_mesh_t(mesh_id, t);
+
+		CHECK(Packing::unpack_hit_mesh_id(packed) == mesh_id);
+		CHECK_LESS_EQUAL(fabsf(Packing::unpack_hit_t(packed) - t), t * (1.0f / 2048.0f));
+	}
+	CHECK(Packing::unpack_hit_mesh_id(Packing::pack_hit_mesh_t(HIT_MESH_ID_MASK, 1.0f)) == int(HIT_MESH_ID_MASK));
+}
+
+static void test_pixel_state_round_trip() {
+	for (int i = 0; i < 100000; i++) {
+		int pixel_index   = int(Random::get_value() & PIXEL_STATE_PIXEL_INDEX_MASK);
+		int material_type = int(Random::get_value() & PIXEL_STATE_MATERIAL_TYPE_MASK);
+		int path_start    = int(Random::get_value() & PIXEL_STATE_PATH_START_MASK);
+
+		unsigned pixel_state = Packing::pack_pixel_state(pixel_index, material_type, path_start);
+
+		CHECK(Packing::unpack_pixel_index  (pixel_state) == pixel_index);
+		CHECK(Packing::unpack_material_type(pixel_state) == material_type);
+		CHECK(Packing::unpack_path_start   (pixel_state) == path_start);
+	}
+}
+
+int main() {
+	Random::init(79);
+
+	test_half_round_trip();
+	test_oct_round_trip();
+	test_hit_round_trip();
+	test_pixel_state_round_trip();
+
+	return Test::report("TestPacking");
+}
@@ -0,0 +1,308 @@
+#include "Test.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <unordered_set>
+
+#include "RadianceCacheCPU.h"
+
+#include "CUDA_Source/RadianceCache.h"
+
+// Emulation of radiance_cache_insert and radiance_cache_find in Pathtracer.cu, with atomicCAS executed serially
+static unsigned atomic_cas(unsigned * address, unsigned compare, unsigned value) {
+	unsigned old = *address;
+	if (old == compare) *address = value;
+	return old;
+}
+
+static int device_insert(unsigned * keys, unsigned hash, unsigned fingerprint) {
+	unsigned slot = hash & (RADIANCE_CACHE_SIZE - 1);
+
+	for (int probe = 0; probe < RADIANCE_CACHE_MAX_PROBES; probe++) {
+		unsigned key = atomic_cas(&keys[slot], 0, fingerprint);
+		if (key == 0 || key == fingerprint) return slot;
+
+		slot = (slot + 1) & (RADIANCE_CACHE_SIZE - 1);
+	}
+
+	return -1;
+}
+
+static int device_find(const unsigned * keys, unsigned hash, unsigned fingerprint) {
+	unsigned slot = hash & (RADIANCE_CACHE_SIZE - 1);
+
+	for (int probe = 0; probe < RADIANCE_CACHE_MAX_PROBES; probe++) {
+		unsigned key = keys[slot];
+		if (key == fingerprint) return slot;
+		if (key == 0)           return -1;
+
+		slot = (slot + 1) & (RADIANCE_CACHE_SIZE - 1);
+	}
+
+	return -1;
+}
+
+static void get_key(const Vector3 & position, const Vector3 & normal, int level, unsigned & hash, unsigned & fingerprint) {
+	RadianceCache::get_key(position.x, position.y, position.z, normal.x, normal.y, normal.z, level, hash, fingerprint);
+}
+
+static void test_levels() {
+	const float pixel_spread_angle = 0.001f;
+
+	// Close to the Camera the footprint is smaller than the smallest cell
+	CHECK(RadianceCache::get_level(0.0f, pixel_spread_angle) == 0);
+	CHECK(RadianceCache::get_level(RADIANCE_CACHE_CELL_SIZE / (pixel_spread_angle * RADIANCE_CACHE_CELL_PIXELS), pixel_spread_angle) == 0);
+
+	// Every doubling of the distance goes up one level, until the last level
+	int level_prev = 0;
+	for (float distance = 1.0f; distance < 1e8f; distance *= 2.0f) {
+		int level = RadianceCache::get_level(distance, pixel_spread_angle);
+
+		CHECK(level >= level_prev && level <= level_prev + 1);
+		CHECK(level <= RADIANCE_CACHE_MAX_LEVEL);
+
+		// A cell covers at least the footprint, at most twice it
+		float footprint = distance * pixel_spread_angle * RADIANCE_CACHE_CELL_PIXELS;
+		if (level > 0 && level < RADIANCE_CACHE_MAX_LEVEL) {
+			CHECK(RadianceCache::get_cell_size(level)     <= footprint);
+			CHECK(RadianceCache::get_cell_size(level + 1) >  footprint);
+		}
+
+		level_prev = level;
+	}
+	CHECK(level_prev == RADIANCE_CACHE_MAX_LEVEL);
+}
+
+static void test_keys() {
+	const Vector3 up(0.0f, 1.0f, 0.0f);
+
+	for (int level = 0; level < 4; level++) {
+		float cell_size = RadianceCache::get_cell_size(level);
+
+		for (int i = 0; i < 1000; i++) {
+			Vector3 cell = Vector3(
+				floorf(200.0f * Test::random_float() - 100.0f),
+				floorf(200.0f * Test::random_float() - 100.0f),
+				floorf(200.0f * Test::random_float() - 100.0f)
+			);
+
+			// Two points well inside the same cell have the same key
+			Vector3 position_a = (cell + Vector3(0.1f + 0.8f * Test::random_float(), 0.1f + 0.8f * Test::random_float(), 0.1f + 0.8f * Test::random_float())) * cell_size;
+			Vector3 position_b = (cell + Vector3(0.1f + 0.8f * Test::random_float(), 0.1f + 0.8f * Test::random_float(), 0.1f + 0.8f * Test::random_float())) * cell_size;
+
+			unsigned hash_a, fingerprint_a;
+			unsigned hash_b, fingerprint_b;
+			get_key(position_a, up, level, hash_a, fingerprint_a);
+			get_key(position_b, up, level, hash_b, fingerprint_b);
+
+			CHECK(hash_a == hash_b && fingerprint_a == fingerprint_b);
+			CHECK(fingerprint_a != 0);
+
+			// The neighbouring cell, the opposite normal and the next level all have a different fingerprint
+			unsigned hash_c, fingerprint_c;
+			get_key(position_a + Vector3(cell_size, 0.0f, 0.0f), up, level, hash_c, fingerprint_c);
+			CHECK(fingerprint_c != fingerprint_a);
+
+			get_key(position_a, -up, level, hash_c, fingerprint_c);
+			CHECK(fingerprint_c != fingerprint_a);
+
+			get_key(position_a, up, level + 1, hash_c, fingerprint_c);
+			CHECK(fingerprint_c != fingerprint_a);
+		}
+	}
+
+	// Cells on either side of zero are different, the coordinates are floored rather than truncated
+	unsigned hash_negative, fingerprint_negative;
+	unsigned hash_positive, fingerprint_positive;
+	get_key(Vector3(-0.01f, 0.5f, 0.5f), up, 0, hash_negative, fingerprint_negative);
+	get_key(Vector3(+0.01f, 0.5f, 0.5f), up, 0, hash_positive, fingerprint_positive);
+	CHECK(fingerprint_negative != fingerprint_positive);
+
+	// Normals are binned by their dominant axis
+	CHECK(RadianceCache::get_normal_bin(+0.9f, 0.3f, -0.3f) == 0);
+	CHECK(RadianceCache::get_normal_bin(-0.9f, 0.3f, -0.3f) == 1);
+	CHECK(RadianceCache::get_normal_bin(0.3f, +0.9f, -0.3f) == 2);
+	CHECK(RadianceCache::get_normal_bin(0.3f, -0.9f, -0.3f) == 3);
+	CHECK(RadianceCache::get_normal_bin(0.3f, -0.3f, +0.9f) == 4);
+	CHECK(RadianceCache::get_normal_bin(0.3f, -0.3f, -0.9f) == 5);
+}
+
+static void test_hash_distribution() {
+	// A dense block of cells, as produced by a surface close to the Camera, should spread evenly over the table
+	const int size = 32;
+	const Vector3 up(0.0f, 1.0f, 0.0f);
+
+	std::unordered_set<unsigned> slots;
+	std::unordered_set<unsigned> fingerprints;
+
+	for (int z = 0; z < size; z++) {
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				Vector3 position = (Vector3(float(x), float(y), float(z)) + 0.5f) * RADIANCE_CACHE_CELL_SIZE;
+
+				unsigned hash, fingerprint;
+				get_key(position, up, 0, hash, fingerprint);
+
+				slots       .insert(hash & (RADIANCE_CACHE_SIZE - 1));
+				fingerprints.insert(fingerprint);
+			}
+		}
+	}
+
+	// With 2^15 cells in a table of 2^20 slots a uniform hash shares about 1.6% of the first slots
+	int cell_count = size * size * size;
+	CHECK_LESS_EQUAL(cell_count - int(slots.size()), cell_count / 32);
+	CHECK_LESS_EQUAL(cell_count - int(fingerprints.size()), 1);
+}
+
+static void test_collisions() {
+	RadianceCacheCPU cache;
+	cache.init();
+
+	std::vector<unsigned> device_keys(RADIANCE_CACHE_SIZE, 0);
+
+	// Cells that all start probing at the last slot, so that the probing sequence wraps around the end of the table
+	unsigned hash = RADIANCE_CACHE_SIZE - 1;
+
+	for (int i = 0; i < RADIANCE_CACHE_MAX_PROBES; i++) {
+		unsigned fingerprint = 100 + i;
+
+		int slot = cache.insert(hash, fingerprint);
+		CHECK(slot == int((hash + i) & (RADIANCE_CACHE_SIZE - 1)));
+		CHECK(slot == device_insert(device_keys.data(), hash, fingerprint));
+
+		// Inserting the same cell again returns the same slot
+		CHECK(cache.insert(hash, fingerprint) == slot);
+	}
+
+	// The probing sequence is full
+	CHECK(cache.insert(hash, 1000) == -1);
+	CHECK(device_insert(device_keys.data(), hash, 1000) == -1);
+
+	for (int i = 0; i < RADIANCE_CACHE_MAX_PROBES; i++) {
+		int slot = cache.find(hash, 100 + i);
+		CHECK(slot == int((hash + i) & (RADIANCE_CACHE_SIZE - 1)));
+		CHECK(slot == device_find(device_keys.data(), hash, 100 + i));
+	}
+	CHECK(cache.find(hash, 1000) == -1);
+
+	// A cell that is not in the table is found to be missing at the first empty slot
+	CHECK(cache.find(12345, 99) == -1);
+
+	// A cell whose first slot is taken by a colliding cell is stored in the next free slot
+	CHECK(cache.insert(RADIANCE_CACHE_MAX_PROBES - 2, 2000) == RADIANCE_CACHE_MAX_PROBES - 1);
+
+	cache.free();
+}
+
+static void test_matches_device() {
+	// Insert a stream of random cells into both tables, including colliding ones, the tables have to end up identical
+	RadianceCacheCPU cache;
+	cache.init();
+
+	std::vector<unsigned> device_keys(RADIANCE_CACHE_SIZE, 0);
+
+	const float pixel_spread_angle = 0.002f;
+
+	for (int i = 0; i < 100000; i++) {
+		Vector3 position = Vector3(Test::random_float(), Test::random_float(), Test::random_float()) * 20.0f - 10.0f;
+		Vector3 normal   = Vector3::normalize(Vector3(Test::random_float(), Test::random_float(), Test::random_float()) - 0.5f);
+		float   distance = 50.0f * Test::random_float();
+
+		int level = RadianceCache::get_level(distance, pixel_spread_angle);
+
+		unsigned hash, fingerprint;
+		get_key(position, normal, level, hash, fingerprint);
+
+		int slot_device = device_insert(device_keys.data(), hash, fingerprint);
+		int slot_host   = cache.insert(position, normal, distance, pixel_spread_angle);
+
+		CHECK(slot_host == slot_device);
+	}
+
+	CHECK(memcmp(cache.keys, device_keys.data(), RADIANCE_CACHE_SIZE * sizeof(unsigned)) == 0);
+
+	cache.free();
+}
+
+static void test_update() {
+	RadianceCacheCPU cache;
+	cache.init();
+
+	const Vector3 position(1.0f, 2.0f, 3.0f);
+	const Vector3 normal  (0.0f, 0.0f, 1.0f);
+	const float   distance = 4.0f;
+	const float   pixel_spread_angle = 0.001f;
+
+	int slot = cache.insert(position, normal, distance, pixel_spread_angle);
+	CHECK(slot != -1);
+
+	Vector3 result;
+
+	// The first frames build a cumulative average, lookups fail until the cell has enough samples
+	float sample_count = 0.0f;
+	float sum = 0.0f;
+
+	for (int frame = 0; frame < 4; frame++) {
+		CHECK(!cache.lookup(position, normal, distance, pixel_spread_angle, result));
+
+		for (int s = 0; s < 5; s++) {
+			float value = float(frame * 5 + s);
+			cache.add_sample(slot, Vector3(value, 2.0f * value, 0.0f));
+
+			sum += value;
+			sample_count += 1.0f;
+		}
+		cache.resolve();
+
+		CHECK(cache.accumulator[4 * slot + 3] == 0.0f);
+		CHECK(cache.radiance[4 * slot + 3] == sample_count);
+		CHECK_LESS_EQUAL(fabsf(cache.radiance[4 * slot] - sum / sample_count), 1e-4f);
+		CHECK_LESS_EQUAL(fabsf(cache.radiance[4 * slot + 1] - 2.0f * sum / sample_count), 1e-4f);
+	}
+
+	CHECK(sample_count >= RADIANCE_CACHE_MIN_SAMPLES);
+	CHECK(cache.lookup(position, normal, distance, pixel_spread_angle, result));
+	CHECK_LESS_EQUAL(fabsf(result.x - sum / sample_count), 1e-4f);
+
+	// A nearby point in the same cell finds the same estimate, the other side of the surface does not
+	Vector3 result_nearby;
+	CHECK(cache.lookup(position + Vector3(0.001f, 0.0f, 0.0f), normal, distance, pixel_spread_angle, result_nearby));
+	CHECK(result_nearby.x == result.x);
+	CHECK(!cache.lookup(position, -normal, distance, pixel_spread_angle, result_nearby));
+
+	// Once the cell has many samples new samples still get at least the minimum weight, so the cache follows a change in lighting
+	for (int frame = 0; frame < 1000; frame++) {
+		cache.add_sample(slot, Vector3(1000.0f, 0.0f, 0.0f));
+		cache.resolve();
+	}
+	CHECK(cache.lookup(position, normal, distance, pixel_spread_angle, result));
+	CHECK_LESS_EQUAL(fabsf(result.x - 1000.0f), 1.0f);
+
+	// Cells without samples are left untouched by resolve
+	int slot_other = cache.insert(-position, normal, distance, pixel_spread_angle);
+	cache.resolve();
+	CHECK(cache.radiance[4 * slot_other + 3] == 0.0f);
+
+	cache.free();
+}
+
+static void test_sample() {
+	// The sample is everything the pixel received after the vertex, divided by the throughput up to it
+	CHECK(RadianceCache::get_sample(1.0f, 3.0f, 0.5f) == 4.0f);
+	CHECK(RadianceCache::get_sample(3.0f, 1.0f, 0.5f) == 0.0f);
+	CHECK(RadianceCache::get_sample(1.0f, 3.0f, 0.0f) == 0.0f);
+}
+
+int main() {
+	test_levels();
+	test_keys();
+	test_hash_distribution();
+	test_collisions();
+	test_matches_device();
+	test_update();
+	test_sample();
+
+	return Test::report("RadianceCache");
+}
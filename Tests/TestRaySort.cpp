@@ -0,0 +1,183 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "RaySortCPU.h"
+#include "CountingSort.h"
+
+#include "CUDA_Source/RaySort.h"
+
+static float random_range(float min, float max) {
+	return min + (max - min) * Test::random_float();
+}
+
+struct Rays {
+	std::vector<float> origin_x, origin_y, origin_z;
+	std::vector<float> direction_x, direction_y, direction_z;
+
+	void resize(int count) {
+		origin_x   .resize(count); origin_y   .resize(count); origin_z   .resize(count);
+		direction_x.resize(count); direction_y.resize(count); direction_z.resize(count);
+	}
+};
+
+// Origins partly outside of the bounds, so that the clamping of the quantisation is covered
+static Rays random_rays(int count, const AABB & bounds) {
+	Rays rays;
+	rays.resize(count);
+
+	for (int i = 0; i < count; i++) {
+		rays.origin_x[i] = random_range(bounds.min.x - 1.0f, bounds.max.x + 1.0f);
+		rays.origin_y[i] = random_range(bounds.min.y - 1.0f, bounds.max.y + 1.0f);
+		rays.origin_z[i] = random_range(bounds.min.z - 1.0f, bounds.max.z + 1.0f);
+
+		Vector3 direction = Vector3::normalize(Vector3(random_range(-1.0f, 1.0f), random_range(-1.0f, 1.0f), random_range(-1.0f, 1.0f)));
+		rays.direction_x[i] = direction.x;
+		rays.direction_y[i] = direction.y;
+		rays.direction_z[i] = direction.z;
+	}
+
+	return rays;
+}
+
+static std::vector<int> get_keys(const Rays & rays, const AABB & bounds) {
+	int count = int(rays.origin_x.size());
+
+	std::vector<int> keys(count);
+	RaySortCPU::get_keys(count,
+		rays.origin_x.data(),    rays.origin_y.data(),    rays.origin_z.data(),
+		rays.direction_x.data(), rays.direction_y.data(), rays.direction_z.data(),
+		bounds, keys.data()
+	);
+
+	return keys;
+}
+
+static AABB get_bounds() {
+	AABB bounds;
+	bounds.min = Vector3(-10.0f, 0.0f, -5.0f);
+	bounds.max = Vector3( 10.0f, 4.0f,  5.0f);
+
+	return bounds;
+}
+
+static void test_sort() {
+	const int counts[] = { 1, 31, 32, 33, 1000, 100000 };
+
+	AABB bounds = get_bounds();
+
+	for (int count : counts) {
+		Rays rays = random_rays(count, bounds);
+
+		std::vector<int> keys = get_keys(rays, bounds);
+
+		for (int key : keys) {
+			CHECK(key >= 0 && key < RAY_SORT_KEY_COUNT);
+		}
+
+		std::vector<int> indices(count);
+		CountingSort::sort(keys.data(), count, RAY_SORT_KEY_COUNT, indices.data());
+
+		// Every Ray appears exactly once
+		std::vector<int> seen(count, 0);
+		for (int index : indices) {
+			CHECK(index >= 0 && index < count);
+			if (index >= 0 && index < count) seen[index]++;
+		}
+		for (int i = 0; i < count; i++) {
+			CHECK(seen[i] == 1);
+		}
+
+		// The keys come out ordered, Rays with equal keys keep their order in the queue
+		for (int i = 1; i < count; i++) {
+			int key_prev = keys[indices[i - 1]];
+			int key      = keys[indices[i]];
+
+			CHECK(key_prev <= key);
+			if (key_prev == key) CHECK(indices[i - 1] < indices[i]);
+		}
+
+		CHECK(CountingSort::is_sorted_permutation(keys.data(), count, RAY_SORT_KEY_COUNT, indices.data()));
+
+		// The octant of the direction only increases along the sorted queue
+		auto get_octant = [&](int index) {
+			return (rays.direction_x[index] < 0.0f ? 1 : 0) | (rays.direction_y[index] < 0.0f ? 2 : 0) | (rays.direction_z[index] < 0.0f ? 4 : 0);
+		};
+		for (int i = 1; i < count; i++) {
+			CHECK(get_octant(indices[i - 1]) <= get_octant(indices[i]));
+		}
+	}
+}
+
+static void test_keys() {
+	AABB bounds = get_bounds();
+
+	float bounds_min       [3] = { bounds.min.x, bounds.min.y, bounds.min.z };
+	float bounds_inv_extent[3] = { 1.0f / 20.0f, 1.0f / 4.0f, 1.0f / 10.0f };
+
+	const int cell_count = 1 << RAY_SORT_ORIGIN_BITS;
+
+	// The Morton code of the origin interleaves the cells, x in the lowest bit
+	for (int i = 0; i < 3; i++) {
+		float offset[3] = { 0.0f, 0.0f, 0.0f };
+		offset[i] = 1.0f / (bounds_inv_extent[i] * float(cell_count)) * 1.5f; // Middle of the second cell along axis i
+
+		int key = RaySort::get_key(bounds_min[0] + offset[0], bounds_min[1] + offset[1], bounds_min[2] + offset[2], 1.0f, 1.0f, 1.0f, bounds_min, bounds_inv_extent);
+		CHECK(key == 1 << i);
+	}
+
+	// Origins outside of the bounds are clamped to the closest cell
+	int key_min = RaySort::get_key(-100.0f, -100.0f, -100.0f, 1.0f, 1.0f, 1.0f, bounds_min, bounds_inv_extent);
+	int key_max = RaySort::get_key(+100.0f, +100.0f, +100.0f, 1.0f, 1.0f, 1.0f, bounds_min, bounds_inv_extent);
+	CHECK(key_min == 0);
+	CHECK(key_max == (1 << (3 * RAY_SORT_ORIGIN_BITS)) - 1);
+
+	// The octant is in the highest bits
+	int key_octant = RaySort::get_key(-100.0f, -100.0f, -100.0f, -1.0f, -1.0f, -1.0f, bounds_min, bounds_inv_extent);
+	CHECK(key_octant == 7 << (3 * RAY_SORT_ORIGIN_BITS));
+	CHECK(key_octant < RAY_SORT_KEY_COUNT);
+
+	// Flat bounds put all origins in the first cell along that axis
+	AABB bounds_flat = bounds;
+	bounds_flat.max.y = bounds_flat.min.y;
+
+	Rays rays = random_rays(1000, bounds);
+	std::vector<int> keys = get_keys(rays, bounds_flat);
+
+	for (int key : keys) {
+		CHECK((key & (RaySort::expand_bits(cell_count - 1) << 1)) == 0);
+	}
+}
+
+static void test_warp_steps() {
+	// Sorting the keys makes the Warps of a random queue more coherent
+	const int count = 64 * WARP_SIZE;
+
+	AABB bounds = get_bounds();
+	Rays rays = random_rays(count, bounds);
+
+	std::vector<int> keys = get_keys(rays, bounds);
+	std::vector<int> indices(count);
+	CountingSort::sort(keys.data(), count, RAY_SORT_KEY_COUNT, indices.data());
+
+	CHECK(CountingSort::distinct_keys_per_warp(keys.data(), count, indices.data()) < CountingSort::distinct_keys_per_warp(keys.data(), count));
+
+	// The cost of a Warp is the largest number of steps of its Rays
+	std::vector<int> steps(count);
+	for (int i = 0; i < count; i++) steps[i] = i % WARP_SIZE == 0 ? 10 : 1;
+
+	CHECK(RaySortCPU::warp_steps(steps.data(), count, nullptr) == 64 * 10);
+
+	std::vector<int> grouped(count);
+	for (int i = 0; i < count; i++) grouped[i] = (i % 64) * WARP_SIZE + i / 64; // The 64 expensive Rays end up in two Warps
+
+	CHECK(RaySortCPU::warp_steps(steps.data(), count, grouped.data()) == 2 * 10 + 62 * 1);
+}
+
+int main() {
+	test_sort();
+	test_keys();
+	test_warp_steps();
+
+	return Test::report("RaySort");
+}
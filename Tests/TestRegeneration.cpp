@@ -0,0 +1,146 @@
+#include "Test.h"
+
+#include <cmath>
+#include <vector>
+#include <unordered_set>
+
+#include "RegenerationCPU.h"
+#include "CUDA_Source/Regeneration.h"
+
+// Same as random_float_xorshift on the Device
+static float random_float_xorshift(unsigned & seed) {
+	seed ^= (seed << 13);
+	seed ^= (seed >> 17);
+	seed ^= (seed << 5);
+
+	return float(seed) * 2.3283064365387e-10f;
+}
+
+static void test_sample_counts() {
+	const int pixel_count = 1000;
+
+	int stride = Regeneration::get_stride(pixel_count);
+	CHECK(Regeneration::gcd(stride, pixel_count) == 1);
+
+	// Regenerating exactly 'pixel_count' samples visits every pixel once, wherever the cursor starts
+	for (int cursor : { 0, 1, 517, pixel_count - 1 }) {
+		int regenerated[MAX_WAVEFRONT_ITERATIONS] = { };
+		regenerated[1] = 300;
+		regenerated[2] = 700;
+
+		std::vector<int> sample_counts(pixel_count, 0);
+		RegenerationCPU::get_sample_counts(pixel_count, stride, cursor, regenerated, sample_counts.data());
+
+		for (int p = 0; p < pixel_count; p++) CHECK(sample_counts[p] == 1);
+	}
+
+	// Any number of samples is spread evenly, no pixel gets more than one sample more than another
+	int regenerated[MAX_WAVEFRONT_ITERATIONS] = { };
+	regenerated[1] = 1234;
+
+	std::vector<int> sample_counts(pixel_count, 0);
+	RegenerationCPU::get_sample_counts(pixel_count, stride, 42, regenerated, sample_counts.data());
+
+	int total = 0;
+	for (int p = 0; p < pixel_count; p++) {
+		CHECK(sample_counts[p] == 1 || sample_counts[p] == 2);
+		total += sample_counts[p];
+	}
+	CHECK(total == regenerated[1]);
+}
+
+static void test_path_seeds() {
+	const int pixel_count = 10000;
+
+	unsigned rand_seed = 1337;
+
+	// Paths of the same pixel that only differ in their start iteration or sample index get different seeds
+	for (int p = 0; p < 16; p++) {
+		std::unordered_set<unsigned> seeds;
+
+		for (int path_start = 0; path_start <= PATH_REGENERATION_ITERATIONS; path_start++) {
+			for (int sample_index = 0; sample_index < 64; sample_index++) {
+				seeds.insert(Regeneration::get_path_seed(p, path_start, sample_index, rand_seed));
+			}
+		}
+		CHECK(seeds.size() == size_t(PATH_REGENERATION_ITERATIONS + 1) * 64);
+	}
+
+	// The random numbers of such paths are uncorrelated. With 10000 pixels the standard error of the correlation is 0.01
+	auto get_correlation = [&](int path_start_a, int sample_index_a, int path_start_b, int sample_index_b) {
+		double sum_a = 0.0, sum_b = 0.0, sum_aa = 0.0, sum_bb = 0.0, sum_ab = 0.0;
+
+		for (int p = 0; p < pixel_count; p++) {
+			unsigned seed_a = Regeneration::get_path_seed(p, path_start_a, sample_index_a, rand_seed);
+			unsigned seed_b = Regeneration::get_path_seed(p, path_start_b, sample_index_b, rand_seed);
+
+			double a = random_float_xorshift(seed_a);
+			double b = random_float_xorshift(seed_b);
+
+			sum_a  += a;
+			sum_b  += b;
+			sum_aa += a * a;
+			sum_bb += b * b;
+			sum_ab += a * b;
+		}
+
+		double n = double(pixel_count);
+		double covariance = sum_ab / n - (sum_a / n) * (sum_b / n);
+		double variance_a = sum_aa / n - (sum_a / n) * (sum_a / n);
+		double variance_b = sum_bb / n - (sum_b / n) * (sum_b / n);
+
+		return covariance / sqrt(variance_a * variance_b);
+	};
+
+	for (int path_start = 1; path_start <= PATH_REGENERATION_ITERATIONS; path_start++) {
+		CHECK_LESS_EQUAL(fabs(get_correlation(0, 0, path_start, 0)), 0.05);
+	}
+	for (int sample_index = 1; sample_index < 8; sample_index++) {
+		CHECK_LESS_EQUAL(fabs(get_correlation(0, 0, 0, sample_index)), 0.05);
+		CHECK_LESS_EQUAL(fabs(get_correlation(1, 0, 1, sample_index)), 0.05);
+	}
+}
+
+static void test_sample_index() {
+	// The first path of a pixel keeps its place in the blue noise sequence, regenerated paths index past its 256 samples
+	for (int sample_index = 0; sample_index < 256; sample_index++) {
+		CHECK(Regeneration::get_sample_index(sample_index, 0) == sample_index);
+
+		for (int path_start = 1; path_start <= PATH_REGENERATION_ITERATIONS; path_start++) {
+			CHECK(Regeneration::get_sample_index(sample_index, path_start) >= 256);
+		}
+	}
+}
+
+static void test_unbiased() {
+	// The errors are in standard errors. The mean error is a single normal variate, the max error the largest of 4096 of them
+	for (unsigned seed : { 1337u, 42u, 7u }) {
+		RegenerationCPU::Validation validation = RegenerationCPU::validate(64 * 64, 1024, seed);
+
+		printf("    seed %u: %.2f spp, analytic %.2f max %.2f mean, reference %.2f max %.2f mean\n", seed,
+			validation.samples_per_pixel,
+			validation.max_error,           validation.mean_error,
+			validation.reference_max_error, validation.reference_mean_error
+		);
+
+		// Regeneration has to add samples, otherwise the comparison below is trivial
+		CHECK(validation.samples_per_pixel > 1.1f);
+
+		CHECK_LESS_EQUAL(validation.mean_error,           4.0f);
+		CHECK_LESS_EQUAL(validation.max_error,            5.5f);
+		CHECK_LESS_EQUAL(validation.reference_mean_error, 4.0f);
+		CHECK_LESS_EQUAL(validation.reference_max_error,  5.5f);
+
+		// Regeneration keeps the later iterations of the queue fuller than without it
+		CHECK(validation.occupancy[PATH_REGENERATION_ITERATIONS] > validation.occupancy_no_regeneration[PATH_REGENERATION_ITERATIONS]);
+	}
+}
+
+int main() {
+	test_sample_counts();
+	test_path_seeds();
+	test_sample_index();
+	test_unbiased();
+
+	return Test::report("Regeneration");
+}
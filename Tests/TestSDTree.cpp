@@ -0,0 +1,316 @@
+#include "Test.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "SDTree.h"
+
+static AABB get_bounds() {
+	AABB bounds;
+	bounds.min = Vector3(-1.0f);
+	bounds.max = Vector3(+1.0f);
+
+	return bounds;
+}
+
+static void random_position(float position[3]) {
+	for (int dimension = 0; dimension < 3; dimension++) position[dimension] = 2.0f * Test::random_float() - 1.0f;
+}
+
+static void random_direction(float direction[3]) {
+	PathGuiding::square_to_direction(Test::random_float(), Test::random_float(), direction);
+}
+
+// Incident radiance with a bright cone whose axis depends on the octant of the position, so that the tree has something to learn
+static float get_radiance(const float position[3], const float direction[3]) {
+	float cos_theta = 0.0f;
+	for (int dimension = 0; dimension < 3; dimension++) {
+		cos_theta += (position[dimension] >= 0.0f ? direction[dimension] : -direction[dimension]) * 0.57735026919f;
+	}
+
+	return cos_theta > 0.9f ? 100.0f : 1.0f;
+}
+
+// Records 'sample_count' uniformly sampled directions per frame and refines the tree whenever its schedule says so
+static void train(SDTree & tree, int iteration_count, int sample_count) {
+	while (tree.iteration < iteration_count) {
+		for (int s = 0; s < sample_count; s++) {
+			PathGuiding::Sample sample = { };
+			random_position (sample.position);
+			random_direction(sample.direction);
+
+			sample.radiance = get_radiance(sample.position, sample.direction) / ONE_OVER_FOUR_PI;
+
+			tree.record(sample);
+		}
+
+		if (tree.frame_done()) tree.refine();
+	}
+}
+
+// Calls visit(node, quadrant, u, v, size) for every cell of the quadtree on which the pdf is constant: the quadrants without a child,
+// and the whole cell of a node without energy. The cell covers [u, u + size) x [v, v + size) of the unit square, 'quadrant' is -1 for a whole node
+template<typename Visit>
+static void visit_cells(const std::vector<PathGuiding::DirectionalNode> & nodes, int node, float u, float v, float size, Visit visit) {
+	if (PathGuiding::get_total(nodes[node]) <= 0.0f) {
+		visit(node, -1, u, v, size);
+		return;
+	}
+
+	float half = 0.5f * size;
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		float quadrant_u = u + float(quadrant & 1)  * half;
+		float quadrant_v = v + float(quadrant >> 1) * half;
+
+		int child = nodes[node].child[quadrant];
+		if (child != 0) {
+			visit_cells(nodes, child, quadrant_u, quadrant_v, half, visit);
+		} else {
+			visit(node, quadrant, quadrant_u, quadrant_v, half);
+		}
+	}
+}
+
+// Probability of a cell with constant pdf. The mapping to the square preserves area, so the square covers a solid angle of 4 pi
+static double get_cell_mass(const SDTree & tree, int root, float u, float v, float size) {
+	float direction[3];
+	PathGuiding::square_to_direction(u + 0.5f * size, v + 0.5f * size, direction);
+
+	return double(PathGuiding::pdf(tree.directional_nodes.data(), root, direction)) * double(size) * double(size) * 4.0 * PI;
+}
+
+static void test_schedule() {
+	SDTree tree;
+	tree.init(get_bounds());
+
+	// Iteration k is refined after 2^k frames, up to 2^PATH_GUIDING_MAX_ITERATION frames
+	int frame_refined = 0;
+	int frame         = 0;
+
+	for (int iteration = 0; iteration < PATH_GUIDING_MAX_ITERATION + 3; iteration++) {
+		int iteration_length = 1 << (iteration < PATH_GUIDING_MAX_ITERATION ? iteration : PATH_GUIDING_MAX_ITERATION);
+
+		CHECK(tree.get_iteration_length() == iteration_length);
+
+		while (!tree.frame_done()) frame++;
+		frame++;
+
+		CHECK(frame - frame_refined == iteration_length);
+		CHECK(tree.frame == 0);
+
+		tree.refine();
+		CHECK(tree.iteration == iteration + 1);
+
+		frame_refined = frame;
+	}
+}
+
+static void test_pdf_integral() {
+	SDTree tree;
+	tree.init(get_bounds());
+
+	train(tree, 4, 50000);
+
+	int leaf_count = 0;
+
+	for (const PathGuiding::SpatialNode & node : tree.spatial_nodes) {
+		if (node.child != 0) continue;
+
+		leaf_count++;
+
+		// The pdf is constant on every cell of the quadtree, so summing over the cells integrates it exactly
+		double integral = 0.0;
+		visit_cells(tree.directional_nodes, node.dtree, 0.0f, 0.0f, 1.0f, [&](int, int, float u, float v, float size) {
+			integral += get_cell_mass(tree, node.dtree, u, v, size);
+		});
+
+		CHECK_LESS_EQUAL(fabs(integral - 1.0), 1e-4);
+	}
+
+	// The tree has to be refined in space and direction, otherwise the checks are trivial
+	CHECK(leaf_count > 1);
+	CHECK(tree.directional_nodes.size() > size_t(leaf_count));
+}
+
+static void test_sample_matches_pdf() {
+	SDTree tree;
+	tree.init(get_bounds());
+
+	train(tree, 4, 50000);
+
+	float position[3] = { 0.3f, 0.6f, 0.2f };
+
+	float p[3];
+	for (int dimension = 0; dimension < 3; dimension++) p[dimension] = (position[dimension] - tree.bounds_min[dimension]) * tree.bounds_inv_extent[dimension];
+
+	int root = PathGuiding::find_dtree(tree.spatial_nodes.data(), p);
+
+	// Expected number of samples in every cell of a histogram over the square, cells of the quadtree that are larger than a bin spread over several bins
+	const int histogram_depth   = 4;
+	const int histogram_size    = 1 << histogram_depth;
+	const int histogram_samples = 1 << 20;
+
+	std::vector<double> expected(histogram_size * histogram_size, 0.0);
+
+	visit_cells(tree.directional_nodes, root, 0.0f, 0.0f, 1.0f, [&](int, int, float u, float v, float size) {
+		double mass = get_cell_mass(tree, root, u, v, size);
+
+		int bin_count = size * histogram_size > 1.0f ? int(size * histogram_size) : 1;
+		int bin_u     = int(u * histogram_size);
+		int bin_v     = int(v * histogram_size);
+
+		for (int j = 0; j < bin_count; j++) {
+			for (int i = 0; i < bin_count; i++) {
+				expected[(bin_u + i) + (bin_v + j) * histogram_size] += double(histogram_samples) * mass / double(bin_count * bin_count);
+			}
+		}
+	});
+
+	std::vector<int> histogram(histogram_size * histogram_size, 0);
+
+	int zero_pdf_count = 0;
+
+	for (int s = 0; s < histogram_samples; s++) {
+		float direction[3];
+		tree.sample(position, Test::random_float(), Test::random_float(), direction);
+
+		// Sampled directions always have a positive pdf
+		if (tree.pdf(position, direction) <= 0.0f) zero_pdf_count++;
+
+		float u, v;
+		PathGuiding::direction_to_square(direction, u, v);
+
+		histogram[int(u * histogram_size) + int(v * histogram_size) * histogram_size]++;
+	}
+
+	CHECK(zero_pdf_count == 0);
+
+	// The largest deviation of 256 bins is typically about 3 standard errors
+	float error_max = 0.0f;
+
+	for (int i = 0; i < histogram_size * histogram_size; i++) {
+		if (expected[i] < 1.0) {
+			CHECK(histogram[i] <= 5);
+			continue;
+		}
+		error_max = fmaxf(error_max, float(fabs(double(histogram[i]) - expected[i]) / sqrt(expected[i])));
+	}
+
+	CHECK_LESS_EQUAL(error_max, 5.0f);
+}
+
+// Checks that every quadrant with a child holds exactly the energy of that child, returns the total energy of the quadtree
+static double check_quadtree_energy(const SDTree & tree, int node) {
+	const PathGuiding::DirectionalNode & directional_node = tree.directional_nodes[node];
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		int child = directional_node.child[quadrant];
+		if (child == 0) continue;
+
+		double sum   = directional_node.sum[quadrant];
+		double total = check_quadtree_energy(tree, child);
+
+		CHECK_LESS_EQUAL(fabs(total - sum), 1e-4 * sum);
+	}
+
+	return PathGuiding::get_total(directional_node);
+}
+
+static void test_spatial_split_keeps_energy() {
+	SDTree tree;
+	tree.init(get_bounds());
+
+	// Enough samples to split the root three times at the threshold of the first iteration
+	int sample_count = 4 * PATH_GUIDING_SPATIAL_THRESHOLD + 1000;
+
+	double energy = 0.0;
+
+	for (int s = 0; s < sample_count; s++) {
+		PathGuiding::Sample sample = { };
+		random_position (sample.position);
+		random_direction(sample.direction);
+
+		sample.radiance = get_radiance(sample.position, sample.direction);
+		energy += sample.radiance;
+
+		tree.record(sample);
+	}
+
+	CHECK(tree.frame_done());
+	tree.refine();
+
+	// Every leaf starts out with a copy of the quadtree of the leaf it was split from, with all of its energy
+	int leaf_count = 0;
+
+	for (const PathGuiding::SpatialNode & node : tree.spatial_nodes) {
+		if (node.child != 0) continue;
+
+		leaf_count++;
+
+		double leaf_energy = check_quadtree_energy(tree, node.dtree);
+		CHECK_LESS_EQUAL(fabs(leaf_energy - energy), 1e-4 * energy);
+	}
+
+	CHECK(leaf_count == 8);
+}
+
+static void test_directional_split_keeps_energy() {
+	SDTree tree;
+	tree.init(get_bounds());
+
+	// Few enough samples that the tree is not split in space, all samples share one position so the quadtree becomes deep
+	int sample_count = PATH_GUIDING_SPATIAL_THRESHOLD / 2;
+
+	float position[3] = { 0.5f, 0.5f, 0.5f };
+
+	for (int iteration = 0; iteration < 3; iteration++) {
+		double energy = 0.0;
+
+		for (int s = 0; s < sample_count; s++) {
+			PathGuiding::Sample sample = { };
+			memcpy(sample.position, position, sizeof(position));
+			random_direction(sample.direction);
+
+			sample.radiance = get_radiance(sample.position, sample.direction);
+			energy += sample.radiance;
+
+			tree.record(sample);
+		}
+
+		// The samples of the whole iteration are recorded in its first frame
+		while (!tree.frame_done()) { }
+		tree.refine();
+
+		CHECK(tree.spatial_nodes.size() == 1);
+
+		// The sampling quadtree is the building quadtree of the iteration that just ended, every level holds all of the recorded energy
+		double tree_energy = check_quadtree_energy(tree, tree.spatial_nodes[0].dtree);
+		CHECK_LESS_EQUAL(fabs(tree_energy - energy), 1e-4 * energy);
+	}
+
+	CHECK(tree.directional_nodes.size() > 1);
+}
+
+static void test_training() {
+	// Guided samples have a lower variance than uniform samples once the tree has been trained
+	SDTree::Validation validation = SDTree::validate(PATH_GUIDING_MAX_ITERATION, 1337);
+
+	printf("    %i spatial leaves, %i directional nodes, variance ratio %.3f\n", validation.spatial_leaves, validation.directional_nodes, validation.variance_ratio);
+
+	CHECK_LESS_EQUAL(validation.pdf_integral_error, 1e-3f);
+	CHECK_LESS_EQUAL(validation.sample_error,       5.0f);
+	CHECK_LESS_EQUAL(validation.variance_ratio,     0.9f);
+}
+
+int main() {
+	test_schedule();
+	test_pdf_integral();
+	test_sample_matches_pdf();
+	test_spatial_split_keeps_energy();
+	test_directional_split_keeps_energy();
+	test_training();
+
+	return Test::report("SDTree");
+}
@@ -0,0 +1,259 @@
+#include "Test.h"
+
+#include <cmath>
+#include <vector>
+
+#include "TextureCPU.h"
+#include "MathSoA.h"
+
+#include "Math.h"
+#include "Util.h"
+
+#include "CUDA_Source/Common.h"
+
+// Counts around multiples of the SIMD width, so that both the full blocks and the remainder are covered
+static const int counts[] = { 1, 2, SOA_WIDTH - 1, SOA_WIDTH, SOA_WIDTH + 1, 3 * SOA_WIDTH + 5, 1000 };
+
+// Not square, so that wrapping in s and t can not be mixed up
+static constexpr int WIDTH  = 64;
+static constexpr int HEIGHT = 32;
+
+static float random_range(float min, float max) {
+	return min + (max - min) * Test::random_float();
+}
+
+// RGBA float Texture with a full Mip chain down to a single texel
+static Texture create_texture_rgba() {
+	int mip_levels = 1 + int(log2f(float(Math::max(WIDTH, HEIGHT))));
+
+	int texel_count = 0;
+	for (int l = 0; l < mip_levels; l++) texel_count += Math::max(WIDTH >> l, 1) * Math::max(HEIGHT >> l, 1);
+
+	Vector4 * data        = new Vector4[texel_count];
+	int     * mip_offsets = new int[mip_levels];
+
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		data[i] = Vector4(Test::random_float(), Test::random_float(), Test::random_float(), Test::random_float());
+	}
+
+	std::vector<Vector4> temp(WIDTH * HEIGHT);
+
+	int offset = 0;
+
+	for (int l = 0; l < mip_levels; l++) {
+		mip_offsets[l] = offset * sizeof(Vector4);
+
+		int width_dst  = Math::max(WIDTH  >> l, 1);
+		int height_dst = Math::max(HEIGHT >> l, 1);
+
+		if (l > 0) {
+			int width_src  = Math::max(WIDTH  >> (l - 1), 1);
+			int height_src = Math::max(HEIGHT >> (l - 1), 1);
+
+			Texture::downsample(MIPMAP_DOWNSAMPLE_FILTER_BOX, width_src, height_src, width_dst, height_dst, data + offset - width_src * height_src, data + offset, temp.data());
+		}
+
+		offset += width_dst * height_dst;
+	}
+
+	Texture texture;
+	texture.data        = reinterpret_cast<const unsigned char *>(data);
+	texture.format      = Texture::Format::RGBA;
+	texture.channels    = 4;
+	texture.width       = WIDTH;
+	texture.height      = HEIGHT;
+	texture.mip_levels  = mip_levels;
+	texture.mip_offsets = mip_offsets;
+
+	return texture;
+}
+
+// BC Texture with random blocks and a full Mip chain down to a single block, the width and height are stored in blocks
+static Texture create_texture_bc(Texture::Format format) {
+	int block_size = format == Texture::Format::BC1 ? 8 : 16;
+	int blocks_x   = WIDTH  / 4;
+	int blocks_y   = HEIGHT / 4;
+	int mip_levels = 1 + int(log2f(float(Math::max(blocks_x, blocks_y))));
+
+	int * mip_offsets = new int[mip_levels];
+
+	int byte_count = 0;
+	for (int l = 0; l < mip_levels; l++) {
+		mip_offsets[l] = byte_count;
+
+		byte_count += block_size * Math::max(blocks_x >> l, 1) * Math::max(blocks_y >> l, 1);
+	}
+
+	unsigned char * data = new unsigned char[byte_count];
+	for (int i = 0; i < byte_count; i++) data[i] = (unsigned char)(Test::random_float() * 256.0f);
+
+	Texture texture;
+	texture.data        = data;
+	texture.format      = format;
+	texture.channels    = format == Texture::Format::BC1 ? 2 : 4;
+	texture.width       = blocks_x;
+	texture.height      = blocks_y;
+	texture.mip_levels  = mip_levels;
+	texture.mip_offsets = mip_offsets;
+
+	return texture;
+}
+
+// Coordinates on the edges of the Texture and on texel boundaries, outside of [0, 1) so that they wrap, and random ones
+static float get_coordinate(int i, int size) {
+	const float edges[] = { 0.0f, 1.0f, -1.0f, 2.0f, -0.0f, 1.0f - 1e-7f, -1e-7f, 0.5f / float(size), 1.0f - 0.5f / float(size), 3.0f / float(size) };
+
+	if (i % 3 == 0) return edges[(i / 3) % Util::array_element_count(edges)];
+
+	return random_range(-3.0f, 3.0f);
+}
+
+// Negative LODs and LODs past the last Mip level are clamped
+static float get_lod(int i, int mip_levels) {
+	const float lods[] = { -1.0f, 0.0f, 0.5f, float(mip_levels - 1), float(mip_levels), 100.0f };
+
+	if (i % 4 == 0) return lods[(i / 4) % Util::array_element_count(lods)];
+
+	return random_range(0.0f, float(mip_levels));
+}
+
+static bool equal(const Vector4 & a, const Vector4 & b) {
+	return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+static void test_batch_lod(const Texture & texture) {
+	for (int count : counts) {
+		// One element of padding in front makes the inputs and outputs unaligned
+		std::vector<float> s(count + 1), t(count + 1), lod(count + 1);
+
+		for (int i = 0; i < count; i++) {
+			s  [i + 1] = get_coordinate(i,     WIDTH);
+			t  [i + 1] = get_coordinate(i + 1, HEIGHT);
+			lod[i + 1] = get_lod(i, texture.mip_levels);
+		}
+
+		// One element past the end checks that the remainder does not write a full block
+		std::vector<Vector4> result(count + 2, Vector4(-1.0f));
+		TextureCPU::get_lod_batch(texture, count, s.data() + 1, t.data() + 1, lod.data() + 1, result.data() + 1);
+
+		CHECK(equal(result[0],         Vector4(-1.0f)));
+		CHECK(equal(result[count + 1], Vector4(-1.0f)));
+
+		for (int i = 0; i < count; i++) {
+			CHECK(equal(result[i + 1], TextureCPU::get_lod(texture, s[i + 1], t[i + 1], lod[i + 1])));
+		}
+	}
+}
+
+static void test_batch_grad(const Texture & texture) {
+	for (int count : counts) {
+		std::vector<float> s(count + 1), t(count + 1);
+		std::vector<float> dsdx(count + 1), dtdx(count + 1), dsdy(count + 1), dtdy(count + 1);
+
+		for (int i = 0; i < count; i++) {
+			s[i + 1] = get_coordinate(i,     WIDTH);
+			t[i + 1] = get_coordinate(i + 1, HEIGHT);
+
+			// Isotropic, anisotropic beyond TEXTURE_CPU_MAX_ANISOTROPY, zero and larger than the whole Texture
+			float angle = random_range(0.0f, 6.28318530718f);
+			float major, minor;
+			switch (i % 4) {
+				case 0:  major = minor = random_range(0.5f, 4.0f); break;
+				case 1:  major = random_range(1.0f, 32.0f); minor = random_range(0.5f, 2.0f); break;
+				case 2:  major = minor = 0.0f; break;
+				default: major = 2.0f * float(WIDTH); minor = float(HEIGHT); break;
+			}
+			major /= float(WIDTH);
+			minor /= float(WIDTH);
+
+			dsdx[i + 1] =  major * cosf(angle);
+			dtdx[i + 1] =  major * sinf(angle);
+			dsdy[i + 1] = -minor * sinf(angle);
+			dtdy[i + 1] =  minor * cosf(angle);
+		}
+
+		std::vector<Vector4> result(count + 2, Vector4(-1.0f));
+		TextureCPU::get_grad_batch(texture, count, s.data() + 1, t.data() + 1, dsdx.data() + 1, dtdx.data() + 1, dsdy.data() + 1, dtdy.data() + 1, result.data() + 1);
+
+		CHECK(equal(result[0],         Vector4(-1.0f)));
+		CHECK(equal(result[count + 1], Vector4(-1.0f)));
+
+		for (int i = 0; i < count; i++) {
+			CHECK(equal(result[i + 1], TextureCPU::get_grad(texture, s[i + 1], t[i + 1], dsdx[i + 1], dtdx[i + 1], dsdy[i + 1], dtdy[i + 1])));
+		}
+	}
+}
+
+static Vector4 get_texel(const Texture & texture, int x, int y) {
+	return reinterpret_cast<const Vector4 *>(texture.data)[x + y * texture.width];
+}
+
+static bool approx_equal(const Vector4 & a, const Vector4 & b) {
+	return fabsf(a.x - b.x) <= 1e-6f && fabsf(a.y - b.y) <= 1e-6f && fabsf(a.z - b.z) <= 1e-6f && fabsf(a.w - b.w) <= 1e-6f;
+}
+
+static void test_wrap() {
+	// The single lookups themselves, on the finest Mip level of an RGBA Texture where the texels can be read directly
+	Texture texture = create_texture_rgba();
+
+	for (int y = 0; y < HEIGHT; y += 7) {
+		for (int x = 0; x < WIDTH; x += 5) {
+			float s = (float(x) + 0.5f) / float(WIDTH);
+			float t = (float(y) + 0.5f) / float(HEIGHT);
+
+			// Texel centers return the texel, also one period away in either direction
+			CHECK(approx_equal(TextureCPU::get_lod(texture, s,        t,        0.0f), get_texel(texture, x, y)));
+			CHECK(approx_equal(TextureCPU::get_lod(texture, s + 1.0f, t - 1.0f, 0.0f), get_texel(texture, x, y)));
+			CHECK(approx_equal(TextureCPU::get_lod(texture, s - 2.0f, t + 2.0f, -1.0f), get_texel(texture, x, y)));
+		}
+	}
+
+	// The edge of the Texture lies between the last and the first texel
+	for (int y = 0; y < HEIGHT; y += 3) {
+		float t = (float(y) + 0.5f) / float(HEIGHT);
+
+		Vector4 expected = 0.5f * (get_texel(texture, WIDTH - 1, y) + get_texel(texture, 0, y));
+
+		CHECK(approx_equal(TextureCPU::get_lod(texture, 0.0f, t, 0.0f), expected));
+		CHECK(approx_equal(TextureCPU::get_lod(texture, 1.0f, t, 0.0f), expected));
+	}
+	for (int x = 0; x < WIDTH; x += 3) {
+		float s = (float(x) + 0.5f) / float(WIDTH);
+
+		Vector4 expected = 0.5f * (get_texel(texture, x, HEIGHT - 1) + get_texel(texture, x, 0));
+
+		CHECK(approx_equal(TextureCPU::get_lod(texture, s, 0.0f, 0.0f), expected));
+	}
+
+	// LODs past the last Mip level return the single texel of the last level everywhere
+	Vector4 texel_last = *reinterpret_cast<const Vector4 *>(texture.data + texture.mip_offsets[texture.mip_levels - 1]);
+	CHECK(approx_equal(TextureCPU::get_lod(texture, 0.3f, 0.7f, 100.0f), texel_last));
+
+	texture.free();
+}
+
+int main() {
+	printf("    SOA_WIDTH = %i\n", SOA_WIDTH);
+
+	test_wrap();
+
+	Texture texture_rgba  = create_texture_rgba();
+	Texture texture_rgba8 = TextureCPU::convert_to_rgba8(texture_rgba);
+	Texture texture_bc1   = create_texture_bc(Texture::Format::BC1);
+	Texture texture_bc2   = create_texture_bc(Texture::Format::BC2);
+	Texture texture_bc3   = create_texture_bc(Texture::Format::BC3);
+
+	// The batched lookups do the same arithmetic per lane as the single lookups, so the results are bit-identical
+	for (const Texture * texture : { &texture_rgba, &texture_rgba8, &texture_bc1, &texture_bc2, &texture_bc3 }) {
+		test_batch_lod (*texture);
+		test_batch_grad(*texture);
+	}
+
+	texture_rgba .free();
+	texture_rgba8.free();
+	texture_bc1  .free();
+	texture_bc2  .free();
+	texture_bc3  .free();
+
+	return Test::report("TextureCPU");
+}
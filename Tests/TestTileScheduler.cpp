@@ -0,0 +1,169 @@
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "TileScheduler.h"
+
+#include "CUDA_Source/Common.h"
+
+static const int orders[] = { TILE_ORDER_SCANLINE, TILE_ORDER_MORTON, TILE_ORDER_HILBERT };
+
+static void test_coverage() {
+	// Image sizes that are not a multiple of the tile size leave smaller tiles along the right and bottom edge
+	struct { int width, height, tile_size; } sizes[] = {
+		{ 256, 256, 32 },
+		{ 1000, 700, 64 },
+		{ 33, 17, 16 },
+		{ 10, 10, 64 }
+	};
+
+	for (const auto & size : sizes) {
+		for (int order : orders) {
+			TileScheduler scheduler;
+			scheduler.init(size.width, size.height, size.tile_size, order);
+
+			CHECK(int(scheduler.tiles.size()) == scheduler.tile_count_x * scheduler.tile_count_y);
+
+			// Every pixel is covered by exactly one tile
+			std::vector<int> coverage(size.width * size.height, 0);
+
+			for (const TileScheduler::Tile & tile : scheduler.tiles) {
+				CHECK(tile.width > 0 && tile.width <= size.tile_size);
+				CHECK(tile.height > 0 && tile.height <= size.tile_size);
+				CHECK(tile.x + tile.width <= size.width && tile.y + tile.height <= size.height);
+
+				for (int y = tile.y; y < tile.y + tile.height; y++) {
+					for (int x = tile.x; x < tile.x + tile.width; x++) {
+						coverage[x + y * size.width]++;
+					}
+				}
+			}
+
+			for (int count : coverage) {
+				CHECK(count == 1);
+			}
+		}
+	}
+}
+
+static void test_curves() {
+	// On a power of two sized square grid consecutive tiles along the Hilbert curve are neighbours
+	for (int tile_count : { 1, 2, 4, 16, 64 }) {
+		TileScheduler scheduler;
+		scheduler.init(tile_count * 8, tile_count * 8, 8, TILE_ORDER_HILBERT);
+
+		for (int i = 1; i < int(scheduler.tiles.size()); i++) {
+			const TileScheduler::Tile & a = scheduler.tiles[i - 1];
+			const TileScheduler::Tile & b = scheduler.tiles[i];
+
+			int distance = abs(a.x - b.x) / 8 + abs(a.y - b.y) / 8;
+			CHECK(distance == 1);
+		}
+	}
+
+	// Every aligned run of 4^k tiles along the Morton curve fills a square of 2^k x 2^k tiles
+	TileScheduler scheduler;
+	scheduler.init(256, 256, 16, TILE_ORDER_MORTON);
+
+	for (int run = 4; run <= int(scheduler.tiles.size()); run *= 4) {
+		int extent = 16;
+		while (extent * extent < run * 16 * 16) extent *= 2;
+
+		for (int first = 0; first < int(scheduler.tiles.size()); first += run) {
+			int x_min = scheduler.tiles[first].x;
+			int y_min = scheduler.tiles[first].y;
+
+			CHECK(x_min % extent == 0 && y_min % extent == 0);
+
+			for (int i = first; i < first + run; i++) {
+				CHECK(scheduler.tiles[i].x >= x_min && scheduler.tiles[i].x < x_min + extent);
+				CHECK(scheduler.tiles[i].y >= y_min && scheduler.tiles[i].y < y_min + extent);
+			}
+		}
+	}
+
+	// Scanline order goes row by row
+	scheduler.init(100, 50, 16, TILE_ORDER_SCANLINE);
+	for (int i = 0; i < int(scheduler.tiles.size()); i++) {
+		CHECK(scheduler.tiles[i].x == (i % scheduler.tile_count_x) * 16);
+		CHECK(scheduler.tiles[i].y == (i / scheduler.tile_count_x) * 16);
+	}
+}
+
+// Runs the scheduler and checks that every tile was handed out exactly once. If 'slow_thread' is given,
+// its tiles take longer so that the other threads run out of work and have to steal from it
+static void run(TileScheduler & scheduler, ThreadPool & thread_pool, const int * thread_nodes, int slow_thread) {
+	int tile_count = int(scheduler.tiles.size());
+
+	std::vector<std::atomic<int>> counts (tile_count);
+	std::vector<std::atomic<int>> threads(tile_count);
+	for (int i = 0; i < tile_count; i++) {
+		counts [i] = 0;
+		threads[i] = -1;
+	}
+
+	scheduler.run(thread_pool, [&](const TileScheduler::Tile & tile, int thread_index) {
+		int index = int(&tile - scheduler.tiles.data());
+
+		counts [index]++;
+		threads[index] = thread_index;
+
+		if (thread_index == slow_thread) std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}, thread_nodes);
+
+	for (int i = 0; i < tile_count; i++) {
+		CHECK(counts[i] == 1);
+		CHECK(threads[i] >= 0 && threads[i] < thread_pool.thread_count);
+	}
+
+	CHECK(scheduler.tiles_stolen >= 0 && scheduler.tiles_stolen <= tile_count);
+}
+
+static void test_run() {
+	const int thread_counts[] = { 1, 2, 4, 7 };
+
+	for (int thread_count : thread_counts) {
+		ThreadPool thread_pool;
+		thread_pool.init(thread_count);
+
+		// Fewer tiles than threads, a tile count that does not divide evenly and many tiles
+		for (int tile_count_x : { 1, 3, 13, 40 }) {
+			for (int order : orders) {
+				TileScheduler scheduler;
+				scheduler.init(tile_count_x * 16, 16 * 16, 16, order);
+
+				for (int repeat = 0; repeat < 10; repeat++) {
+					run(scheduler, thread_pool, nullptr, -1);
+				}
+			}
+		}
+
+		// The slow thread has its tiles stolen, both with and without NUMA nodes
+		if (thread_count > 1) {
+			std::vector<int> thread_nodes(thread_count);
+			for (int i = 0; i < thread_count; i++) thread_nodes[i] = i % 2;
+
+			TileScheduler scheduler;
+			scheduler.init(640, 640, 16, TILE_ORDER_HILBERT);
+
+			run(scheduler, thread_pool, nullptr, 0);
+			CHECK(scheduler.tiles_stolen > 0);
+
+			run(scheduler, thread_pool, thread_nodes.data(), 0);
+			CHECK(scheduler.tiles_stolen > 0);
+		}
+
+		thread_pool.free();
+	}
+}
+
+int main() {
+	test_coverage();
+	test_curves();
+	test_run();
+
+	return Test::report("TileScheduler");
+}
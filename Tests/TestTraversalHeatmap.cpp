@@ -0,0 +1,83 @@
+#include "Test.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "TraversalHeatmap.h"
+
+static const char * FILE_PATH = "TestTraversalHeatmap.ppm";
+
+// Reads back a binary PPM as written by Util::export_ppm, returns an empty vector if the header does not match
+static std::vector<unsigned char> read_ppm(const char * file_path, int width, int height) {
+	FILE * file = fopen(file_path, "rb");
+	if (!file) return { };
+
+	int file_width, file_height, file_max;
+	bool header_valid = fscanf(file, "P6 %d %d %d", &file_width, &file_height, &file_max) == 3 && fgetc(file) == '\n';
+
+	std::vector<unsigned char> data;
+
+	if (header_valid && file_width == width && file_height == height && file_max == 255) {
+		data.resize(width * height * 3);
+		if (fread(data.data(), 1, data.size(), file) != data.size()) data.clear();
+	}
+
+	fclose(file);
+
+	return data;
+}
+
+static void test_export_ppm() {
+	// Some pixels without cost, a linear ramp of costs and a single outlier that lies above the 99th percentile
+	const int width  = 101;
+	const int height = 1;
+
+	std::vector<float> values(width * height);
+	for (int i = 0; i < 10; i++) values[i] = 0.0f;
+	for (int i = 10; i < 100; i++) values[i] = float(i - 9);
+	values[100] = 10000.0f;
+
+	TraversalHeatmap::export_ppm(FILE_PATH, width, height, values.data());
+
+	std::vector<unsigned char> data = read_ppm(FILE_PATH, width, height);
+	CHECK(data.size() == size_t(width * height * 3));
+
+	if (data.size() == size_t(width * height * 3)) {
+		auto get = [&](int i, int c) { return int(data[3 * i + c]); };
+
+		// No cost stays black
+		for (int i = 0; i < 10; i++) {
+			CHECK(get(i, 0) == 0 && get(i, 1) == 0 && get(i, 2) == 0);
+		}
+
+		// The cheapest pixel is nearly pure blue, the 99th percentile and the outlier are pure red
+		CHECK(get(10, 0) == 0 && get(10, 1) < 32 && get(10, 2) == 255);
+		CHECK(get(99,  0) == 255 && get(99,  1) == 0 && get(99,  2) == 0);
+		CHECK(get(100, 0) == 255 && get(100, 1) == 0 && get(100, 2) == 0);
+
+		// Along the ramp red only increases and blue only decreases
+		for (int i = 11; i < width; i++) {
+			CHECK(get(i, 0) >= get(i - 1, 0));
+			CHECK(get(i, 2) <= get(i - 1, 2));
+		}
+	}
+
+	// An image without any cost is black
+	std::vector<float> zeros(width * height, 0.0f);
+	TraversalHeatmap::export_ppm(FILE_PATH, width, height, zeros.data());
+
+	data = read_ppm(FILE_PATH, width, height);
+	CHECK(data.size() == size_t(width * height * 3));
+
+	for (unsigned char value : data) {
+		CHECK(value == 0);
+	}
+
+	remove(FILE_PATH);
+}
+
+int main() {
+	test_export_ppm();
+
+	return Test::report("TraversalHeatmap");
+}
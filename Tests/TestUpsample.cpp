@@ -0,0 +1,133 @@
+#include "Test.h"
+
+#include <cmath>
+#include <vector>
+
+#include "UpsampleCPU.h"
+
+#include "CUDA_Source/Upsample.h"
+
+static constexpr int WIDTH  = 96;
+static constexpr int HEIGHT = 64;
+static constexpr int PITCH  = 100; // Padded like the Device buffers
+
+// Every pixel must be the source of its block exactly once per factor^2 frames
+static void test_source_coverage(int factor) {
+	std::vector<int> counts(WIDTH * HEIGHT, 0);
+
+	for (int frame = 0; frame < factor * factor; frame++) {
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				if (Upsample::is_source(x, y, factor, frame)) counts[x + y * WIDTH]++;
+			}
+		}
+	}
+
+	int wrong_count = 0;
+	for (int count : counts) {
+		if (count != 1) wrong_count++;
+	}
+	CHECK(wrong_count == 0);
+}
+
+// Two surfaces meet at x = WIDTH / 2: a plane facing the Camera on the left, and a brightly lit plane
+// that is further away and perpendicular to it on the right. The lighting on the left plane varies smoothly with
+// the given amplitude. The albedo is a per pixel checkerboard, so that demodulation is required to reconstruct the lighting
+struct Scene {
+	std::vector<float> guide;
+	std::vector<float> albedo;
+	std::vector<float> reference; // Indirect lighting of every pixel
+
+	Scene(float amplitude) : guide(4 * PITCH * HEIGHT, 0.0f), albedo(4 * PITCH * HEIGHT, 0.0f), reference(4 * PITCH * HEIGHT, 0.0f) {
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				int index = 4 * (x + y * PITCH);
+
+				bool  left = x < WIDTH / 2;
+				float irradiance;
+
+				if (left) {
+					guide[index + 0] = 0.0f;
+					guide[index + 1] = 0.0f;
+					guide[index + 2] = 1.0f;
+					guide[index + 3] = 2.0f + 0.01f * float(y);
+
+					irradiance = 1.0f + amplitude * sinf(0.1f * float(x)) * cosf(0.1f * float(y));
+				} else {
+					guide[index + 0] = 1.0f;
+					guide[index + 1] = 0.0f;
+					guide[index + 2] = 0.0f;
+					guide[index + 3] = 6.0f;
+
+					irradiance = 4.0f;
+				}
+
+				float a = (x + y) % 2 == 0 ? 0.2f : 0.8f;
+
+				for (int c = 0; c < 3; c++) {
+					albedo   [index + c] = a;
+					reference[index + c] = a * irradiance * (1.0f + 0.1f * float(c));
+				}
+			}
+		}
+	}
+};
+
+// Only the source pixels of the frame hold indirect lighting, the others have to be reconstructed
+static void test_reconstruction(const Scene & scene, int factor, float mean_error_max, float error_max_max) {
+	for (int frame = 0; frame < factor * factor; frame++) {
+		std::vector<float> indirect(4 * PITCH * HEIGHT, 0.0f);
+
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				if (!Upsample::is_source(x, y, factor, frame)) continue;
+
+				for (int c = 0; c < 4; c++) indirect[4 * (x + y * PITCH) + c] = scene.reference[4 * (x + y * PITCH) + c];
+			}
+		}
+
+		std::vector<float> result(4 * PITCH * HEIGHT);
+		UpsampleCPU::upsample(WIDTH, HEIGHT, PITCH, factor, frame, scene.guide.data(), scene.albedo.data(), indirect.data(), result.data());
+
+		double error_sum = 0.0;
+		float  error_max = 0.0f;
+
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				for (int c = 0; c < 3; c++) {
+					int index = 4 * (x + y * PITCH) + c;
+
+					float error = fabsf(result[index] - scene.reference[index]) / scene.reference[index];
+
+					error_sum += error;
+					if (error > error_max) error_max = error;
+				}
+			}
+		}
+
+		float error_mean = float(error_sum / double(3 * WIDTH * HEIGHT));
+
+		if (frame == 0) printf("    Factor %i: mean relative error %.5f%%, max %.5f%%\n", factor, 100.0f * error_mean, 100.0f * error_max);
+
+		CHECK_LESS_EQUAL(error_mean, mean_error_max);
+		CHECK_LESS_EQUAL(error_max,  error_max_max);
+	}
+}
+
+int main() {
+	test_source_coverage(2);
+	test_source_coverage(4);
+
+	// With constant lighting per surface the reconstruction is exact up to rounding,
+	// any bleeding across the edge would mix in lighting that differs by a factor of 4
+	Scene scene_constant(0.0f);
+	test_reconstruction(scene_constant, 2, 1e-6f, 1e-5f);
+	test_reconstruction(scene_constant, 4, 1e-6f, 1e-5f);
+
+	// Smoothly varying lighting is blurred by the tent filter, more so at lower resolution
+	Scene scene_smooth(0.2f);
+	test_reconstruction(scene_smooth, 2, 0.0015f, 0.04f);
+	test_reconstruction(scene_smooth, 4, 0.006f,  0.08f);
+
+	return Test::report("TestUpsample");
+}
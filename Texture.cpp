@@ -1,5 +1,9 @@
 #include "Texture.h"
 
+#include <cstring>
+#include <cassert>
+#include <atomic>
+#include <string>
 #include <unordered_map>
 #include <ctype.h>
 
@@ -11,8 +15,9 @@
 
 #include "Math.h"
 #include "Vector4.h"
+#include "Util.h"
 
-#include "CUDA_Source\Common.h"
+#include "CUDA_Source/Common.h"
 
 /*
 	Mipmap filter code based on http://number-none.com/product/Mipmapping,%20Part%201/index.html and https://github.com/castano/nvidia-texture-tools
@@ -67,6 +72,7 @@ typedef FilterLanczos Filter;
 typedef FilterKaiser Filter;
 #endif
 
+template<typename Filter>
 static float filter_sample_box(float x, float scale) {
 	constexpr int   SAMPLE_COUNT     = 32;
 	constexpr float SAMPLE_COUNT_INV = 1.0f / float(SAMPLE_COUNT);
@@ -83,6 +89,7 @@ static float filter_sample_box(float x, float scale) {
 	return sum * SAMPLE_COUNT_INV;
 }
 
+template<typename Filter>
 static void downsample(int width_src, int height_src, int width_dst, int height_dst, const Vector4 texture_src[], Vector4 texture_dst[], Vector4 temp[]) {
 	float scale_x = float(width_dst)  / float(width_src);
 	float scale_y = float(height_dst) / float(height_src);
@@ -110,7 +117,7 @@ static void downsample(int width_src, int height_src, int width_dst, int height_
 
 	// Fill horizontal kernel
 	for (int x = 0; x < window_size_x; x++) {
-		float sample = filter_sample_box(x - window_size_x / 2, scale_x);
+		float sample = filter_sample_box<Filter>(x - window_size_x / 2, scale_x);
 
 		kernel_x[x] = sample;
 		sum_x += sample;
@@ -118,7 +125,7 @@ static void downsample(int width_src, int height_src, int width_dst, int height_
 
 	// Fill vertical kernel
 	for (int y = 0; y < window_size_y; y++) {
-		float sample = filter_sample_box(y - window_size_y / 2, scale_y);
+		float sample = filter_sample_box<Filter>(y - window_size_y / 2, scale_y);
 
 		kernel_y[y] = sample;
 		sum_y += sample;
@@ -169,8 +176,18 @@ static void downsample(int width_src, int height_src, int width_dst, int height_
 	delete [] kernels;
 }
 
+void Texture::downsample(int filter, int width_src, int height_src, int width_dst, int height_dst, const Vector4 texture_src[], Vector4 texture_dst[], Vector4 temp[]) {
+	switch (filter) {
+		case MIPMAP_DOWNSAMPLE_FILTER_BOX:     ::downsample<FilterBox>    (width_src, height_src, width_dst, height_dst, texture_src, texture_dst, temp); break;
+		case MIPMAP_DOWNSAMPLE_FILTER_LANCZOS: ::downsample<FilterLanczos>(width_src, height_src, width_dst, height_dst, texture_src, texture_dst, temp); break;
+		case MIPMAP_DOWNSAMPLE_FILTER_KAISER:  ::downsample<FilterKaiser> (width_src, height_src, width_dst, height_dst, texture_src, texture_dst, temp); break;
+
+		default: abort();
+	}
+}
+
 static bool load_dds(Texture & texture, const char * file_path) {
-	FILE * file; fopen_s(&file, file_path, "rb");
+	FILE * file = Util::file_open(file_path, "rb");
 
 	if (file == nullptr) return false;
 	
@@ -181,15 +198,15 @@ static bool load_dds(Texture & texture, const char * file_path) {
 	fseek(file, 0, SEEK_SET);
 
 	unsigned char header[128];
-	fread_s(header, sizeof(header), 1, 128, file);
+	fread(header, 1, sizeof(header), file);
 
 	// First four bytes should be "DDS "
 	if (memcmp(header, "DDS ", 4) != 0) goto exit;
 
 	// Get width and height
-	memcpy_s(&texture.width,      sizeof(int), header + 16, sizeof(int));
-	memcpy_s(&texture.height,     sizeof(int), header + 12, sizeof(int));
-	memcpy_s(&texture.mip_levels, sizeof(int), header + 28, sizeof(int));
+	memcpy(&texture.width,      header + 16, sizeof(int));
+	memcpy(&texture.height,     header + 12, sizeof(int));
+	memcpy(&texture.mip_levels, header + 28, sizeof(int));
 
 	texture.width  = (texture.width  + 3) / 4;
 	texture.height = (texture.height + 3) / 4;
@@ -221,37 +238,39 @@ static bool load_dds(Texture & texture, const char * file_path) {
 		default: goto exit; // Unsupported format
 	}
 
-	int data_size = file_size - sizeof(header);
+	{
+		int data_size = file_size - sizeof(header);
 
-	unsigned char * data = new unsigned char[data_size];
-	fread_s(data, data_size, 1, data_size, file);
+		unsigned char * data = new unsigned char[data_size];
+		fread(data, 1, data_size, file);
 
-	int * mip_offsets = new int[texture.mip_levels];
+		int * mip_offsets = new int[texture.mip_levels];
 	
-	int block_size = texture.channels * 4;
+		int block_size = texture.channels * 4;
 
-	int level_width  = texture.width;
-	int level_height = texture.height;
-	int level_offset = 0;
+		int level_width  = texture.width;
+		int level_height = texture.height;
+		int level_offset = 0;
 
-	for (int level = 0; level < texture.mip_levels; level++) {
-		if (level_width == 0 || level_height == 0) {
-			texture.mip_levels = level;
+		for (int level = 0; level < texture.mip_levels; level++) {
+			if (level_width == 0 || level_height == 0) {
+				texture.mip_levels = level;
 			
-			break;
-		}
+				break;
+			}
 
-		mip_offsets[level] = level_offset;
-		level_offset += level_width * level_height * block_size;
+			mip_offsets[level] = level_offset;
+			level_offset += level_width * level_height * block_size;
 
-		level_width  /= 2;
-		level_height /= 2;
-	}
+			level_width  /= 2;
+			level_height /= 2;
+		}
 	
-	texture.data = data;
-	texture.mip_offsets = mip_offsets;
+		texture.data = data;
+		texture.mip_offsets = mip_offsets;
 
-	success = true;
+		success = true;
+	}
 
 exit:
 	fclose(file);
@@ -302,10 +321,10 @@ static bool load_stbi(Texture & texture, const char * file_path) {
 	while (true) {
 #if MIPMAP_DOWNSAMPLE_FILTER == MIPMAP_DOWNSAMPLE_FILTER_BOX
 		// Box filter can downsample the previous Mip level
-		downsample(level_width * 2, level_height * 2, level_width, level_height, data_rgba + offset_prev, data_rgba + offset, temp);
+		downsample<Filter>(level_width * 2, level_height * 2, level_width, level_height, data_rgba + offset_prev, data_rgba + offset, temp);
 #else
 		// Other filters downsample the original Texture for better quality
-		downsample(texture.width, texture.height, level_width, level_height, data_rgba, data_rgba + offset, temp);
+		downsample<Filter>(texture.width, texture.height, level_width, level_height, data_rgba, data_rgba + offset, temp);
 #endif
 
 		mip_offsets[level++] = offset * sizeof(Vector4);
@@ -428,45 +447,16 @@ void Texture::wait_until_textures_loaded() {
 void Texture::free() {
 	delete [] data;
 	delete [] mip_offsets;
-}
-
-CUarray_format Texture::get_cuda_array_format() const {
-	switch (format) {
-		case Format::BC1:  return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT32;
-		case Format::BC2:  return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT32;
-		case Format::BC3:  return CUarray_format::CU_AD_FORMAT_UNSIGNED_INT32;
-		case Format::RGBA: return CUarray_format::CU_AD_FORMAT_FLOAT;
-	}
-}
 
-CUresourceViewFormat Texture::get_cuda_resource_view_format() const {
-	switch (format) {
-		case Texture::Format::BC1:  return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UNSIGNED_BC1;
-		case Texture::Format::BC2:  return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UNSIGNED_BC2;
-		case Texture::Format::BC3:  return CUresourceViewFormat::CU_RES_VIEW_FORMAT_UNSIGNED_BC3;
-		case Texture::Format::RGBA: return CUresourceViewFormat::CU_RES_VIEW_FORMAT_FLOAT_4X32;
-	}
-}
-
-int Texture::get_cuda_resource_view_width() const {
-	if (format == Format::RGBA) {
-		return width;
-	} else {
-		return width * 4;
-	}
-}
-
-int Texture::get_cuda_resource_view_height() const {
-	if (format == Format::RGBA) {
-		return height;
-	} else {
-		return height * 4;
-	}
+	data        = nullptr;
+	mip_offsets = nullptr;
 }
 
 int Texture::get_width_in_bytes() const {
 	if (format == Format::RGBA) {
 		return width * sizeof(Vector4);
+	} else if (format == Format::RGBA8) {
+		return width * 4;
 	} else {
 		return width * channels * 4;
 	}
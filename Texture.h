@@ -1,14 +1,15 @@
 #pragma once
 #include <vector>
 
-#include <cuda.h>
+#include "Vector4.h"
 
 struct Texture {
 	enum class Format {
 		BC1,
 		BC2,
 		BC3,
-		RGBA
+		RGBA,
+		RGBA8 // Four bytes per texel with the colour sRGB encoded, see TextureCPU::convert_to_rgba8
 	};
 
 	const unsigned char * data;
@@ -23,16 +24,18 @@ struct Texture {
 
 	void free();
 
-	CUarray_format       get_cuda_array_format()         const;
-	CUresourceViewFormat get_cuda_resource_view_format() const;
-
-	int get_cuda_resource_view_width()  const;
-	int get_cuda_resource_view_height() const;
-
 	int get_width_in_bytes() const;
 
+	// BC Textures store their width and height in blocks of 4x4 texels
+	inline bool is_block_compressed() const {
+		return format == Format::BC1 || format == Format::BC2 || format == Format::BC3;
+	}
+
 	static int load(const char * file_path);
 
+	// Downsamples an RGBA Texture using one of the MIPMAP_DOWNSAMPLE_FILTER_* filters, 'temp' needs space for width_dst * height_src pixels
+	static void downsample(int filter, int width_src, int height_src, int width_dst, int height_dst, const Vector4 texture_src[], Vector4 texture_dst[], Vector4 temp[]);
+
 	static void wait_until_textures_loaded();
 
 	inline static std::vector<Texture> textures;
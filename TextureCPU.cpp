@@ -0,0 +1,693 @@
+#include "TextureCPU.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "MathSoA.h"
+#include "Math.h"
+
+#include "CUDA_Source/Common.h"
+
+// Same wrappers as in MathSoA.cpp, extended with the rounding and selection the address arithmetic needs
+#if SIMD_AVX
+typedef __m256 Float;
+typedef __m256 Mask;
+
+static inline Float load      (const float * data)          { return _mm256_load_ps(data); }
+static inline void  store     (float * data, Float value)   { _mm256_store_ps(data, value); }
+static inline Float set1      (float value)                 { return _mm256_set1_ps(value); }
+static inline Float add       (Float a, Float b)            { return _mm256_add_ps(a, b); }
+static inline Float sub       (Float a, Float b)            { return _mm256_sub_ps(a, b); }
+static inline Float mul       (Float a, Float b)            { return _mm256_mul_ps(a, b); }
+static inline Float minimum   (Float a, Float b)            { return _mm256_min_ps(a, b); }
+static inline Float maximum   (Float a, Float b)            { return _mm256_max_ps(a, b); }
+static inline Float round_down(Float a)                     { return _mm256_floor_ps(a); }
+static inline Mask  less      (Float a, Float b)            { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Float select    (Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+#elif SIMD_SSE
+typedef __m128 Float;
+typedef __m128 Mask;
+
+static inline Float load      (const float * data)          { return _mm_load_ps(data); }
+static inline void  store     (float * data, Float value)   { _mm_store_ps(data, value); }
+static inline Float set1      (float value)                 { return _mm_set1_ps(value); }
+static inline Float add       (Float a, Float b)            { return _mm_add_ps(a, b); }
+static inline Float sub       (Float a, Float b)            { return _mm_sub_ps(a, b); }
+static inline Float mul       (Float a, Float b)            { return _mm_mul_ps(a, b); }
+static inline Float minimum   (Float a, Float b)            { return _mm_min_ps(a, b); }
+static inline Float maximum   (Float a, Float b)            { return _mm_max_ps(a, b); }
+static inline Mask  less      (Float a, Float b)            { return _mm_cmplt_ps(a, b); }
+static inline Float select    (Mask mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+// SSE2 has no floor, truncation rounds negative values up so those are corrected by one
+static inline Float round_down(Float a) {
+	Float truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f)));
+}
+#else
+typedef float Float;
+typedef bool  Mask;
+
+static inline Float load      (const float * data)          { return *data; }
+static inline void  store     (float * data, Float value)   { *data = value; }
+static inline Float set1      (float value)                 { return value; }
+static inline Float add       (Float a, Float b)            { return a + b; }
+static inline Float sub       (Float a, Float b)            { return a - b; }
+static inline Float mul       (Float a, Float b)            { return a * b; }
+static inline Float minimum   (Float a, Float b)            { return a < b ? a : b; }
+static inline Float maximum   (Float a, Float b)            { return a > b ? a : b; }
+static inline Float round_down(Float a)                     { return floorf(a); }
+static inline Mask  less      (Float a, Float b)            { return a < b; }
+static inline Float select    (Mask mask, Float a, Float b) { return mask ? a : b; }
+#endif
+
+static inline Float lerp(Float a, Float b, Float t) {
+	return add(a, mul(sub(b, a), t));
+}
+
+static inline Vector4 lerp(const Vector4 & a, const Vector4 & b, float t) {
+	return a + (b - a) * t;
+}
+
+// Location and size in texels of a Mip level
+struct Level {
+	const unsigned char * data;
+
+	int width;
+	int height;
+	int width_in_blocks; // Only used by BC Textures
+};
+
+static Level get_level(const Texture & texture, int level_index) {
+	Level level;
+	level.data = texture.data + texture.mip_offsets[level_index];
+
+	if (texture.is_block_compressed()) {
+		level.width_in_blocks = Math::max(texture.width >> level_index, 1);
+
+		level.width  = 4 * level.width_in_blocks;
+		level.height = 4 * Math::max(texture.height >> level_index, 1);
+	} else {
+		level.width_in_blocks = 0;
+
+		level.width  = Math::max(texture.width  >> level_index, 1);
+		level.height = Math::max(texture.height >> level_index, 1);
+	}
+
+	return level;
+}
+
+// Linear value of every 8 bit sRGB value
+static const struct SRGBTable {
+	float values[256];
+
+	SRGBTable() {
+		for (int i = 0; i < 256; i++) values[i] = Math::gamma_to_linear(float(i) / 255.0f);
+	}
+} srgb_table;
+
+static float srgb_to_linear(unsigned char value) {
+	return srgb_table.values[value];
+}
+
+// Expands a 5:6:5 endpoint to 8 bits per channel like the Texture units do, the result is normalized
+static Vector4 bc_endpoint(unsigned value) {
+	unsigned r = (value >> 11) & 31;
+	unsigned g = (value >>  5) & 63;
+	unsigned b =  value        & 31;
+
+	return Vector4(float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)), 255.0f) * (1.0f / 255.0f);
+}
+
+// Decoded BC block, the colour and alpha of a texel are looked up using its codes
+struct BCBlock {
+	const unsigned char * data;
+
+	float    colours[4][4];
+	unsigned colour_codes; // 2 bits per texel
+
+	float              alphas[8];   // Only used by BC3
+	unsigned long long alpha_codes; // 3 bits per texel, only used by BC3
+};
+
+// Colours of a colour block. BC1 blocks whose first endpoint is not larger than the second
+// use three colours and transparent black, the colour blocks of BC2 and BC3 always use four colours
+static void bc_decode_colours(const unsigned char * block, bool four_colours, BCBlock & result) {
+	unsigned endpoint_0 = block[0] | block[1] << 8;
+	unsigned endpoint_1 = block[2] | block[3] << 8;
+
+	result.colour_codes = block[4] | block[5] << 8 | block[6] << 16 | unsigned(block[7]) << 24;
+
+	Vector4 colour_0 = bc_endpoint(endpoint_0);
+	Vector4 colour_1 = bc_endpoint(endpoint_1);
+
+	Vector4 colours[4] = { colour_0, colour_1 };
+
+	if (four_colours || endpoint_0 > endpoint_1) {
+		colours[2] = (2.0f * colour_0 + colour_1) * (1.0f / 3.0f);
+		colours[3] = (colour_0 + 2.0f * colour_1) * (1.0f / 3.0f);
+	} else {
+		colours[2] = (colour_0 + colour_1) * 0.5f;
+		colours[3] = Vector4(0.0f);
+	}
+
+	memcpy(result.colours, colours, sizeof(result.colours));
+}
+
+// Explicit 4 bit alpha of BC2
+static float bc2_decode_alpha(const unsigned char * block, int i) {
+	unsigned alpha = (block[i >> 1] >> (4 * (i & 1))) & 15;
+
+	return float(alpha) * (1.0f / 15.0f);
+}
+
+// 3 bit alpha codes of the texels of a BC3 block
+static unsigned long long bc3_alpha_codes(const unsigned char * block) {
+	unsigned long long codes = 0;
+	for (int b = 0; b < 6; b++) codes |= (unsigned long long)(block[2 + b]) << (8 * b);
+
+	return codes;
+}
+
+// Interpolated alpha of BC3, with six interpolated values or four and the constants 0 and 1
+static float bc3_decode_alpha(const unsigned char * block, int code) {
+	float alpha_0 = float(block[0]) * (1.0f / 255.0f);
+	float alpha_1 = float(block[1]) * (1.0f / 255.0f);
+
+	if (code == 0) return alpha_0;
+	if (code == 1) return alpha_1;
+
+	if (block[0] > block[1]) {
+		return (float(8 - code) * alpha_0 + float(code - 1) * alpha_1) * (1.0f / 7.0f);
+	} else if (code < 6) {
+		return (float(6 - code) * alpha_0 + float(code - 1) * alpha_1) * (1.0f / 5.0f);
+	} else {
+		return code == 6 ? 0.0f : 1.0f;
+	}
+}
+
+template<Texture::Format FORMAT>
+static void bc_decode(const unsigned char * data, BCBlock & block) {
+	block.data = data;
+
+	if constexpr (FORMAT == Texture::Format::BC1) {
+		bc_decode_colours(data, false, block);
+	} else {
+		bc_decode_colours(data + 8, true, block);
+	}
+
+	if constexpr (FORMAT == Texture::Format::BC3) {
+		block.alpha_codes = bc3_alpha_codes(data);
+
+		for (int code = 0; code < 8; code++) block.alphas[code] = bc3_decode_alpha(data, code);
+	}
+}
+
+// Texel 'i' of a decoded block
+template<Texture::Format FORMAT>
+static Vector4 bc_get_texel(const BCBlock & block, int i) {
+	Vector4 colour(block.colours[(block.colour_codes >> (2 * i)) & 3]);
+
+	if constexpr (FORMAT == Texture::Format::BC2) colour.w = bc2_decode_alpha(block.data, i);
+	if constexpr (FORMAT == Texture::Format::BC3) colour.w = block.alphas[int(block.alpha_codes >> (3 * i)) & 7];
+
+	return colour;
+}
+
+template<Texture::Format FORMAT>
+static const unsigned char * bc_get_block(const Level & level, int x, int y) {
+	constexpr int block_size = FORMAT == Texture::Format::BC1 ? 8 : 16;
+
+	return level.data + block_size * ((x >> 2) + (y >> 2) * level.width_in_blocks);
+}
+
+// Texel at (x, y), which must lie within the Mip level. The format is a template argument so that the batched
+// lookups decode their texels without branching on the format
+template<Texture::Format FORMAT>
+static Vector4 fetch(const Level & level, int x, int y) {
+	assert(x >= 0 && x < level.width && y >= 0 && y < level.height);
+
+	if constexpr (FORMAT == Texture::Format::RGBA) {
+		return reinterpret_cast<const Vector4 *>(level.data)[x + y * level.width];
+	} else if constexpr (FORMAT == Texture::Format::RGBA8) {
+		const unsigned char * texel = level.data + 4 * (x + y * level.width);
+
+		return Vector4(srgb_to_linear(texel[0]), srgb_to_linear(texel[1]), srgb_to_linear(texel[2]), float(texel[3]) * (1.0f / 255.0f));
+	} else {
+		const unsigned char * block = bc_get_block<FORMAT>(level, x, y);
+
+		int i = (x & 3) + 4 * (y & 3);
+
+		// A single texel only needs its own alpha, so unlike bc_decode this does not interpolate all alphas of a BC3 block
+		BCBlock decoded;
+		bc_decode_colours(FORMAT == Texture::Format::BC1 ? block : block + 8, FORMAT != Texture::Format::BC1, decoded);
+
+		Vector4 colour(decoded.colours[(decoded.colour_codes >> (2 * i)) & 3]);
+
+		if constexpr (FORMAT == Texture::Format::BC2) colour.w = bc2_decode_alpha(block, i);
+		if constexpr (FORMAT == Texture::Format::BC3) colour.w = bc3_decode_alpha(block, int(bc3_alpha_codes(block) >> (3 * i)) & 7);
+
+		return colour;
+	}
+}
+
+// Same as above for a format that is only known at run time
+static Vector4 fetch(const Texture & texture, const Level & level, int x, int y) {
+	switch (texture.format) {
+		case Texture::Format::RGBA:  return fetch<Texture::Format::RGBA> (level, x, y);
+		case Texture::Format::RGBA8: return fetch<Texture::Format::RGBA8>(level, x, y);
+		case Texture::Format::BC1:   return fetch<Texture::Format::BC1>  (level, x, y);
+		case Texture::Format::BC2:   return fetch<Texture::Format::BC2>  (level, x, y);
+		default:                     return fetch<Texture::Format::BC3>  (level, x, y);
+	}
+}
+
+static Vector4 sample_bilinear(const Texture & texture, int level_index, float s, float t) {
+	Level level = get_level(texture, level_index);
+
+	// Wrap addressing
+	s -= floorf(s);
+	t -= floorf(t);
+
+	float x = s * float(level.width)  - 0.5f;
+	float y = t * float(level.height) - 0.5f;
+
+	float x_0 = floorf(x);
+	float y_0 = floorf(y);
+
+	float fraction_x = x - x_0;
+	float fraction_y = y - y_0;
+
+	int x0 = int(x_0), x1 = x0 + 1;
+	int y0 = int(y_0), y1 = y0 + 1;
+
+	if (x0 < 0) x0 += level.width;
+	if (y0 < 0) y0 += level.height;
+	if (x1 >= level.width)  x1 -= level.width;
+	if (y1 >= level.height) y1 -= level.height;
+
+	Vector4 top    = lerp(fetch(texture, level, x0, y0), fetch(texture, level, x1, y0), fraction_x);
+	Vector4 bottom = lerp(fetch(texture, level, x0, y1), fetch(texture, level, x1, y1), fraction_x);
+
+	return lerp(top, bottom, fraction_y);
+}
+
+Vector4 TextureCPU::get_lod(const Texture & texture, float s, float t, float lod) {
+	int level_max = texture.mip_levels - 1;
+
+	lod = fminf(fmaxf(lod, 0.0f), float(level_max));
+
+	float level = floorf(lod);
+	float fraction = lod - level;
+
+	int level_0 = int(level);
+	int level_1 = Math::min(level_0 + 1, level_max);
+
+	Vector4 colour_0 = sample_bilinear(texture, level_0, s, t);
+	if (fraction == 0.0f) return colour_0;
+
+	return lerp(colour_0, sample_bilinear(texture, level_1, s, t), fraction);
+}
+
+// Returns the number of samples of an anisotropic lookup, their Mip level, and the offset between consecutive samples
+static int get_anisotropy(const Texture & texture, float dsdx, float dtdx, float dsdy, float dtdy, float & lod, float & step_s, float & step_t) {
+	Level level = get_level(texture, 0);
+
+	// Gradients in texels of the first Mip level
+	float dxdx = dsdx * float(level.width), dydx = dtdx * float(level.height);
+	float dxdy = dsdy * float(level.width), dydy = dtdy * float(level.height);
+
+	float length_x = sqrtf(dxdx * dxdx + dydx * dydx);
+	float length_y = sqrtf(dxdy * dxdy + dydy * dydy);
+
+	float length_major, length_minor;
+	float axis_s, axis_t;
+
+	if (length_x >= length_y) {
+		length_major = length_x; length_minor = length_y;
+		axis_s = dsdx; axis_t = dtdx;
+	} else {
+		length_major = length_y; length_minor = length_x;
+		axis_s = dsdy; axis_t = dtdy;
+	}
+
+	float ratio = fminf(ceilf(length_major / fmaxf(length_minor, 1e-6f)), float(TEXTURE_CPU_MAX_ANISOTROPY));
+	int   count = Math::max(int(ratio), 1);
+
+	lod = log2f(length_major / float(count));
+
+	step_s = axis_s / float(count);
+	step_t = axis_t / float(count);
+
+	return count;
+}
+
+Vector4 TextureCPU::get_grad(const Texture & texture, float s, float t, float dsdx, float dtdx, float dsdy, float dtdy) {
+	float lod, step_s, step_t;
+	int count = get_anisotropy(texture, dsdx, dtdx, dsdy, dtdy, lod, step_s, step_t);
+
+	// The samples are spread evenly along the major axis of the footprint, centred on (s, t)
+	float offset = 0.5f * float(1 - count);
+
+	Vector4 sum(0.0f);
+
+	for (int i = 0; i < count; i++) {
+		float o = offset + float(i);
+
+		sum += get_lod(texture, s + o * step_s, t + o * step_t, lod);
+	}
+
+	return sum * (1.0f / float(count));
+}
+
+// Transposes the texels of SOA_WIDTH lanes, stored one after the other, into one register per channel
+static inline void load_channels(const float texels[SOA_WIDTH][4], Float channels[4]) {
+#if SIMD_AVX
+	__m128 rows[8];
+	for (int lane = 0; lane < 8; lane++) rows[lane] = _mm_load_ps(texels[lane]);
+
+	_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+	_MM_TRANSPOSE4_PS(rows[4], rows[5], rows[6], rows[7]);
+
+	for (int c = 0; c < 4; c++) channels[c] = _mm256_insertf128_ps(_mm256_castps128_ps256(rows[c]), rows[c + 4], 1);
+#elif SIMD_SSE
+	__m128 rows[4];
+	for (int lane = 0; lane < 4; lane++) rows[lane] = _mm_load_ps(texels[lane]);
+
+	_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+
+	for (int c = 0; c < 4; c++) channels[c] = rows[c];
+#else
+	for (int c = 0; c < 4; c++) channels[c] = texels[0][c];
+#endif
+}
+
+// Fetches the four corners of the bilinear footprint of every lane, the result is stored per corner and channel.
+// RGBA8 texels are decoded straight into one array per channel, the other formats are decoded one lane at a time
+// and transposed into channels four lanes at a time. The corners of a lane usually share a BC block, which is then only decoded once
+template<Texture::Format FORMAT>
+static void fetch_corners(const Level levels[SOA_WIDTH], const float corner_x[2][SOA_WIDTH], const float corner_y[2][SOA_WIDTH], Float corners[4][4]) {
+	if constexpr (FORMAT == Texture::Format::RGBA8) {
+		alignas(32) float texels[4][4][SOA_WIDTH]; // Corner, channel, lane
+
+		for (int lane = 0; lane < SOA_WIDTH; lane++) {
+			for (int corner = 0; corner < 4; corner++) {
+				int x = int(corner_x[corner & 1][lane]);
+				int y = int(corner_y[corner >> 1][lane]);
+
+				const unsigned char * texel = levels[lane].data + 4 * (x + y * levels[lane].width);
+
+				texels[corner][0][lane] = srgb_to_linear(texel[0]);
+				texels[corner][1][lane] = srgb_to_linear(texel[1]);
+				texels[corner][2][lane] = srgb_to_linear(texel[2]);
+				texels[corner][3][lane] = float(texel[3]) * (1.0f / 255.0f);
+			}
+		}
+
+		for (int corner = 0; corner < 4; corner++) {
+			for (int c = 0; c < 4; c++) corners[corner][c] = load(texels[corner][c]);
+		}
+	} else {
+		alignas(32) float texels[4][SOA_WIDTH][4]; // Corner, lane, channel
+
+		for (int lane = 0; lane < SOA_WIDTH; lane++) {
+			if constexpr (FORMAT == Texture::Format::RGBA) {
+				for (int corner = 0; corner < 4; corner++) {
+					Vector4 texel = fetch<FORMAT>(levels[lane], int(corner_x[corner & 1][lane]), int(corner_y[corner >> 1][lane]));
+
+					memcpy(texels[corner][lane], texel.data, sizeof(texel.data));
+				}
+			} else {
+				const unsigned char * blocks[4];
+				BCBlock               blocks_decoded[4];
+
+				int block_count = 0;
+
+				for (int corner = 0; corner < 4; corner++) {
+					int x = int(corner_x[corner & 1][lane]);
+					int y = int(corner_y[corner >> 1][lane]);
+
+					const unsigned char * block = bc_get_block<FORMAT>(levels[lane], x, y);
+
+					int b = 0;
+					while (b < block_count && blocks[b] != block) b++;
+
+					if (b == block_count) {
+						blocks[block_count++] = block;
+						bc_decode<FORMAT>(block, blocks_decoded[b]);
+					}
+
+					Vector4 texel = bc_get_texel<FORMAT>(blocks_decoded[b], (x & 3) + 4 * (y & 3));
+
+					memcpy(texels[corner][lane], texel.data, sizeof(texel.data));
+				}
+			}
+		}
+
+		for (int corner = 0; corner < 4; corner++) load_channels(texels[corner], corners[corner]);
+	}
+}
+
+// Trilinear lookups of a block of SOA_WIDTH coordinates, the result is stored per channel.
+// The address and filter arithmetic is done a block at a time, texels are fetched one lane at a time
+template<Texture::Format FORMAT>
+static void sample_block(const Texture & texture, const float s[], const float t[], const float lod[], float result[4][SOA_WIDTH]) {
+	int level_max = texture.mip_levels - 1;
+
+	alignas(32) float level[SOA_WIDTH];
+
+	Float lod_clamped = minimum(maximum(load(lod), set1(0.0f)), set1(float(level_max)));
+	Float lod_level   = round_down(lod_clamped);
+	Float fraction    = sub(lod_clamped, lod_level);
+
+	store(level, lod_level);
+
+	// Wrap addressing
+	Float s_wrapped = sub(load(s), round_down(load(s)));
+	Float t_wrapped = sub(load(t), round_down(load(t)));
+
+	Float colour[2][4]; // Mip level, channel
+
+	for (int k = 0; k < 2; k++) {
+		Level levels[SOA_WIDTH];
+
+		alignas(32) float width [SOA_WIDTH];
+		alignas(32) float height[SOA_WIDTH];
+
+		for (int lane = 0; lane < SOA_WIDTH; lane++) {
+			levels[lane] = get_level(texture, Math::min(int(level[lane]) + k, level_max));
+
+			width [lane] = float(levels[lane].width);
+			height[lane] = float(levels[lane].height);
+		}
+
+		Float w = load(width);
+		Float h = load(height);
+
+		Float x = sub(mul(s_wrapped, w), set1(0.5f));
+		Float y = sub(mul(t_wrapped, h), set1(0.5f));
+
+		Float x0 = round_down(x);
+		Float y0 = round_down(y);
+
+		Float fraction_x = sub(x, x0);
+		Float fraction_y = sub(y, y0);
+
+		Float x1 = add(x0, set1(1.0f));
+		Float y1 = add(y0, set1(1.0f));
+
+		x0 = select(less(x0, set1(0.0f)), add(x0, w), x0);
+		y0 = select(less(y0, set1(0.0f)), add(y0, h), y0);
+		x1 = select(less(x1, w), x1, sub(x1, w));
+		y1 = select(less(y1, h), y1, sub(y1, h));
+
+		alignas(32) float corner_x[2][SOA_WIDTH];
+		alignas(32) float corner_y[2][SOA_WIDTH];
+
+		store(corner_x[0], x0); store(corner_x[1], x1);
+		store(corner_y[0], y0); store(corner_y[1], y1);
+
+		Float corners[4][4]; // Corner, channel
+		fetch_corners<FORMAT>(levels, corner_x, corner_y, corners);
+
+		for (int c = 0; c < 4; c++) {
+			Float top    = lerp(corners[0][c], corners[1][c], fraction_x);
+			Float bottom = lerp(corners[2][c], corners[3][c], fraction_x);
+
+			colour[k][c] = lerp(top, bottom, fraction_y);
+		}
+	}
+
+	for (int c = 0; c < 4; c++) store(result[c], lerp(colour[0][c], colour[1][c], fraction));
+}
+
+template<Texture::Format FORMAT>
+static void get_lod_batch(const Texture & texture, int count, const float s[], const float t[], const float lod[], Vector4 result[]) {
+	alignas(32) float block_s  [SOA_WIDTH];
+	alignas(32) float block_t  [SOA_WIDTH];
+	alignas(32) float block_lod[SOA_WIDTH];
+
+	alignas(32) float colour[4][SOA_WIDTH];
+
+	for (int base = 0; base < count; base += SOA_WIDTH) {
+		int lane_count = Math::min(count - base, SOA_WIDTH);
+
+		// The last block is padded by repeating its first lookup
+		for (int lane = 0; lane < SOA_WIDTH; lane++) {
+			int index = base + (lane < lane_count ? lane : 0);
+
+			block_s  [lane] = s  [index];
+			block_t  [lane] = t  [index];
+			block_lod[lane] = lod[index];
+		}
+
+		sample_block<FORMAT>(texture, block_s, block_t, block_lod, colour);
+
+		for (int lane = 0; lane < lane_count; lane++) {
+			result[base + lane] = Vector4(colour[0][lane], colour[1][lane], colour[2][lane], colour[3][lane]);
+		}
+	}
+}
+
+// The anisotropic samples of a chunk of lookups are laid out one after the other and filtered as a stream of trilinear
+// lookups, so that every block is full no matter how many samples the individual lookups take.
+// The samples of a lookup are summed in order, which keeps the results the same as the single lookups
+template<Texture::Format FORMAT>
+static void get_grad_batch(const Texture & texture, int count, const float s[], const float t[], const float dsdx[], const float dtdx[], const float dsdy[], const float dtdy[], Vector4 result[]) {
+	constexpr int CHUNK_SIZE  = 32;
+	constexpr int STREAM_SIZE = CHUNK_SIZE * TEXTURE_CPU_MAX_ANISOTROPY + SOA_WIDTH;
+
+	alignas(32) float stream_s  [STREAM_SIZE];
+	alignas(32) float stream_t  [STREAM_SIZE];
+	alignas(32) float stream_lod[STREAM_SIZE];
+
+	int stream_lookup[STREAM_SIZE]; // Index of the lookup within the chunk that every sample belongs to
+
+	int     sample_count[CHUNK_SIZE];
+	Vector4 sum         [CHUNK_SIZE];
+
+	alignas(32) float colour[4][SOA_WIDTH];
+
+	for (int base = 0; base < count; base += CHUNK_SIZE) {
+		int lookup_count = Math::min(count - base, CHUNK_SIZE);
+		int stream_size  = 0;
+
+		for (int i = 0; i < lookup_count; i++) {
+			int index = base + i;
+
+			float lod, step_s, step_t;
+			sample_count[i] = get_anisotropy(texture, dsdx[index], dtdx[index], dsdy[index], dtdy[index], lod, step_s, step_t);
+
+			float offset = 0.5f * float(1 - sample_count[i]);
+
+			for (int j = 0; j < sample_count[i]; j++) {
+				float o = offset + float(j);
+
+				stream_s     [stream_size] = s[index] + o * step_s;
+				stream_t     [stream_size] = t[index] + o * step_t;
+				stream_lod   [stream_size] = lod;
+				stream_lookup[stream_size] = i;
+				stream_size++;
+			}
+
+			sum[i] = Vector4(0.0f);
+		}
+
+		// The last block is padded by repeating the first sample
+		for (int i = stream_size; i < Math::divide_round_up(stream_size, SOA_WIDTH) * SOA_WIDTH; i++) {
+			stream_s  [i] = stream_s  [0];
+			stream_t  [i] = stream_t  [0];
+			stream_lod[i] = stream_lod[0];
+		}
+
+		for (int block = 0; block < stream_size; block += SOA_WIDTH) {
+			sample_block<FORMAT>(texture, stream_s + block, stream_t + block, stream_lod + block, colour);
+
+			int lane_count = Math::min(stream_size - block, SOA_WIDTH);
+
+			for (int lane = 0; lane < lane_count; lane++) {
+				sum[stream_lookup[block + lane]] += Vector4(colour[0][lane], colour[1][lane], colour[2][lane], colour[3][lane]);
+			}
+		}
+
+		for (int i = 0; i < lookup_count; i++) {
+			result[base + i] = sum[i] * (1.0f / float(sample_count[i]));
+		}
+	}
+}
+
+void TextureCPU::get_lod_batch(const Texture & texture, int count, const float s[], const float t[], const float lod[], Vector4 result[]) {
+	switch (texture.format) {
+		case Texture::Format::RGBA:  ::get_lod_batch<Texture::Format::RGBA> (texture, count, s, t, lod, result); break;
+		case Texture::Format::RGBA8: ::get_lod_batch<Texture::Format::RGBA8>(texture, count, s, t, lod, result); break;
+		case Texture::Format::BC1:   ::get_lod_batch<Texture::Format::BC1>  (texture, count, s, t, lod, result); break;
+		case Texture::Format::BC2:   ::get_lod_batch<Texture::Format::BC2>  (texture, count, s, t, lod, result); break;
+		default:                     ::get_lod_batch<Texture::Format::BC3>  (texture, count, s, t, lod, result); break;
+	}
+}
+
+void TextureCPU::get_grad_batch(const Texture & texture, int count, const float s[], const float t[], const float dsdx[], const float dtdx[], const float dsdy[], const float dtdy[], Vector4 result[]) {
+	switch (texture.format) {
+		case Texture::Format::RGBA:  ::get_grad_batch<Texture::Format::RGBA> (texture, count, s, t, dsdx, dtdx, dsdy, dtdy, result); break;
+		case Texture::Format::RGBA8: ::get_grad_batch<Texture::Format::RGBA8>(texture, count, s, t, dsdx, dtdx, dsdy, dtdy, result); break;
+		case Texture::Format::BC1:   ::get_grad_batch<Texture::Format::BC1>  (texture, count, s, t, dsdx, dtdx, dsdy, dtdy, result); break;
+		case Texture::Format::BC2:   ::get_grad_batch<Texture::Format::BC2>  (texture, count, s, t, dsdx, dtdx, dsdy, dtdy, result); break;
+		default:                     ::get_grad_batch<Texture::Format::BC3>  (texture, count, s, t, dsdx, dtdx, dsdy, dtdy, result); break;
+	}
+}
+
+Vector3 TextureCPU::albedo(const Material & material, float s, float t, float lod) {
+	if (material.texture_id == -1) return material.diffuse;
+
+	Vector4 colour = get_lod(Texture::textures[material.texture_id], s, t, lod);
+	return material.diffuse * Vector3(colour.x, colour.y, colour.z);
+}
+
+Vector3 TextureCPU::albedo(const Material & material, float s, float t, float dsdx, float dtdx, float dsdy, float dtdy) {
+	if (material.texture_id == -1) return material.diffuse;
+
+	Vector4 colour = get_grad(Texture::textures[material.texture_id], s, t, dsdx, dtdx, dsdy, dtdy);
+	return material.diffuse * Vector3(colour.x, colour.y, colour.z);
+}
+
+Texture TextureCPU::convert_to_rgba8(const Texture & texture) {
+	assert(texture.format == Texture::Format::RGBA);
+
+	int texel_count = 0;
+	for (int l = 0; l < texture.mip_levels; l++) {
+		Level level = get_level(texture, l);
+		texel_count += level.width * level.height;
+	}
+
+	unsigned char * data        = new unsigned char[4 * texel_count];
+	int           * mip_offsets = new int[texture.mip_levels];
+
+	int offset = 0;
+
+	for (int l = 0; l < texture.mip_levels; l++) {
+		Level level = get_level(texture, l);
+
+		mip_offsets[l] = offset;
+
+		const Vector4 * texels = reinterpret_cast<const Vector4 *>(level.data);
+
+		for (int i = 0; i < level.width * level.height; i++) {
+			unsigned char * texel = data + offset + 4 * i;
+
+			texel[0] = (unsigned char)(255.0f * Math::linear_to_gamma(texels[i].x) + 0.5f);
+			texel[1] = (unsigned char)(255.0f * Math::linear_to_gamma(texels[i].y) + 0.5f);
+			texel[2] = (unsigned char)(255.0f * Math::linear_to_gamma(texels[i].z) + 0.5f);
+			texel[3] = (unsigned char)(255.0f * Math::clamp(texels[i].w, 0.0f, 1.0f) + 0.5f);
+		}
+
+		offset += 4 * level.width * level.height;
+	}
+
+	Texture result = texture;
+	result.format      = Texture::Format::RGBA8;
+	result.data        = data;
+	result.mip_offsets = mip_offsets;
+
+	return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "Vector3.h"
+#include "Vector4.h"
+
+#include "Texture.h"
+#include "Material.h"
+
+// Host side equivalent of sampling Textures on the Device, see Texture<float4>::get_lod and get_grad in CUDA_Source/Util.h.
+// Like the Device Texture objects the lookups use normalized coordinates, wrap addressing, bilinear filtering within
+// and linear filtering between Mip levels. Gradient lookups are anisotropic, taking up to TEXTURE_CPU_MAX_ANISOTROPY
+// trilinear samples along the major axis of the footprint. Supports RGBA float, RGBA8 and BC1, BC2 and BC3 Textures.
+// Results match the Device up to the 8 bit precision of the filter weights of the Texture units
+namespace TextureCPU {
+	Vector4 get_lod (const Texture & texture, float s, float t, float lod);
+	Vector4 get_grad(const Texture & texture, float s, float t, float dsdx, float dtdx, float dsdy, float dtdy);
+
+	// Batched lookups of 'count' coordinates in SoA layout, with the address and filter arithmetic
+	// of SOA_WIDTH lookups done at a time using SSE or AVX. The results are the same as the single lookups
+	void get_lod_batch (const Texture & texture, int count, const float s[], const float t[], const float lod[], Vector4 result[]);
+	void get_grad_batch(const Texture & texture, int count, const float s[], const float t[], const float dsdx[], const float dtdx[], const float dsdy[], const float dtdy[], Vector4 result[]);
+
+	// Same as Material::albedo on the Device
+	Vector3 albedo(const Material & material, float s, float t, float lod);
+	Vector3 albedo(const Material & material, float s, float t, float dsdx, float dtdx, float dsdy, float dtdy);
+
+	// Converts an RGBA float Texture, including its Mip levels, to 8 bits per channel with the colour sRGB encoded
+	Texture convert_to_rgba8(const Texture & texture);
+}
@@ -0,0 +1,123 @@
+#include "ThreadPool.h"
+
+#include <cstdio>
+
+#include "Numa.h"
+
+void ThreadPool::init(int thread_count, const int * thread_cpus) {
+	if (thread_count <= 0) {
+		thread_count = std::thread::hardware_concurrency();
+		if (thread_count <= 0) thread_count = 1;
+	}
+	this->thread_count = thread_count;
+
+	task         = nullptr;
+	task_count   = 0;
+	generation   = 0;
+	workers_busy = 0;
+	quit         = false;
+
+	// Workers pin themselves, the CPUs are copied since they are only read once the workers have started
+	if (thread_cpus) {
+		int * cpus = new int[thread_count];
+		for (int i = 0; i < thread_count; i++) cpus[i] = thread_cpus[i];
+
+		this->thread_cpus = cpus;
+
+		if (!Numa::pin_thread(cpus[0])) printf("WARNING: Unable to pin thread 0 to cpu %i!\n", cpus[0]);
+	} else {
+		this->thread_cpus = nullptr;
+	}
+
+	// The calling thread acts as thread 0, so only thread_count - 1 workers are created
+	workers = new std::thread[thread_count - 1];
+	for (int i = 0; i < thread_count - 1; i++) {
+		workers[i] = std::thread(&ThreadPool::worker, this, i + 1);
+	}
+}
+
+void ThreadPool::free() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	condition_start.notify_all();
+
+	for (int i = 0; i < thread_count - 1; i++) {
+		workers[i].join();
+	}
+	delete [] workers;
+
+	if (thread_cpus) {
+		Numa::unpin_thread();
+
+		delete [] thread_cpus;
+		thread_cpus = nullptr;
+	}
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int index, int thread_index)> & task) {
+	if (count <= 0) return;
+
+	// Not worth waking up the workers
+	if (count == 1 || thread_count == 1) {
+		for (int i = 0; i < count; i++) task(i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		this->task       = &task;
+		this->task_count = count;
+		next_index = 0;
+
+		workers_busy = thread_count - 1;
+		generation++;
+	}
+	condition_start.notify_all();
+
+	execute(0);
+
+	// Wait until every worker has left the current task, after which it is safe to release it
+	std::unique_lock<std::mutex> lock(mutex);
+	condition_done.wait(lock, [this]() { return workers_busy == 0; });
+
+	this->task = nullptr;
+}
+
+void ThreadPool::worker(int thread_index) {
+	if (thread_cpus && !Numa::pin_thread(thread_cpus[thread_index])) {
+		printf("WARNING: Unable to pin thread %i to cpu %i!\n", thread_index, thread_cpus[thread_index]);
+	}
+
+	int generation_seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition_start.wait(lock, [&]() { return quit || generation != generation_seen; });
+
+			if (quit) return;
+
+			generation_seen = generation;
+		}
+
+		execute(thread_index);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			workers_busy--;
+		}
+		condition_done.notify_one();
+	}
+}
+
+void ThreadPool::execute(int thread_index) {
+	while (true) {
+		int index = next_index.fetch_add(1, std::memory_order_relaxed);
+		if (index >= task_count) break;
+
+		(*task)(index, thread_index);
+	}
+}
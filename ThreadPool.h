@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Pool of persistent worker threads used to parallelize Host side loops
+struct ThreadPool {
+	int thread_count; // Includes the calling thread
+
+	// If thread_count is 0 the number of hardware threads is used.
+	// If given, thread i is pinned to CPU thread_cpus[i], this includes the calling thread as thread 0 until free is called
+	void init(int thread_count = 0, const int * thread_cpus = nullptr);
+	void free();
+
+	// Calls task(index, thread_index) for every index in [0, count) and blocks until all calls have finished.
+	// Indices are handed out dynamically, the calling thread participates with thread_index 0
+	void parallel_for(int count, const std::function<void(int index, int thread_index)> & task);
+
+private:
+	std::thread * workers;
+
+	const int * thread_cpus;
+
+	std::mutex              mutex;
+	std::condition_variable condition_start;
+	std::condition_variable condition_done;
+
+	const std::function<void(int, int)> * task;
+
+	int task_count;
+	int generation; // Incremented every time a new parallel_for starts
+	int workers_busy;
+
+	bool quit;
+
+	std::atomic<int> next_index;
+
+	void worker(int thread_index);
+	void execute(int thread_index);
+};
@@ -0,0 +1,282 @@
+#include "TileRendererCPU.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "CUDA_Source/Common.h"
+
+#include "Material.h"
+#include "RaySortCPU.h"
+#include "Numa.h"
+
+// Same as wang_hash and random_xorshift on the Device
+static unsigned wang_hash(unsigned seed) {
+	seed = (seed ^ 61) ^ (seed >> 16);
+	seed *= 9;
+	seed = seed ^ (seed >> 4);
+	seed *= 0x27d4eb2d;
+	seed = seed ^ (seed >> 15);
+
+	return seed;
+}
+
+static float random_float_xorshift(unsigned & seed) {
+	seed ^= (seed << 13);
+	seed ^= (seed >> 17);
+	seed ^= (seed << 5);
+
+	return float(seed) * 2.3283064365387e-10f;
+}
+
+// Rays of a tile in SoA layout, all arrays live in a single allocation of get_batch_size bytes
+struct RayBatch {
+	float * origin_x;
+	float * origin_y;
+	float * origin_z;
+
+	float * direction_x;
+	float * direction_y;
+	float * direction_z;
+
+	float * throughput_x;
+	float * throughput_y;
+	float * throughput_z;
+
+	int * pixel_index;
+
+	void init(int tile_size) {
+		int capacity = tile_size * tile_size;
+
+		float * data = new float[10 * capacity];
+
+		origin_x     = data;
+		origin_y     = data + 1 * capacity;
+		origin_z     = data + 2 * capacity;
+		direction_x  = data + 3 * capacity;
+		direction_y  = data + 4 * capacity;
+		direction_z  = data + 5 * capacity;
+		throughput_x = data + 6 * capacity;
+		throughput_y = data + 7 * capacity;
+		throughput_z = data + 8 * capacity;
+		pixel_index  = reinterpret_cast<int *>(data + 9 * capacity);
+	}
+
+	void free() {
+		delete [] origin_x;
+	}
+
+	inline void set(int index, const Vector3 & origin, const Vector3 & direction, const Vector3 & throughput, int pixel) {
+		origin_x[index] = origin.x;
+		origin_y[index] = origin.y;
+		origin_z[index] = origin.z;
+
+		direction_x[index] = direction.x;
+		direction_y[index] = direction.y;
+		direction_z[index] = direction.z;
+
+		throughput_x[index] = throughput.x;
+		throughput_y[index] = throughput.y;
+		throughput_z[index] = throughput.z;
+
+		pixel_index[index] = pixel;
+	}
+};
+
+int TileRendererCPU::get_batch_size(int tile_size) {
+	return 10 * sizeof(float) * tile_size * tile_size;
+}
+
+// Traces all camera samples of a tile through all bounces and sums them in 'tile_buffer', which holds the pixels of the tile.
+// Returns the number of Rays that were traced
+static long long render_tile(
+	const BVH & bvh, const Triangle * triangles,
+	const TileRendererCPU::Camera & camera,
+	int width, int height, int samples_per_pixel,
+	const TileScheduler::Tile & tile, int tile_index, RayBatch & batch,
+	Vector3 * tile_buffer
+) {
+	long long ray_count = 0;
+
+	float aspect = float(width) / float(height);
+
+	unsigned seed = wang_hash(tile_index);
+
+	for (int sample = 0; sample < samples_per_pixel; sample++) {
+		int count = 0;
+
+		for (int j = tile.y; j < tile.y + tile.height; j++) {
+			for (int i = tile.x; i < tile.x + tile.width; i++) {
+				float u = (2.0f * (float(i) + random_float_xorshift(seed)) / float(width)  - 1.0f) * camera.tan_half_fov * aspect;
+				float v = (1.0f - 2.0f * (float(j) + random_float_xorshift(seed)) / float(height)) * camera.tan_half_fov;
+
+				batch.set(count++, camera.position, Vector3::normalize(Vector3(u, v, -1.0f)), Vector3(1.0f), (i - tile.x) + (j - tile.y) * tile.width);
+			}
+		}
+
+		for (int bounce = 0; bounce < NUM_BOUNCES && count > 0; bounce++) {
+			ray_count += count;
+
+			// Rays that hit a surface continue in the same batch, compacted to its front
+			int count_next = 0;
+
+			for (int r = 0; r < count; r++) {
+				Vector3 origin    (batch.origin_x    [r], batch.origin_y    [r], batch.origin_z    [r]);
+				Vector3 direction (batch.direction_x [r], batch.direction_y [r], batch.direction_z [r]);
+				Vector3 throughput(batch.throughput_x[r], batch.throughput_y[r], batch.throughput_z[r]);
+
+				int pixel = batch.pixel_index[r];
+
+				float t;
+				int   triangle_index;
+				RaySortCPU::trace(bvh, triangles, origin, direction, t, nullptr, &triangle_index);
+
+				if (triangle_index == -1) {
+					tile_buffer[pixel] += throughput;
+
+					continue;
+				}
+
+				const Triangle & triangle = triangles[triangle_index];
+
+				Vector3 normal = Vector3::normalize(Vector3::cross(triangle.position_1 - triangle.position_0, triangle.position_2 - triangle.position_0));
+				if (Vector3::dot(normal, direction) > 0.0f) normal = -normal;
+
+				if (triangle.material_id != -1) {
+					throughput *= Material::materials[triangle.material_id].diffuse;
+				} else {
+					throughput *= 0.8f;
+				}
+
+				// Cosine weighted direction around the normal, the cosine and pdf cancel against the Lambertian BRDF
+				float r0 = random_float_xorshift(seed);
+				float r1 = random_float_xorshift(seed);
+
+				float radius = sqrtf(r0);
+				float local_x = radius * cosf(TWO_PI * r1);
+				float local_y = radius * sinf(TWO_PI * r1);
+				float local_z = sqrtf(fmaxf(1.0f - r0, 0.0f));
+
+				// Same orthonormal basis as on the Device
+				float sign = copysignf(1.0f, normal.z);
+				float a = -1.0f / (sign + normal.z);
+				float b = normal.x * normal.y * a;
+
+				Vector3 tangent (1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+				Vector3 binormal(b, sign + normal.y * normal.y * a, -normal.y);
+
+				Vector3 direction_next = Vector3::normalize(local_x * tangent + local_y * binormal + local_z * normal);
+
+				batch.set(count_next++, origin + t * direction + EPSILON * normal, direction_next, throughput, pixel);
+			}
+
+			count = count_next;
+		}
+	}
+
+	return ray_count;
+}
+
+TileRendererCPU::Result TileRendererCPU::render(
+	const BVH & bvh, const Triangle * triangles, int triangle_count,
+	const Camera & camera,
+	int width, int height, int samples_per_pixel,
+	TileScheduler & scheduler, ThreadPool & thread_pool, const Placement & placement,
+	Vector3 * frame_buffer
+) {
+	int node_count = placement.thread_nodes ? placement.node_count : 1;
+
+	struct SceneCopy {
+		BVH              bvh;
+		const Triangle * triangles;
+	};
+	std::vector<SceneCopy> scenes(node_count, { bvh, triangles });
+
+	bool replicate = placement.replicate_scene && placement.thread_nodes;
+
+	// The copies are allocated and filled by a thread on their node, so that their pages are first touched there
+	if (replicate) {
+		for (int node = 0; node < node_count; node++) {
+			Numa::run_on_node(node, [&]() {
+				BVHNode  * nodes           = new BVHNode [bvh.node_count];
+				int      * indices         = new int     [bvh.index_count];
+				Triangle * triangles_local = new Triangle[triangle_count];
+
+				memcpy(nodes,           bvh.nodes,   bvh.node_count  * sizeof(BVHNode));
+				memcpy(indices,         bvh.indices, bvh.index_count * sizeof(int));
+				memcpy(triangles_local, triangles,   triangle_count  * sizeof(Triangle));
+
+				scenes[node].bvh.nodes   = nodes;
+				scenes[node].bvh.indices = indices;
+				scenes[node].triangles   = triangles_local;
+			});
+		}
+	}
+
+	// Every thread allocates its batch when it renders its first tile, after it has been pinned, which places the batch on the NUMA node
+	// of that thread. The batch is then reused for every tile the thread renders
+	std::vector<RayBatch> batches(thread_pool.thread_count);
+
+	// Indexed by the position of the tile, like the seeds
+	std::vector<Vector3 *> tile_buffers(scheduler.tiles.size(), nullptr);
+
+	std::atomic<long long> ray_count = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	scheduler.run(thread_pool, [&](const TileScheduler::Tile & tile, int thread_index) {
+		// Tiles are identified by their position rather than their place in the schedule, to keep the random numbers independent of the order
+		int tile_index = tile.x / scheduler.tile_size + tile.y / scheduler.tile_size * scheduler.tile_count_x;
+
+		const SceneCopy & scene = scenes[placement.thread_nodes ? placement.thread_nodes[thread_index] : 0];
+
+		// Allocated and cleared by the thread that renders the tile, which places it on the NUMA node of that thread
+		Vector3 * tile_buffer = new Vector3[tile.width * tile.height];
+		tile_buffers[tile_index] = tile_buffer;
+
+		RayBatch & batch = batches[thread_index];
+		if (batch.origin_x == nullptr) batch.init(scheduler.tile_size);
+
+		long long tile_ray_count = render_tile(scene.bvh, scene.triangles, camera, width, height, samples_per_pixel, tile, tile_index, batch, tile_buffer);
+
+		ray_count.fetch_add(tile_ray_count, std::memory_order_relaxed);
+	}, placement.thread_nodes);
+
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	// Copy the tiles into the frame buffer
+	thread_pool.parallel_for(int(scheduler.tiles.size()), [&](int index, int) {
+		const TileScheduler::Tile & tile = scheduler.tiles[index];
+
+		int tile_index = tile.x / scheduler.tile_size + tile.y / scheduler.tile_size * scheduler.tile_count_x;
+
+		const Vector3 * tile_buffer = tile_buffers[tile_index];
+
+		for (int j = 0; j < tile.height; j++) {
+			for (int i = 0; i < tile.width; i++) {
+				frame_buffer[(tile.x + i) + (tile.y + j) * width] = tile_buffer[i + j * tile.width] / float(samples_per_pixel);
+			}
+		}
+
+		delete [] tile_buffer;
+	});
+
+	for (RayBatch & batch : batches) {
+		if (batch.origin_x) batch.free();
+	}
+
+	if (replicate) {
+		for (const SceneCopy & scene : scenes) {
+			delete [] scene.bvh.nodes;
+			delete [] scene.bvh.indices;
+			delete [] scene.triangles;
+		}
+	}
+
+	Result result;
+	result.ray_count    = ray_count;
+	result.seconds      = std::chrono::duration<double>(stop - start).count();
+	result.tiles_stolen = scheduler.tiles_stolen;
+
+	return result;
+}
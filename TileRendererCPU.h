@@ -0,0 +1,46 @@
+#pragma once
+#include "BVH.h"
+
+#include "TileScheduler.h"
+#include "ThreadPool.h"
+
+// Host side path tracer that renders an image in tiles handed out by a TileScheduler.
+// Every thread traces the camera samples of its current tile as a single SoA batch of Rays, which is compacted in place
+// after every bounce and reused for all bounces and samples of the tile, so that it stays in the L2 cache of the core.
+// Tiles accumulate into their own buffer. Both the buffers and the batches are allocated by the thread that uses them,
+// so that they are local to its NUMA node.
+// Surfaces are diffuse with the colour of their Material and only lit by a uniform white sky
+namespace TileRendererCPU {
+	struct Camera {
+		Vector3 position; // Looks down the negative z axis
+		float   tan_half_fov;
+	};
+
+	// Placement of the render threads and the data they read on the NUMA nodes of the machine, see Numa
+	struct Placement {
+		const int * thread_nodes = nullptr; // NUMA node of every thread of the ThreadPool, nullptr if the threads are not pinned
+		int         node_count   = 1;
+
+		bool replicate_scene = false; // Every node traces its own copy of the BVH and Triangles, in memory local to that node
+	};
+
+	struct Result {
+		long long ray_count; // Over all samples and bounces
+		double    seconds;
+
+		int tiles_stolen;
+	};
+
+	// Size in bytes of the Ray batch of a single thread
+	int get_batch_size(int tile_size);
+
+	// Renders 'samples_per_pixel' paths per pixel into 'frame_buffer', which holds width x height pixels top row first.
+	// Every tile seeds its own random numbers, so the image does not depend on the number of threads or the order of the tiles
+	Result render(
+		const BVH & bvh, const Triangle * triangles, int triangle_count,
+		const Camera & camera,
+		int width, int height, int samples_per_pixel,
+		TileScheduler & scheduler, ThreadPool & thread_pool, const Placement & placement,
+		Vector3 * frame_buffer
+	);
+}
@@ -0,0 +1,201 @@
+#include "TileScheduler.h"
+
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include "CUDA_Source/Common.h"
+
+#include "Math.h"
+
+// Interleaves the bits of x and y
+static unsigned morton_index(unsigned x, unsigned y) {
+	unsigned result = 0;
+
+	for (int b = 0; b < 16; b++) {
+		result |= ((x >> b) & 1) << (2 * b);
+		result |= ((y >> b) & 1) << (2 * b + 1);
+	}
+
+	return result;
+}
+
+// Distance of (x, y) along the Hilbert curve that fills an n x n grid, n must be a power of two
+static unsigned hilbert_index(int n, int x, int y) {
+	unsigned result = 0;
+
+	for (int s = n / 2; s > 0; s /= 2) {
+		int rx = (x & s) > 0;
+		int ry = (y & s) > 0;
+
+		result += unsigned(s) * unsigned(s) * unsigned((3 * rx) ^ ry);
+
+		// Rotate the quadrant, so that the curve within it has the right orientation
+		if (ry == 0) {
+			if (rx == 1) {
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+
+	return result;
+}
+
+void TileScheduler::init(int width, int height, int tile_size, int order) {
+	this->tile_size = tile_size;
+
+	tile_count_x = Math::divide_round_up(width,  tile_size);
+	tile_count_y = Math::divide_round_up(height, tile_size);
+
+	int curve_size = 1;
+	while (curve_size < tile_count_x || curve_size < tile_count_y) curve_size *= 2;
+
+	std::vector<unsigned> keys;
+
+	tiles.clear();
+	tiles.reserve(tile_count_x * tile_count_y);
+	keys .reserve(tile_count_x * tile_count_y);
+
+	for (int j = 0; j < tile_count_y; j++) {
+		for (int i = 0; i < tile_count_x; i++) {
+			Tile tile;
+			tile.x = i * tile_size;
+			tile.y = j * tile_size;
+			tile.width  = Math::min(tile_size, width  - tile.x);
+			tile.height = Math::min(tile_size, height - tile.y);
+
+			tiles.push_back(tile);
+
+			switch (order) {
+				case TILE_ORDER_SCANLINE: keys.push_back(i + j * tile_count_x);            break;
+				case TILE_ORDER_MORTON:   keys.push_back(morton_index(i, j));              break;
+				case TILE_ORDER_HILBERT:  keys.push_back(hilbert_index(curve_size, i, j)); break;
+
+				default: abort();
+			}
+		}
+	}
+
+	// The curves cover a power of two sized grid, the keys of the tiles outside the image are simply skipped
+	std::vector<int> indices(tiles.size());
+	for (int i = 0; i < int(indices.size()); i++) indices[i] = i;
+
+	std::sort(indices.begin(), indices.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+
+	std::vector<Tile> tiles_sorted(tiles.size());
+	for (int i = 0; i < int(indices.size()); i++) tiles_sorted[i] = tiles[indices[i]];
+
+	tiles.swap(tiles_sorted);
+
+	tiles_stolen = 0;
+}
+
+// Remaining tiles [first, last) of a thread, padded to avoid false sharing between threads
+struct alignas(64) Queue {
+	std::mutex mutex;
+
+	int first;
+	int last;
+};
+
+static bool pop(Queue & queue, int & tile_index) {
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.first == queue.last) return false;
+
+	tile_index = queue.first++;
+
+	return true;
+}
+
+// Moves the second half of the remaining tiles of the thread with the most tiles left to the queue of 'thread_index',
+// preferring threads on the same NUMA node. Returns the number of stolen tiles, which is 0 once every other queue is empty
+static int steal(std::vector<Queue> & queues, int thread_index, const int * thread_nodes) {
+	while (true) {
+		// The counts can change right after they are read, they only guide the choice of victim
+		int victim     = -1;
+		int victim_max = 0;
+
+		bool victim_same_node = false;
+
+		for (int i = 0; i < int(queues.size()); i++) {
+			if (i == thread_index) continue;
+
+			std::lock_guard<std::mutex> lock(queues[i].mutex);
+
+			int  remaining = queues[i].last - queues[i].first;
+			bool same_node = thread_nodes == nullptr || thread_nodes[i] == thread_nodes[thread_index];
+
+			if (remaining == 0 || (victim_same_node && !same_node)) continue;
+
+			if (remaining > victim_max || (same_node && !victim_same_node)) {
+				victim     = i;
+				victim_max = remaining;
+
+				victim_same_node = same_node;
+			}
+		}
+
+		if (victim == -1) return 0;
+
+		int first, last;
+		{
+			std::lock_guard<std::mutex> lock(queues[victim].mutex);
+
+			int remaining = queues[victim].last - queues[victim].first;
+
+			// The victim may have finished its tiles in the meantime
+			if (remaining == 0) continue;
+
+			last  = queues[victim].last;
+			first = last - Math::divide_round_up(remaining, 2);
+
+			queues[victim].last = first;
+		}
+
+		// The queue of the thief is empty, so no other thread takes from it until it is refilled here
+		{
+			std::lock_guard<std::mutex> lock(queues[thread_index].mutex);
+
+			queues[thread_index].first = first;
+			queues[thread_index].last  = last;
+		}
+
+		return last - first;
+	}
+}
+
+void TileScheduler::run(ThreadPool & thread_pool, const std::function<void(const Tile & tile, int thread_index)> & task, const int * thread_nodes) {
+	int thread_count = thread_pool.thread_count;
+	int tile_count   = int(tiles.size());
+
+	// Every thread starts on an equal share of consecutive tiles along the curve
+	std::vector<Queue> queues(thread_count);
+
+	for (int i = 0; i < thread_count; i++) {
+		queues[i].first = int((long long)tile_count *  i      / thread_count);
+		queues[i].last  = int((long long)tile_count * (i + 1) / thread_count);
+	}
+
+	std::atomic<int> stolen = 0;
+
+	// One call per thread, a thread that happens to pick up more than one call simply keeps stealing
+	thread_pool.parallel_for(thread_count, [&](int, int thread_index) {
+		while (true) {
+			int tile_index;
+
+			if (pop(queues[thread_index], tile_index)) {
+				task(tiles[tile_index], thread_index);
+			} else {
+				int count = steal(queues, thread_index, thread_nodes);
+				if (count == 0) break;
+
+				stolen.fetch_add(count, std::memory_order_relaxed);
+			}
+		}
+	});
+
+	tiles_stolen = stolen;
+}
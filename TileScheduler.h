@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+#include "ThreadPool.h"
+
+// Hands out the tiles of an image to the threads of a ThreadPool. The tiles are ordered along a space filling curve
+// (see TILE_ORDER_*) and every thread starts on its own contiguous run of the curve, so that consecutive tiles of a thread
+// are close together in the image. A thread that runs out of tiles steals the second half of the remaining run of the
+// thread with the most tiles left, which keeps the stolen tiles contiguous as well. If the NUMA nodes of the threads are known,
+// threads steal from threads on their own node first, so that tiles only move between nodes once a whole node runs out of work
+struct TileScheduler {
+	struct Tile {
+		int x, y;          // In pixels
+		int width, height; // Tiles along the right and bottom edge of the image can be smaller than tile_size
+	};
+
+	int tile_size;
+	int tile_count_x;
+	int tile_count_y;
+
+	std::vector<Tile> tiles; // In the order of the curve
+
+	int tiles_stolen; // Number of tiles that changed threads during the last call to run
+
+	void init(int width, int height, int tile_size, int order);
+
+	// Calls task(tile, thread_index) once for every tile and blocks until all calls have finished.
+	// 'thread_nodes' optionally gives the NUMA node of every thread of the ThreadPool
+	void run(ThreadPool & thread_pool, const std::function<void(const Tile & tile, int thread_index)> & task, const int * thread_nodes = nullptr);
+};
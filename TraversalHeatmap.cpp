@@ -0,0 +1,88 @@
+#include "TraversalHeatmap.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "CUDA_Source/Common.h"
+
+#include "Util.h"
+
+// Colour ramp of the heatmap, from cheap to expensive
+static constexpr float colour_ramp[][3] = {
+	{ 0.0f, 0.0f, 1.0f },
+	{ 0.0f, 1.0f, 1.0f },
+	{ 0.0f, 1.0f, 0.0f },
+	{ 1.0f, 1.0f, 0.0f },
+	{ 1.0f, 0.0f, 0.0f }
+};
+static constexpr int colour_ramp_size = sizeof(colour_ramp) / sizeof(colour_ramp[0]);
+
+void TraversalHeatmap::export_ppm(const char * file_path, int width, int height, const float * values) {
+	int count = width * height;
+
+	// Pixels without any cost are left black and do not count towards the percentile
+	std::vector<float> sorted;
+	sorted.reserve(count);
+
+	for (int i = 0; i < count; i++) {
+		if (values[i] > 0.0f) sorted.push_back(values[i]);
+	}
+
+	float value_max = 1.0f;
+
+	if (sorted.size() > 0) {
+		size_t percentile = (sorted.size() - 1) * 99 / 100;
+
+		std::nth_element(sorted.begin(), sorted.begin() + percentile, sorted.end());
+		value_max = std::max(sorted[percentile], 1.0f);
+	}
+
+	std::vector<unsigned char> data(count * 3, 0);
+
+	for (int i = 0; i < count; i++) {
+		if (values[i] <= 0.0f) continue;
+
+		float x = std::min(values[i] / value_max, 1.0f) * float(colour_ramp_size - 1);
+
+		int   index = std::min(int(x), colour_ramp_size - 2);
+		float t     = x - float(index);
+
+		for (int c = 0; c < 3; c++) {
+			float colour = (1.0f - t) * colour_ramp[index][c] + t * colour_ramp[index + 1][c];
+
+			data[3 * i + c] = (unsigned char)(255.0f * colour + 0.5f);
+		}
+	}
+
+	Util::export_ppm(file_path, width, height, data.data());
+
+	printf("Traversal heatmap %s: red is %.1f or more\n", file_path, value_max);
+}
+
+void TraversalHeatmap::print_histogram(const char * name, const float * values, int count) {
+	int bins[TRAVERSAL_HEATMAP_HISTOGRAM_BINS] = { };
+
+	for (int i = 0; i < count; i++) {
+		int bin = values[i] < 1.0f ? 0 : 1 + int(log2f(values[i]));
+
+		bins[std::min(bin, TRAVERSAL_HEATMAP_HISTOGRAM_BINS - 1)]++;
+	}
+
+	int bin_max = *std::max_element(bins, bins + TRAVERSAL_HEATMAP_HISTOGRAM_BINS);
+
+	printf("Traversal cost histogram of %s:\n", name);
+
+	for (int b = 0; b < TRAVERSAL_HEATMAP_HISTOGRAM_BINS; b++) {
+		// Bar of at most 50 characters, relative to the largest bin
+		int bar = bin_max > 0 ? int(50.0f * float(bins[b]) / float(bin_max) + 0.5f) : 0;
+
+		if (b == 0) {
+			printf("    [%6i, %6i) %8i %.*s\n", 0, 1, bins[b], bar, "##################################################");
+		} else if (b == TRAVERSAL_HEATMAP_HISTOGRAM_BINS - 1) {
+			printf("    [%6i,    inf) %8i %.*s\n", 1 << (b - 1), bins[b], bar, "##################################################");
+		} else {
+			printf("    [%6i, %6i) %8i %.*s\n", 1 << (b - 1), 1 << b, bins[b], bar, "##################################################");
+		}
+	}
+}
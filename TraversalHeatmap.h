@@ -0,0 +1,13 @@
+#pragma once
+
+// Host side output of the traversal cost instrumentation, see ENABLE_TRAVERSAL_HEATMAP and CUDA_Source/Tracing.h.
+// Also used by the Headless tool, which counts the cost of the Host traversal in RaySortCPU::trace
+namespace TraversalHeatmap {
+	// Writes 'values' as a false colour image from blue (cheap) over green and yellow to red (expensive).
+	// The colours are normalized to the 99th percentile, so that a few outliers do not wash out the rest of the image
+	void export_ppm(const char * file_path, int width, int height, const float * values);
+
+	// Prints how many of the 'count' values fall in each of the TRAVERSAL_HEATMAP_HISTOGRAM_BINS bins,
+	// bin 0 holds the values below 1 and every next bin covers twice the range of the previous one
+	void print_histogram(const char * name, const float * values, int count);
+}
@@ -0,0 +1,42 @@
+#include "UpsampleCPU.h"
+
+#include <cstring>
+
+#include "CUDA_Source/Upsample.h"
+
+void UpsampleCPU::upsample(int width, int height, int pitch, int factor, int frame_index, const float * guide, const float * albedo, const float * indirect, float * result) {
+	memcpy(result, indirect, 4 * pitch * height * sizeof(float));
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int pixel_index = x + y * pitch;
+
+			if (guide[4 * pixel_index + 3] == 0.0f || Upsample::is_source(x, y, factor, frame_index)) continue;
+
+			float * pixel = result + 4 * pixel_index;
+
+			Upsample::upsample_pixel(x, y, width, height, pitch, factor, frame_index, guide, albedo, indirect, pixel[0], pixel[1], pixel[2]);
+			pixel[3] = 0.0f;
+		}
+	}
+}
+
+float UpsampleCPU::max_relative_difference(int width, int height, int pitch, const float * reference, const float * image) {
+	float max_difference = 0.0f;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int pixel_index = x + y * pitch;
+
+			for (int c = 0; c < 3; c++) {
+				float a = reference[4 * pixel_index + c];
+				float b = image    [4 * pixel_index + c];
+
+				float difference = fabsf(a - b) / fmaxf(fabsf(a), 1e-3f);
+				if (difference > max_difference) max_difference = difference;
+			}
+		}
+	}
+
+	return max_difference;
+}
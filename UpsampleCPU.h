@@ -0,0 +1,17 @@
+#pragma once
+
+// Host side reference implementation of the joint bilateral upsampling of indirect lighting,
+// see kernel_indirect_upsample and CUDA_Source/Upsample.h
+namespace UpsampleCPU {
+	// Writes the upsampled indirect lighting of all pixels to 'result', pixels that are not upsampled keep their input.
+	// All buffers have four floats per pixel and rows of 'pitch' pixels
+	void upsample(
+		int width, int height, int pitch,
+		int factor, int frame_index,
+		const float * guide, const float * albedo, const float * indirect,
+		float * result
+	);
+
+	// Largest difference between two images relative to the magnitude of the first, ignoring the w channel
+	float max_relative_difference(int width, int height, int pitch, const float * reference, const float * image);
+}
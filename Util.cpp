@@ -10,13 +10,13 @@ void Util::get_path(const char * filename, char * path) {
 	const char * last_path_end = nullptr;
 
 	// Keep advancing the path_end pointer until we run out of '/' characters in the string
-	while (path_end = strchr(path_end, '/')) {
+	while ((path_end = strchr(path_end, '/'))) {
 		path_end++;
 		last_path_end = path_end;
 	}
 
 	if (last_path_end == nullptr) {
-		path[0] = NULL;
+		path[0] = '\0';
 
 		return;
 	}
@@ -24,13 +24,24 @@ void Util::get_path(const char * filename, char * path) {
 	// Copy the right amount over
 	int path_length = last_path_end - filename;
 	memcpy(path, filename, path_length);
-	path[path_length] = NULL;
+	path[path_length] = '\0';
 }
 
 bool Util::file_exists(const char * filename) {
 	return std::filesystem::exists(filename);
 }
 
+FILE * Util::file_open(const char * filename, const char * mode) {
+#ifdef _MSC_VER
+	FILE * file;
+	fopen_s(&file, filename, mode);
+
+	return file;
+#else
+	return fopen(filename, mode);
+#endif
+}
+
 bool Util::file_is_newer(const char * file_reference, const char * file_check) {
 	std::filesystem::file_time_type last_write_time_reference = std::filesystem::last_write_time(file_reference);
 	std::filesystem::file_time_type last_write_time_check     = std::filesystem::last_write_time(file_check);
@@ -39,8 +50,7 @@ bool Util::file_is_newer(const char * file_reference, const char * file_check) {
 }
 
 char * Util::file_read(const char * filename) {
-	FILE * file;
-	fopen_s(&file, filename, "rb");
+	FILE * file = file_open(filename, "rb");
 
 	if (file == nullptr) {
 		printf("ERROR: Unable to open %s!\n", filename);
@@ -54,18 +64,17 @@ char * Util::file_read(const char * filename) {
 
 	// Copy file source into c string
 	char * data = new char[file_length + 1];
-	fread_s(data, file_length + 1, 1, file_length, file);
+	fread(data, 1, file_length, file);
 
 	fclose(file);
 
-	data[file_length] = NULL;
+	data[file_length] = '\0';
 	return data;
 }
 
 // Based on: https://rosettacode.org/wiki/Bitmap/Write_a_PPM_file
 void Util::export_ppm(const char * file_path, int width, int height, const unsigned char * data) {
-	FILE * file;
-	fopen_s(&file, file_path, "wb");
+	FILE * file = file_open(file_path, "wb");
 
 	if (file == nullptr) {
 		printf("Failed to take export %s!\n", file_path);
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdio>
+#include <cstdlib>
 
 #define INVALID -1
 
@@ -11,6 +13,7 @@
 #define MEGA_BYTE(value) (value) * 1024 * 1024
 #define GIGA_BYTE(value) (value) * 1024 * 1024 * 1024
 
+#ifdef _MSC_VER
 #define FORCEINLINE __forceinline
 
 #define ALLIGNED_MALLOC(size, align) _aligned_malloc(size, align)
@@ -18,12 +21,26 @@
 
 #define MALLOCA(type, count) reinterpret_cast<type *>(_malloca(count * sizeof(type)))
 #define FREEA(ptr) _freea(ptr)
+#else
+#define FORCEINLINE __attribute__((always_inline))
+
+// aligned_alloc requires the size to be a multiple of the alignment
+#define ALLIGNED_MALLOC(size, align) aligned_alloc(align, (((size) + (align) - 1) / (align)) * (align))
+#define ALLIGNED_FREE(ptr)           ::free(ptr)
+
+// There is no portable equivalent of _malloca, so fall back to the heap
+#define MALLOCA(type, count) reinterpret_cast<type *>(::malloc((count) * sizeof(type)))
+#define FREEA(ptr) ::free(ptr)
+#endif
 
 namespace Util {
 	void get_path(const char * filename, char * path);
 	
 	bool file_exists(const char * filename);
 
+	// Returns nullptr if the file could not be opened
+	FILE * file_open(const char * filename, const char * mode);
+
 	// Checks if file_check is newer than file_reference
 	bool file_is_newer(const char * file_reference, const char * file_check);
 
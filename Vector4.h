@@ -2,6 +2,8 @@
 #include <math.h>
 #include <cassert>
 
+#include "SIMD.h"
+
 struct Vector4 {
 	union {
 		struct {
@@ -15,6 +17,12 @@ struct Vector4 {
 	inline Vector4(const float f[4]) : x(f[0]), y(f[1]), z(f[2]), w(f[3]) { }
 	inline Vector4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) { }
 
+#if SIMD_SSE
+	inline explicit Vector4(__m128 value) { _mm_storeu_ps(data, value); }
+
+	inline __m128 load() const { return _mm_loadu_ps(data); }
+#endif
+
 	inline static float length_squared(const Vector4 & vector) {
 		return dot(vector, vector);
 	}
@@ -34,9 +42,27 @@ struct Vector4 {
 	}
 
 	inline static float dot(const Vector4 & left, const Vector4 & right) {
+#if SIMD_SSE
+		return SIMD::horizontal_sum(_mm_mul_ps(left.load(), right.load()));
+#else
 		return left.x * right.x + left.y * right.y + left.z * right.z + left.w * right.w;
+#endif
 	}
 
+#if SIMD_SSE
+	inline static Vector4 min(const Vector4 & left, const Vector4 & right) { return Vector4(_mm_min_ps(left.load(), right.load())); }
+	inline static Vector4 max(const Vector4 & left, const Vector4 & right) { return Vector4(_mm_max_ps(left.load(), right.load())); }
+
+	inline Vector4 operator+=(const Vector4 & vector) { return *this = Vector4(_mm_add_ps(load(), vector.load())); }
+	inline Vector4 operator-=(const Vector4 & vector) { return *this = Vector4(_mm_sub_ps(load(), vector.load())); }
+	inline Vector4 operator*=(const Vector4 & vector) { return *this = Vector4(_mm_mul_ps(load(), vector.load())); }
+	inline Vector4 operator/=(const Vector4 & vector) { return *this = Vector4(_mm_div_ps(load(), vector.load())); }
+
+	inline Vector4 operator+=(float scalar) { return *this = Vector4(_mm_add_ps(load(), _mm_set1_ps(scalar))); }
+	inline Vector4 operator-=(float scalar) { return *this = Vector4(_mm_sub_ps(load(), _mm_set1_ps(scalar))); }
+	inline Vector4 operator*=(float scalar) { return *this = Vector4(_mm_mul_ps(load(), _mm_set1_ps(scalar))); }
+	inline Vector4 operator/=(float scalar) { return *this = Vector4(_mm_mul_ps(load(), _mm_set1_ps(1.0f / scalar))); }
+#else
 	inline static Vector4 min(const Vector4 & left, const Vector4 & right) {
 		return Vector4(
 			left.x < right.x ? left.x : right.x,
@@ -64,11 +90,30 @@ struct Vector4 {
 	inline Vector4 operator-=(float scalar) {                                   x -= scalar;     y -= scalar;     z -= scalar;     w -= scalar;     return *this; }
 	inline Vector4 operator*=(float scalar) {                                   x *= scalar;     y *= scalar;     z *= scalar;     w *= scalar;     return *this; }
 	inline Vector4 operator/=(float scalar) { float inv_scalar = 1.0f / scalar; x *= inv_scalar; y *= inv_scalar; z *= inv_scalar; w *= inv_scalar; return *this; }
+#endif
 
 	inline       float & operator[](int index)       { assert(index >= 0 && index < 4); return data[index]; }
 	inline const float & operator[](int index) const { assert(index >= 0 && index < 4); return data[index]; }
 };
 
+#if SIMD_SSE
+inline Vector4 operator-(const Vector4 & vector) { return Vector4(_mm_xor_ps(vector.load(), _mm_set1_ps(-0.0f))); }
+
+inline Vector4 operator+(const Vector4 & left, const Vector4 & right) { return Vector4(_mm_add_ps(left.load(), right.load())); }
+inline Vector4 operator-(const Vector4 & left, const Vector4 & right) { return Vector4(_mm_sub_ps(left.load(), right.load())); }
+inline Vector4 operator*(const Vector4 & left, const Vector4 & right) { return Vector4(_mm_mul_ps(left.load(), right.load())); }
+inline Vector4 operator/(const Vector4 & left, const Vector4 & right) { return Vector4(_mm_div_ps(left.load(), right.load())); }
+
+inline Vector4 operator+(const Vector4 & vector, float scalar) { return Vector4(_mm_add_ps(vector.load(), _mm_set1_ps(scalar))); }
+inline Vector4 operator-(const Vector4 & vector, float scalar) { return Vector4(_mm_sub_ps(vector.load(), _mm_set1_ps(scalar))); }
+inline Vector4 operator*(const Vector4 & vector, float scalar) { return Vector4(_mm_mul_ps(vector.load(), _mm_set1_ps(scalar))); }
+inline Vector4 operator/(const Vector4 & vector, float scalar) { return Vector4(_mm_mul_ps(vector.load(), _mm_set1_ps(1.0f / scalar))); }
+
+inline Vector4 operator+(float scalar, const Vector4 & vector) { return Vector4(_mm_add_ps(vector.load(), _mm_set1_ps(scalar))); }
+inline Vector4 operator-(float scalar, const Vector4 & vector) { return Vector4(_mm_sub_ps(vector.load(), _mm_set1_ps(scalar))); }
+inline Vector4 operator*(float scalar, const Vector4 & vector) { return Vector4(_mm_mul_ps(vector.load(), _mm_set1_ps(scalar))); }
+inline Vector4 operator/(float scalar, const Vector4 & vector) { return Vector4(_mm_mul_ps(vector.load(), _mm_set1_ps(1.0f / scalar))); }
+#else
 inline Vector4 operator-(const Vector4 & vector) { return Vector4(-vector.x, -vector.y, -vector.z, -vector.w); }
 
 inline Vector4 operator+(const Vector4 & left, const Vector4 & right) { return Vector4(left.x + right.x, left.y + right.y, left.z + right.z, left.w + right.w); }
@@ -81,10 +126,11 @@ inline Vector4 operator-(const Vector4 & vector, float scalar) {
 inline Vector4 operator*(const Vector4 & vector, float scalar) {                                   return Vector4(vector.x * scalar,     vector.y * scalar,     vector.z * scalar,     vector.w * scalar); }
 inline Vector4 operator/(const Vector4 & vector, float scalar) { float inv_scalar = 1.0f / scalar; return Vector4(vector.x * inv_scalar, vector.y * inv_scalar, vector.z * inv_scalar, vector.w * inv_scalar); }
 
-inline Vector4 operator+(float scalar, const Vector4 & vector) {                                   return Vector4(vector.x + scalar,     vector.y + scalar,     vector.z + scalar,     vector.z + scalar); }
-inline Vector4 operator-(float scalar, const Vector4 & vector) {                                   return Vector4(vector.x - scalar,     vector.y - scalar,     vector.z - scalar,     vector.z - scalar); }
-inline Vector4 operator*(float scalar, const Vector4 & vector) {                                   return Vector4(vector.x * scalar,     vector.y * scalar,     vector.z * scalar,     vector.z * scalar); }
-inline Vector4 operator/(float scalar, const Vector4 & vector) { float inv_scalar = 1.0f / scalar; return Vector4(vector.x * inv_scalar, vector.y * inv_scalar, vector.z * inv_scalar, vector.z * inv_scalar); }
+inline Vector4 operator+(float scalar, const Vector4 & vector) {                                   return Vector4(vector.x + scalar,     vector.y + scalar,     vector.z + scalar,     vector.w + scalar); }
+inline Vector4 operator-(float scalar, const Vector4 & vector) {                                   return Vector4(vector.x - scalar,     vector.y - scalar,     vector.z - scalar,     vector.w - scalar); }
+inline Vector4 operator*(float scalar, const Vector4 & vector) {                                   return Vector4(vector.x * scalar,     vector.y * scalar,     vector.z * scalar,     vector.w * scalar); }
+inline Vector4 operator/(float scalar, const Vector4 & vector) { float inv_scalar = 1.0f / scalar; return Vector4(vector.x * inv_scalar, vector.y * inv_scalar, vector.z * inv_scalar, vector.w * inv_scalar); }
+#endif
 
 inline bool operator==(const Vector4 & left, const Vector4 & right) { return left.x == right.x && left.y == right.y && left.z == right.z && left.w == right.w; }
 inline bool operator!=(const Vector4 & left, const Vector4 & right) { return left.x != right.x || left.y != right.y || left.z != right.z || left.w != right.w; }